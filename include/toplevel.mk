@@ -54,6 +54,9 @@ export ORIG_PATH:=$(if $(ORIG_PATH),$(ORIG_PATH),$(PATH))
 export PATH:=$(path)
 export STAGING_DIR_HOST:=$(if $(STAGING_DIR),$(abspath $(STAGING_DIR)/../host),$(TOPDIR)/staging_dir/host)
 
+# conf/mconf reuse the parsed Config.in tree as long as none of its inputs change
+export KCONFIG_PARSE_CACHE:=$(TOPDIR)/tmp/.kconfig-cache
+
 unexport TAR_OPTIONS
 
 ifeq ($(FORCE),)
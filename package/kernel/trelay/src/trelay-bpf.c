@@ -0,0 +1,75 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * trelay-bpf.c: XDP fast path for trelay
+ *
+ * Redirects frames received on one relay port straight to its peer, which
+ * is looked up by ingress ifindex in trelay_peer. EAPOL frames and frames
+ * of ports without an entry are passed on to the trelay rx handler.
+ */
+#include <uapi/linux/bpf.h>
+#include <uapi/linux/if_ether.h>
+#include <bpf/bpf_helpers.h>
+#include <bpf/bpf_endian.h>
+
+enum {
+	TRELAY_XDP_RX,
+	TRELAY_XDP_TX,
+	TRELAY_XDP_EAPOL,
+	TRELAY_XDP_SLOWPATH,
+	__TRELAY_XDP_MAX
+};
+
+struct {
+	__uint(type, BPF_MAP_TYPE_DEVMAP_HASH);
+	__type(key, __u32);
+	__type(value, __u32);
+	__uint(max_entries, 64);
+} trelay_peer SEC(".maps");
+
+/* shared by all relays, redirected frames are not in trelay's debugfs stats */
+struct {
+	__uint(type, BPF_MAP_TYPE_PERCPU_ARRAY);
+	__type(key, __u32);
+	__type(value, __u64);
+	__uint(max_entries, __TRELAY_XDP_MAX);
+} trelay_stats SEC(".maps");
+
+static __always_inline void trelay_count(__u32 idx)
+{
+	__u64 *val = bpf_map_lookup_elem(&trelay_stats, &idx);
+
+	if (val)
+		(*val)++;
+}
+
+SEC("xdp")
+int trelay_xdp(struct xdp_md *ctx)
+{
+	void *data_end = (void *)(long)ctx->data_end;
+	struct ethhdr *eth = (void *)(long)ctx->data;
+	long ret;
+
+	trelay_count(TRELAY_XDP_RX);
+
+	if ((void *)(eth + 1) > data_end)
+		return XDP_PASS;
+
+	if (eth->h_proto == bpf_htons(ETH_P_PAE)) {
+		trelay_count(TRELAY_XDP_EAPOL);
+		return XDP_PASS;
+	}
+
+	ret = bpf_redirect_map(&trelay_peer, ctx->ingress_ifindex, XDP_PASS);
+	trelay_count(ret == XDP_REDIRECT ? TRELAY_XDP_TX : TRELAY_XDP_SLOWPATH);
+
+	return ret;
+}
+
+/* Lets veth peers accept redirected frames in the selftest */
+SEC("xdp")
+int trelay_xdp_pass(struct xdp_md *ctx)
+{
+	return XDP_PASS;
+}
+
+char _license[] SEC("license") = "GPL";
@@ -19,6 +19,8 @@
 #include <linux/netdevice.h>
 #include <linux/rtnetlink.h>
 #include <linux/debugfs.h>
+#include <linux/seq_file.h>
+#include <linux/u64_stats_sync.h>
 
 #define trelay_log(loglevel, tr, fmt, ...) \
 	printk(loglevel "trelay: %s <-> %s: " fmt "\n", \
@@ -27,9 +29,18 @@
 static LIST_HEAD(trelay_devs);
 static struct dentry *debugfs_dir;
 
+struct trelay_stats {
+	u64_stats_t rx_packets;
+	u64_stats_t tx_packets;
+	u64_stats_t tx_dropped;
+	u64_stats_t eapol_packets;
+	struct u64_stats_sync syncp;
+};
+
 struct trelay {
 	struct list_head list;
 	struct net_device *dev1, *dev2;
+	struct trelay_stats __percpu *stats;
 	struct dentry *debugfs;
 	int to_remove;
 	char name[];
@@ -37,22 +48,37 @@ struct trelay {
 
 static rx_handler_result_t trelay_handle_frame(struct sk_buff **pskb)
 {
-	struct net_device *dev;
+	struct trelay_stats *stats;
 	struct sk_buff *skb = *pskb;
+	struct trelay *tr;
+	bool eapol;
+	int ret = 0;
 
-	dev = rcu_dereference(skb->dev->rx_handler_data);
-	if (!dev)
-		return RX_HANDLER_PASS;
-
-	if (skb->protocol == htons(ETH_P_PAE))
+	tr = rcu_dereference(skb->dev->rx_handler_data);
+	if (!tr)
 		return RX_HANDLER_PASS;
 
-	skb_push(skb, ETH_HLEN);
-	skb->dev = dev;
-	skb_forward_csum(skb);
-	dev_queue_xmit(skb);
+	eapol = skb->protocol == htons(ETH_P_PAE);
+	if (!eapol) {
+		skb_push(skb, ETH_HLEN);
+		skb->dev = skb->dev == tr->dev1 ? tr->dev2 : tr->dev1;
+		skb_forward_csum(skb);
+		ret = net_xmit_eval(dev_queue_xmit(skb));
+	}
 
-	return RX_HANDLER_CONSUMED;
+	/* Not held across the xmit, which may end up back in here */
+	stats = this_cpu_ptr(tr->stats);
+	u64_stats_update_begin(&stats->syncp);
+	u64_stats_inc(&stats->rx_packets);
+	if (eapol)
+		u64_stats_inc(&stats->eapol_packets);
+	else if (ret)
+		u64_stats_inc(&stats->tx_dropped);
+	else
+		u64_stats_inc(&stats->tx_packets);
+	u64_stats_update_end(&stats->syncp);
+
+	return eapol ? RX_HANDLER_PASS : RX_HANDLER_CONSUMED;
 }
 
 static int trelay_open(struct inode *inode, struct file *file)
@@ -77,6 +103,7 @@ static int trelay_do_remove(struct trelay *tr)
 
 	trelay_log(KERN_INFO, tr, "stopped");
 
+	free_percpu(tr->stats);
 	kfree(tr);
 
 	return 0;
@@ -145,6 +172,44 @@ static const struct file_operations fops_remove = {
 	.release = trelay_remove_release,
 };
 
+/*
+ * Frames forwarded by the XDP fast path never reach the rx handler, they are
+ * only counted in the trelay_stats map of trelay-bpf.c.
+ */
+static int trelay_stats_show(struct seq_file *s, void *unused)
+{
+	struct trelay *tr = s->private;
+	u64 rx = 0, tx = 0, dropped = 0, eapol = 0;
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		const struct trelay_stats *stats = per_cpu_ptr(tr->stats, cpu);
+		u64 c_rx, c_tx, c_dropped, c_eapol;
+		unsigned int start;
+
+		do {
+			start = u64_stats_fetch_begin(&stats->syncp);
+			c_rx = u64_stats_read(&stats->rx_packets);
+			c_tx = u64_stats_read(&stats->tx_packets);
+			c_dropped = u64_stats_read(&stats->tx_dropped);
+			c_eapol = u64_stats_read(&stats->eapol_packets);
+		} while (u64_stats_fetch_retry(&stats->syncp, start));
+
+		rx += c_rx;
+		tx += c_tx;
+		dropped += c_dropped;
+		eapol += c_eapol;
+	}
+
+	seq_printf(s, "rx_packets: %llu\n", rx);
+	seq_printf(s, "tx_packets: %llu\n", tx);
+	seq_printf(s, "tx_dropped: %llu\n", dropped);
+	seq_printf(s, "eapol_packets: %llu\n", eapol);
+
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(trelay_stats);
+
 
 static int trelay_do_add(char *name, char *devn1, char *devn2)
 {
@@ -156,6 +221,12 @@ static int trelay_do_add(char *name, char *devn1, char *devn2)
 	if (!tr)
 		return -ENOMEM;
 
+	tr->stats = netdev_alloc_pcpu_stats(struct trelay_stats);
+	if (!tr->stats) {
+		kfree(tr);
+		return -ENOMEM;
+	}
+
 	rtnl_lock();
 	rcu_read_lock();
 
@@ -171,11 +242,16 @@ static int trelay_do_add(char *name, char *devn1, char *devn2)
 	if (!dev1 || !dev2)
 		goto out;
 
-	ret = netdev_rx_handler_register(dev1, trelay_handle_frame, dev2);
+	/* The rx handler looks up the peer port through tr */
+	strcpy(tr->name, name);
+	tr->dev1 = dev1;
+	tr->dev2 = dev2;
+
+	ret = netdev_rx_handler_register(dev1, trelay_handle_frame, tr);
 	if (ret < 0)
 		goto out;
 
-	ret = netdev_rx_handler_register(dev2, trelay_handle_frame, dev1);
+	ret = netdev_rx_handler_register(dev2, trelay_handle_frame, tr);
 	if (ret < 0) {
 		netdev_rx_handler_unregister(dev1);
 		goto out;
@@ -184,22 +260,22 @@ static int trelay_do_add(char *name, char *devn1, char *devn2)
 	dev_hold(dev1);
 	dev_hold(dev2);
 
-	strcpy(tr->name, name);
-	tr->dev1 = dev1;
-	tr->dev2 = dev2;
 	list_add_tail(&tr->list, &trelay_devs);
 
 	trelay_log(KERN_INFO, tr, "started");
 
 	tr->debugfs = debugfs_create_dir(name, debugfs_dir);
 	debugfs_create_file("remove", S_IWUSR, tr->debugfs, tr, &fops_remove);
+	debugfs_create_file("stats", S_IRUSR, tr->debugfs, tr, &trelay_stats_fops);
 	ret = 0;
 
 out:
 	rcu_read_unlock();
 	rtnl_unlock();
-	if (ret < 0)
+	if (ret < 0) {
+		free_percpu(tr->stats);
 		kfree(tr);
+	}
 
 	return ret;
 }
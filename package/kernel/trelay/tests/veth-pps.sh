@@ -0,0 +1,136 @@
+#!/bin/sh
+# SPDX-License-Identifier: GPL-2.0-or-later
+#
+# Measure trelay forwarding rate between two veth pairs, with the rx handler
+# and with the XDP fast path:
+#
+#   [trsrc] s0 --- s1 <== trelay ==> d1 --- d0 [trdst]
+#
+# pktgen sends from s0, the rate is what arrives on d0. Needs root, trelay
+# loaded, debugfs mounted and pktgen. The XDP run needs bpftool, a mounted
+# bpffs and trelay-bpf.o (first argument, default /lib/bpf/trelay-bpf.o).
+# bpftool takes map keys in host byte order, "be" or "le" (default) as the
+# third argument.
+#
+# Usage: veth-pps.sh [trelay-bpf.o [count [be|le]]]
+
+XDP_OBJ="${1:-/lib/bpf/trelay-bpf.o}"
+COUNT="${2:-2000000}"
+BYTE_ORDER="${3:-le}"
+TRELAY=/sys/kernel/debug/trelay
+XDP_PIN=/sys/fs/bpf/trelay-selftest
+PG=/proc/net/pktgen
+
+cleanup() {
+	[ -d "$TRELAY/selftest" ] && echo > "$TRELAY/selftest/remove"
+	ip link del s1 2>/dev/null
+	ip link del d1 2>/dev/null
+	ip netns del trsrc 2>/dev/null
+	ip netns del trdst 2>/dev/null
+	rm -rf "$XDP_PIN"
+}
+
+fail() {
+	echo "FAIL: $*" >&2
+	cleanup
+	exit 1
+}
+
+u32() {
+	local v="$1"
+
+	if [ "$BYTE_ORDER" = be ]; then
+		echo $((v >> 24 & 255)) $((v >> 16 & 255)) $((v >> 8 & 255)) $((v & 255))
+	else
+		echo $((v & 255)) $((v >> 8 & 255)) $((v >> 16 & 255)) $((v >> 24 & 255))
+	fi
+}
+
+pg() {
+	ip netns exec trsrc sh -c "echo '$2' > $PG/$1" || fail "pktgen: $1: $2"
+}
+
+# centiseconds, busybox date has no %N
+now() {
+	cut -d' ' -f1 /proc/uptime | tr -d .
+}
+
+rx_packets() {
+	ip netns exec trdst cat /sys/class/net/d0/statistics/rx_packets
+}
+
+run() {
+	local mode="$1" start end t0 t1 dt
+
+	pg kpktgend_0 "rem_device_all"
+	pg kpktgend_0 "add_device s0"
+	pg s0 "count $COUNT"
+	pg s0 "clone_skb 0"
+	pg s0 "pkt_size 60"
+	pg s0 "delay 0"
+	pg s0 "dst 198.51.100.2"
+	pg s0 "dst_mac $(ip netns exec trdst cat /sys/class/net/d0/address)"
+
+	start=$(rx_packets)
+	t0=$(now)
+	pg pgctrl "start"
+	# let the last frames drain through the relay
+	sleep 1
+	end=$(rx_packets)
+	t1=$(now)
+
+	dt=$((t1 - t0 - 100))
+	[ "$dt" -gt 0 ] || dt=1
+	printf "%-8s %10d frames %12d pps\n" "$mode" $((end - start)) \
+		$(( (end - start) * 100 / dt ))
+	[ $((end - start)) -gt 0 ] || fail "$mode: nothing was forwarded"
+}
+
+case "$BYTE_ORDER" in
+be|le) ;;
+*) echo "usage: $0 [trelay-bpf.o [count [be|le]]]" >&2; exit 1 ;;
+esac
+
+[ "$(id -u)" = 0 ] || { echo "SKIP: needs root"; exit 4; }
+[ -f "$TRELAY/add" ] || { echo "SKIP: trelay not loaded or debugfs not mounted"; exit 4; }
+[ -d "$PG" ] || modprobe pktgen 2>/dev/null || { echo "SKIP: no pktgen"; exit 4; }
+
+cleanup
+ip netns add trsrc || fail "netns"
+ip netns add trdst || fail "netns"
+ip link add s0 netns trsrc type veth peer name s1 || fail "veth"
+ip link add d0 netns trdst type veth peer name d1 || fail "veth"
+ip link set dev s1 up
+ip link set dev d1 up
+ip -n trsrc link set dev s0 up
+ip -n trdst link set dev d0 up
+# veth only takes XDP redirects once d0 has NAPI enabled
+ip netns exec trdst ethtool -K d0 gro on >/dev/null 2>&1
+
+echo "selftest,s1,d1" > "$TRELAY/add" || fail "could not add relay"
+
+run skb
+cat "$TRELAY/selftest/stats"
+
+if ! command -v bpftool >/dev/null || [ ! -f "$XDP_OBJ" ]; then
+	echo "SKIP: xdp, bpftool or $XDP_OBJ missing"
+	cleanup
+	exit 0
+fi
+
+bpftool prog loadall "$XDP_OBJ" "$XDP_PIN" type xdp pinmaps "$XDP_PIN" || fail "loading $XDP_OBJ"
+for port in "s1 d1" "d1 s1"; do
+	set -- $port
+	bpftool map update pinned "$XDP_PIN/trelay_peer" \
+		key $(u32 $(cat /sys/class/net/$1/ifindex)) \
+		value $(u32 $(cat /sys/class/net/$2/ifindex)) || fail "peer map"
+	bpftool net attach xdp pinned "$XDP_PIN/trelay_xdp" dev "$1" || fail "attach $1"
+done
+
+run xdp
+# XDP forwarded frames are only in trelay_stats, not in trelay's stats
+cat "$TRELAY/selftest/stats"
+bpftool map dump pinned "$XDP_PIN/trelay_stats"
+
+cleanup
+echo "PASS"
@@ -42,6 +42,7 @@ enum {
 	CMD_HELP,
 	CMD_SHOW,
 	CMD_PORTMAP,
+	CMD_MIBS,
 };
 
 static void
@@ -218,11 +219,37 @@ show_vlan(struct switch_dev *dev, int vlan, bool all)
 	show_attrs(dev, dev->vlan_ops, &val);
 }
 
+/* one "<port> <counter> <value>" line per counter */
+static int
+show_mibs(struct switch_dev *dev, int port)
+{
+	struct switch_port_mibs *mibs;
+	int i, j;
+	int ret;
+
+	ret = swlib_get_mibs(dev, &mibs);
+	if (ret < 0)
+		return ret;
+
+	for (i = 0; i < dev->ports; i++) {
+		if (port >= 0 && port != i)
+			continue;
+
+		for (j = 0; j < mibs[i].n_mibs; j++)
+			printf("%d %s %" PRIu64 "\n", i, mibs[i].mibs[j].name,
+			       mibs[i].mibs[j].value);
+	}
+
+	swlib_free_mibs(dev, mibs);
+	return 0;
+}
+
 static void
 print_usage(void)
 {
 	printf("swconfig list\n");
 	printf("swconfig dev <dev> [port <port>|vlan <vlan>] (help|set <key> <value>|get <key>|load <config>|show)\n");
+	printf("swconfig dev <dev> [port <port>] mibs\n");
 	exit(1);
 }
 
@@ -311,6 +338,10 @@ int main(int argc, char **argv)
 			cmd = CMD_PORTMAP;
 		} else if (!strcmp(arg, "show")) {
 			cmd = CMD_SHOW;
+		} else if (!strcmp(arg, "mibs")) {
+			if (cvlan >= 0)
+				print_usage();
+			cmd = CMD_MIBS;
 		} else {
 			print_usage();
 		}
@@ -386,6 +417,11 @@ int main(int argc, char **argv)
 	case CMD_PORTMAP:
 		swlib_print_portmap(dev, csegment);
 		break;
+	case CMD_MIBS:
+		retval = show_mibs(dev, cport);
+		if (retval < 0)
+			nl_perror(-retval, "Failed to get MIB counters");
+		break;
 	case CMD_SHOW:
 		if (cport >= 0 || cvlan >= 0) {
 			if (cport >= 0)
@@ -52,6 +52,9 @@ Usage of the library functions:
   switch_set_attr() and switch_get_attr() can alter or request the values
   of attributes.
 
+  swlib_get_mibs() reads the MIB counters of all ports with a single
+  request, captured by the driver at the same time.
+
 Usage of the switch_attr struct:
 
   ->atype: attribute group, one of:
@@ -115,6 +118,7 @@ struct switch_attr;
 struct switch_port;
 struct switch_port_map;
 struct switch_port_link;
+struct switch_port_mibs;
 struct switch_val;
 struct uci_package;
 
@@ -178,6 +182,17 @@ struct switch_port_link {
 	uint32_t eee;
 };
 
+struct switch_mib {
+	char *name;
+	uint64_t value;
+};
+
+struct switch_port_mibs {
+	int port;
+	int n_mibs;
+	struct switch_mib *mibs;
+};
+
 /**
  * swlib_list: list all switches
  */
@@ -259,6 +274,22 @@ int swlib_set_attr_string(struct switch_dev *dev, struct switch_attr *attr,
 int swlib_get_attr(struct switch_dev *dev, struct switch_attr *attr,
 		struct switch_val *val);
 
+/**
+ * swlib_get_mibs: get the MIB counters of all ports
+ * @dev: switch device struct
+ * @mibs: set to an array of dev->ports entries, indexed by port
+ * returns 0 on success
+ * the result must be freed with swlib_free_mibs()
+ */
+int swlib_get_mibs(struct switch_dev *dev, struct switch_port_mibs **mibs);
+
+/**
+ * swlib_free_mibs: free the result of swlib_get_mibs
+ * @dev: switch device struct
+ * @mibs: counters returned by swlib_get_mibs
+ */
+void swlib_free_mibs(struct switch_dev *dev, struct switch_port_mibs *mibs);
+
 /**
  * swlib_apply_from_uci: set up the switch from a uci configuration
  * @dev: switch device struct
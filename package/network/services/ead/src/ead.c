@@ -15,6 +15,10 @@
 #include <sys/types.h>
 #include <sys/time.h>
 #include <sys/select.h>
+#include <sys/socket.h>
+#include <sys/mman.h>
+#include <sys/epoll.h>
+#include <sys/wait.h>
 #include <stdio.h>
 #include <stddef.h>
 #include <stdlib.h>
@@ -23,8 +27,11 @@
 #include <stdbool.h>
 #include <fcntl.h>
 #include <signal.h>
-#include <pcap.h>
-#include <pcap-bpf.h>
+#include <time.h>
+#include <errno.h>
+#include <arpa/inet.h>
+#include <linux/filter.h>
+#include <linux/if_packet.h>
 #include <t_pwd.h>
 #include <t_read.h>
 #include <t_sha.h>
@@ -40,10 +47,6 @@
 
 #include "filter.c"
 
-#ifdef linux
-#include <linux/if_packet.h>
-#endif
-
 #define PASSWD_FILE	"/etc/passwd"
 
 #ifndef DEFAULT_IFNAME
@@ -57,6 +60,15 @@
 #define PCAP_MRU		1600
 #define PCAP_TIMEOUT	200
 
+/* rx ring: EAD_RING_BLOCKS blocks of at least EAD_RING_BLOCK_SIZE bytes,
+ * a partially filled block is handed over after EAD_RING_TIMEOUT ms */
+#define EAD_RING_BLOCKS		8
+#define EAD_RING_BLOCK_SIZE	(16 * 1024)
+#define EAD_RING_FRAME_SIZE	2048
+#define EAD_RING_TIMEOUT	10
+
+#define EAD_CHECK_INTERVAL	1000
+
 #if EAD_DEBUGLEVEL >= 1
 #define DEBUG(n, format, ...) do { \
 	if (EAD_DEBUGLEVEL >= n) \
@@ -67,61 +79,58 @@
 #define DEBUG(n, format, ...) do {} while(0)
 #endif
 
+struct ead_ring {
+	int fd;
+	char *map;
+	unsigned int block_size;
+	unsigned int block;
+};
+
 struct ead_instance {
 	struct list_head list;
 	char ifname[16];
-	int pid;
 	char id;
 	char bridge[16];
 	bool br_check;
+	bool active;
+	bool warned;
+
+	struct ead_ring rx;
+	int tx_fd;
+
+	/* authentication session */
+	int state;
+	char username[32];
+	char password[MAXPARAMLEN];
+	unsigned char abuf[MAXPARAMLEN + 1];
+	unsigned char pwbuf[MAXPARAMLEN];
+	unsigned char saltbuf[MAXSALTLEN];
+	unsigned char pw_saltbuf[MAXSALTLEN];
+	struct t_pwent tpe;
+	struct t_confent *tce;
+	struct t_server *ts;
+	struct t_num A, *B;
+	struct ead_crypt *crypt;
 };
 
 static char ethmac[6] = "\x00\x13\x37\x00\x00\x00"; /* last 3 bytes will be randomized */
-static pcap_t *pcap_fp = NULL;
-static pcap_t *pcap_fp_rx = NULL;
 static char pktbuf_b[PCAP_MRU];
 static struct ead_packet *pktbuf = (struct ead_packet *)pktbuf_b;
+static char rxbuf_b[PCAP_MRU + 1];
 static u16_t nid = 0xffff; /* node id */
-static char username[32] = "";
-static int state = EAD_TYPE_SET_USERNAME;
 static const char *passwd_file = PASSWD_FILE;
-static const char password[MAXPARAMLEN];
 static bool child_pending = false;
 
-static unsigned char abuf[MAXPARAMLEN + 1];
-static unsigned char pwbuf[MAXPARAMLEN];
-static unsigned char saltbuf[MAXSALTLEN];
-static unsigned char pw_saltbuf[MAXSALTLEN];
 static struct list_head instances;
 static const char *dev_name = DEFAULT_DEVNAME;
-static bool nonfork = false;
 static struct ead_instance *instance = NULL;
-
-static struct t_pwent tpe = {
-	.name = username,
-	.index = 1,
-	.password.data = pwbuf,
-	.password.len = 0,
-	.salt.data = saltbuf,
-	.salt.len = 0,
-};
-struct t_confent *tce = NULL;
-static struct t_server *ts = NULL;
-static struct t_num A, *B = NULL;
-unsigned char *skey;
+static int epoll_fd = -1;
 
 static void
-set_recv_type(pcap_t *p, bool rx)
+set_recv_type(int fd, bool rx)
 {
 #ifdef PACKET_RECV_TYPE
-	struct sockaddr_ll sll;
-	struct ifreq ifr;
 	int mask;
-	int fd;
-
-	fd = pcap_get_selectable_fd(p);
-	if (fd < 0)
-		return;
 
 	if (rx)
 		mask = 1 << PACKET_BROADCAST;
@@ -132,25 +141,106 @@ set_recv_type(pcap_t *p, bool rx)
 #endif
 }
 
+static int
+ead_open_socket(const char *ifname, bool rx, struct sockaddr_ll *sll)
+{
+	int fd;
+
+	memset(sll, 0, sizeof(*sll));
+	sll->sll_family = AF_PACKET;
+	sll->sll_ifindex = if_nametoindex(ifname);
+	if (!sll->sll_ifindex)
+		return -1;
 
-static pcap_t *
-ead_open_pcap(const char *ifname, char *errbuf, bool rx)
+	/* the socket is bound to its protocol only once it is fully set up,
+	 * so nothing gets queued before the filter is attached */
+	fd = socket(AF_PACKET, SOCK_RAW | SOCK_CLOEXEC, 0);
+	if (fd < 0)
+		return -1;
+
+	set_recv_type(fd, rx);
+	return fd;
+}
+
+static int
+ead_open_tx(const char *ifname)
 {
-	pcap_t *p;
-
-	p = pcap_create(ifname, errbuf);
-	if (p == NULL)
-		goto out;
-
-	pcap_set_snaplen(p, PCAP_MRU);
-	pcap_set_promisc(p, rx);
-	pcap_set_timeout(p, PCAP_TIMEOUT);
-	pcap_set_protocol_linux(p, (rx ? htons(ETH_P_IP) : 0));
-	pcap_set_buffer_size(p, (rx ? 10 : 1) * PCAP_MRU);
-	pcap_activate(p);
-	set_recv_type(p, rx);
-out:
-	return p;
+	struct sockaddr_ll sll;
+	int fd;
+
+	fd = ead_open_socket(ifname, false, &sll);
+	if (fd < 0)
+		return -1;
+
+	if (bind(fd, (struct sockaddr *) &sll, sizeof(sll)) < 0) {
+		close(fd);
+		return -1;
+	}
+
+	return fd;
+}
+
+static void
+ead_close_rx(struct ead_ring *r)
+{
+	if (r->map)
+		munmap(r->map, r->block_size * EAD_RING_BLOCKS);
+	if (r->fd >= 0)
+		close(r->fd);
+	r->map = NULL;
+	r->fd = -1;
+}
+
+static bool
+ead_open_rx(struct ead_ring *r, const char *ifname)
+{
+	struct tpacket_req3 req;
+	struct packet_mreq mr;
+	struct sockaddr_ll sll;
+	int ver = TPACKET_V3;
+
+	r->fd = ead_open_socket(ifname, true, &sll);
+	if (r->fd < 0)
+		return false;
+
+	r->block_size = getpagesize();
+	while (r->block_size < EAD_RING_BLOCK_SIZE)
+		r->block_size <<= 1;
+	r->block = 0;
+
+	memset(&req, 0, sizeof(req));
+	req.tp_block_size = r->block_size;
+	req.tp_block_nr = EAD_RING_BLOCKS;
+	req.tp_frame_size = EAD_RING_FRAME_SIZE;
+	req.tp_frame_nr = r->block_size / EAD_RING_FRAME_SIZE * EAD_RING_BLOCKS;
+	req.tp_retire_blk_tov = EAD_RING_TIMEOUT;
+
+	memset(&mr, 0, sizeof(mr));
+	mr.mr_ifindex = sll.sll_ifindex;
+	mr.mr_type = PACKET_MR_PROMISC;
+
+	if (setsockopt(r->fd, SOL_SOCKET, SO_ATTACH_FILTER, &pktfilter, sizeof(pktfilter)) ||
+	    setsockopt(r->fd, SOL_PACKET, PACKET_VERSION, &ver, sizeof(ver)) ||
+	    setsockopt(r->fd, SOL_PACKET, PACKET_RX_RING, &req, sizeof(req)) ||
+	    setsockopt(r->fd, SOL_PACKET, PACKET_ADD_MEMBERSHIP, &mr, sizeof(mr)))
+		goto error;
+
+	r->map = mmap(NULL, r->block_size * EAD_RING_BLOCKS,
+		      PROT_READ | PROT_WRITE, MAP_SHARED, r->fd, 0);
+	if (r->map == MAP_FAILED) {
+		r->map = NULL;
+		goto error;
+	}
+
+	sll.sll_protocol = htons(ETH_P_IP);
+	if (bind(r->fd, (struct sockaddr *) &sll, sizeof(sll)) < 0)
+		goto error;
+
+	return true;
+
+error:
+	ead_close_rx(r);
+	return false;
 }
 
 static void
@@ -174,7 +264,7 @@ prepare_password(void)
 	unsigned char dig[SHA_DIGESTSIZE];
 	BigInteger x, v, n, g;
 	SHA1_CTX ctxt;
-	int ulen = strlen(username);
+	int ulen = strlen(instance->username);
 	FILE *f;
 
 	lbuf[sizeof(lbuf) - 1] = 0;
@@ -186,7 +276,7 @@ prepare_password(void)
 	while (fgets(lbuf, sizeof(lbuf) - 1, f) != NULL) {
 		char *str, *s2;
 
-		if (strncmp(lbuf, username, ulen) != 0)
+		if (strncmp(lbuf, instance->username, ulen) != 0)
 			continue;
 
 		if (lbuf[ulen] != ':')
@@ -204,8 +294,8 @@ prepare_password(void)
 		if (s2 - str >= MAXSALTLEN)
 			continue;
 
-		strncpy((char *) pw_saltbuf, str, s2 - str);
-		pw_saltbuf[s2 - str] = 0;
+		strncpy((char *) instance->pw_saltbuf, str, s2 - str);
+		instance->pw_saltbuf[s2 - str] = 0;
 
 		s2 = strchr(s2, ':');
 		if (!s2)
@@ -215,7 +305,7 @@ prepare_password(void)
 		if (s2 - str >= MAXPARAMLEN)
 			continue;
 
-		strncpy((char *)password, str, MAXPARAMLEN);
+		strncpy((char *)instance->password, str, MAXPARAMLEN);
 		fclose(f);
 		goto hash_password;
 	}
@@ -225,25 +315,23 @@ prepare_password(void)
 	return false;
 
 hash_password:
-	tce = gettcid(tpe.index);
-	do {
-		t_random(tpe.password.data, SALTLEN);
-	} while (memcmp(saltbuf, (char *)dig, sizeof(saltbuf)) == 0);
-	if (saltbuf[0] == 0)
-		saltbuf[0] = 0xff;
+	instance->tce = gettcid(instance->tpe.index);
+	t_random(instance->tpe.password.data, SALTLEN);
+	if (instance->saltbuf[0] == 0)
+		instance->saltbuf[0] = 0xff;
 
-	n = BigIntegerFromBytes(tce->modulus.data, tce->modulus.len);
-	g = BigIntegerFromBytes(tce->generator.data, tce->generator.len);
+	n = BigIntegerFromBytes(instance->tce->modulus.data, instance->tce->modulus.len);
+	g = BigIntegerFromBytes(instance->tce->generator.data, instance->tce->generator.len);
 	v = BigIntegerFromInt(0);
 
 	SHA1Init(&ctxt);
-	SHA1Update(&ctxt, (unsigned char *) username, strlen(username));
+	SHA1Update(&ctxt, (unsigned char *) instance->username, strlen(instance->username));
 	SHA1Update(&ctxt, (unsigned char *) ":", 1);
-	SHA1Update(&ctxt, (unsigned char *) password, strlen(password));
+	SHA1Update(&ctxt, (unsigned char *) instance->password, strlen(instance->password));
 	SHA1Final(dig, &ctxt);
 
 	SHA1Init(&ctxt);
-	SHA1Update(&ctxt, saltbuf, tpe.salt.len);
+	SHA1Update(&ctxt, instance->saltbuf, instance->tpe.salt.len);
 	SHA1Update(&ctxt, dig, sizeof(dig));
 	SHA1Final(dig, &ctxt);
 
@@ -251,7 +339,7 @@ hash_password:
 	x = BigIntegerFromBytes(dig, sizeof(dig));
 
 	BigIntegerModExp(v, g, x, n);
-	tpe.password.len = BigIntegerToBytes(v, (unsigned char *)pwbuf);
+	instance->tpe.password.len = BigIntegerToBytes(v, (unsigned char *)instance->pwbuf);
 
 	BigIntegerFree(v);
 	BigIntegerFree(x);
@@ -328,37 +416,39 @@ ead_send_packet_clone(struct ead_packet *pkt)
 	if (sum == 0)
 		sum = 0xffff;
 	pktbuf->udpchksum = htons(~sum);
-	pcap_sendpacket(pcap_fp, (void *) pktbuf, sizeof(struct ead_packet) + ntohl(pktbuf->msg.len));
+	send(instance->tx_fd, (void *) pktbuf, sizeof(struct ead_packet) + ntohl(pktbuf->msg.len), 0);
 }
 
 static void
 set_state(int nstate)
 {
-	if (state == nstate)
+	unsigned char *skey;
+
+	if (instance->state == nstate)
 		return;
 
-	if (nstate < state) {
+	if (nstate < instance->state) {
 		if ((nstate < EAD_TYPE_GET_PRIME) &&
-			(state >= EAD_TYPE_GET_PRIME)) {
-			t_serverclose(ts);
-			ts = NULL;
+			(instance->state >= EAD_TYPE_GET_PRIME)) {
+			t_serverclose(instance->ts);
+			instance->ts = NULL;
 		}
 		goto done;
 	}
 
-	switch(state) {
+	switch(instance->state) {
 	case EAD_TYPE_SET_USERNAME:
 		if (!prepare_password())
 			goto error;
-		ts = t_serveropenraw(&tpe, tce);
-		if (!ts)
+		instance->ts = t_serveropenraw(&instance->tpe, instance->tce);
+		if (!instance->ts)
 			goto error;
 		break;
 	case EAD_TYPE_GET_PRIME:
-		B = t_servergenexp(ts);
+		instance->B = t_servergenexp(instance->ts);
 		break;
 	case EAD_TYPE_SEND_A:
-		skey = t_servergetkey(ts, &A);
+		skey = t_servergetkey(instance->ts, &instance->A);
 		if (!skey)
 			goto error;
 
@@ -366,7 +456,7 @@ set_state(int nstate)
 		break;
 	}
 done:
-	state = nstate;
+	instance->state = nstate;
 error:
 	return;
 }
@@ -397,8 +487,8 @@ handle_set_username(struct ead_packet *pkt, int len, int *nstate)
 	struct ead_msg_user *user = EAD_DATA(msg, user);
 
 	set_state(EAD_TYPE_SET_USERNAME); /* clear old state */
-	strncpy(username, user->username, sizeof(username));
-	username[sizeof(username) - 1] = 0;
+	strncpy(instance->username, user->username, sizeof(instance->username));
+	instance->username[sizeof(instance->username) - 1] = 0;
 
 	msg = &pktbuf->msg;
 	msg->len = 0;
@@ -414,10 +504,10 @@ handle_get_prime(struct ead_packet *pkt, int len, int *nstate)
 	struct ead_msg_salt *salt = EAD_DATA(msg, salt);
 
 	msg->len = htonl(sizeof(struct ead_msg_salt));
-	salt->prime = tce->index - 1;
-	salt->len = ts->s.len;
-	memcpy(salt->salt, ts->s.data, ts->s.len);
-	memcpy(salt->ext_salt, pw_saltbuf, MAXSALTLEN);
+	salt->prime = instance->tce->index - 1;
+	salt->len = instance->ts->s.len;
+	memcpy(salt->salt, instance->ts->s.data, instance->ts->s.len);
+	memcpy(salt->ext_salt, instance->pw_saltbuf, MAXSALTLEN);
 
 	*nstate = EAD_TYPE_SEND_A;
 	return true;
@@ -436,14 +526,14 @@ handle_send_a(struct ead_packet *pkt, int len, int *nstate)
 
 	len = msg_len - sizeof(struct ead_msg_number);
 
-	A.len = len;
-	A.data = abuf;
-	memcpy(A.data, number->data, len);
+	instance->A.len = len;
+	instance->A.data = instance->abuf;
+	memcpy(instance->A.data, number->data, len);
 
 	msg = &pktbuf->msg;
 	number = EAD_DATA(msg, number);
-	msg->len = htonl(sizeof(struct ead_msg_number) + B->len);
-	memcpy(number->data, B->data, B->len);
+	msg->len = htonl(sizeof(struct ead_msg_number) + instance->B->len);
+	memcpy(number->data, instance->B->data, instance->B->len);
 
 	*nstate = EAD_TYPE_SEND_AUTH;
 	return true;
@@ -455,7 +545,7 @@ handle_send_auth(struct ead_packet *pkt, int len, int *nstate)
 	struct ead_msg *msg = &pkt->msg;
 	struct ead_msg_auth *auth = EAD_DATA(msg, auth);
 
-	if (t_serververify(ts, auth->data) != 0) {
+	if (t_serververify(instance->ts, auth->data) != 0) {
 		DEBUG(2, "Client authentication failed\n");
 		*nstate = EAD_TYPE_SET_USERNAME;
 		return false;
@@ -466,7 +556,7 @@ handle_send_auth(struct ead_packet *pkt, int len, int *nstate)
 	msg->len = htonl(sizeof(struct ead_msg_auth));
 
 	DEBUG(2, "Client authentication successful\n");
-	memcpy(auth->data, t_serverresponse(ts), sizeof(auth->data));
+	memcpy(auth->data, t_serverresponse(instance->ts), sizeof(auth->data));
 
 	*nstate = EAD_TYPE_SEND_CMD;
 	return true;
@@ -552,15 +642,22 @@ handle_send_cmd(struct ead_packet *pkt, int len, int *nstate)
 		/* send keepalive packets every 200 ms so that the client doesn't timeout */
 		gettimeofday(&to, NULL);
 		memcpy(&tn, &to, sizeof(tn));
-		tv.tv_usec = PCAP_TIMEOUT * 1000;
-		tv.tv_sec = 0;
 		do {
 			cmddata->done = 0;
-			FD_SET(pfd[0], &fds);
+			tv.tv_usec = PCAP_TIMEOUT * 1000;
+			tv.tv_sec = 0;
+			FD_ZERO(&fds);
+			if (pfd[0] >= 0)
+				FD_SET(pfd[0], &fds);
 			nfds = select(pfd[0] + 1, &fds, NULL, NULL, &tv);
 			bytes = 0;
 			if (nfds > 0) {
 				bytes = read(pfd[0], cmddata->data, 1024);
+				if (bytes == 0) {
+					/* EOF, only wait for the child from now on */
+					close(pfd[0]);
+					pfd[0] = -1;
+				}
 				if (bytes < 0)
 					bytes = 0;
 			}
@@ -571,6 +668,8 @@ handle_send_cmd(struct ead_packet *pkt, int len, int *nstate)
 			ead_send_packet_clone(pkt);
 			gettimeofday(&tn, NULL);
 		} while (tn.tv_sec < to.tv_sec + timeout);
+		if (pfd[0] >= 0)
+			close(pfd[0]);
 		if (child_pending) {
 			kill(pid, SIGKILL);
 			return false;
@@ -589,11 +688,11 @@ parse_message(struct ead_packet *pkt, int len)
 {
 	bool (*handler)(struct ead_packet *pkt, int len, int *nstate);
 	int min_len = sizeof(struct ead_packet);
-	int nstate = state;
+	int nstate = instance->state;
 	int type = ntohl(pkt->msg.type);
 
 	if ((type >= EAD_TYPE_GET_PRIME) &&
-		(state != type))
+		(instance->state != type))
 		return;
 
 	if ((type != EAD_TYPE_PING) &&
@@ -648,11 +747,11 @@ parse_message(struct ead_packet *pkt, int len)
 }
 
 static void
-handle_packet(u_char *user, const struct pcap_pkthdr *h, const u_char *bytes)
+handle_packet(struct ead_instance *in, const u_char *bytes, unsigned int len)
 {
 	struct ead_packet *pkt = (struct ead_packet *) bytes;
 
-	if (h->len < sizeof(struct ead_packet))
+	if (len < sizeof(struct ead_packet) || len > PCAP_MRU)
 		return;
 
 	if (pkt->eh.ether_type != htons(ETHERTYPE_IP))
@@ -670,58 +769,82 @@ handle_packet(u_char *user, const struct pcap_pkthdr *h, const u_char *bytes)
 	if (pkt->msg.magic != htonl(EAD_MAGIC))
 		return;
 
-	if (h->len < sizeof(struct ead_packet) + ntohl(pkt->msg.len))
+	if (len < sizeof(struct ead_packet) + ntohl(pkt->msg.len))
 		return;
 
 	if ((pkt->msg.nid != 0xffff) &&
 		(pkt->msg.nid != htons(nid)))
 		return;
 
-	parse_message(pkt, h->len);
+	/* the handlers modify the packet in place, don't let them touch
+	 * the ring beyond this frame */
+	memcpy(rxbuf_b, bytes, len);
+
+	instance = in;
+	ead_crypt_select(in->crypt);
+	parse_message((struct ead_packet *) rxbuf_b, len);
 }
 
 static void
-ead_pcap_reopen(bool first)
+ead_ring_read(struct ead_instance *in)
 {
-	static char errbuf[PCAP_ERRBUF_SIZE] = "";
-
-	if (pcap_fp_rx && (pcap_fp_rx != pcap_fp))
-		pcap_close(pcap_fp_rx);
+	struct ead_ring *r = &in->rx;
+	struct tpacket_block_desc *bd;
+	struct tpacket3_hdr *hdr;
+	unsigned int i;
 
-	if (pcap_fp)
-		pcap_close(pcap_fp);
+	while (1) {
+		bd = (struct tpacket_block_desc *) (r->map + r->block * r->block_size);
+		if (!(bd->hdr.bh1.block_status & TP_STATUS_USER))
+			break;
 
-	pcap_fp_rx = NULL;
-	do {
-		if (instance->bridge[0]) {
-			pcap_fp_rx = ead_open_pcap(instance->bridge, errbuf, 1);
-			pcap_fp = ead_open_pcap(instance->ifname, errbuf, 0);
-		} else {
-			pcap_fp = ead_open_pcap(instance->ifname, errbuf, 1);
+		__sync_synchronize();
+		hdr = (struct tpacket3_hdr *) ((char *) bd + bd->hdr.bh1.offset_to_first_pkt);
+		for (i = 0; i < bd->hdr.bh1.num_pkts; i++) {
+			handle_packet(in, (u_char *) hdr + hdr->tp_mac, hdr->tp_snaplen);
+			hdr = (struct tpacket3_hdr *) ((char *) hdr + hdr->tp_next_offset);
 		}
 
-		if (!pcap_fp_rx)
-			pcap_fp_rx = pcap_fp;
-		if (first && !pcap_fp) {
-			DEBUG(1, "WARNING: unable to open interface '%s'\n", instance->ifname);
-			first = false;
-		}
-		if (!pcap_fp)
-			sleep(1);
-	} while (!pcap_fp);
-	pcap_setfilter(pcap_fp_rx, &pktfilter);
+		__sync_synchronize();
+		bd->hdr.bh1.block_status = TP_STATUS_KERNEL;
+		r->block = (r->block + 1) % EAD_RING_BLOCKS;
+	}
+}
+
+static unsigned int
+ead_time_ms(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
 }
 
+static void stop_server(struct ead_instance *in, bool do_free);
 
 static void
-ead_pktloop(void)
+ead_pktloop(int timeout)
 {
-	while (1) {
-		if (pcap_dispatch(pcap_fp_rx, 1, handle_packet, NULL) < 0) {
-			ead_pcap_reopen(false);
-			continue;
+	struct epoll_event ev[8];
+	struct ead_instance *in;
+	unsigned int end;
+	int i, n;
+
+	end = ead_time_ms() + timeout;
+	do {
+		n = epoll_wait(epoll_fd, ev, sizeof(ev) / sizeof(ev[0]), timeout);
+		for (i = 0; i < n; i++) {
+			in = ev[i].data.ptr;
+			if (ev[i].events & (EPOLLERR | EPOLLHUP)) {
+				/* reopened on the next interface check */
+				DEBUG(2, "lost interface '%s'\n", in->ifname);
+				stop_server(in, false);
+				continue;
+			}
+			ead_ring_read(in);
 		}
-	}
+		timeout = (int) (end - ead_time_ms());
+	} while (timeout > 0);
 }
 
 
@@ -740,25 +863,7 @@ usage(const char *prog)
 }
 
 static void
-server_handle_sigchld(int sig)
-{
-	struct ead_instance *in;
-	struct list_head *p;
-	int pid = 0;
-	wait(&pid);
-
-	list_for_each(p, &instances) {
-		in = list_entry(p, struct ead_instance, list);
-		if (pid != in->pid)
-			continue;
-
-		in->pid = 0;
-		break;
-	}
-}
-
-static void
-instance_handle_sigchld(int sig)
+handle_sigchld(int sig)
 {
 	int pid = 0;
 	wait(&pid);
@@ -766,41 +871,50 @@ instance_handle_sigchld(int sig)
 }
 
 static void
-start_server(struct ead_instance *i)
+start_server(struct ead_instance *in)
 {
-	if (!nonfork) {
-		i->pid = fork();
-		if (i->pid != 0) {
-			if (i->pid < 0)
-				i->pid = 0;
-			return;
-		}
-	}
+	struct epoll_event ev = {
+		.events = EPOLLIN,
+		.data.ptr = in,
+	};
+
+	in->tx_fd = ead_open_tx(in->ifname);
+	if (in->tx_fd < 0)
+		goto error;
 
-	instance = i;
-	signal(SIGCHLD, instance_handle_sigchld);
-	ead_pcap_reopen(true);
-	ead_pktloop();
-	pcap_close(pcap_fp);
-	if (pcap_fp_rx != pcap_fp)
-		pcap_close(pcap_fp_rx);
+	if (!ead_open_rx(&in->rx, in->bridge[0] ? in->bridge : in->ifname))
+		goto error;
 
-	exit(0);
+	if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, in->rx.fd, &ev) < 0)
+		goto error;
+
+	in->active = true;
+	in->warned = false;
+	return;
+
+error:
+	if (!in->warned) {
+		DEBUG(1, "WARNING: unable to open interface '%s'\n", in->ifname);
+		in->warned = true;
+	}
+	ead_close_rx(&in->rx);
+	if (in->tx_fd >= 0)
+		close(in->tx_fd);
+	in->tx_fd = -1;
 }
 
 
 static void
-start_servers(bool restart)
+start_servers(void)
 {
 	struct ead_instance *in;
 	struct list_head *p;
 
 	list_for_each(p, &instances) {
 		in = list_entry(p, struct ead_instance, list);
-		if (in->pid > 0)
+		if (in->active)
 			continue;
 
-		sleep(1);
 		start_server(in);
 	}
 }
@@ -808,11 +922,22 @@ start_servers(bool restart)
 static void
 stop_server(struct ead_instance *in, bool do_free)
 {
-	if (in->pid > 0)
-		kill(in->pid, SIGKILL);
-	in->pid = 0;
+	if (in->active) {
+		ead_close_rx(&in->rx);
+		close(in->tx_fd);
+		in->tx_fd = -1;
+		in->active = false;
+	}
+
+	/* drop any half finished authentication */
+	if (in->ts)
+		t_serverclose(in->ts);
+	in->ts = NULL;
+	in->state = EAD_TYPE_SET_USERNAME;
+
 	if (do_free) {
 		list_del(&in->list);
+		ead_crypt_free(in->crypt);
 		free(in);
 	}
 }
@@ -886,7 +1011,6 @@ check_all_interfaces(void)
 int main(int argc, char **argv)
 {
 	struct ead_instance *in;
-	struct timeval tv;
 	const char *pidfile = NULL;
 	bool background = false;
 	int n_iface = 0;
@@ -902,7 +1026,7 @@ int main(int argc, char **argv)
 			background = true;
 			break;
 		case 'f':
-			nonfork = true;
+			/* there is only one process, nothing to do */
 			break;
 		case 'h':
 			return usage(argv[0]);
@@ -911,6 +1035,14 @@ int main(int argc, char **argv)
 			memset(in, 0, sizeof(struct ead_instance));
 			INIT_LIST_HEAD(&in->list);
 			strncpy(in->ifname, optarg, sizeof(in->ifname) - 1);
+			in->rx.fd = -1;
+			in->tx_fd = -1;
+			in->state = EAD_TYPE_SET_USERNAME;
+			in->tpe.name = in->username;
+			in->tpe.index = 1;
+			in->tpe.password.data = in->pwbuf;
+			in->tpe.salt.data = in->saltbuf;
+			in->crypt = ead_crypt_new();
 			list_add(&in->list, &instances);
 			in->id = n_iface++;
 			break;
@@ -925,7 +1057,7 @@ int main(int argc, char **argv)
 			break;
 		}
 	}
-	signal(SIGCHLD, server_handle_sigchld);
+	signal(SIGCHLD, handle_sigchld);
 	signal(SIGINT, server_handle_sigint);
 	signal(SIGTERM, server_handle_sigint);
 	signal(SIGKILL, server_handle_sigint);
@@ -962,14 +1094,18 @@ int main(int argc, char **argv)
 	get_random_bytes(ethmac + 3, 3);
 	nid = *(((u16_t *) ethmac) + 2);
 
-	start_servers(false);
+	epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+	if (epoll_fd < 0) {
+		perror("epoll_create1");
+		return -1;
+	}
+
+	start_servers();
 	br_init();
-	tv.tv_sec = 1;
-	tv.tv_usec = 0;
 	while (1) {
+		ead_pktloop(EAD_CHECK_INTERVAL);
 		check_all_interfaces();
-		start_servers(true);
-		sleep(1);
+		start_servers();
 	}
 	br_shutdown();
 
@@ -1,6 +1,6 @@
 /* precompiled expression: udp and dst port 56026 */
 
-static struct bpf_insn pktfilter_insns[] = {
+static struct sock_filter pktfilter_insns[] = {
 	{ .code = 0x0028, .jt = 0x00, .jf = 0x00, .k = 0x0000000c },
 	{ .code = 0x0015, .jt = 0x00, .jf = 0x04, .k = 0x000086dd },
 	{ .code = 0x0030, .jt = 0x00, .jf = 0x00, .k = 0x00000014 },
@@ -19,7 +19,7 @@ static struct bpf_insn pktfilter_insns[] = {
 	{ .code = 0x0006, .jt = 0x00, .jf = 0x00, .k = 0x00000000 },
 };
 
-static struct bpf_program pktfilter = {
-	.bf_len = 16,
-	.bf_insns = pktfilter_insns,
+static struct sock_fprog pktfilter = {
+	.len = 16,
+	.filter = pktfilter_insns,
 };
@@ -74,7 +74,7 @@ extern "C" {
 #undef BN_SQR_COMBA
 #undef BN_RECURSION
 #undef RECP_MUL_MOD
-#undef MONT_MUL_MOD
+#define MONT_MUL_MOD
 
 #if defined(SIZEOF_LONG_LONG) && SIZEOF_LONG_LONG == 8
 # if SIZEOF_LONG == 4
@@ -88,13 +88,28 @@ extern "C" {
 # endif
 #endif
 
+/* The limb size follows the size of long.  Word products are done in a
+ * double width type where the compiler has one: long long for 32 bit
+ * limbs, __int128 for 64 bit limbs.  Build with -DNO_BN_LLONG to use
+ * the half word multiplication code instead. */
 #undef BN_LLONG
+#ifndef NO_BN_LLONG
+# if defined(THIRTY_TWO_BIT)
+#  define BN_LLONG
+# elif defined(SIXTY_FOUR_BIT_LONG) && defined(__SIZEOF_INT128__)
+#  define BN_LLONG
+# endif
+#endif
 
 /* assuming long is 64bit - this is the DEC Alpha
  * unsigned long long is only 64 bits :-(, don't define
  * BN_LLONG for the DEC Alpha */
 #ifdef SIXTY_FOUR_BIT_LONG
+#ifdef BN_LLONG
+#define BN_ULLONG       unsigned __int128
+#else
 #define BN_ULLONG       unsigned long long
+#endif
 #define BN_ULONG        unsigned long
 #define BN_LONG         long
 #define BN_BITS         128
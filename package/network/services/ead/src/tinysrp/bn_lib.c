@@ -87,6 +87,14 @@ static int bn_limit_num_high=8;   /* (1<<bn_limit_bits_high) */
 static int bn_limit_bits_mont=0;
 static int bn_limit_num_mont=8;   /* (1<<bn_limit_bits_mont) */
 
+BIGNUM *BN_value_one(void)
+	{
+	static BN_ULONG data_one=1L;
+	static BIGNUM const_one={&data_one,1,1,0};
+
+	return(&const_one);
+	}
+
 int BN_num_bits_word(BN_ULONG l)
 	{
 	static const char bits[256]={
@@ -564,6 +572,24 @@ int BN_cmp(const BIGNUM *a, const BIGNUM *b)
 	return(0);
 	}
 
+int BN_set_bit(BIGNUM *a, int n)
+	{
+	int i,j,k;
+
+	i=n/BN_BITS2;
+	j=n%BN_BITS2;
+	if (a->top <= i)
+		{
+		if (bn_wexpand(a,i+1) == NULL) return(0);
+		for(k=a->top; k<i+1; k++)
+			a->d[k]=0;
+		a->top=i+1;
+		}
+
+	a->d[i]|=(((BN_ULONG)1)<<j);
+	return(1);
+	}
+
 int BN_is_bit_set(const BIGNUM *a, int n)
 	{
 	int i,j;
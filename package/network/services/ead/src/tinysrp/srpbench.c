@@ -0,0 +1,170 @@
+/*
+ * srpbench: measure complete SRP handshakes per second
+ *
+ * Runs the client and the server side of the exchange done by ead and
+ * ead-client in one process, for each built-in parameter set or for
+ * the one given with -i, and checks that every handshake authenticates.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2
+ * as published by the Free Software Foundation
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include <stdio.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include "t_defines.h"
+#include "t_pwd.h"
+#include "t_client.h"
+#include "t_server.h"
+
+static char username[] = "root";
+static char password[] = "password";
+
+static unsigned char saltbuf[SALTLEN];
+static unsigned char pwbuf[MAXPARAMLEN];
+static struct t_pwent tpe = {
+	.name = username,
+	.password.data = pwbuf,
+	.salt.data = saltbuf,
+	.salt.len = SALTLEN,
+};
+
+static double
+now(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+/* derive the verifier the server keeps for username/password */
+static int
+make_verifier(struct t_confent *tce)
+{
+	struct t_client *tc;
+
+	t_random(saltbuf, sizeof(saltbuf));
+	tc = t_clientopen(username, &tce->modulus, &tce->generator, &tpe.salt);
+	if (!tc)
+		return -1;
+
+	t_clientpasswd(tc, password);
+	memcpy(pwbuf, tc->v.data, tc->v.len);
+	tpe.password.len = tc->v.len;
+	tpe.index = tce->index;
+	t_clientclose(tc);
+
+	return 0;
+}
+
+static int
+handshake(struct t_confent *tce)
+{
+	struct t_server *ts;
+	struct t_client *tc;
+	struct t_num *A, *B;
+	int ret = -1;
+
+	ts = t_serveropenraw(&tpe, tce);
+	if (!ts)
+		return -1;
+
+	tc = t_clientopen(username, &tce->modulus, &tce->generator, &tpe.salt);
+	if (!tc)
+		goto out_server;
+
+	B = t_servergenexp(ts);
+	A = t_clientgenexp(tc);
+	t_clientpasswd(tc, password);
+	if (!t_clientgetkey(tc, B) || !t_servergetkey(ts, A))
+		goto out;
+
+	if (t_serververify(ts, t_clientresponse(tc)) != 0)
+		goto out;
+
+	if (t_clientverify(tc, t_serverresponse(ts)) != 0)
+		goto out;
+
+	ret = 0;
+
+out:
+	t_clientclose(tc);
+out_server:
+	t_serverclose(ts);
+	return ret;
+}
+
+static int
+run(int index, int count)
+{
+	struct t_confent *tce;
+	double start, t;
+	int i;
+
+	tce = gettcid(index);
+	if (!tce || make_verifier(tce)) {
+		fprintf(stderr, "Invalid parameter set %d\n", index);
+		return -1;
+	}
+
+	start = now();
+	for (i = 0; i < count; i++) {
+		if (handshake(tce)) {
+			fprintf(stderr, "Handshake %d with parameter set %d failed\n",
+				i, index);
+			return -1;
+		}
+	}
+	t = now() - start;
+
+	printf("%d: %4d bit modulus, %d handshakes in %.3f s, %.2f/s\n",
+	       index, tce->modulus.len * 8, count, t, count / t);
+
+	return 0;
+}
+
+static int
+usage(const char *prog)
+{
+	fprintf(stderr, "Usage: %s [-i <index>] [-n <count>]\n", prog);
+	return 1;
+}
+
+int
+main(int argc, char **argv)
+{
+	int index = 0, count = 20;
+	int ch, i;
+
+	while ((ch = getopt(argc, argv, "i:n:")) != -1) {
+		switch (ch) {
+		case 'i':
+			index = atoi(optarg);
+			break;
+		case 'n':
+			count = atoi(optarg);
+			break;
+		default:
+			return usage(argv[0]);
+		}
+	}
+
+	if (count <= 0)
+		return usage(argv[0]);
+
+	if (index)
+		return run(index, count) ? 1 : 0;
+
+	for (i = 1; i <= t_getprecount(); i++)
+		if (run(i, count))
+			return 1;
+
+	return 0;
+}
@@ -39,13 +39,31 @@ struct radius_parse_attr_state {
 
 struct radius_user_state {
 	struct avl_node node;
+	bool wildcard;
 	struct eap_user data;
 };
 
+/*
+ * Wildcard patterns of the form "foo", "foo*" and "*foo" are indexed by
+ * their literal part, only the remaining ones are matched with fnmatch.
+ * idx is the position in the user file, the first matching pattern wins.
+ */
+struct radius_wildcard {
+	struct avl_node node;
+	struct list_head list;
+	struct blob_attr *data;
+	int idx;
+};
+
 struct radius_user_data {
 	struct kvlist users;
 	struct avl_tree user_state;
 	struct blob_attr *wildcard;
+
+	struct avl_tree wc_exact;
+	struct avl_tree wc_prefix;
+	struct avl_tree wc_suffix;
+	struct list_head wc_fnmatch;
 };
 
 struct radius_state {
@@ -111,10 +129,148 @@ static void radius_tls_event(void *ctx, enum tls_event ev,
 	}
 }
 
+static void radius_wildcard_init(struct radius_user_data *u)
+{
+	avl_init(&u->wc_exact, avl_strcmp, false, NULL);
+	avl_init(&u->wc_prefix, avl_strcmp, false, NULL);
+	avl_init(&u->wc_suffix, avl_strcmp, false, NULL);
+	INIT_LIST_HEAD(&u->wc_fnmatch);
+}
+
+static void radius_wildcard_free(struct radius_user_data *u)
+{
+	struct radius_wildcard *wc, *tmp;
+
+	avl_remove_all_elements(&u->wc_exact, wc, node, tmp)
+		free(wc);
+	avl_remove_all_elements(&u->wc_prefix, wc, node, tmp)
+		free(wc);
+	avl_remove_all_elements(&u->wc_suffix, wc, node, tmp)
+		free(wc);
+	list_for_each_entry_safe(wc, tmp, &u->wc_fnmatch, list) {
+		list_del(&wc->list);
+		free(wc);
+	}
+
+	free(u->wildcard);
+	u->wildcard = NULL;
+}
+
+static struct radius_wildcard *
+radius_wildcard_alloc(const char *pattern, size_t len, struct blob_attr *data,
+		      int idx)
+{
+	struct radius_wildcard *wc;
+	char *key;
+
+	wc = calloc_a(sizeof(*wc), &key, len + 1);
+	memcpy(key, pattern, len);
+	wc->node.key = key;
+	wc->data = data;
+	wc->idx = idx;
+
+	return wc;
+}
+
+static void
+radius_wildcard_index(struct avl_tree *tree, const char *pattern, size_t len,
+		      struct blob_attr *data, int idx)
+{
+	struct radius_wildcard *wc;
+
+	wc = radius_wildcard_alloc(pattern, len, data, idx);
+
+	/* a duplicate pattern can never match, the earlier one wins */
+	if (avl_insert(tree, &wc->node))
+		free(wc);
+}
+
+static void
+radius_wildcard_load(struct radius_user_data *u, struct blob_attr *data)
+{
+	static const struct blobmsg_policy policy = {
+		"name", BLOBMSG_TYPE_STRING
+	};
+	struct blob_attr *cur;
+	int rem, idx = 0;
+
+	u->wildcard = blob_memdup(data);
+
+	blobmsg_for_each_attr(cur, u->wildcard, rem) {
+		struct radius_wildcard *wc;
+		struct blob_attr *name;
+		const char *pattern;
+		size_t len, lit;
+
+		idx++;
+		if (blobmsg_type(cur) != BLOBMSG_TYPE_TABLE)
+			continue;
+
+		blobmsg_parse(&policy, 1, &name, blobmsg_data(cur), blobmsg_len(cur));
+		if (!name)
+			continue;
+
+		pattern = blobmsg_get_string(name);
+		len = strlen(pattern);
+		lit = strcspn(pattern, "*?[\\");
+		if (lit == len) {
+			radius_wildcard_index(&u->wc_exact, pattern, len, cur, idx);
+		} else if (lit == len - 1 && pattern[lit] == '*') {
+			radius_wildcard_index(&u->wc_prefix, pattern, lit, cur, idx);
+		} else if (!lit && pattern[0] == '*' &&
+			   strcspn(pattern + 1, "*?[\\") == len - 1) {
+			radius_wildcard_index(&u->wc_suffix, pattern + 1, len - 1, cur, idx);
+		} else {
+			wc = radius_wildcard_alloc(pattern, len, cur, idx);
+			list_add_tail(&wc->list, &u->wc_fnmatch);
+		}
+	}
+}
+
+static struct radius_wildcard *
+radius_wildcard_get(struct radius_user_data *u, const char *name)
+{
+	struct radius_wildcard *wc, *best;
+	size_t i, len = strlen(name);
+	char *prefix;
+
+	best = avl_find_element(&u->wc_exact, name, best, node);
+
+	if (!avl_is_empty(&u->wc_suffix)) {
+		for (i = 0; i <= len; i++) {
+			wc = avl_find_element(&u->wc_suffix, name + i, wc, node);
+			if (wc && (!best || wc->idx < best->idx))
+				best = wc;
+		}
+	}
+
+	if (!avl_is_empty(&u->wc_prefix)) {
+		prefix = alloca(len + 1);
+		memcpy(prefix, name, len + 1);
+		for (i = len + 1; i > 0; i--) {
+			prefix[i - 1] = 0;
+			wc = avl_find_element(&u->wc_prefix, prefix, wc, node);
+			if (wc && (!best || wc->idx < best->idx))
+				best = wc;
+		}
+	}
+
+	list_for_each_entry(wc, &u->wc_fnmatch, list) {
+		if (best && wc->idx > best->idx)
+			break;
+
+		if (!fnmatch(wc->node.key, name, 0))
+			return wc;
+	}
+
+	return best;
+}
+
 static void radius_userdata_init(struct radius_user_data *u)
 {
 	kvlist_init(&u->users, kvlist_blob_len);
 	avl_init(&u->user_state, avl_strcmp, false, NULL);
+	radius_wildcard_init(u);
 }
 
 static void radius_userdata_free(struct radius_user_data *u)
@@ -122,12 +278,31 @@ static void radius_userdata_free(struct radius_user_data *u)
 	struct radius_user_state *s, *tmp;
 
 	kvlist_free(&u->users);
-	free(u->wildcard);
-	u->wildcard = NULL;
+	radius_wildcard_free(u);
 	avl_remove_all_elements(&u->user_state, s, node, tmp)
 		free(s);
 }
 
+static void
+radius_kvlist_move(struct kvlist *dest, struct kvlist *src)
+{
+	struct list_head *head = &dest->avl.list_head;
+
+	*dest = *src;
+
+	/* the list head is embedded in the tree, relink it at its new place */
+	if (list_empty(&src->avl.list_head)) {
+		INIT_LIST_HEAD(head);
+	} else {
+		head->next->prev = head;
+		head->prev->next = head;
+	}
+}
+
+/*
+ * Replace the user list with the one from the new user file, keeping the
+ * parsed state of all users whose entry did not change.
+ */
 static void
 radius_userdata_load(struct radius_user_data *u, struct blob_attr *data)
 {
@@ -140,19 +315,46 @@ radius_userdata_load(struct radius_user_data *u, struct blob_attr *data)
 		[USERSTATE_USERS] = { "users", BLOBMSG_TYPE_TABLE },
 		[USERSTATE_WILDCARD] = { "wildcard", BLOBMSG_TYPE_ARRAY },
 	};
-	struct blob_attr *tb[__USERSTATE_MAX], *cur;
+	struct blob_attr *tb[__USERSTATE_MAX] = {}, *cur;
+	struct radius_user_state *state, *tmp;
+	struct kvlist users;
+	bool wildcard_changed;
 	int rem;
 
-	if (!data)
-		return;
-
-	blobmsg_parse(policy, __USERSTATE_MAX, tb, blobmsg_data(data), blobmsg_len(data));
+	if (data)
+		blobmsg_parse(policy, __USERSTATE_MAX, tb, blobmsg_data(data), blobmsg_len(data));
 
+	kvlist_init(&users, kvlist_blob_len);
 	blobmsg_for_each_attr(cur, tb[USERSTATE_USERS], rem)
-		kvlist_set(&u->users, blobmsg_name(cur), cur);
+		kvlist_set(&users, blobmsg_name(cur), cur);
+
+	if (!u->wildcard || !tb[USERSTATE_WILDCARD])
+		wildcard_changed = !!u->wildcard != !!tb[USERSTATE_WILDCARD];
+	else
+		wildcard_changed = !blob_attr_equal(u->wildcard, tb[USERSTATE_WILDCARD]);
+
+	avl_for_each_element_safe(&u->user_state, state, node, tmp) {
+		const char *name = state->node.key;
+		struct blob_attr *old = kvlist_get(&u->users, name);
+		struct blob_attr *new = kvlist_get(&users, name);
+
+		if (state->wildcard ? !new && !wildcard_changed :
+				      new && old && blob_attr_equal(old, new))
+			continue;
+
+		avl_delete(&u->user_state, &state->node);
+		free(state);
+	}
+
+	kvlist_free(&u->users);
+	radius_kvlist_move(&u->users, &users);
 
+	if (!wildcard_changed)
+		return;
+
+	radius_wildcard_free(u);
 	if (tb[USERSTATE_WILDCARD])
-		u->wildcard = blob_memdup(tb[USERSTATE_WILDCARD]);
+		radius_wildcard_load(u, tb[USERSTATE_WILDCARD]);
 }
 
 static void
@@ -179,8 +381,6 @@ load_userfile(struct radius_state *s)
 		return;
 
 	s->user_file_ts = st.st_mtime;
-	radius_userdata_free(&s->phase1);
-	radius_userdata_free(&s->phase2);
 
 	blob_buf_init(&b, 0);
 	blobmsg_add_json_from_file(&b, s->user_file);
@@ -192,33 +392,22 @@ load_userfile(struct radius_state *s)
 }
 
 static struct blob_attr *
-radius_user_get(struct radius_user_data *s, const char *name)
+radius_user_get(struct radius_user_data *s, const char *name, bool *wildcard)
 {
+	struct radius_wildcard *wc;
 	struct blob_attr *cur;
-	int rem;
 
+	*wildcard = false;
 	cur = kvlist_get(&s->users, name);
 	if (cur)
 		return cur;
 
-	blobmsg_for_each_attr(cur, s->wildcard, rem) {
-		static const struct blobmsg_policy policy = {
-			"name", BLOBMSG_TYPE_STRING
-		};
-		struct blob_attr *pattern;
-
-		if (blobmsg_type(cur) != BLOBMSG_TYPE_TABLE)
-			continue;
-
-		blobmsg_parse(&policy, 1, &pattern, blobmsg_data(cur), blobmsg_len(cur));
-		if (!name)
-			continue;
-
-		if (!fnmatch(blobmsg_get_string(pattern), name, 0))
-			return cur;
-	}
+	wc = radius_wildcard_get(s, name);
+	if (!wc)
+		return NULL;
 
-	return NULL;
+	*wildcard = true;
+	return wc->data;
 }
 
 static struct radius_parse_attr_data *
@@ -438,7 +627,7 @@ radius_user_parse_methods(struct eap_user *eap, struct blob_attr *data)
 
 static struct eap_user *
 radius_user_get_state(struct radius_user_data *u, struct blob_attr *data,
-		      const char *id)
+		      const char *id, bool wildcard)
 {
 	static const struct blobmsg_policy policy[__USER_ATTR_MAX] = {
 		[USER_ATTR_PASSWORD] = { "password", BLOBMSG_TYPE_STRING },
@@ -482,6 +671,7 @@ radius_user_get_state(struct radius_user_data *u, struct blob_attr *data,
 			 &astate.attr, n_attr * sizeof(*astate.attr),
 			 &astate.buf, n_attr * sizeof(*astate.buf),
 			 &astate.attrdata, attrsize);
+	state->wildcard = wildcard;
 	eap = &state->data;
 	eap->salt = salt_len ? salt_buf : NULL;
 	eap->salt_len = salt_len;
@@ -521,8 +711,10 @@ static int radius_get_eap_user(void *ctx, const u8 *identity,
 {
 	struct radius_state *s = ctx;
 	struct radius_user_data *u = phase2 ? &s->phase2 : &s->phase1;
+	struct radius_user_state *state;
 	struct blob_attr *entry;
 	struct eap_user *data;
+	bool wildcard;
 	char *id;
 
 	if (identity_len > 512)
@@ -534,17 +726,25 @@ static int radius_get_eap_user(void *ctx, const u8 *identity,
 	memcpy(id, identity, identity_len);
 	id[identity_len] = 0;
 
-	entry = radius_user_get(u, id);
-	if (!entry)
-		return -1;
+	state = avl_find_element(&u->user_state, id, state, node);
+	if (state) {
+		data = &state->data;
+	} else {
+		entry = radius_user_get(u, id, &wildcard);
+		if (!entry)
+			return -1;
+
+		if (!user)
+			return 0;
+
+		data = radius_user_get_state(u, entry, id, wildcard);
+		if (!data)
+			return -1;
+	}
 
 	if (!user)
 		return 0;
 
-	data = radius_user_get_state(u, entry, id);
-	if (!data)
-		return -1;
-
 	*user = *data;
 	if (user->password_len > 0)
 		user->password = os_memdup(user->password, user->password_len);
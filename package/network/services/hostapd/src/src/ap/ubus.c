@@ -30,14 +30,76 @@ static struct ubus_context *ctx;
 static struct blob_buf b;
 static int ctx_ref;
 
+#define HOSTAPD_UBUS_BAN_HASH_SIZE		1024
+#define HOSTAPD_UBUS_BAN_WHEEL_SIZE		256
+#define HOSTAPD_UBUS_BAN_TICK			100 /* ms */
+
+/*
+ * Bans of all BSSes live in one hash table, expiry is driven by a single
+ * hashed timer wheel with HOSTAPD_UBUS_BAN_TICK resolution.
+ */
+static struct list_head ban_hash[HOSTAPD_UBUS_BAN_HASH_SIZE];
+static struct list_head ban_wheel[HOSTAPD_UBUS_BAN_WHEEL_SIZE];
+static unsigned long ban_last_tick;
+static int n_bans;
+
 static inline struct hostapd_data *get_hapd_from_object(struct ubus_object *obj)
 {
 	return container_of(obj, struct hostapd_data, ubus.obj);
 }
 
+#define HOSTAPD_UBUS_NOTIFY_TIMEOUT		100
+#define HOSTAPD_UBUS_DEFERRED_TIMEOUT		1000
+#define HOSTAPD_UBUS_DEFERRED_MAX_PENDING	64
+#define HOSTAPD_UBUS_VERDICT_TTL		5000
+#define HOSTAPD_UBUS_PROBE_WINDOW_MAX		5000
+#define HOSTAPD_UBUS_PROBE_CLIENT_TTL		10
+#define HOSTAPD_UBUS_PROBE_MAX_CLIENTS		256
+
 struct ubus_banned_client {
+	struct list_head hash;
+	struct list_head wheel;
+	struct hostapd_data *hapd;
+	u8 addr[ETH_ALEN];
+	unsigned long expire; /* in ban ticks */
+};
+
+struct ubus_sta_verdict {
 	struct avl_node avl;
 	u8 addr[ETH_ALEN];
+	u8 valid;
+	int resp[HOSTAPD_UBUS_TYPE_MAX];
+};
+
+struct ubus_probe_client {
+	struct avl_node avl;
+	u8 addr[ETH_ALEN];
+	struct os_reltime last_seen;
+	struct list_head bss;
+
+	/* capability tables of the last probe request, serialized */
+	bool has_ht, has_vht;
+	struct ieee80211_ht_capabilities ht;
+	struct ieee80211_vht_capabilities vht;
+	struct blob_attr *capab;
+};
+
+struct ubus_probe_bss {
+	struct list_head list;
+	struct ubus_probe_client *client;
+	struct hostapd_data *hapd;
+	struct os_reltime last_notify;
+	unsigned int count;
+	int signal;
+};
+
+struct ubus_deferred_req {
+	struct ubus_notify_request nreq;
+	struct list_head list;
+	struct hostapd_data *hapd;
+	enum hostapd_ubus_event_type type;
+	u8 addr[ETH_ALEN];
+	int resp;
 };
 
 static void ubus_reconnect_timeout(void *eloop_data, void *user_ctx)
@@ -56,8 +118,25 @@ static void hostapd_ubus_connection_lost(struct ubus_context *ctx)
 	eloop_register_timeout(1, 0, ubus_reconnect_timeout, ctx, NULL);
 }
 
+static void hostapd_ubus_ban_init(void)
+{
+	static bool init;
+	int i;
+
+	if (init)
+		return;
+
+	for (i = 0; i < ARRAY_SIZE(ban_hash); i++)
+		INIT_LIST_HEAD(&ban_hash[i]);
+	for (i = 0; i < ARRAY_SIZE(ban_wheel); i++)
+		INIT_LIST_HEAD(&ban_wheel[i]);
+	init = true;
+}
+
 static bool hostapd_ubus_init(void)
 {
+	hostapd_ubus_ban_init();
+
 	if (ctx)
 		return true;
 
@@ -119,42 +198,197 @@ static void hostapd_notify_ubus(struct ubus_object *obj, char *bssname, char *ev
 	free(event_type);
 }
 
-static void
-hostapd_bss_del_ban(void *eloop_data, void *user_ctx)
+static unsigned long
+hostapd_ubus_ban_now(void)
 {
-	struct ubus_banned_client *ban = eloop_data;
-	struct hostapd_data *hapd = user_ctx;
+	struct os_reltime now;
+
+	os_get_reltime(&now);
+	return now.sec * (1000 / HOSTAPD_UBUS_BAN_TICK) +
+	       now.usec / (HOSTAPD_UBUS_BAN_TICK * 1000);
+}
+
+static unsigned int
+hostapd_ubus_ban_hash(struct hostapd_data *hapd, const u8 *addr)
+{
+	u32 h = (uintptr_t) hapd;
+	int i;
+
+	for (i = 0; i < ETH_ALEN; i++)
+		h = h * 31 + addr[i];
+
+	return (h ^ (h >> 16)) % HOSTAPD_UBUS_BAN_HASH_SIZE;
+}
+
+static struct ubus_banned_client *
+hostapd_bss_find_ban(struct hostapd_data *hapd, const u8 *addr)
+{
+	struct list_head *head = &ban_hash[hostapd_ubus_ban_hash(hapd, addr)];
+	struct ubus_banned_client *ban;
+
+	list_for_each_entry(ban, head, hash)
+		if (ban->hapd == hapd && !memcmp(ban->addr, addr, ETH_ALEN))
+			return ban;
+
+	return NULL;
+}
 
-	avl_delete(&hapd->ubus.banned, &ban->avl);
+static void hostapd_ubus_ban_timer(void *eloop_data, void *user_ctx);
+
+static void
+hostapd_bss_del_ban(struct ubus_banned_client *ban)
+{
+	list_del(&ban->hash);
+	list_del(&ban->wheel);
+	ban->hapd->ubus.n_bans--;
+	if (!--n_bans)
+		eloop_cancel_timeout(hostapd_ubus_ban_timer, NULL, NULL);
 	free(ban);
 }
 
+static void
+hostapd_ubus_ban_timer(void *eloop_data, void *user_ctx)
+{
+	struct ubus_banned_client *ban, *tmp;
+	unsigned long now = hostapd_ubus_ban_now();
+	unsigned long tick = ban_last_tick;
+	int n = 0;
+
+	/* catch up with all ticks since the last run, each slot once at most */
+	while (tick != now && n++ < HOSTAPD_UBUS_BAN_WHEEL_SIZE) {
+		struct list_head *slot;
+
+		tick++;
+		slot = &ban_wheel[tick % HOSTAPD_UBUS_BAN_WHEEL_SIZE];
+		list_for_each_entry_safe(ban, tmp, slot, wheel)
+			if ((long) (now - ban->expire) >= 0)
+				hostapd_bss_del_ban(ban);
+	}
+	ban_last_tick = now;
+
+	if (n_bans)
+		eloop_register_timeout(0, HOSTAPD_UBUS_BAN_TICK * 1000,
+				       hostapd_ubus_ban_timer, NULL, NULL);
+}
+
 static void
 hostapd_bss_ban_client(struct hostapd_data *hapd, u8 *addr, int time)
 {
 	struct ubus_banned_client *ban;
+	unsigned long now;
 
 	if (time < 0)
 		time = 0;
 
-	ban = avl_find_element(&hapd->ubus.banned, addr, ban, avl);
+	ban = hostapd_bss_find_ban(hapd, addr);
 	if (!ban) {
 		if (!time)
 			return;
 
 		ban = os_zalloc(sizeof(*ban));
-		memcpy(ban->addr, addr, sizeof(ban->addr));
-		ban->avl.key = ban->addr;
-		avl_insert(&hapd->ubus.banned, &ban->avl);
-	} else {
-		eloop_cancel_timeout(hostapd_bss_del_ban, ban, hapd);
-		if (!time) {
-			hostapd_bss_del_ban(ban, hapd);
+		if (!ban)
 			return;
+
+		ban->hapd = hapd;
+		memcpy(ban->addr, addr, sizeof(ban->addr));
+		list_add(&ban->hash, &ban_hash[hostapd_ubus_ban_hash(hapd, addr)]);
+		INIT_LIST_HEAD(&ban->wheel);
+		hapd->ubus.n_bans++;
+		if (!n_bans++ &&
+		    !eloop_is_timeout_registered(hostapd_ubus_ban_timer,
+						 NULL, NULL)) {
+			ban_last_tick = hostapd_ubus_ban_now();
+			eloop_register_timeout(0, HOSTAPD_UBUS_BAN_TICK * 1000,
+					       hostapd_ubus_ban_timer, NULL, NULL);
 		}
+	} else if (!time) {
+		hostapd_bss_del_ban(ban);
+		return;
+	}
+
+	now = hostapd_ubus_ban_now();
+	ban->expire = now + DIV_ROUND_UP(time, HOSTAPD_UBUS_BAN_TICK);
+	list_del(&ban->wheel);
+	list_add_tail(&ban->wheel,
+		      &ban_wheel[ban->expire % HOSTAPD_UBUS_BAN_WHEEL_SIZE]);
+}
+
+static void
+hostapd_bss_flush_bans(struct hostapd_data *hapd)
+{
+	struct ubus_banned_client *ban, *tmp;
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(ban_hash) && hapd->ubus.n_bans; i++)
+		list_for_each_entry_safe(ban, tmp, &ban_hash[i], hash)
+			if (ban->hapd == hapd)
+				hostapd_bss_del_ban(ban);
+}
+
+static void
+hostapd_bss_del_verdict(void *eloop_data, void *user_ctx)
+{
+	struct ubus_sta_verdict *v = eloop_data;
+	struct hostapd_data *hapd = user_ctx;
+
+	avl_delete(&hapd->ubus.verdicts, &v->avl);
+	free(v);
+}
+
+static void
+hostapd_bss_set_verdict(struct hostapd_data *hapd, const u8 *addr,
+			enum hostapd_ubus_event_type type, int resp)
+{
+	struct ubus_sta_verdict *v;
+
+	if (type >= HOSTAPD_UBUS_TYPE_MAX || hapd->ubus.verdict_ttl <= 0)
+		return;
+
+	v = avl_find_element(&hapd->ubus.verdicts, addr, v, avl);
+	if (!v) {
+		v = os_zalloc(sizeof(*v));
+		if (!v)
+			return;
+
+		memcpy(v->addr, addr, sizeof(v->addr));
+		v->avl.key = v->addr;
+		avl_insert(&hapd->ubus.verdicts, &v->avl);
+	} else {
+		eloop_cancel_timeout(hostapd_bss_del_verdict, v, hapd);
 	}
 
-	eloop_register_timeout(0, time * 1000, hostapd_bss_del_ban, ban, hapd);
+	v->valid |= BIT(type);
+	v->resp[type] = resp;
+	eloop_register_timeout(0, hapd->ubus.verdict_ttl * 1000,
+			       hostapd_bss_del_verdict, v, hapd);
+}
+
+static bool
+hostapd_bss_get_verdict(struct hostapd_data *hapd, const u8 *addr,
+			enum hostapd_ubus_event_type type, int *resp)
+{
+	struct ubus_sta_verdict *v;
+
+	if (type >= HOSTAPD_UBUS_TYPE_MAX)
+		return false;
+
+	v = avl_find_element(&hapd->ubus.verdicts, addr, v, avl);
+	if (!v || !(v->valid & BIT(type)))
+		return false;
+
+	*resp = v->resp[type];
+	return true;
+}
+
+static void
+hostapd_bss_flush_verdicts(struct hostapd_data *hapd)
+{
+	struct ubus_sta_verdict *v, *tmp;
+
+	avl_remove_all_elements(&hapd->ubus.verdicts, v, avl, tmp) {
+		eloop_cancel_timeout(hostapd_bss_del_verdict, v, hapd);
+		free(v);
+	}
 }
 
 static int
@@ -354,7 +588,7 @@ hostapd_bss_get_status(struct ubus_context *ctx, struct ubus_object *obj,
 		       struct blob_attr *msg)
 {
 	struct hostapd_data *hapd = container_of(obj, struct hostapd_data, ubus.obj);
-	void *airtime_table, *dfs_table, *rrm_table, *wnm_table;
+	void *airtime_table, *dfs_table, *notify_table, *rrm_table, *wnm_table;
 	struct os_reltime now;
 	char ssid[SSID_MAX_LEN + 1];
 	char phy_name[17];
@@ -411,6 +645,17 @@ hostapd_bss_get_status(struct ubus_context *ctx, struct ubus_object *obj,
 	blobmsg_add_u16(&b, "utilization", hapd->iface->channel_utilization);
 	blobmsg_close_table(&b, airtime_table);
 
+	/* Notify response */
+	notify_table = blobmsg_open_table(&b, "notify");
+	blobmsg_add_u8(&b, "deferred", hapd->ubus.notify_deferred);
+	blobmsg_add_u32(&b, "pending", hapd->ubus.n_pending);
+	blobmsg_add_u64(&b, "decisions", hapd->ubus.notify_stats.decisions);
+	blobmsg_add_u64(&b, "cache_hits", hapd->ubus.notify_stats.cache_hits);
+	blobmsg_add_u64(&b, "timeouts", hapd->ubus.notify_stats.timeouts);
+	blobmsg_add_u32(&b, "probe_window", hapd->ubus.probe_window);
+	blobmsg_add_u64(&b, "coalesced", hapd->ubus.notify_stats.coalesced);
+	blobmsg_close_table(&b, notify_table);
+
 	/* DFS */
 	dfs_table = blobmsg_open_table(&b, "dfs");
 	blobmsg_add_u32(&b, "cac_seconds", hapd->iface->dfs_cac_ms / 1000);
@@ -427,11 +672,15 @@ hostapd_bss_get_status(struct ubus_context *ctx, struct ubus_object *obj,
 
 enum {
 	NOTIFY_RESPONSE,
+	NOTIFY_DEFERRED,
+	NOTIFY_VERDICT_TTL,
 	__NOTIFY_MAX
 };
 
 static const struct blobmsg_policy notify_policy[__NOTIFY_MAX] = {
 	[NOTIFY_RESPONSE] = { "notify_response", BLOBMSG_TYPE_INT32 },
+	[NOTIFY_DEFERRED] = { "deferred", BLOBMSG_TYPE_BOOL },
+	[NOTIFY_VERDICT_TTL] = { "verdict_ttl", BLOBMSG_TYPE_INT32 },
 };
 
 static int
@@ -452,6 +701,47 @@ hostapd_notify_response(struct ubus_context *ctx, struct ubus_object *obj,
 		return UBUS_STATUS_INVALID_ARGUMENT;
 
 	hapd->ubus.notify_response = blobmsg_get_u32(tb[NOTIFY_RESPONSE]);
+	hapd->ubus.notify_deferred = false;
+	if (tb[NOTIFY_DEFERRED])
+		hapd->ubus.notify_deferred = blobmsg_get_bool(tb[NOTIFY_DEFERRED]);
+	if (tb[NOTIFY_VERDICT_TTL])
+		hapd->ubus.verdict_ttl = blobmsg_get_u32(tb[NOTIFY_VERDICT_TTL]);
+
+	/* the subscriber policy may have changed, drop stale verdicts */
+	hostapd_bss_flush_verdicts(hapd);
+
+	return UBUS_STATUS_OK;
+}
+
+enum {
+	PROBE_COALESCE_WINDOW,
+	__PROBE_COALESCE_MAX
+};
+
+static const struct blobmsg_policy probe_coalesce_policy[__PROBE_COALESCE_MAX] = {
+	[PROBE_COALESCE_WINDOW] = { "window", BLOBMSG_TYPE_INT32 },
+};
+
+static int
+hostapd_probe_coalesce(struct ubus_context *ctx, struct ubus_object *obj,
+		       struct ubus_request_data *req, const char *method,
+		       struct blob_attr *msg)
+{
+	struct blob_attr *tb[__PROBE_COALESCE_MAX];
+	struct hostapd_data *hapd = get_hapd_from_object(obj);
+	int window;
+
+	blobmsg_parse(probe_coalesce_policy, __PROBE_COALESCE_MAX, tb,
+		      blob_data(msg), blob_len(msg));
+
+	if (!tb[PROBE_COALESCE_WINDOW])
+		return UBUS_STATUS_INVALID_ARGUMENT;
+
+	window = blobmsg_get_u32(tb[PROBE_COALESCE_WINDOW]);
+	if (window < 0 || window > HOSTAPD_UBUS_PROBE_WINDOW_MAX)
+		return UBUS_STATUS_INVALID_ARGUMENT;
+
+	hapd->ubus.probe_window = window;
 
 	return UBUS_STATUS_OK;
 }
@@ -537,17 +827,71 @@ hostapd_bss_list_bans(struct ubus_context *ctx, struct ubus_object *obj,
 	struct hostapd_data *hapd = container_of(obj, struct hostapd_data, ubus.obj);
 	struct ubus_banned_client *ban;
 	void *c;
+	int i;
 
 	blob_buf_init(&b, 0);
 	c = blobmsg_open_array(&b, "clients");
-	avl_for_each_element(&hapd->ubus.banned, ban, avl)
-		blobmsg_add_macaddr(&b, NULL, ban->addr);
+	for (i = 0; i < ARRAY_SIZE(ban_hash) && hapd->ubus.n_bans; i++)
+		list_for_each_entry(ban, &ban_hash[i], hash)
+			if (ban->hapd == hapd)
+				blobmsg_add_macaddr(&b, NULL, ban->addr);
 	blobmsg_close_array(&b, c);
 	ubus_send_reply(ctx, req, b.head);
 
 	return 0;
 }
 
+enum {
+	BAN_CLIENTS_ADDRS,
+	BAN_CLIENTS_BAN_TIME,
+	__BAN_CLIENTS_MAX
+};
+
+static const struct blobmsg_policy ban_clients_policy[__BAN_CLIENTS_MAX] = {
+	[BAN_CLIENTS_ADDRS] = { "addrs", BLOBMSG_TYPE_ARRAY },
+	[BAN_CLIENTS_BAN_TIME] = { "ban_time", BLOBMSG_TYPE_INT32 },
+};
+
+static int
+hostapd_bss_ban_clients(struct ubus_context *ctx, struct ubus_object *obj,
+			struct ubus_request_data *req, const char *method,
+			struct blob_attr *msg)
+{
+	struct hostapd_data *hapd = container_of(obj, struct hostapd_data, ubus.obj);
+	struct blob_attr *tb[__BAN_CLIENTS_MAX];
+	struct blob_attr *cur;
+	int rem, time = 0;
+	u8 addr[ETH_ALEN];
+
+	blobmsg_parse(ban_clients_policy, __BAN_CLIENTS_MAX, tb,
+		      blob_data(msg), blob_len(msg));
+
+	if (!strcmp(method, "ban_clients")) {
+		if (!tb[BAN_CLIENTS_ADDRS] || !tb[BAN_CLIENTS_BAN_TIME])
+			return UBUS_STATUS_INVALID_ARGUMENT;
+
+		time = blobmsg_get_u32(tb[BAN_CLIENTS_BAN_TIME]);
+	} else if (!tb[BAN_CLIENTS_ADDRS]) {
+		hostapd_bss_flush_bans(hapd);
+		return 0;
+	}
+
+	blobmsg_for_each_attr(cur, tb[BAN_CLIENTS_ADDRS], rem) {
+		if (blobmsg_type(cur) != BLOBMSG_TYPE_STRING)
+			return UBUS_STATUS_INVALID_ARGUMENT;
+
+		if (hwaddr_aton(blobmsg_data(cur), addr))
+			return UBUS_STATUS_INVALID_ARGUMENT;
+	}
+
+	blobmsg_for_each_attr(cur, tb[BAN_CLIENTS_ADDRS], rem) {
+		hwaddr_aton(blobmsg_data(cur), addr);
+		hostapd_bss_ban_client(hapd, addr, time);
+	}
+
+	return 0;
+}
+
 #ifdef CONFIG_WPS
 static int
 hostapd_bss_wps_start(struct ubus_context *ctx, struct ubus_object *obj,
@@ -1656,6 +2000,8 @@ static const struct ubus_method bss_methods[] = {
 	UBUS_METHOD("update_airtime", hostapd_bss_update_airtime, airtime_policy),
 #endif
 	UBUS_METHOD_NOARG("list_bans", hostapd_bss_list_bans),
+	UBUS_METHOD("ban_clients", hostapd_bss_ban_clients, ban_clients_policy),
+	UBUS_METHOD("unban_clients", hostapd_bss_ban_clients, ban_clients_policy),
 #ifdef CONFIG_WPS
 	UBUS_METHOD_NOARG("wps_start", hostapd_bss_wps_start),
 	UBUS_METHOD_NOARG("wps_status", hostapd_bss_wps_status),
@@ -1668,6 +2014,7 @@ static const struct ubus_method bss_methods[] = {
 #endif
 	UBUS_METHOD("set_vendor_elements", hostapd_vendor_elements, ve_policy),
 	UBUS_METHOD("notify_response", hostapd_notify_response, notify_policy),
+	UBUS_METHOD("probe_coalesce", hostapd_probe_coalesce, probe_coalesce_policy),
 	UBUS_METHOD("bss_mgmt_enable", hostapd_bss_mgmt_enable, bss_mgmt_enable_policy),
 	UBUS_METHOD_NOARG("rrm_nr_get_own", hostapd_rrm_nr_get_own),
 	UBUS_METHOD_NOARG("rrm_nr_list", hostapd_rrm_nr_list),
@@ -1766,6 +2113,341 @@ static const struct ubus_method wired_methods[] = {
 static struct ubus_object_type wired_object_type =
 	UBUS_OBJECT_TYPE("hostapd_wired", wired_methods);
 
+static void
+hostapd_ubus_deferred_free(struct ubus_deferred_req *dreq)
+{
+	struct hostapd_data *hapd = dreq->hapd;
+
+	list_del(&dreq->list);
+	hapd->ubus.n_pending--;
+	free(dreq);
+}
+
+static void
+hostapd_ubus_deferred_timeout(void *eloop_data, void *user_ctx)
+{
+	struct ubus_deferred_req *dreq = eloop_data;
+	struct hostapd_data *hapd = user_ctx;
+
+	ubus_abort_request(ctx, &dreq->nreq.req);
+	hapd->ubus.notify_stats.timeouts++;
+	hostapd_ubus_deferred_free(dreq);
+}
+
+static void
+hostapd_ubus_deferred_status_cb(struct ubus_notify_request *req, int idx, int ret)
+{
+	struct ubus_deferred_req *dreq = container_of(req, struct ubus_deferred_req, nreq);
+
+	dreq->resp = ret;
+}
+
+static void
+hostapd_ubus_deferred_complete_cb(struct ubus_notify_request *req, int idx, int ret)
+{
+	struct ubus_deferred_req *dreq = container_of(req, struct ubus_deferred_req, nreq);
+	struct hostapd_data *hapd = dreq->hapd;
+
+	eloop_cancel_timeout(hostapd_ubus_deferred_timeout, dreq, hapd);
+	hostapd_bss_set_verdict(hapd, dreq->addr, dreq->type, dreq->resp);
+	hapd->ubus.notify_stats.decisions++;
+	hostapd_ubus_deferred_free(dreq);
+}
+
+static void
+hostapd_ubus_flush_deferred(struct hostapd_data *hapd)
+{
+	struct ubus_deferred_req *dreq, *tmp;
+
+	list_for_each_entry_safe(dreq, tmp, &hapd->ubus.pending, list) {
+		eloop_cancel_timeout(hostapd_ubus_deferred_timeout, dreq, hapd);
+		ubus_abort_request(ctx, &dreq->nreq.req);
+		hostapd_ubus_deferred_free(dreq);
+	}
+
+	hostapd_bss_flush_verdicts(hapd);
+}
+
+/*
+ * Deferred notify_response: instead of blocking the event loop until the
+ * subscribers reply, apply the verdict cached from an earlier reply for this
+ * station (if any) and let the reply to this notification refresh the cache.
+ * Stations retransmit rejected or unanswered frames, so the verdict takes
+ * effect on the retransmission.
+ */
+static int
+hostapd_ubus_notify_deferred(struct hostapd_data *hapd, const char *type,
+			     enum hostapd_ubus_event_type req_type, const u8 *addr)
+{
+	struct ubus_deferred_req *dreq;
+	int resp;
+
+	if (hostapd_bss_get_verdict(hapd, addr, req_type, &resp)) {
+		hapd->ubus.notify_stats.cache_hits++;
+		ubus_notify(ctx, &hapd->ubus.obj, type, b.head, -1);
+		return resp;
+	}
+
+	if (hapd->ubus.n_pending >= HOSTAPD_UBUS_DEFERRED_MAX_PENDING)
+		goto out;
+
+	dreq = os_zalloc(sizeof(*dreq));
+	if (!dreq)
+		goto out;
+
+	if (ubus_notify_async(ctx, &hapd->ubus.obj, type, b.head, &dreq->nreq)) {
+		free(dreq);
+		return WLAN_STATUS_SUCCESS;
+	}
+
+	dreq->hapd = hapd;
+	dreq->type = req_type;
+	memcpy(dreq->addr, addr, sizeof(dreq->addr));
+	dreq->nreq.status_cb = hostapd_ubus_deferred_status_cb;
+	dreq->nreq.complete_cb = hostapd_ubus_deferred_complete_cb;
+	list_add_tail(&dreq->list, &hapd->ubus.pending);
+	hapd->ubus.n_pending++;
+
+	ubus_complete_request_async(ctx, &dreq->nreq.req);
+	eloop_register_timeout(0, HOSTAPD_UBUS_DEFERRED_TIMEOUT * 1000,
+			       hostapd_ubus_deferred_timeout, dreq, hapd);
+
+	return WLAN_STATUS_SUCCESS;
+
+out:
+	ubus_notify(ctx, &hapd->ubus.obj, type, b.head, -1);
+	return WLAN_STATUS_SUCCESS;
+}
+
+static struct blob_buf capab_buf;
+static AVL_TREE(probe_clients, avl_compare_macaddr, false, NULL);
+
+static void
+hostapd_ubus_add_capab(struct blob_buf *buf, const struct ieee802_11_elems *elems)
+{
+	if(elems->ht_capabilities)
+	{
+		struct ieee80211_ht_capabilities *ht_capabilities;
+		void *ht_cap, *ht_cap_mcs_set, *mcs_set;
+
+
+		ht_capabilities = (struct ieee80211_ht_capabilities*) elems->ht_capabilities;
+		ht_cap = blobmsg_open_table(buf, "ht_capabilities");
+		blobmsg_add_u16(buf, "ht_capabilities_info", ht_capabilities->ht_capabilities_info);
+		ht_cap_mcs_set = blobmsg_open_table(buf, "supported_mcs_set");
+		blobmsg_add_u16(buf, "a_mpdu_params", ht_capabilities->a_mpdu_params);
+		blobmsg_add_u16(buf, "ht_extended_capabilities", ht_capabilities->ht_extended_capabilities);
+		blobmsg_add_u32(buf, "tx_bf_capability_info", ht_capabilities->tx_bf_capability_info);
+		blobmsg_add_u16(buf, "asel_capabilities", ht_capabilities->asel_capabilities);
+		mcs_set = blobmsg_open_array(buf, "supported_mcs_set");
+		for (int i = 0; i < 16; i++) {
+			blobmsg_add_u16(buf, NULL, (u16) ht_capabilities->supported_mcs_set[i]);
+		}
+		blobmsg_close_array(buf, mcs_set);
+		blobmsg_close_table(buf, ht_cap_mcs_set);
+		blobmsg_close_table(buf, ht_cap);
+	}
+	if(elems->vht_capabilities)
+	{
+		struct ieee80211_vht_capabilities *vht_capabilities;
+		void *vht_cap, *vht_cap_mcs_set;
+
+		vht_capabilities = (struct ieee80211_vht_capabilities*) elems->vht_capabilities;
+		vht_cap = blobmsg_open_table(buf, "vht_capabilities");
+		blobmsg_add_u32(buf, "vht_capabilities_info", vht_capabilities->vht_capabilities_info);
+		vht_cap_mcs_set = blobmsg_open_table(buf, "vht_supported_mcs_set");
+		blobmsg_add_u16(buf, "rx_map", vht_capabilities->vht_supported_mcs_set.rx_map);
+		blobmsg_add_u16(buf, "rx_highest", vht_capabilities->vht_supported_mcs_set.rx_highest);
+		blobmsg_add_u16(buf, "tx_map", vht_capabilities->vht_supported_mcs_set.tx_map);
+		blobmsg_add_u16(buf, "tx_highest", vht_capabilities->vht_supported_mcs_set.tx_highest);
+		blobmsg_close_table(buf, vht_cap_mcs_set);
+		blobmsg_close_table(buf, vht_cap);
+	}
+}
+
+/* Serialize the capability tables only when they differ from the last probe */
+static struct blob_attr *
+hostapd_ubus_probe_capab(struct ubus_probe_client *pc,
+			 const struct ieee802_11_elems *elems)
+{
+	const u8 *ht = elems->ht_capabilities;
+	const u8 *vht = elems->vht_capabilities;
+
+	if (pc->capab && pc->has_ht == !!ht && pc->has_vht == !!vht &&
+	    (!ht || !memcmp(&pc->ht, ht, sizeof(pc->ht))) &&
+	    (!vht || !memcmp(&pc->vht, vht, sizeof(pc->vht))))
+		return pc->capab;
+
+	free(pc->capab);
+	pc->has_ht = !!ht;
+	if (ht)
+		memcpy(&pc->ht, ht, sizeof(pc->ht));
+	pc->has_vht = !!vht;
+	if (vht)
+		memcpy(&pc->vht, vht, sizeof(pc->vht));
+
+	blob_buf_init(&capab_buf, 0);
+	hostapd_ubus_add_capab(&capab_buf, elems);
+	pc->capab = blob_memdup(capab_buf.head);
+
+	return pc->capab;
+}
+
+static void
+hostapd_ubus_probe_flush(void *eloop_data, void *user_ctx)
+{
+	struct ubus_probe_bss *pb = eloop_data;
+	struct ubus_probe_client *pc = pb->client;
+	struct hostapd_data *hapd = pb->hapd;
+
+	if (hapd->ubus.obj.has_subscribers) {
+		blob_buf_init(&b, 0);
+		blobmsg_add_macaddr(&b, "address", pc->addr);
+		blobmsg_add_string(&b, "ifname", hapd->conf->iface);
+		if (pb->signal)
+			blobmsg_add_u32(&b, "signal", pb->signal);
+		blobmsg_add_u32(&b, "freq", hapd->iface->freq);
+		blobmsg_add_u32(&b, "count", pb->count);
+		if (pc->capab)
+			blob_put_raw(&b, blob_data(pc->capab), blob_len(pc->capab));
+		ubus_notify(ctx, &hapd->ubus.obj, "probe", b.head, -1);
+	}
+
+	os_get_reltime(&pb->last_notify);
+	pb->count = 0;
+	pb->signal = 0;
+}
+
+static void
+hostapd_ubus_probe_bss_free(struct ubus_probe_bss *pb)
+{
+	eloop_cancel_timeout(hostapd_ubus_probe_flush, pb, NULL);
+	list_del(&pb->list);
+	free(pb);
+}
+
+static void
+hostapd_ubus_probe_client_free(struct ubus_probe_client *pc)
+{
+	struct ubus_probe_bss *pb, *tmp;
+
+	list_for_each_entry_safe(pb, tmp, &pc->bss, list)
+		hostapd_ubus_probe_bss_free(pb);
+
+	avl_delete(&probe_clients, &pc->avl);
+	free(pc->capab);
+	free(pc);
+}
+
+static void
+hostapd_ubus_probe_gc(void *eloop_data, void *user_ctx)
+{
+	struct ubus_probe_client *pc, *tmp;
+	struct os_reltime now;
+
+	os_get_reltime(&now);
+	avl_for_each_element_safe(&probe_clients, pc, avl, tmp) {
+		if (os_reltime_expired(&now, &pc->last_seen,
+				       HOSTAPD_UBUS_PROBE_CLIENT_TTL))
+			hostapd_ubus_probe_client_free(pc);
+	}
+
+	if (!avl_is_empty(&probe_clients))
+		eloop_register_timeout(1, 0, hostapd_ubus_probe_gc, NULL, NULL);
+}
+
+static void
+hostapd_ubus_probe_flush_bss(struct hostapd_data *hapd)
+{
+	struct ubus_probe_client *pc, *tmp;
+	struct ubus_probe_bss *pb, *ptmp;
+
+	avl_for_each_element_safe(&probe_clients, pc, avl, tmp) {
+		list_for_each_entry_safe(pb, ptmp, &pc->bss, list)
+			if (pb->hapd == hapd)
+				hostapd_ubus_probe_bss_free(pb);
+
+		if (list_empty(&pc->bss))
+			hostapd_ubus_probe_client_free(pc);
+	}
+
+	if (avl_is_empty(&probe_clients))
+		eloop_cancel_timeout(hostapd_ubus_probe_gc, NULL, NULL);
+}
+
+static struct ubus_probe_bss *
+hostapd_ubus_probe_get(struct hostapd_data *hapd, const u8 *addr)
+{
+	struct ubus_probe_client *pc;
+	struct ubus_probe_bss *pb;
+
+	pc = avl_find_element(&probe_clients, addr, pc, avl);
+	if (!pc) {
+		/* Source addresses are cheap to spoof, notify new ones right away */
+		if (probe_clients.count >= HOSTAPD_UBUS_PROBE_MAX_CLIENTS)
+			return NULL;
+
+		pc = os_zalloc(sizeof(*pc));
+		if (!pc)
+			return NULL;
+
+		memcpy(pc->addr, addr, sizeof(pc->addr));
+		pc->avl.key = pc->addr;
+		INIT_LIST_HEAD(&pc->bss);
+		avl_insert(&probe_clients, &pc->avl);
+
+		if (!eloop_is_timeout_registered(hostapd_ubus_probe_gc, NULL, NULL))
+			eloop_register_timeout(1, 0, hostapd_ubus_probe_gc, NULL, NULL);
+	}
+	os_get_reltime(&pc->last_seen);
+
+	list_for_each_entry(pb, &pc->bss, list)
+		if (pb->hapd == hapd)
+			return pb;
+
+	pb = os_zalloc(sizeof(*pb));
+	if (!pb)
+		return NULL;
+
+	pb->client = pc;
+	pb->hapd = hapd;
+	list_add_tail(&pb->list, &pc->bss);
+
+	return pb;
+}
+
+/*
+ * Returns true if the probe request was folded into a pending aggregated
+ * notification, false if it should be notified right away.
+ */
+static bool
+hostapd_ubus_probe_coalesce(struct ubus_probe_bss *pb, int signal)
+{
+	int window = pb->hapd->ubus.probe_window;
+	struct os_reltime age;
+	int age_ms;
+
+	os_reltime_age(&pb->last_notify, &age);
+	if (age.sec > HOSTAPD_UBUS_PROBE_CLIENT_TTL)
+		age_ms = window;
+	else
+		age_ms = age.sec * 1000 + age.usec / 1000;
+
+	if (!pb->count && age_ms >= window) {
+		os_get_reltime(&pb->last_notify);
+		return false;
+	}
+
+	if (signal && (!pb->signal || signal > pb->signal))
+		pb->signal = signal;
+
+	if (!pb->count++)
+		eloop_register_timeout(0, (window - age_ms) * 1000,
+				       hostapd_ubus_probe_flush, pb, NULL);
+
+	return true;
+}
+
 void hostapd_ubus_add_bss(struct hostapd_data *hapd)
 {
 	struct ubus_object *obj = &hapd->ubus.obj;
@@ -1783,7 +2465,9 @@ void hostapd_ubus_add_bss(struct hostapd_data *hapd)
 	if (asprintf(&name, "hostapd.%s", hapd->conf->iface) < 0)
 		return;
 
-	avl_init(&hapd->ubus.banned, avl_compare_macaddr, false, NULL);
+	avl_init(&hapd->ubus.verdicts, avl_compare_macaddr, false, NULL);
+	INIT_LIST_HEAD(&hapd->ubus.pending);
+	hapd->ubus.verdict_ttl = HOSTAPD_UBUS_VERDICT_TTL;
 	obj->name = name;
 	if (!strcmp(hapd->driver->name, "wired")) {
 		obj->type = &wired_object_type;
@@ -1811,7 +2495,11 @@ void hostapd_ubus_free_bss(struct hostapd_data *hapd)
 	if (!ctx)
 		return;
 
+	hostapd_bss_flush_bans(hapd);
+
 	if (obj->id) {
+		hostapd_ubus_flush_deferred(hapd);
+		hostapd_ubus_probe_flush_bss(hapd);
 		ubus_remove_object(ctx, obj);
 		hostapd_ubus_ref_dec();
 	}
@@ -1872,7 +2560,6 @@ ubus_event_cb(struct ubus_notify_request *req, int idx, int ret)
 
 int hostapd_ubus_handle_event(struct hostapd_data *hapd, struct hostapd_ubus_request *req)
 {
-	struct ubus_banned_client *ban;
 	const u8 bcast[ETH_ALEN] = { 0xff, 0xff, 0xff, 0xff, 0xff, 0xff };
 	const char *types[HOSTAPD_UBUS_TYPE_MAX] = {
 		[HOSTAPD_UBUS_PROBE_REQ] = "probe",
@@ -1881,24 +2568,42 @@ int hostapd_ubus_handle_event(struct hostapd_data *hapd, struct hostapd_ubus_req
 	};
 	const char *type = "mgmt";
 	struct ubus_event_req ureq = {};
+	struct ubus_probe_bss *pb = NULL;
 	const u8 *addr;
+	int resp;
 
 	if (req->mgmt_frame)
 		addr = req->mgmt_frame->sa;
 	else
 		addr = req->addr;
 
-	ban = avl_find_element(&hapd->ubus.banned, addr, ban, avl);
-	if (ban)
-		return WLAN_STATUS_AP_UNABLE_TO_HANDLE_NEW_STA;
-
-	ban = avl_find_element(&hapd->ubus.banned, bcast, ban, avl);
-	if (ban)
+	if (hapd->ubus.n_bans &&
+	    (hostapd_bss_find_ban(hapd, addr) ||
+	     hostapd_bss_find_ban(hapd, bcast)))
 		return WLAN_STATUS_AP_UNABLE_TO_HANDLE_NEW_STA;
 
 	if (!hapd->ubus.obj.has_subscribers)
 		return WLAN_STATUS_SUCCESS;
 
+	/*
+	 * Coalescing needs an answer without asking the subscribers, which
+	 * only the deferred notify_response mode can give.
+	 */
+	if (req->type == HOSTAPD_UBUS_PROBE_REQ && hapd->ubus.probe_window &&
+	    (!hapd->ubus.notify_response || hapd->ubus.notify_deferred))
+		pb = hostapd_ubus_probe_get(hapd, addr);
+
+	if (pb && hostapd_ubus_probe_coalesce(pb, req->ssi_signal)) {
+		hapd->ubus.notify_stats.coalesced++;
+		if (hapd->ubus.notify_response &&
+		    hostapd_bss_get_verdict(hapd, addr, req->type, &resp)) {
+			hapd->ubus.notify_stats.cache_hits++;
+			return resp;
+		}
+
+		return WLAN_STATUS_SUCCESS;
+	}
+
 	if (req->type < ARRAY_SIZE(types))
 		type = types[req->type];
 
@@ -1912,44 +2617,15 @@ int hostapd_ubus_handle_event(struct hostapd_data *hapd, struct hostapd_ubus_req
 	blobmsg_add_u32(&b, "freq", hapd->iface->freq);
 
 	if (req->elems) {
-		if(req->elems->ht_capabilities)
-		{
-			struct ieee80211_ht_capabilities *ht_capabilities;
-			void *ht_cap, *ht_cap_mcs_set, *mcs_set;
-
-
-			ht_capabilities = (struct ieee80211_ht_capabilities*) req->elems->ht_capabilities;
-			ht_cap = blobmsg_open_table(&b, "ht_capabilities");
-			blobmsg_add_u16(&b, "ht_capabilities_info", ht_capabilities->ht_capabilities_info);
-			ht_cap_mcs_set = blobmsg_open_table(&b, "supported_mcs_set");
-			blobmsg_add_u16(&b, "a_mpdu_params", ht_capabilities->a_mpdu_params);
-			blobmsg_add_u16(&b, "ht_extended_capabilities", ht_capabilities->ht_extended_capabilities);
-			blobmsg_add_u32(&b, "tx_bf_capability_info", ht_capabilities->tx_bf_capability_info);
-			blobmsg_add_u16(&b, "asel_capabilities", ht_capabilities->asel_capabilities);
-			mcs_set = blobmsg_open_array(&b, "supported_mcs_set");
-			for (int i = 0; i < 16; i++) {
-				blobmsg_add_u16(&b, NULL, (u16) ht_capabilities->supported_mcs_set[i]);
-			}
-			blobmsg_close_array(&b, mcs_set);
-			blobmsg_close_table(&b, ht_cap_mcs_set);
-			blobmsg_close_table(&b, ht_cap);
-		}
-		if(req->elems->vht_capabilities)
-		{
-			struct ieee80211_vht_capabilities *vht_capabilities;
-			void *vht_cap, *vht_cap_mcs_set;
-
-			vht_capabilities = (struct ieee80211_vht_capabilities*) req->elems->vht_capabilities;
-			vht_cap = blobmsg_open_table(&b, "vht_capabilities");
-			blobmsg_add_u32(&b, "vht_capabilities_info", vht_capabilities->vht_capabilities_info);
-			vht_cap_mcs_set = blobmsg_open_table(&b, "vht_supported_mcs_set");
-			blobmsg_add_u16(&b, "rx_map", vht_capabilities->vht_supported_mcs_set.rx_map);
-			blobmsg_add_u16(&b, "rx_highest", vht_capabilities->vht_supported_mcs_set.rx_highest);
-			blobmsg_add_u16(&b, "tx_map", vht_capabilities->vht_supported_mcs_set.tx_map);
-			blobmsg_add_u16(&b, "tx_highest", vht_capabilities->vht_supported_mcs_set.tx_highest);
-			blobmsg_close_table(&b, vht_cap_mcs_set);
-			blobmsg_close_table(&b, vht_cap);
-		}
+		struct blob_attr *capab = NULL;
+
+		if (pb)
+			capab = hostapd_ubus_probe_capab(pb->client, req->elems);
+
+		if (capab)
+			blob_put_raw(&b, blob_data(capab), blob_len(capab));
+		else
+			hostapd_ubus_add_capab(&b, req->elems);
 	}
 
 	if (!hapd->ubus.notify_response) {
@@ -1957,11 +2633,18 @@ int hostapd_ubus_handle_event(struct hostapd_data *hapd, struct hostapd_ubus_req
 		return WLAN_STATUS_SUCCESS;
 	}
 
+	if (hapd->ubus.notify_deferred)
+		return hostapd_ubus_notify_deferred(hapd, type, req->type, addr);
+
 	if (ubus_notify_async(ctx, &hapd->ubus.obj, type, b.head, &ureq.nreq))
 		return WLAN_STATUS_SUCCESS;
 
 	ureq.nreq.status_cb = ubus_event_cb;
-	ubus_complete_request(ctx, &ureq.nreq.req, 100);
+	if (ubus_complete_request(ctx, &ureq.nreq.req,
+				  HOSTAPD_UBUS_NOTIFY_TIMEOUT) == UBUS_STATUS_TIMEOUT)
+		hapd->ubus.notify_stats.timeouts++;
+	else
+		hapd->ubus.notify_stats.decisions++;
 
 	if (ureq.resp)
 		return ureq.resp;
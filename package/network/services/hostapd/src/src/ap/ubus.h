@@ -34,10 +34,27 @@ struct sta_info;
 #include <libubox/avl.h>
 #include <libubus.h>
 
+struct hostapd_ubus_notify_stats {
+	u64 decisions;
+	u64 cache_hits;
+	u64 timeouts;
+	u64 coalesced;
+};
+
 struct hostapd_ubus_bss {
 	struct ubus_object obj;
-	struct avl_tree banned;
+	int n_bans;
 	int notify_response;
+
+	/* deferred notify_response mode */
+	bool notify_deferred;
+	int verdict_ttl; /* ms */
+	int n_pending;
+	struct list_head pending;
+	struct avl_tree verdicts;
+	struct hostapd_ubus_notify_stats notify_stats;
+
+	int probe_window; /* ms, 0: every probe request is notified */
 };
 
 void hostapd_ubus_add_iface(struct hostapd_iface *iface);
@@ -25,6 +25,7 @@
 #include <byteswap.h>
 #include <endian.h>
 #include <limits.h>
+#include <pthread.h>
 #include <unistd.h>
 #include <stdlib.h>
 #include <stdio.h>
@@ -47,10 +48,13 @@
 #include "crc32.h"
 #include "fis.h"
 #include "mtd.h"
+#include "sha256.h"
 
 #include <libubox/md5.h>
 
 #define MAX_ARGS 8
+#define IMAGE_BUFS 3
+#define VERIFY_BUFSIZE	(256 * 1024)
 #define JFFS2_DEFAULT_DIR	"" /* directory name without /, empty means root dir */
 
 #define TRX_MAGIC		0x48445230	/* "HDR0" */
@@ -90,12 +94,155 @@ static char *tpl_uboot_args_part;
 static int buflen = 0;
 int quiet;
 int no_erase;
+int diff_write;
+int verify_write;
 int mtdsize = 0;
 int erasesize = 0;
 int jffs2_skip_bytes=0;
 int mtdtype = 0;
 uint32_t opt_trxmagic = TRX_MAGIC;
 
+/*
+ * The image is read ahead by a separate thread, so that a slow source
+ * (typically stdin, fed from the network) is read while the flash is busy
+ * erasing and writing.
+ */
+static struct {
+	pthread_t thread;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	bool running;
+	int fd;
+	int size;
+	char *data[IMAGE_BUFS];
+	int len[IMAGE_BUFS];
+	int head;	/* next buffer to fill */
+	int tail;	/* next buffer to consume */
+	int count;	/* number of filled buffers */
+	int pos;	/* consumed part of the tail buffer */
+	bool done;	/* no more data will be read */
+	int err;	/* errno of a failed read */
+} reader;
+
+static void *image_reader_thread(void *arg)
+{
+	ssize_t r;
+	bool done = false;
+	int err = 0;
+	int idx, len;
+
+	while (!done) {
+		pthread_mutex_lock(&reader.lock);
+		while (reader.count == IMAGE_BUFS)
+			pthread_cond_wait(&reader.cond, &reader.lock);
+		idx = reader.head;
+		pthread_mutex_unlock(&reader.lock);
+
+		len = 0;
+		while (len < reader.size) {
+			r = read(reader.fd, reader.data[idx] + len, reader.size - len);
+			if (r < 0) {
+				if ((errno == EINTR) || (errno == EAGAIN))
+					continue;
+				err = errno;
+				done = true;
+				break;
+			}
+			if (r == 0) {
+				done = true;
+				break;
+			}
+			len += r;
+		}
+
+		pthread_mutex_lock(&reader.lock);
+		if (len) {
+			reader.len[idx] = len;
+			reader.head = (idx + 1) % IMAGE_BUFS;
+			reader.count++;
+		}
+		reader.done = done;
+		reader.err = err;
+		pthread_cond_broadcast(&reader.cond);
+		pthread_mutex_unlock(&reader.lock);
+	}
+
+	return NULL;
+}
+
+static void image_reader_stop(void)
+{
+	int i;
+
+	if (reader.running)
+		pthread_join(reader.thread, NULL);
+	reader.running = false;
+
+	for (i = 0; i < IMAGE_BUFS; i++) {
+		free(reader.data[i]);
+		reader.data[i] = NULL;
+	}
+}
+
+/* Without the reader thread image_read() falls back to plain read(2) */
+static void image_reader_start(int fd)
+{
+	int i;
+
+	reader.fd = fd;
+	reader.size = erasesize;
+	for (i = 0; i < IMAGE_BUFS; i++) {
+		reader.data[i] = malloc(reader.size);
+		if (!reader.data[i]) {
+			image_reader_stop();
+			return;
+		}
+	}
+
+	pthread_mutex_init(&reader.lock, NULL);
+	pthread_cond_init(&reader.cond, NULL);
+	if (!pthread_create(&reader.thread, NULL, image_reader_thread, NULL))
+		reader.running = true;
+	else
+		image_reader_stop();
+}
+
+/* read(2) replacement for the image, returns 0 at the end of the image */
+static ssize_t image_read(int fd, char *data, size_t len)
+{
+	int n;
+
+	if (!reader.running)
+		return read(fd, data, len);
+
+	pthread_mutex_lock(&reader.lock);
+	while (!reader.count && !reader.done)
+		pthread_cond_wait(&reader.cond, &reader.lock);
+
+	if (!reader.count) {
+		pthread_mutex_unlock(&reader.lock);
+		if (!reader.err)
+			return 0;
+		errno = reader.err;
+		return -1;
+	}
+
+	n = reader.len[reader.tail] - reader.pos;
+	if (n > len)
+		n = len;
+	memcpy(data, reader.data[reader.tail] + reader.pos, n);
+	reader.pos += n;
+	if (reader.pos == reader.len[reader.tail]) {
+		reader.tail = (reader.tail + 1) % IMAGE_BUFS;
+		reader.count--;
+		reader.pos = 0;
+		pthread_cond_broadcast(&reader.cond);
+	}
+	pthread_mutex_unlock(&reader.lock);
+
+	return n;
+}
+
 int mtd_open(const char *mtd, bool block, bool write_mode)
 {
 	FILE *fp;
@@ -194,6 +341,74 @@ int mtd_write_buffer(int fd, const char *buf, int offset, int length)
 	return 0;
 }
 
+static void *
+alloc_aligned(size_t size)
+{
+	void *ptr;
+
+	if (posix_memalign(&ptr, sysconf(_SC_PAGESIZE), size))
+		return NULL;
+
+	return ptr;
+}
+
+/*
+ * Compare len bytes of the device at pos with buf, without moving the
+ * file position. len must not exceed the erase size. Returns 1 if they
+ * match, 0 if they differ and -1 with errno set if the data could not be
+ * compared.
+ */
+static int
+mtd_compare(int fd, off_t pos, const char *buf, int len)
+{
+	static char *cmpbuf;
+	static int cmplen;
+	ssize_t r;
+	int done = 0;
+
+	if (cmplen < erasesize) {
+		free(cmpbuf);
+		cmpbuf = alloc_aligned(erasesize);
+		cmplen = cmpbuf ? erasesize : 0;
+	}
+	if (!cmpbuf) {
+		errno = ENOMEM;
+		return -1;
+	}
+	if (pos < 0 || len > cmplen) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	while (done < len) {
+		r = pread(fd, cmpbuf + done, len - done, pos + done);
+		if (r < 0 && errno == EINTR)
+			continue;
+		if (r == 0)
+			errno = EIO;
+		if (r <= 0)
+			return -1;
+		done += r;
+	}
+
+	return !memcmp(cmpbuf, buf, len);
+}
+
+/* Compare the erase block at the current position of fd with buf */
+static int
+mtd_block_is_same(int fd, const char *buf)
+{
+	off_t pos = lseek(fd, 0, SEEK_CUR);
+	int ret;
+
+	ret = mtd_compare(fd, pos, buf, erasesize);
+	if (ret < 0)
+		fprintf(stderr, "\nCould not compare block at 0x%08llx, rewriting it: %s\n",
+			(unsigned long long) pos, strerror(errno));
+
+	return ret > 0;
+}
+
 static int
 image_check(int imagefd, const char *mtd)
 {
@@ -417,60 +632,142 @@ out:
 	return ret;
 }
 
+enum verify_hash {
+	VERIFY_MD5,
+	VERIFY_SHA256,
+};
+
+static enum verify_hash verify_hash = VERIFY_MD5;
+
+union verify_ctx {
+	md5_ctx_t md5;
+	SHA256_CTX sha256;
+};
+
+/* one side of mtd verify, hashed in a thread of its own */
+struct verify_src {
+	int fd;
+	off_t len;
+	union verify_ctx ctx;
+	unsigned char hash[SHA256_DIGEST_LENGTH];
+	int err;
+};
+
+static int
+verify_hash_len(void)
+{
+	return verify_hash == VERIFY_SHA256 ? SHA256_DIGEST_LENGTH : 16;
+}
+
+static void *
+verify_hash_fd(void *arg)
+{
+	struct verify_src *src = arg;
+	ssize_t r;
+	char *buf;
+
+	buf = alloc_aligned(VERIFY_BUFSIZE);
+	if (!buf) {
+		src->err = ENOMEM;
+		return NULL;
+	}
+
+	if (verify_hash == VERIFY_SHA256)
+		SHA256_Init(&src->ctx.sha256);
+	else
+		md5_begin(&src->ctx.md5);
+
+	while (src->len > 0) {
+		r = read(src->fd, buf, MIN(src->len, VERIFY_BUFSIZE));
+		if (r < 0) {
+			if (errno == EINTR)
+				continue;
+			src->err = errno;
+			break;
+		}
+		if (!r)
+			break;
+
+		if (verify_hash == VERIFY_SHA256)
+			SHA256_Update(&src->ctx.sha256, buf, r);
+		else
+			md5_hash(buf, r, &src->ctx.md5);
+		src->len -= r;
+	}
+
+	if (verify_hash == VERIFY_SHA256)
+		SHA256_Final(src->hash, &src->ctx.sha256);
+	else
+		md5_end(src->hash, &src->ctx.md5);
+
+	free(buf);
+	return NULL;
+}
+
+static void
+verify_print(const unsigned char *hash, const char *name)
+{
+	int i;
+
+	for (i = 0; i < verify_hash_len(); i++)
+		fprintf(stderr, "%02x", hash[i]);
+	fprintf(stderr, " - %s\n", name);
+}
+
 static int
 mtd_verify(const char *mtd, char *file)
 {
-	uint32_t f_md5[4], m_md5[4];
+	struct verify_src f = {}, m = {};
+	pthread_t thread;
+	bool threaded;
 	struct stat s;
-	md5_ctx_t ctx;
-	int ret = 0;
-	int fd;
+	int ret = -1;
 
 	if (quiet < 2)
 		fprintf(stderr, "Verifying %s against %s ...\n", mtd, file);
 
-	if (stat(file, &s) || md5sum(file, f_md5) < 0) {
+	f.fd = open(file, O_RDONLY);
+	if (f.fd < 0 || fstat(f.fd, &s)) {
 		fprintf(stderr, "Failed to hash %s\n", file);
-		return -1;
+		goto out_file;
 	}
 
-	fd = mtd_check_open(mtd, false);
-	if(fd < 0) {
+	m.fd = mtd_check_open(mtd, false);
+	if(m.fd < 0) {
 		fprintf(stderr, "Could not open mtd device: %s\n", mtd);
-		return -1;
+		goto out_file;
 	}
 
-	md5_begin(&ctx);
-	do {
-		char buf[256];
-		int len = (s.st_size > sizeof(buf)) ? (sizeof(buf)) : (s.st_size);
-		int rlen = read(fd, buf, len);
-
-		if (rlen < 0) {
-			if (errno == EINTR)
-				continue;
-			ret = -1;
-			goto out;
-		}
-		if (!rlen)
-			break;
-		md5_hash(buf, rlen, &ctx);
-		s.st_size -= rlen;
-	} while (s.st_size > 0);
+	/* hash the device and the file at the same time */
+	f.len = m.len = s.st_size;
+	threaded = !pthread_create(&thread, NULL, verify_hash_fd, &m);
+	verify_hash_fd(&f);
+	if (threaded)
+		pthread_join(thread, NULL);
+	else
+		verify_hash_fd(&m);
 
-	md5_end(m_md5, &ctx);
+	if (f.err) {
+		fprintf(stderr, "Failed to hash %s\n", file);
+		goto out;
+	}
+	if (m.err)
+		goto out;
 
-	fprintf(stderr, "%08x%08x%08x%08x - %s\n", m_md5[0], m_md5[1], m_md5[2], m_md5[3], mtd);
-	fprintf(stderr, "%08x%08x%08x%08x - %s\n", f_md5[0], f_md5[1], f_md5[2], f_md5[3], file);
+	verify_print(m.hash, mtd);
+	verify_print(f.hash, file);
 
-	ret = memcmp(f_md5, m_md5, sizeof(m_md5));
+	ret = memcmp(f.hash, m.hash, verify_hash_len());
 	if (!ret)
 		fprintf(stderr, "Success\n");
 	else
 		fprintf(stderr, "Failed\n");
 
 out:
-	close(fd);
+	close(m.fd);
+out_file:
+	if (f.fd >= 0)
+		close(f.fd);
 	return ret;
 }
 
@@ -496,6 +793,8 @@ mtd_write(int imagefd, const char *mtd, char *fis_layout, size_t part_offset)
 	int buflen_raw = 0;
 	int jffs2_replaced = 0;
 	int skip_bad_blocks = 0;
+	int same, n_same = 0, n_written = 0;
+	off_t pos;
 
 #ifdef FIS_SUPPORT
 	static struct fis_part new_parts[MAX_ARGS];
@@ -562,6 +861,8 @@ next:
 
 	r = 0;
 
+	image_reader_start(imagefd);
+
 resume:
 	next = strchr(mtd, ':');
 	if (next) {
@@ -596,7 +897,7 @@ resume:
 	for (;;) {
 		/* buffer may contain data already (from trx check or last mtd partition write attempt) */
 		while (buflen < erasesize) {
-			r = read(imagefd, buf + buflen, erasesize - buflen);
+			r = image_read(imagefd, buf + buflen, erasesize - buflen);
 			if (r < 0) {
 				if ((errno == EINTR) || (errno == EAGAIN))
 					continue;
@@ -661,6 +962,7 @@ resume:
 		}
 
 		/* need to erase the next block before writing data to it */
+		same = 0;
 		if(!no_erase)
 		{
 			while (w + buflen > e - skip_bad_blocks) {
@@ -679,6 +981,19 @@ resume:
 					continue;
 				}
 
+				/*
+				 * If the block already holds this data, leave
+				 * it alone. Only done in the common case of
+				 * writing a whole block to the block erased here.
+				 */
+				if (diff_write && !offset && buflen == erasesize &&
+				    e - skip_bad_blocks == w &&
+				    mtd_block_is_same(fd, buf)) {
+					same = 1;
+					e += erasesize;
+					continue;
+				}
+
 				if (mtd_erase_block(fd, e + part_offset) < 0) {
 					if (next) {
 						if (w < e) {
@@ -702,16 +1017,43 @@ resume:
 			}
 		}
 
-		if (!quiet)
-			fprintf(stderr, "\b\b\b[w]");
+		if (same) {
+			if (!quiet)
+				fprintf(stderr, "\b\b\b[s]");
 
-		if ((result = write(fd, buf + offset, buflen)) < buflen) {
-			if (result < 0) {
-				fprintf(stderr, "Error writing image.\n");
-				exit(1);
-			} else {
-				fprintf(stderr, "Insufficient space.\n");
-				exit(1);
+			lseek(fd, buflen, SEEK_CUR);
+			n_same++;
+		} else {
+			if (!quiet)
+				fprintf(stderr, "\b\b\b[w]");
+
+			if ((result = write(fd, buf + offset, buflen)) < buflen) {
+				if (result < 0) {
+					fprintf(stderr, "Error writing image.\n");
+					exit(1);
+				} else {
+					fprintf(stderr, "Insufficient space.\n");
+					exit(1);
+				}
+			}
+			n_written++;
+
+			if (verify_write) {
+				if (!quiet)
+					fprintf(stderr, "\b\b\b[v]");
+
+				pos = lseek(fd, 0, SEEK_CUR) - buflen;
+				result = mtd_compare(fd, pos, buf + offset, buflen);
+				if (result < 0) {
+					fprintf(stderr, "\nCould not verify data at 0x%08llx: %s\n",
+						(unsigned long long) pos, strerror(errno));
+					exit(1);
+				}
+				if (!result) {
+					fprintf(stderr, "\nVerification failed at 0x%08llx\n",
+						(unsigned long long) pos);
+					exit(1);
+				}
 			}
 		}
 		w += buflen;
@@ -731,6 +1073,8 @@ resume:
 		offset = 0;
 	}
 
+	image_reader_stop();
+
 	if (jffs2_replaced) {
 		switch (imageformat) {
 		case MTD_IMAGE_FORMAT_TRX:
@@ -760,6 +1104,10 @@ resume:
 	if (quiet < 2)
 		fprintf(stderr, "\n");
 
+	if (diff_write && quiet < 2)
+		fprintf(stderr, "%d blocks unchanged, %d blocks written\n",
+			n_same, n_written);
+
 #ifdef FIS_SUPPORT
 	if (fis_layout) {
 		if (fis_remap(old_parts, n_old, new_parts, n_new) < 0)
@@ -820,6 +1168,9 @@ static void usage(void)
 	"        -q                      quiet mode (once: no [w] on writing,\n"
 	"                                           twice: no status messages)\n"
 	"        -n                      write without first erasing the blocks\n"
+	"        -u                      only erase and write blocks that differ from the image\n"
+	"        -v                      read back and compare every block after writing it\n"
+	"        -a <hash>               hash used by verify, md5 (default) or sha256\n"
 	"        -r                      reboot after successful command\n"
 	"        -f                      force write without trx checks\n"
 	"        -e <device>             erase <device> before executing the command\n"
@@ -896,12 +1247,14 @@ int main (int argc, char **argv)
 	buflen = 0;
 	quiet = 0;
 	no_erase = 0;
+	diff_write = 0;
+	verify_write = 0;
 
 	while ((ch = getopt(argc, argv,
 #ifdef FIS_SUPPORT
 			"F:"
 #endif
-			"frnqe:d:s:j:p:o:c:t:l:M:")) != -1)
+			"frnquva:e:d:s:j:p:o:c:t:l:M:")) != -1)
 		switch (ch) {
 			case 'f':
 				force = 1;
@@ -912,6 +1265,20 @@ int main (int argc, char **argv)
 			case 'n':
 				no_erase = 1;
 				break;
+			case 'u':
+				diff_write = 1;
+				break;
+			case 'v':
+				verify_write = 1;
+				break;
+			case 'a':
+				if (!strcmp(optarg, "md5"))
+					verify_hash = VERIFY_MD5;
+				else if (!strcmp(optarg, "sha256"))
+					verify_hash = VERIFY_SHA256;
+				else
+					usage();
+				break;
 			case 'j':
 				jffs2file = optarg;
 				break;
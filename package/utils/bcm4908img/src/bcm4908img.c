@@ -12,7 +12,9 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
+#include <sys/syscall.h>
 #include <unistd.h>
 
 #if !defined(__BYTE_ORDER)
@@ -57,6 +59,8 @@
 
 #define UBI_EC_HDR_MAGIC		0x55424923
 
+#define BCM4908IMG_CHUNK		0x10000
+
 static int debug;
 
 struct bcm4908img_tail {
@@ -166,8 +170,43 @@ static const uint32_t crc32_tbl[] = {
 	0xb40bbe37, 0xc30c8ea1, 0x5a05df1b, 0x2d02ef8d,
 };
 
+/* Slicing-by-8 tables: crc32_tbl8[k][i] is CRC of byte i followed by k zero bytes */
+static uint32_t crc32_tbl8[8][256];
+static bool crc32_tbl8_ready;
+
+static void bcm4908img_crc32_init(void) {
+	int i, k;
+
+	for (i = 0; i < 256; i++) {
+		crc32_tbl8[0][i] = crc32_tbl[i];
+		for (k = 1; k < 8; k++)
+			crc32_tbl8[k][i] = crc32_tbl[crc32_tbl8[k - 1][i] & 0xff] ^ (crc32_tbl8[k - 1][i] >> 8);
+	}
+
+	crc32_tbl8_ready = true;
+}
+
 uint32_t bcm4908img_crc32(uint32_t crc, const void *buf, size_t len) {
 	const uint8_t *in = buf;
+	uint32_t a, b;
+
+	if (!crc32_tbl8_ready)
+		bcm4908img_crc32_init();
+
+	while (len >= 8) {
+		memcpy(&a, in, sizeof(a));
+		memcpy(&b, in + 4, sizeof(b));
+		a = le32_to_cpu(a) ^ crc;
+		b = le32_to_cpu(b);
+
+		crc = crc32_tbl8[7][a & 0xff] ^ crc32_tbl8[6][(a >> 8) & 0xff] ^
+		      crc32_tbl8[5][(a >> 16) & 0xff] ^ crc32_tbl8[4][a >> 24] ^
+		      crc32_tbl8[3][b & 0xff] ^ crc32_tbl8[2][(b >> 8) & 0xff] ^
+		      crc32_tbl8[1][(b >> 16) & 0xff] ^ crc32_tbl8[0][b >> 24];
+
+		in += 8;
+		len -= 8;
+	}
 
 	while (len) {
 		crc = crc32_tbl[(crc ^ *in) & 0xff] ^ (crc >> 8);
@@ -211,16 +250,38 @@ static void bcm4908img_close(FILE *fp) {
 		fclose(fp);
 }
 
+/* Maps the first length bytes of the file read-only, returns NULL on failure */
+static uint8_t *bcm4908img_mmap(FILE *fp, size_t length) {
+	void *map;
+
+	if (!length)
+		return NULL;
+
+	map = mmap(NULL, length, PROT_READ, MAP_SHARED, fileno(fp), 0);
+
+	return map == MAP_FAILED ? NULL : map;
+}
+
 static int bcm4908img_calc_crc32(FILE *fp, struct bcm4908img_info *info) {
-	uint8_t buf[1024];
+	uint8_t buf[BCM4908IMG_CHUNK];
+	uint8_t *map;
 	size_t length;
 	size_t bytes;
 
+	info->crc32 = 0xffffffff;
+	length = info->tail_offset - info->cferom_offset;
+
+	map = bcm4908img_mmap(fp, info->tail_offset);
+	if (map) {
+		/* Start with cferom (or bootfs) - skip vendor header */
+		info->crc32 = bcm4908img_crc32(info->crc32, map + info->cferom_offset, length);
+		munmap(map, info->tail_offset);
+		return 0;
+	}
+
 	/* Start with cferom (or bootfs) - skip vendor header */
 	fseek(fp, info->cferom_offset, SEEK_SET);
 
-	info->crc32 = 0xffffffff;
-	length = info->tail_offset - info->cferom_offset;
 	while (length && (bytes = fread(buf, 1, bcm4908img_min(sizeof(buf), length), fp)) > 0) {
 		info->crc32 = bcm4908img_crc32(info->crc32, buf, bytes);
 		length -= bytes;
@@ -233,6 +294,43 @@ static int bcm4908img_calc_crc32(FILE *fp, struct bcm4908img_info *info) {
 	return 0;
 }
 
+/* Copies length bytes at offset of in to the current position of out */
+static int bcm4908img_copy_range(FILE *in, size_t offset, size_t length, FILE *out) {
+	uint8_t buf[BCM4908IMG_CHUNK];
+	int64_t pos = offset;
+	ssize_t bytes;
+
+	fflush(out);
+
+#ifdef SYS_copy_file_range
+	/* In-kernel copy between regular files, falls through for pipes and ttys */
+	while (length) {
+		bytes = syscall(SYS_copy_file_range, fileno(in), &pos, fileno(out), NULL, length, 0);
+		if (bytes <= 0)
+			break;
+		length -= bytes;
+	}
+#endif
+
+	while (length) {
+		bytes = pread(fileno(in), buf, bcm4908img_min(sizeof(buf), length), pos);
+		if (bytes <= 0)
+			break;
+		if (write(fileno(out), buf, bytes) != bytes) {
+			fprintf(stderr, "Failed to write %zd B\n", bytes);
+			return -EIO;
+		}
+		pos += bytes;
+		length -= bytes;
+	}
+	if (length) {
+		fprintf(stderr, "Failed to read last %zd B of data\n", length);
+		return -EIO;
+	}
+
+	return 0;
+}
+
 /**************************************************
  * Existing firmware parser
  **************************************************/
@@ -372,23 +470,14 @@ static int bcm4908img_parse(FILE *fp, struct bcm4908img_info *info) {
 
 	/* CRC32 */
 
-	/* Start with cferom (or bootfs) - skip vendor header */
-	fseek(fp, info->cferom_offset, SEEK_SET);
-
-	info->crc32 = 0xffffffff;
-	length = info->tail_offset - info->cferom_offset;
-	while (length && (bytes = fread(buf, 1, bcm4908img_min(sizeof(buf), length), fp)) > 0) {
-		info->crc32 = bcm4908img_crc32(info->crc32, buf, bytes);
-		length -= bytes;
-	}
-	if (length) {
-		fprintf(stderr, "Failed to read last %zd B of data\n", length);
-		return -EIO;
-	}
+	err = bcm4908img_calc_crc32(fp, info);
+	if (err)
+		return err;
 
 	/* Tail */
 
-	if (fread(tail, 1, sizeof(*tail), fp) != sizeof(*tail)) {
+	if (fseek(fp, info->tail_offset, SEEK_SET) ||
+	    fread(tail, 1, sizeof(*tail), fp) != sizeof(*tail)) {
 		fprintf(stderr, "Failed to read BCM4908 image tail\n");
 		return -EIO;
 	}
@@ -453,11 +542,25 @@ out:
  * Create
  **************************************************/
 
+/* All image data goes through here so the checksum is updated as it is written */
+static int bcm4908img_create_write(FILE *trx, const void *buf, size_t length, uint32_t *crc32) {
+	if (fwrite(buf, 1, length, trx) != length) {
+		fprintf(stderr, "Failed to write %zu B to %s\n", length, pathname);
+		return -EIO;
+	}
+	*crc32 = bcm4908img_crc32(*crc32, buf, length);
+
+	return 0;
+}
+
 static ssize_t bcm4908img_create_append_file(FILE *trx, const char *in_path, uint32_t *crc32) {
+	uint8_t buf[BCM4908IMG_CHUNK];
+	struct stat st;
+	uint8_t *map;
 	FILE *in;
 	size_t bytes;
 	ssize_t length = 0;
-	uint8_t buf[1024];
+	int err;
 
 	in = fopen(in_path, "r");
 	if (!in) {
@@ -465,13 +568,29 @@ static ssize_t bcm4908img_create_append_file(FILE *trx, const char *in_path, uin
 		return -EACCES;
 	}
 
+	map = fstat(fileno(in), &st) ? NULL : bcm4908img_mmap(in, st.st_size);
+	if (map) {
+		/* Checksum each chunk right after writing it, while it is still cached */
+		for (; length < st.st_size; length += bytes) {
+			bytes = bcm4908img_min(BCM4908IMG_CHUNK, st.st_size - length);
+			err = bcm4908img_create_write(trx, map + length, bytes, crc32);
+			if (err) {
+				length = err;
+				break;
+			}
+		}
+		munmap(map, st.st_size);
+		fclose(in);
+
+		return length;
+	}
+
 	while ((bytes = fread(buf, 1, sizeof(buf), in)) > 0) {
-		if (fwrite(buf, 1, bytes, trx) != bytes) {
-			fprintf(stderr, "Failed to write %zu B to %s\n", bytes, pathname);
-			length = -EIO;
+		err = bcm4908img_create_write(trx, buf, bytes, crc32);
+		if (err) {
+			length = err;
 			break;
 		}
-		*crc32 = bcm4908img_crc32(*crc32, buf, bytes);
 		length += bytes;
 	}
 
@@ -480,29 +599,24 @@ static ssize_t bcm4908img_create_append_file(FILE *trx, const char *in_path, uin
 	return length;
 }
 
-static ssize_t bcm4908img_create_append_zeros(FILE *trx, size_t length) {
-	uint8_t *buf;
-
-	buf = malloc(length);
-	if (!buf)
-		return -ENOMEM;
-	memset(buf, 0, length);
+static ssize_t bcm4908img_create_append_zeros(FILE *trx, size_t length, uint32_t *crc32) {
+	static const uint8_t zeros[BCM4908IMG_CHUNK];
+	size_t bytes;
+	int err;
 
-	if (fwrite(buf, 1, length, trx) != length) {
-		fprintf(stderr, "Failed to write %zu B to %s\n", length, pathname);
-		free(buf);
-		return -EIO;
+	for (bytes = 0; bytes < length; bytes += sizeof(zeros)) {
+		err = bcm4908img_create_write(trx, zeros, bcm4908img_min(sizeof(zeros), length - bytes), crc32);
+		if (err)
+			return err;
 	}
 
-	free(buf);
-
 	return length;
 }
 
-static ssize_t bcm4908img_create_align(FILE *trx, size_t cur_offset, size_t alignment) {
+static ssize_t bcm4908img_create_align(FILE *trx, size_t cur_offset, size_t alignment, uint32_t *crc32) {
 	if (cur_offset & (alignment - 1)) {
 		size_t length = alignment - (cur_offset % alignment);
-		return bcm4908img_create_append_zeros(trx, length);
+		return bcm4908img_create_append_zeros(trx, length, crc32);
 	}
 
 	return 0;
@@ -548,7 +662,7 @@ static int bcm4908img_create(int argc, char **argv) {
 			}
 			break;
 		case 'a':
-			bytes = bcm4908img_create_align(fp, cur_offset, strtol(optarg, NULL, 0));
+			bytes = bcm4908img_create_align(fp, cur_offset, strtol(optarg, NULL, 0), &crc32);
 			if (bytes < 0)
 				fprintf(stderr, "Failed to append zeros\n");
 			else
@@ -559,7 +673,7 @@ static int bcm4908img_create(int argc, char **argv) {
 			if (bytes < 0) {
 				fprintf(stderr, "Current BCM4908 image length is 0x%zx, can't pad it with zeros to 0x%lx\n", cur_offset, strtol(optarg, NULL, 0));
 			} else {
-				bytes = bcm4908img_create_append_zeros(fp, bytes);
+				bytes = bcm4908img_create_append_zeros(fp, bytes, &crc32);
 				if (bytes < 0)
 					fprintf(stderr, "Failed to append zeros\n");
 				else
@@ -593,10 +707,8 @@ static int bcm4908img_extract(int argc, char **argv) {
 	struct bcm4908img_info info;
 	const char *pathname = NULL;
 	const char *type = NULL;
-	uint8_t buf[1024];
 	size_t offset;
 	size_t length;
-	size_t bytes;
 	FILE *fp;
 	int c;
 	int err = 0;
@@ -658,16 +770,9 @@ static int bcm4908img_extract(int argc, char **argv) {
 		goto err_close;
 	}
 
-	fseek(fp, offset, SEEK_SET);
-	while (length && (bytes = fread(buf, 1, bcm4908img_min(sizeof(buf), length), fp)) > 0) {
-		fwrite(buf, bytes, 1, stdout);
-		length -= bytes;
-	}
-	if (length) {
-		err = -EIO;
-		fprintf(stderr, "Failed to read last %zd B of data\n", length);
+	err = bcm4908img_copy_range(fp, offset, length, stdout);
+	if (err)
 		goto err_close;
-	}
 
 err_close:
 	bcm4908img_close(fp);
@@ -741,70 +846,68 @@ struct jffs2_raw_dirent
 #define je16_to_cpu(x) ((x).v16)
 #define je32_to_cpu(x) ((x).v32)
 
+/* Returns the JFFS2 node at offset or NULL if it doesn't fit before the tail */
+static const void *bcm4908img_bootfs_node(const uint8_t *map, struct bcm4908img_info *info,
+					  size_t offset, size_t length) {
+	if (offset + length > info->tail_offset) {
+		fprintf(stderr, "Failed to read %zu bytes\n", length);
+		return NULL;
+	}
+
+	return map + offset;
+}
+
 static int bcm4908img_bootfs_ls(FILE *fp, struct bcm4908img_info *info) {
-	struct jffs2_unknown_node node;
-	struct jffs2_raw_dirent dirent;
+	const struct jffs2_unknown_node *node;
+	const struct jffs2_raw_dirent *dirent;
 	size_t offset;
-	size_t bytes;
+	uint8_t *map;
 	int err = 0;
 
-	for (offset = info->bootfs_offset; ; offset += (je32_to_cpu(node.totlen) + 0x03) & ~0x03) {
-		char name[FILENAME_MAX + 1];
-
-		if (fseek(fp, offset, SEEK_SET)) {
-			err = -errno;
-			fprintf(stderr, "Failed to fseek: %d\n", err);
-			return err;
-		}
-
-		bytes = fread(&node, 1, sizeof(node), fp);
-		if (bytes != sizeof(node)) {
-			fprintf(stderr, "Failed to read %zu bytes\n", sizeof(node));
-			return -EIO;
-		}
+	map = bcm4908img_mmap(fp, info->tail_offset);
+	if (!map) {
+		err = -errno;
+		fprintf(stderr, "Failed to mmap: %d\n", err);
+		return err;
+	}
 
-		if (je16_to_cpu(node.magic) != JFFS2_MAGIC_BITMASK) {
+	for (offset = info->bootfs_offset; ; offset += (je32_to_cpu(node->totlen) + 0x03) & ~0x03) {
+		node = bcm4908img_bootfs_node(map, info, offset, sizeof(*node));
+		if (!node) {
+			err = -EIO;
 			break;
 		}
 
-		if (je16_to_cpu(node.nodetype) != JFFS2_NODETYPE_DIRENT) {
-			continue;
-		}
-
-		memcpy(&dirent, &node, sizeof(node));
-		bytes += fread((uint8_t *)&dirent + sizeof(node), 1, sizeof(dirent) - sizeof(node), fp);
-		if (bytes != sizeof(dirent)) {
-			fprintf(stderr, "Failed to read %zu bytes\n", sizeof(node));
-			return -EIO;
+		if (je16_to_cpu(node->magic) != JFFS2_MAGIC_BITMASK) {
+			break;
 		}
 
-		if (dirent.nsize + 1 > sizeof(name)) {
-			/* Keep reading & printing BUT exit with error code */
-			fprintf(stderr, "Too long filename\n");
-			err = -ENOMEM;
+		if (je16_to_cpu(node->nodetype) != JFFS2_NODETYPE_DIRENT) {
 			continue;
 		}
 
-		bytes = fread(name, 1, dirent.nsize, fp);
-		if (bytes != dirent.nsize) {
+		dirent = bcm4908img_bootfs_node(map, info, offset, sizeof(*dirent));
+		if (!dirent || !bcm4908img_bootfs_node(map, info, offset, sizeof(*dirent) + dirent->nsize)) {
 			fprintf(stderr, "Failed to read filename\n");
-			return -EIO;
+			err = -EIO;
+			break;
 		}
-		name[bytes] = '\0';
 
-		printf("%s\n", name);
+		printf("%.*s\n", dirent->nsize, dirent->name);
 	}
 
+	munmap(map, info->tail_offset);
+
 	return err;
 }
 
 static int bcm4908img_bootfs_mv(FILE *fp, struct bcm4908img_info *info, int argc, char **argv) {
-	struct jffs2_unknown_node node;
-	struct jffs2_raw_dirent dirent;
+	const struct jffs2_unknown_node *node;
+	const struct jffs2_raw_dirent *dirent;
 	const char *oldname;
 	const char *newname;
 	size_t offset;
-	size_t bytes;
+	uint8_t *map;
 	int err = -ENOENT;
 
 	if (argc - optind < 2) {
@@ -819,107 +922,103 @@ static int bcm4908img_bootfs_mv(FILE *fp, struct bcm4908img_info *info, int argc
 		return -EINVAL;
 	}
 
-	for (offset = info->bootfs_offset; ; offset += (je32_to_cpu(node.totlen) + 0x03) & ~0x03) {
-		char name[FILENAME_MAX];
-		uint32_t crc32;
+	map = bcm4908img_mmap(fp, info->tail_offset);
+	if (!map) {
+		err = -errno;
+		fprintf(stderr, "Failed to mmap: %d\n", err);
+		return err;
+	}
 
-		if (fseek(fp, offset, SEEK_SET)) {
-			err = -errno;
-			fprintf(stderr, "Failed to fseek: %d\n", err);
-			return err;
-		}
+	for (offset = info->bootfs_offset; ; offset += (je32_to_cpu(node->totlen) + 0x03) & ~0x03) {
+		uint32_t crc32;
 
-		bytes = fread(&node, 1, sizeof(node), fp);
-		if (bytes != sizeof(node)) {
-			fprintf(stderr, "Failed to read %zu bytes\n", sizeof(node));
-			return -EIO;
+		node = bcm4908img_bootfs_node(map, info, offset, sizeof(*node));
+		if (!node) {
+			err = -EIO;
+			goto out_unmap;
 		}
 
-		if (je16_to_cpu(node.magic) != JFFS2_MAGIC_BITMASK) {
+		if (je16_to_cpu(node->magic) != JFFS2_MAGIC_BITMASK) {
 			break;
 		}
 
-		if (je16_to_cpu(node.nodetype) != JFFS2_NODETYPE_DIRENT) {
+		if (je16_to_cpu(node->nodetype) != JFFS2_NODETYPE_DIRENT) {
 			continue;
 		}
 
-		bytes += fread((uint8_t *)&dirent + sizeof(node), 1, sizeof(dirent) - sizeof(node), fp);
-		if (bytes != sizeof(dirent)) {
-			fprintf(stderr, "Failed to read %zu bytes\n", sizeof(node));
-			return -EIO;
-		}
-
-		if (dirent.nsize + 1 > sizeof(name)) {
-			fprintf(stderr, "Too long filename\n");
-			err = -ENOMEM;
-			continue;
-		}
-
-		bytes = fread(name, 1, dirent.nsize, fp);
-		if (bytes != dirent.nsize) {
+		dirent = bcm4908img_bootfs_node(map, info, offset, sizeof(*dirent));
+		if (!dirent || !bcm4908img_bootfs_node(map, info, offset, sizeof(*dirent) + dirent->nsize)) {
 			fprintf(stderr, "Failed to read filename\n");
-			return -EIO;
+			err = -EIO;
+			goto out_unmap;
 		}
-		name[bytes] = '\0';
 
 		if (debug)
-			printf("offset:%08zx name_crc:%04x filename:%s\n", offset, je32_to_cpu(dirent.name_crc), name);
+			printf("offset:%08zx name_crc:%04x filename:%.*s\n", offset, je32_to_cpu(dirent->name_crc),
+			       dirent->nsize, dirent->name);
 
-		if (strcmp(name, oldname)) {
+		if (dirent->nsize != strlen(oldname) || memcmp(dirent->name, oldname, dirent->nsize)) {
 			continue;
 		}
 
 		if (fseek(fp, offset + offsetof(struct jffs2_raw_dirent, name_crc), SEEK_SET)) {
 			err = -errno;
 			fprintf(stderr, "Failed to fseek: %d\n", err);
-			return err;
+			goto out_unmap;
 		}
-		crc32 = bcm4908img_crc32(0, newname, dirent.nsize);
-		bytes = fwrite(&crc32, 1, sizeof(crc32), fp);
-		if (bytes != sizeof(crc32)) {
+		crc32 = bcm4908img_crc32(0, newname, dirent->nsize);
+		if (fwrite(&crc32, 1, sizeof(crc32), fp) != sizeof(crc32)) {
 			fprintf(stderr, "Failed to write new CRC32\n");
-			return -EIO;
+			err = -EIO;
+			goto out_unmap;
 		}
 
 		if (fseek(fp, offset + offsetof(struct jffs2_raw_dirent, name), SEEK_SET)) {
 			err = -errno;
 			fprintf(stderr, "Failed to fseek: %d\n", err);
-			return err;
+			goto out_unmap;
 		}
-		bytes = fwrite(newname, 1, dirent.nsize, fp);
-		if (bytes != dirent.nsize) {
+		if (fwrite(newname, 1, dirent->nsize, fp) != dirent->nsize) {
 			fprintf(stderr, "Failed to write new filename\n");
-			return -EIO;
+			err = -EIO;
+			goto out_unmap;
 		}
 
 		/* Calculate new BCM4908 image checksum */
 
+		fflush(fp);
 		err = bcm4908img_calc_crc32(fp, info);
 		if (err) {
 			fprintf(stderr, "Failed to write new filename\n");
-			return err;
+			goto out_unmap;
 		}
 
 		info->tail.crc32 = cpu_to_le32(info->crc32);
 		if (fseek(fp, -sizeof(struct bcm4908img_tail), SEEK_END)) {
 			err = -errno;
 			fprintf(stderr, "Failed to write new filename\n");
-			return err;
+			goto out_unmap;
 		}
 
 		if (fwrite(&info->tail, 1, sizeof(struct bcm4908img_tail), fp) != sizeof(struct bcm4908img_tail)) {
 			fprintf(stderr, "Failed to write updated tail\n");
-			return -EIO;
+			err = -EIO;
+			goto out_unmap;
 		}
 
 		printf("Successfully renamed %s to the %s\n", oldname, newname);
 
-		return 0;
+		err = 0;
+		goto out_unmap;
 	}
 
 	fprintf(stderr, "Failed to find %s\n", oldname);
+	err = -ENOENT;
 
-	return -ENOENT;
+out_unmap:
+	munmap(map, info->tail_offset);
+
+	return err;
 }
 
 static int bcm4908img_bootfs(int argc, char **argv) {
@@ -0,0 +1,97 @@
+#!/bin/sh
+# SPDX-License-Identifier: GPL-2.0-only
+#
+# Time bcm4908img create, info, extract and bootfs on a large synthetic image:
+#
+#   [bootfs: one JFFS2 dirent, 0xff padded] [rootfs: "UBI#" + random data] [tail]
+#
+# With a reference binary (e.g. a build of the previous version) both are
+# timed and their images and outputs must match. Timing uses date +%N, so
+# this is meant for the Linux build host.
+#
+# Usage: bench.sh [bcm4908img [reference bcm4908img [rootfs MiB [runs]]]]
+
+BIN="${1:-./bcm4908img}"
+REF="$2"
+ROOTFS_MB="${3:-256}"
+RUNS="${4:-3}"
+TMP="$(mktemp -d)"
+
+trap 'rm -rf "$TMP"' EXIT
+
+fail() {
+	echo "FAIL: $*" >&2
+	exit 1
+}
+
+# le32 as octal printf escapes
+le32() {
+	printf '\\%03o\\%03o\\%03o\\%03o' \
+		$(($1 & 255)) $((($1 >> 8) & 255)) $((($1 >> 16) & 255)) $((($1 >> 24) & 255))
+}
+
+ms() {
+	echo $(($(date +%s%N) / 1000000))
+}
+
+# Best of $RUNS runs of "$@", output goes to $TMP/out
+best() {
+	local best= start t i=0
+
+	while [ $i -lt "$RUNS" ]; do
+		start=$(ms)
+		"$@" > "$TMP/out" 2>&1 || fail "$*: $(cat "$TMP/out")"
+		t=$(($(ms) - start))
+		[ -z "$best" ] || [ $t -lt "$best" ] && best=$t
+		i=$((i + 1))
+	done
+	printf ' %8s' $best
+}
+
+bench() {
+	local bin="$1" tag="$2"
+
+	printf '%-10s' "$tag"
+	best "$bin" create "$TMP/$tag.bin" -f "$TMP/bootfs" -a 0x20000 -f "$TMP/rootfs"
+	best "$bin" info -i "$TMP/$tag.bin"
+	cp "$TMP/out" "$TMP/$tag.info"
+	best sh -c "\"$bin\" extract -i \"$TMP/$tag.bin\" -t rootfs > \"$TMP/$tag.rootfs\""
+	best sh -c "\"$bin\" extract -i \"$TMP/$tag.bin\" -t firmware | cat > /dev/null"
+	best "$bin" bootfs -i "$TMP/$tag.bin" ls
+	cp "$TMP/out" "$TMP/$tag.ls"
+	# Rename there and back so every run sees the same image
+	best sh -c "\"$bin\" bootfs -i \"$TMP/$tag.bin\" mv 1-openwrt 1-xxxxxxx && \"$bin\" bootfs -i \"$TMP/$tag.bin\" mv 1-xxxxxxx 1-openwrt"
+	echo
+
+	cmp -s "$TMP/rootfs" "$TMP/$tag.rootfs" || fail "$tag: extracted rootfs differs"
+	grep -qx 1-openwrt "$TMP/$tag.ls" || fail "$tag: bootfs ls"
+}
+
+[ -x "$BIN" ] || fail "no $BIN"
+
+# Dirent for "1-openwrt": magic, nodetype, totlen, hdr_crc, pino, version,
+# ino, mctime, nsize/type/unused, node_crc, name_crc, name. The bootfs is
+# kept erase block aligned: older builds left -a padding out of the CRC.
+{
+	printf '\205\031\001\340'
+	printf "$(le32 49)$(le32 0)$(le32 1)$(le32 1)$(le32 2)$(le32 0)"
+	printf '\011\010\000\000'
+	printf "$(le32 0)$(le32 0)"
+	printf '1-openwrt'
+	dd if=/dev/zero bs=1024 count=8192 2>/dev/null | tr '\000' '\377'
+} | head -c $((0x800000)) > "$TMP/bootfs"
+
+{
+	printf 'UBI#'
+	dd if=/dev/urandom bs=1048576 count="$ROOTFS_MB" 2>/dev/null
+} > "$TMP/rootfs"
+
+echo "rootfs: $ROOTFS_MB MiB, best of $RUNS runs, ms"
+printf '%-10s %8s %8s %8s %8s %8s %8s\n' "" create info extract "ext|pipe" ls "mv x2"
+
+bench "$BIN" new
+if [ -n "$REF" ]; then
+	bench "$REF" ref
+	cmp -s "$TMP/new.bin" "$TMP/ref.bin" || fail "images differ"
+	cmp -s "$TMP/new.info" "$TMP/ref.info" || fail "info output differs"
+fi
@@ -0,0 +1,184 @@
+/*
+ * Set and commit latency of libnvram on a file backed image
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ */
+
+#include <sys/time.h>
+
+#include "nvram.h"
+
+#define BENCH_IMAGE_SIZE	0x10000
+#define BENCH_VARS		800
+#define BENCH_BATCH		100
+
+
+static double now(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+/* Create an empty image with just a header. */
+static int create_image(const char *file)
+{
+	nvram_header_t header = {
+		.magic = NVRAM_MAGIC,
+		.len   = sizeof(nvram_header_t) + 4,
+	};
+	char *buf;
+	int fd, stat = -1;
+
+	if( (buf = malloc(BENCH_IMAGE_SIZE)) == NULL )
+		return -1;
+
+	memset(buf, 0xFF, BENCH_IMAGE_SIZE);
+	memcpy(buf, &header, sizeof(header));
+	memset(buf + sizeof(header), 0, 4);
+
+	if( (fd = open(file, O_RDWR | O_CREAT | O_TRUNC, 0600)) > -1 )
+	{
+		if( write(fd, buf, BENCH_IMAGE_SIZE) == BENCH_IMAGE_SIZE )
+			stat = 0;
+
+		close(fd);
+	}
+
+	free(buf);
+	return stat;
+}
+
+/* Check the CRC8 the way the bootloader does. */
+static int check_crc(nvram_handle_t *h)
+{
+	nvram_header_t *hdr = nvram_header(h);
+	uint8_t crc = hndcrc8((unsigned char *) &hdr[0] + NVRAM_CRC_START_POSITION,
+		hdr->len - NVRAM_CRC_START_POSITION, 0xff);
+
+	if( (hdr->crc_ver_init & 0xFF) != crc )
+	{
+		fprintf(stderr, "CRC8 mismatch: 0x%02X != 0x%02X\n",
+			hdr->crc_ver_init & 0xFF, crc);
+		return -1;
+	}
+
+	return 0;
+}
+
+/* Set one variable per iteration and commit after every batch sets. */
+static int run(nvram_handle_t *h, const char *what, int var, int step,
+	int batch, int count)
+{
+	char name[16], value[32];
+	double start, t;
+	int i, j;
+
+	start = now();
+
+	for( i = 0; i < count; i++ )
+	{
+		for( j = 0; j < batch; j++ )
+		{
+			snprintf(name, sizeof(name), "var%04d", var + j * step);
+			snprintf(value, sizeof(value), "value-%d-%d", i, j);
+
+			if( nvram_set(h, name, value) )
+				return -1;
+		}
+
+		if( nvram_commit(h) )
+			return -1;
+	}
+
+	t = now() - start;
+
+	if( check_crc(h) )
+		return -1;
+
+	printf("%-30s %8.1f us/commit, %6.2f us/set\n",
+		what, t * 1000000.0 / count, t * 1000000.0 / (count * batch));
+
+	return 0;
+}
+
+int main( int argc, const char *argv[] )
+{
+	const char *file = (argc > 1) ? argv[1] : "/tmp/nvram-bench.img";
+	int count = (argc > 2) ? atoi(argv[2]) : 200;
+	nvram_handle_t *h;
+	char name[16];
+	int i, stat = 1;
+
+	if( count <= 0 || create_image(file) )
+	{
+		fprintf(stderr, "Usage: %s [image [count]]\n", argv[0]);
+		return 1;
+	}
+
+	nvram_part_size = BENCH_IMAGE_SIZE;
+
+	if( (h = nvram_open(file, NVRAM_RW)) == NULL )
+	{
+		fprintf(stderr, "Could not open %s\n", file);
+		return 1;
+	}
+
+	/* Fill the image with a typical number of variables */
+	for( i = 0; i < BENCH_VARS; i++ )
+	{
+		snprintf(name, sizeof(name), "var%04d", i);
+		if( nvram_set(h, name, "0x0000000000000000") )
+			goto out;
+	}
+
+	if( nvram_commit(h) )
+		goto out;
+
+	printf("%d variables, %u bytes used\n",
+		BENCH_VARS, nvram_header(h)->len);
+
+	if( run(h, "set+commit, first variable", 0, 1, 1, count) ||
+		run(h, "set+commit, last variable", BENCH_VARS - 1, 1, 1, count) ||
+		run(h, "set x100+commit, spread", 0, BENCH_VARS / BENCH_BATCH,
+			BENCH_BATCH, count / 10 ? : 1) ||
+		run(h, "set x100+commit, last vars", BENCH_VARS - BENCH_BATCH, 1,
+			BENCH_BATCH, count / 10 ? : 1) )
+		goto out;
+
+	/* Reopen and verify the table round-trips through the image */
+	nvram_close(h);
+	if( (h = nvram_open(file, NVRAM_RO)) == NULL || check_crc(h) )
+		return 1;
+
+	for( i = 0; i < BENCH_VARS; i++ )
+	{
+		snprintf(name, sizeof(name), "var%04d", i);
+		if( !nvram_get(h, name) )
+		{
+			fprintf(stderr, "Lost %s\n", name);
+			goto out;
+		}
+	}
+
+	stat = 0;
+
+out:
+	if( stat )
+		fprintf(stderr, "Benchmark failed\n");
+
+	nvram_close(h);
+	unlink(file);
+
+	return stat;
+}
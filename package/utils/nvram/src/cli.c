@@ -25,6 +25,15 @@
 #include "nvram.h"
 
 
+/* Streams of the current command, per request in daemon mode */
+static FILE *in, *out, *err;
+
+/* Handle kept open between requests in daemon mode */
+static int daemon_mode = 0;
+static nvram_handle_t *cached = NULL;
+static int cached_rw = 0;
+static struct stat cached_st;
+
 static nvram_handle_t * nvram_open_rdonly(void)
 {
 	char *file = nvram_find_staging();
@@ -50,17 +59,75 @@ static nvram_handle_t * nvram_open_staging(void)
 	return NULL;
 }
 
+/* Whether the staging file differs from what the cached handle last saw */
+static int staging_changed(void)
+{
+	struct stat s;
+
+	if( stat(NVRAM_STAGING, &s) )
+		return cached_rw;
+
+	return !cached_rw ||
+		s.st_ino  != cached_st.st_ino  ||
+		s.st_size != cached_st.st_size ||
+		s.st_mtim.tv_sec  != cached_st.st_mtim.tv_sec ||
+		s.st_mtim.tv_nsec != cached_st.st_mtim.tv_nsec;
+}
+
+static nvram_handle_t * nvram_acquire(int write)
+{
+	if( !daemon_mode )
+		return write ? nvram_open_staging() : nvram_open_rdonly();
+
+	/* Someone else created, changed or committed the staging file */
+	if( cached && (staging_changed() || (write && !cached_rw)) )
+	{
+		nvram_close(cached);
+		cached = NULL;
+	}
+
+	if( cached == NULL )
+	{
+		/* Once there is a staging file reads and writes both use it */
+		cached_rw = write || nvram_find_staging() != NULL;
+		cached = cached_rw ? nvram_open_staging() : nvram_open_rdonly();
+
+		if( cached && cached_rw )
+			stat(NVRAM_STAGING, &cached_st);
+	}
+
+	return cached;
+}
+
+/* Keep the handle for the next request unless it may be stale. */
+static void nvram_release(nvram_handle_t *h, int keep)
+{
+	if( daemon_mode && keep )
+	{
+		if( cached_rw )
+			stat(NVRAM_STAGING, &cached_st);
+		return;
+	}
+
+	nvram_close(h);
+
+	if( h == cached )
+		cached = NULL;
+}
+
 static int do_show(nvram_handle_t *nvram)
 {
-	nvram_tuple_t *t;
+	nvram_tuple_t *t, *next;
 	int stat = 1;
 
 	if( (t = nvram_getall(nvram)) != NULL )
 	{
 		while( t )
 		{
-			printf("%s=%s\n", t->name, t->value);
-			t = t->next;
+			fprintf(out, "%s=%s\n", t->name, t->value);
+			next = t->next;
+			free(t);
+			t = next;
 		}
 
 		stat = 0;
@@ -76,7 +143,7 @@ static int do_get(nvram_handle_t *nvram, const char *var)
 
 	if( (val = nvram_get(nvram, var)) != NULL )
 	{
-		printf("%s\n", val);
+		fprintf(out, "%s\n", val);
 		stat = 0;
 	}
 
@@ -104,6 +171,42 @@ static int do_set(nvram_handle_t *nvram, const char *pair)
 	return stat;
 }
 
+static int do_batch(nvram_handle_t *nvram)
+{
+	char *line = NULL;
+	size_t size = 0;
+	ssize_t len;
+	int stat = 0;
+
+	/* Apply "set variable=value" and "unset variable" lines from stdin */
+	while( !stat && (len = getline(&line, &size, in)) > 0 )
+	{
+		if( line[len-1] == '\n' )
+			line[--len] = '\0';
+
+		if( len == 0 || line[0] == '#' )
+			continue;
+
+		if( !strncmp(line, "set ", 4) )
+			stat = do_set(nvram, line + 4);
+		else if( !strncmp(line, "unset ", 6) )
+			stat = do_unset(nvram, line + 6);
+		else
+		{
+			fprintf(err, "Invalid batch line '%s' !\n", line);
+			stat = 1;
+		}
+	}
+
+	free(line);
+
+	/* All or nothing */
+	if( stat )
+		nvram_rollback(nvram);
+
+	return stat;
+}
+
 static int do_info(nvram_handle_t *nvram)
 {
 	nvram_header_t *hdr = nvram_header(nvram);
@@ -113,20 +216,20 @@ static int do_info(nvram_handle_t *nvram)
 		hdr->len - NVRAM_CRC_START_POSITION, 0xff);
 
 	/* Show info */
-	printf("Magic:         0x%08X\n",   hdr->magic);
-	printf("Length:        0x%08X\n",   hdr->len);
-	printf("Offset:        0x%08X\n",   nvram->offset);
+	fprintf(out, "Magic:         0x%08X\n",   hdr->magic);
+	fprintf(out, "Length:        0x%08X\n",   hdr->len);
+	fprintf(out, "Offset:        0x%08X\n",   nvram->offset);
 
-	printf("CRC8:          0x%02X (calculated: 0x%02X)\n",
+	fprintf(out, "CRC8:          0x%02X (calculated: 0x%02X)\n",
 		hdr->crc_ver_init & 0xFF, crc);
 
-	printf("Version:       0x%02X\n",   (hdr->crc_ver_init >> 8) & 0xFF);
-	printf("SDRAM init:    0x%04X\n",   (hdr->crc_ver_init >> 16) & 0xFFFF);
-	printf("SDRAM config:  0x%04X\n",   hdr->config_refresh & 0xFFFF);
-	printf("SDRAM refresh: 0x%04X\n",   (hdr->config_refresh >> 16) & 0xFFFF);
-	printf("NCDL values:   0x%08X\n\n", hdr->config_ncdl);
+	fprintf(out, "Version:       0x%02X\n",   (hdr->crc_ver_init >> 8) & 0xFF);
+	fprintf(out, "SDRAM init:    0x%04X\n",   (hdr->crc_ver_init >> 16) & 0xFFFF);
+	fprintf(out, "SDRAM config:  0x%04X\n",   hdr->config_refresh & 0xFFFF);
+	fprintf(out, "SDRAM refresh: 0x%04X\n",   (hdr->config_refresh >> 16) & 0xFFFF);
+	fprintf(out, "NCDL values:   0x%08X\n\n", hdr->config_ncdl);
 
-	printf("%i bytes used / %i bytes available (%.2f%%)\n",
+	fprintf(out, "%i bytes used / %i bytes available (%.2f%%)\n",
 		hdr->len, nvram->length - nvram->offset - hdr->len,
 		(100.00 / (double)(nvram->length - nvram->offset)) * (double)hdr->len);
 
@@ -135,26 +238,35 @@ static int do_info(nvram_handle_t *nvram)
 
 static void usage(void)
 {
-	fprintf(stderr,
+	fprintf(err,
 		"Usage:\n"
 		"	nvram show\n"
 		"	nvram info\n"
 		"	nvram get variable\n"
 		"	nvram set variable=value [set ...]\n"
 		"	nvram unset variable [unset ...]\n"
+		"	nvram batch < commands\n"
 		"	nvram commit\n"
+		"	nvram daemon\n"
 	);
 }
 
-int main( int argc, const char *argv[] )
+static int nvram_cli( int argc, const char *argv[],
+	FILE *cmd_in, FILE *cmd_out, FILE *cmd_err )
 {
 	nvram_handle_t *nvram;
 	int commit = 0;
 	int write = 0;
+	int modified = 0;
 	int stat = 1;
+	int ret = 0;
 	int done = 0;
 	int i;
 
+	in  = cmd_in;
+	out = cmd_out;
+	err = cmd_err;
+
 	if( argc < 2 ) {
 		usage();
 		return 1;
@@ -163,11 +275,12 @@ int main( int argc, const char *argv[] )
 	/* Ugly... iterate over arguments to see whether we can expect a write */
 	if( ( !strcmp(argv[1], "set")  && 2 < argc ) ||
 		( !strcmp(argv[1], "unset") && 2 < argc ) ||
+		!strcmp(argv[1], "batch") ||
 		!strcmp(argv[1], "commit") )
 		write = 1;
 
 
-	nvram = write ? nvram_open_staging() : nvram_open_rdonly();
+	nvram = nvram_acquire(write);
 
 	if( nvram != NULL && argc > 1 )
 	{
@@ -187,6 +300,9 @@ int main( int argc, const char *argv[] )
 			{
 				if( (i+1) < argc )
 				{
+					if( argv[i][0] != 'g' )
+						modified = 1;
+
 					switch(argv[i++][0])
 					{
 						case 'g':
@@ -205,11 +321,17 @@ int main( int argc, const char *argv[] )
 				}
 				else
 				{
-					fprintf(stderr, "Command '%s' requires an argument!\n", argv[i]);
+					fprintf(err, "Command '%s' requires an argument!\n", argv[i]);
 					done = 0;
 					break;
 				}
 			}
+			else if( !strcmp(argv[i], "batch") )
+			{
+				stat = do_batch(nvram);
+				modified = 1;
+				done++;
+			}
 			else if( !strcmp(argv[i], "commit") )
 			{
 				commit = 1;
@@ -217,16 +339,17 @@ int main( int argc, const char *argv[] )
 			}
 			else
 			{
-				fprintf(stderr, "Unknown option '%s' !\n", argv[i]);
+				fprintf(err, "Unknown option '%s' !\n", argv[i]);
 				done = 0;
 				break;
 			}
 		}
 
-		if( write )
-			stat = nvram_commit(nvram);
+		if( write && (ret = nvram_commit(nvram)) != 0 )
+			stat = ret;
 
-		nvram_close(nvram);
+		/* Uncommitted changes must not leak into the next request */
+		nvram_release(nvram, !commit && !ret && (write || !modified));
 
 		if( commit )
 			stat = staging_to_nvram();
@@ -234,7 +357,7 @@ int main( int argc, const char *argv[] )
 
 	if( !nvram )
 	{
-		fprintf(stderr,
+		fprintf(err,
 			"Could not open nvram! Possible reasons are:\n"
 			"	- No device found (/proc not mounted or no nvram present)\n"
 			"	- Insufficient permissions to open mtd device\n"
@@ -253,3 +376,20 @@ int main( int argc, const char *argv[] )
 
 	return stat;
 }
+
+int main( int argc, const char *argv[] )
+{
+	int stat;
+
+	if( argc == 2 && !strcmp(argv[1], "daemon") )
+	{
+		daemon_mode = 1;
+		return nvram_daemon(nvram_cli);
+	}
+
+	/* Let a running daemon answer from its resident table */
+	if( argc > 1 && (stat = nvram_daemon_call(argc, argv)) >= 0 )
+		return stat;
+
+	return nvram_cli(argc, argv, stdin, stdout, stderr);
+}
@@ -0,0 +1,271 @@
+/*
+ * Resident nvram daemon
+ *
+ * Keeps the parsed NVRAM table open and runs the command lines of nvram
+ * invocations received on a unix socket, so that a lookup does not have
+ * to map and parse the partition again.
+ *
+ * Request:  u32 length, u32 argc, argc NUL terminated strings, stdin data
+ * Response: u32 status, u32 stdout length, u32 stderr length, data
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ */
+
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+
+#include "nvram.h"
+
+#define NVRAM_DAEMON_MAX_REQUEST	(1 << 20)
+#define NVRAM_DAEMON_RX_TIMEOUT		2	/* seconds, per request */
+#define NVRAM_DAEMON_TIMEOUT		30	/* seconds, commit writes flash */
+
+
+/* Read or write exactly len bytes. */
+static int xfer(int fd, void *buf, size_t len, int wr)
+{
+	char *p = buf;
+	ssize_t n;
+
+	while( len > 0 )
+	{
+		n = wr ? write(fd, p, len) : read(fd, p, len);
+
+		if( n < 0 && errno == EINTR )
+			continue;
+
+		if( n <= 0 )
+			return -1;
+
+		p   += n;
+		len -= n;
+	}
+
+	return 0;
+}
+
+static void set_timeout(int fd, int sec)
+{
+	struct timeval tv = { .tv_sec = sec };
+
+	setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+	setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+}
+
+static void set_addr(struct sockaddr_un *sun)
+{
+	memset(sun, 0, sizeof(*sun));
+	sun->sun_family = AF_UNIX;
+	strncpy(sun->sun_path, NVRAM_SOCKET, sizeof(sun->sun_path) - 1);
+}
+
+/* Run one request and send back its status and output. */
+static void nvram_daemon_serve(int fd, nvram_request_cb cb)
+{
+	uint32_t len, argc, i, hdr[3];
+	char *buf = NULL, *obuf = NULL, *ebuf = NULL, *p, *end;
+	size_t olen = 0, elen = 0;
+	const char **argv = NULL;
+	FILE *in = NULL, *out = NULL, *err = NULL;
+	int stat;
+
+	if( xfer(fd, &len, sizeof(len), 0) ||
+		len < sizeof(argc) || len > NVRAM_DAEMON_MAX_REQUEST )
+		return;
+
+	if( (buf = malloc(len + 1)) == NULL || xfer(fd, buf, len, 0) )
+		goto out;
+
+	buf[len] = '\0';
+	end = buf + len;
+
+	memcpy(&argc, buf, sizeof(argc));
+	if( argc == 0 || argc > len || (argv = calloc(argc + 1, sizeof(*argv))) == NULL )
+		goto out;
+
+	for( i = 0, p = buf + sizeof(argc); i < argc; i++, p++ )
+	{
+		argv[i] = p;
+		if( p >= end || (p = memchr(p, '\0', end - p)) == NULL )
+			goto out;
+	}
+
+	/* Whatever follows the arguments is the client's stdin */
+	in  = (p < end) ? fmemopen(p, end - p, "r") : fopen("/dev/null", "r");
+	out = open_memstream(&obuf, &olen);
+	err = open_memstream(&ebuf, &elen);
+
+	if( in == NULL || out == NULL || err == NULL )
+		goto out;
+
+	stat = cb(argc, argv, in, out, err);
+
+	fclose(out);
+	fclose(err);
+	out = err = NULL;
+
+	hdr[0] = stat;
+	hdr[1] = olen;
+	hdr[2] = elen;
+
+	if( !xfer(fd, hdr, sizeof(hdr), 1) && !xfer(fd, obuf, olen, 1) )
+		xfer(fd, ebuf, elen, 1);
+
+out:
+	if( in )
+		fclose(in);
+	if( out )
+		fclose(out);
+	if( err )
+		fclose(err);
+
+	free(obuf);
+	free(ebuf);
+	free(argv);
+	free(buf);
+}
+
+/* Serve requests on NVRAM_SOCKET, one at a time. */
+int nvram_daemon(nvram_request_cb cb)
+{
+	struct sockaddr_un sun;
+	int fd, cfd;
+
+	signal(SIGPIPE, SIG_IGN);
+	set_addr(&sun);
+
+	if( (fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)) < 0 )
+	{
+		perror("socket");
+		return 1;
+	}
+
+	unlink(NVRAM_SOCKET);
+
+	if( bind(fd, (struct sockaddr *) &sun, sizeof(sun)) ||
+		chmod(NVRAM_SOCKET, 0600) || listen(fd, 16) )
+	{
+		perror("bind");
+		close(fd);
+		return 1;
+	}
+
+	while( 1 )
+	{
+		if( (cfd = accept(fd, NULL, NULL)) < 0 )
+		{
+			if( errno == EINTR || errno == ECONNABORTED )
+				continue;
+
+			perror("accept");
+			break;
+		}
+
+		set_timeout(cfd, NVRAM_DAEMON_RX_TIMEOUT);
+		nvram_daemon_serve(cfd, cb);
+		close(cfd);
+	}
+
+	unlink(NVRAM_SOCKET);
+	close(fd);
+
+	return 1;
+}
+
+/* Forward a command line and stdin for "batch" to a running daemon. */
+int nvram_daemon_call(int argc, const char *argv[])
+{
+	struct sockaddr_un sun;
+	uint32_t len, n, hdr[3];
+	char *buf = NULL, *tmp, chunk[4096];
+	size_t size;
+	int fd, i, batch, stat = -1;
+
+	set_addr(&sun);
+
+	if( (fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)) < 0 )
+		return -1;
+
+	/* No daemon, do it ourselves */
+	if( connect(fd, (struct sockaddr *) &sun, sizeof(sun)) )
+	{
+		close(fd);
+		return -1;
+	}
+
+	set_timeout(fd, NVRAM_DAEMON_TIMEOUT);
+
+	/* Length, argc and the arguments */
+	for( i = 0, size = 2 * sizeof(uint32_t); i < argc; i++ )
+		size += strlen(argv[i]) + 1;
+
+	/* Only a leading "batch" reads stdin, as in nvram_cli() */
+	batch = argc > 1 && !strcmp(argv[1], "batch");
+
+	if( (buf = malloc(size)) == NULL )
+		goto out;
+
+	n = argc;
+	memcpy(buf + sizeof(uint32_t), &n, sizeof(n));
+	for( i = 0, len = 2 * sizeof(uint32_t); i < argc; i++ )
+	{
+		strcpy(buf + len, argv[i]);
+		len += strlen(argv[i]) + 1;
+	}
+
+	while( batch && (n = fread(chunk, 1, sizeof(chunk), stdin)) > 0 )
+	{
+		if( len + n > NVRAM_DAEMON_MAX_REQUEST ||
+			(tmp = realloc(buf, len + n)) == NULL )
+			goto out;
+
+		buf = tmp;
+		memcpy(buf + len, chunk, n);
+		len += n;
+	}
+
+	n = len - sizeof(uint32_t);
+	memcpy(buf, &n, sizeof(n));
+
+	if( xfer(fd, buf, len, 1) || xfer(fd, hdr, sizeof(hdr), 0) )
+		goto out;
+
+	/* Pass on the output */
+	for( i = 1; i <= 2; i++ )
+	{
+		while( hdr[i] > 0 )
+		{
+			n = (hdr[i] < sizeof(chunk)) ? hdr[i] : sizeof(chunk);
+			if( xfer(fd, chunk, n, 0) )
+				goto out;
+
+			fwrite(chunk, 1, n, (i == 1) ? stdout : stderr);
+			hdr[i] -= n;
+		}
+	}
+
+	stat = hdr[0] & 0xFF;
+
+out:
+	if( stat < 0 )
+	{
+		fprintf(stderr, "No answer from the nvram daemon!\n");
+		stat = 1;
+	}
+
+	free(buf);
+	close(fd);
+
+	return stat;
+}
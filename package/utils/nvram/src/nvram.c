@@ -26,34 +26,85 @@ size_t nvram_part_size = 0;
  * -- Helper functions --
  */
 
-/* String hash */
-static uint32_t hash(const char *s)
+/* String hash (FNV-1a) */
+static uint32_t hash(const char *s, size_t len)
 {
-	uint32_t hash = 0;
+	uint32_t hash = 2166136261U;
 
-	while (*s)
-		hash = 31 * hash + *s++;
+	while (len--) {
+		hash ^= (uint8_t) *s++;
+		hash *= 16777619U;
+	}
 
 	return hash;
 }
 
-/* Free all tuples. */
-static void _nvram_free(nvram_handle_t *h)
+/* (Re)size the hash table, tuples keep their precomputed hash. */
+static int _nvram_resize(nvram_handle_t *h, unsigned int size)
 {
 	uint32_t i;
-	nvram_tuple_t *t, *next;
+	nvram_tuple_t **table, *t, *next;
 
-	/* Free hash table */
-	for (i = 0; i < NVRAM_ARRAYSIZE(h->nvram_hash); i++) {
+	table = calloc(size, sizeof(*table));
+	if (!table)
+		return -12; /* -ENOMEM */
+
+	for (i = 0; i < h->hash_size; i++) {
 		for (t = h->nvram_hash[i]; t; t = next) {
 			next = t->next;
-			if (t->value)
-				free(t->value);
-			free(t);
+			t->next = table[t->hash & (size - 1)];
+			table[t->hash & (size - 1)] = t;
 		}
-		h->nvram_hash[i] = NULL;
 	}
 
+	free(h->nvram_hash);
+	h->nvram_hash = table;
+	h->hash_size = size;
+
+	return 0;
+}
+
+/* Find the link pointing to a tuple, or the end of its hash chain. */
+static nvram_tuple_t ** _nvram_lookup(nvram_handle_t *h, const char *name,
+	size_t len, uint32_t hv)
+{
+	nvram_tuple_t *t, **prev;
+
+	for (prev = &h->nvram_hash[hv & (h->hash_size - 1)], t = *prev;
+		 t; prev = &t->next, t = *prev)
+		if (t->hash == hv && !strncmp(t->name, name, len) && !t->name[len])
+			break;
+
+	return prev;
+}
+
+/* The image has to be rewritten from data offset pos onwards. */
+static void _nvram_touch(nvram_handle_t *h, uint32_t pos)
+{
+	if (pos < h->img_dirty)
+		h->img_dirty = pos;
+}
+
+/* Free all tuples. */
+static void _nvram_free(nvram_handle_t *h)
+{
+	nvram_tuple_t *t, *next;
+
+	/* Free hash table */
+	for (t = h->img_first; t; t = next) {
+		next = t->img_next;
+		if (t->value)
+			free(t->value);
+		free(t);
+	}
+
+	if (h->nvram_hash)
+		memset(h->nvram_hash, 0, h->hash_size * sizeof(*h->nvram_hash));
+
+	h->img_first = NULL;
+	h->img_last = NULL;
+	h->count = 0;
+
 	/* Free dead table */
 	for (t = h->nvram_dead; t; t = next) {
 		next = t->next;
@@ -67,57 +118,135 @@ static void _nvram_free(nvram_handle_t *h)
 
 /* (Re)allocate NVRAM tuples. */
 static nvram_tuple_t * _nvram_realloc( nvram_handle_t *h, nvram_tuple_t *t,
-	const char *name, const char *value )
+	const char *name, size_t namelen, const char *value )
 {
-	if ((strlen(value) + 1) > h->length - h->offset)
+	size_t len = strlen(value);
+	char *v;
+
+	if ((len + 1) > h->length - h->offset)
 		return NULL;
 
+	/* Copy value */
+	v = realloc(t ? t->value : NULL, len + 1);
+	if (!v)
+		return NULL;
+
+	memcpy(v, value, len + 1);
+
 	if (!t) {
-		t = malloc(sizeof(nvram_tuple_t) + strlen(name) + 1);
-		if (!t)
+		t = malloc(sizeof(nvram_tuple_t) + namelen + 1);
+		if (!t) {
+			free(v);
 			return NULL;
+		}
 
 		/* Copy name */
-		strcpy(t->name, name);
-
-		t->value = NULL;
+		memcpy(t->name, name, namelen);
+		t->name[namelen] = '\0';
 	}
 
-	/* Copy value */
-	if (!t->value || strcmp(t->value, value))
-	{
-		t->value = realloc(t->value, strlen(value) + 1);
-		if(!t->value)
-			return NULL;
+	t->value = v;
+
+	return t;
+}
 
-		strcpy(t->value, value);
-		t->value[strlen(value)] = '\0';
+/* Set a variable, name does not need to be NUL terminated. */
+static int _nvram_set(nvram_handle_t *h, const char *name, size_t len,
+	const char *value)
+{
+	uint32_t hv = hash(name, len);
+	nvram_tuple_t *t, *u, **prev;
+
+	/* Find the associated tuple in the hash table */
+	prev = _nvram_lookup(h, name, len, hv);
+	t = *prev;
+
+	/* Unchanged value, nothing to write out */
+	if (t && !strcmp(t->value, value))
+		return 0;
+
+	/* (Re)allocate tuple */
+	u = _nvram_realloc(h, t, name, len, value);
+	if (!u)
+		return -12; /* -ENOMEM */
+
+	/* Value reallocated, the image changes from this tuple on */
+	if (t) {
+		_nvram_touch(h, t->img_offset);
+		return 0;
 	}
 
-	return t;
+	/* Add new tuple to the hash table and to the end of the image */
+	u->hash = hv;
+	u->next = NULL;
+	*prev = u;
+
+	u->img_offset = NVRAM_NO_OFFSET;
+	u->img_next = NULL;
+	u->img_prev = h->img_last;
+	if (h->img_last)
+		h->img_last->img_next = u;
+	else
+		h->img_first = u;
+	h->img_last = u;
+
+	_nvram_touch(h, h->img_used);
+
+	/* Keep the hash chains short */
+	if (++h->count > h->hash_size)
+		_nvram_resize(h, h->hash_size * 2);
+
+	return 0;
 }
 
 /* (Re)initialize the hash table. */
 static int _nvram_rehash(nvram_handle_t *h)
 {
 	nvram_header_t *header = nvram_header(h);
-	char buf[] = "0xXXXXXXXX", *name, *value, *eq;
+	char buf[] = "0xXXXXXXXX", *data, *name, *value, *eq;
+	unsigned int count;
+	int clean = 1;
+	uint8_t crc;
 
 	/* (Re)initialize hash table */
 	_nvram_free(h);
 
+	if (!h->nvram_hash && _nvram_resize(h, NVRAM_HASH_MIN))
+		return -12; /* -ENOMEM */
+
+	/* CRC8 state after the header, continued over each tuple below */
+	crc = hndcrc8((unsigned char *) header + NVRAM_CRC_START_POSITION,
+		sizeof(nvram_header_t) - NVRAM_CRC_START_POSITION, 0xff);
+
 	/* Parse and set "name=value\0 ... \0\0" */
-	name = (char *) &header[1];
+	data = (char *) &header[1];
+	h->img_used = 0;
 
-	for (; *name; name = value + strlen(value) + 1) {
-		if (!(eq = strchr(name, '=')))
+	for (name = data; *name; name = value + strlen(value) + 1) {
+		/* Unparseable tail, rewrite the image without it */
+		if (!(eq = strchr(name, '='))) {
+			clean = 0;
 			break;
-		*eq = '\0';
+		}
 		value = eq + 1;
-		nvram_set(h, name, value);
-		*eq = '=';
+
+		/* Duplicates make the image differ from the table */
+		count = h->count;
+		_nvram_set(h, name, eq - name, value);
+		if (h->count == count) {
+			clean = 0;
+			continue;
+		}
+
+		h->img_last->img_offset = name - data;
+		h->img_used = value + strlen(value) + 1 - data;
+		crc = hndcrc8((unsigned char *) name,
+			h->img_used - h->img_last->img_offset, crc);
+		h->img_last->crc = crc;
 	}
 
+	h->img_dirty = clean ? NVRAM_NO_OFFSET : 0;
+
 	/* Set special SDRAM parameters */
 	if (!nvram_get(h, "sdram_init")) {
 		sprintf(buf, "0x%04X", (uint16_t)(header->crc_ver_init >> 16));
@@ -140,6 +269,14 @@ static int _nvram_rehash(nvram_handle_t *h)
 	return 0;
 }
 
+/* Sync the pages of the mapping covering len bytes at ptr. */
+static void _nvram_sync(nvram_handle_t *h, char *ptr, size_t len)
+{
+	size_t start = (ptr - h->mmap) & ~((size_t) sysconf(_SC_PAGESIZE) - 1);
+
+	msync(h->mmap + start, ptr + len - (h->mmap + start), MS_SYNC);
+}
+
 
 /*
  * -- Public functions --
@@ -154,18 +291,16 @@ nvram_header_t * nvram_header(nvram_handle_t *h)
 /* Get the value of an NVRAM variable. */
 char * nvram_get(nvram_handle_t *h, const char *name)
 {
-	uint32_t i;
+	size_t len;
 	nvram_tuple_t *t;
 	char *value;
 
 	if (!name)
 		return NULL;
 
-	/* Hash the name */
-	i = hash(name) % NVRAM_ARRAYSIZE(h->nvram_hash);
-
 	/* Find the associated tuple in the hash table */
-	for (t = h->nvram_hash[i]; t && strcmp(t->name, name); t = t->next);
+	len = strlen(name);
+	t = *_nvram_lookup(h, name, len, hash(name, len));
 
 	value = t ? t->value : NULL;
 
@@ -175,58 +310,39 @@ char * nvram_get(nvram_handle_t *h, const char *name)
 /* Set the value of an NVRAM variable. */
 int nvram_set(nvram_handle_t *h, const char *name, const char *value)
 {
-	uint32_t i;
-	nvram_tuple_t *t, *u, **prev;
-
-	/* Hash the name */
-	i = hash(name) % NVRAM_ARRAYSIZE(h->nvram_hash);
-
-	/* Find the associated tuple in the hash table */
-	for (prev = &h->nvram_hash[i], t = *prev;
-		 t && strcmp(t->name, name); prev = &t->next, t = *prev);
-
-	/* (Re)allocate tuple */
-	u = _nvram_realloc(h, t, name, value);
-	if (!u)
-		return -12; /* -ENOMEM */
-
-	/* Value reallocated */
-	if (t && t == u)
-		return 0;
-
-	/* Move old tuple to the dead table */
-	if (t) {
-		*prev = t->next;
-		t->next = h->nvram_dead;
-		h->nvram_dead = t;
-	}
-
-	/* Add new tuple to the hash table */
-	u->next = h->nvram_hash[i];
-	h->nvram_hash[i] = u;
-
-	return 0;
+	return _nvram_set(h, name, strlen(name), value);
 }
 
 /* Unset the value of an NVRAM variable. */
 int nvram_unset(nvram_handle_t *h, const char *name)
 {
-	uint32_t i;
+	size_t len;
 	nvram_tuple_t *t, **prev;
 
 	if (!name)
 		return 0;
 
-	/* Hash the name */
-	i = hash(name) % NVRAM_ARRAYSIZE(h->nvram_hash);
-
 	/* Find the associated tuple in the hash table */
-	for (prev = &h->nvram_hash[i], t = *prev;
-		 t && strcmp(t->name, name); prev = &t->next, t = *prev);
+	len = strlen(name);
+	prev = _nvram_lookup(h, name, len, hash(name, len));
+	t = *prev;
 
 	/* Move it to the dead table */
 	if (t) {
 		*prev = t->next;
+
+		if (t->img_prev)
+			t->img_prev->img_next = t->img_next;
+		else
+			h->img_first = t->img_next;
+		if (t->img_next)
+			t->img_next->img_prev = t->img_prev;
+		else
+			h->img_last = t->img_prev;
+
+		h->count--;
+		_nvram_touch(h, t->img_offset);
+
 		t->next = h->nvram_dead;
 		h->nvram_dead = t;
 	}
@@ -234,106 +350,145 @@ int nvram_unset(nvram_handle_t *h, const char *name)
 	return 0;
 }
 
-/* Get all NVRAM variables. */
+/* Get all NVRAM variables, in image order. */
 nvram_tuple_t * nvram_getall(nvram_handle_t *h)
 {
-	int i;
-	nvram_tuple_t *t, *l, *x;
+	nvram_tuple_t *t, *l, *x, **tail;
 
 	l = NULL;
+	tail = &l;
 
-	for (i = 0; i < NVRAM_ARRAYSIZE(h->nvram_hash); i++) {
-		for (t = h->nvram_hash[i]; t; t = t->next) {
-			x = malloc(sizeof(*x) + strlen(t->name) + 1);
-			if(!x)
-				break;
-			strcpy(x->name, t->name);
-			x->value = t->value;
-			x->next  = l;
-			l = x;
-		}
+	for (t = h->img_first; t; t = t->img_next) {
+		x = malloc(sizeof(*x) + strlen(t->name) + 1);
+		if(!x)
+			break;
+		strcpy(x->name, t->name);
+		x->value = t->value;
+		x->next  = NULL;
+		*tail = x;
+		tail = &x->next;
 	}
 
 	return l;
 }
 
-/* Regenerate NVRAM. */
+/* Write out changes. */
 int nvram_commit(nvram_handle_t *h)
 {
 	nvram_header_t *header = nvram_header(h);
 	char *init, *config, *refresh, *ncdl;
-	char *ptr, *end;
-	int i;
-	nvram_tuple_t *t;
+	char *data = (char *) &header[1];
+	char *ptr;
+	uint32_t pos, len, sync_len = 0;
+	nvram_tuple_t *t, *u, *clean;
 	nvram_header_t tmp;
 	uint8_t crc;
 
 	/* Regenerate header */
-	header->magic = NVRAM_MAGIC;
-	header->crc_ver_init = (NVRAM_VERSION << 8);
+	memset(&tmp, 0, sizeof(nvram_header_t));
+	tmp.magic = NVRAM_MAGIC;
+	tmp.crc_ver_init = (NVRAM_VERSION << 8);
 	if (!(init = nvram_get(h, "sdram_init")) ||
 		!(config = nvram_get(h, "sdram_config")) ||
 		!(refresh = nvram_get(h, "sdram_refresh")) ||
 		!(ncdl = nvram_get(h, "sdram_ncdl"))) {
-		header->crc_ver_init |= SDRAM_INIT << 16;
-		header->config_refresh = SDRAM_CONFIG;
-		header->config_refresh |= SDRAM_REFRESH << 16;
-		header->config_ncdl = 0;
+		tmp.crc_ver_init |= SDRAM_INIT << 16;
+		tmp.config_refresh = SDRAM_CONFIG;
+		tmp.config_refresh |= SDRAM_REFRESH << 16;
+		tmp.config_ncdl = 0;
 	} else {
-		header->crc_ver_init |= (strtoul(init, NULL, 0) & 0xffff) << 16;
-		header->config_refresh = strtoul(config, NULL, 0) & 0xffff;
-		header->config_refresh |= (strtoul(refresh, NULL, 0) & 0xffff) << 16;
-		header->config_ncdl = strtoul(ncdl, NULL, 0);
+		tmp.crc_ver_init |= (strtoul(init, NULL, 0) & 0xffff) << 16;
+		tmp.config_refresh = strtoul(config, NULL, 0) & 0xffff;
+		tmp.config_refresh |= (strtoul(refresh, NULL, 0) & 0xffff) << 16;
+		tmp.config_ncdl = strtoul(ncdl, NULL, 0);
 	}
 
-	/* Clear data area */
-	ptr = (char *) header + sizeof(nvram_header_t);
-	memset(ptr, 0xFF, nvram_part_size - h->offset - sizeof(nvram_header_t));
-	memset(&tmp, 0, sizeof(nvram_header_t));
+	/* The per-tuple CRC8 states only hold for an unchanged header */
+	if (header->magic != tmp.magic ||
+		(header->crc_ver_init & ~0xff) != tmp.crc_ver_init ||
+		header->config_refresh != tmp.config_refresh ||
+		header->config_ncdl != tmp.config_ncdl)
+		h->img_dirty = 0;
 
-	/* Leave space for a double NUL at the end */
-	end = (char *) header + nvram_part_size - h->offset - 2;
+	/* Little-endian CRC8 over the last 11 bytes of the header */
+	crc = hndcrc8((unsigned char *) &tmp + NVRAM_CRC_START_POSITION,
+		sizeof(nvram_header_t) - NVRAM_CRC_START_POSITION, 0xff);
 
-	/* Write out all tuples */
-	for (i = 0; i < NVRAM_ARRAYSIZE(h->nvram_hash); i++) {
-		for (t = h->nvram_hash[i]; t; t = t->next) {
-			if ((ptr + strlen(t->name) + 1 + strlen(t->value) + 1) > end)
-				break;
-			ptr += sprintf(ptr, "%s=%s", t->name, t->value) + 1;
-		}
+	/* Tuples in front of the first change are already in place */
+	for (clean = NULL, t = h->img_first;
+		 t && t->img_offset < h->img_dirty; t = t->img_next)
+		clean = t;
+
+	pos = 0;
+	if (clean) {
+		pos = clean->img_offset + strlen(clean->name) + 1 +
+			strlen(clean->value) + 1;
+		crc = clean->crc;
 	}
 
-	/* End with a double NULL and pad to 4 bytes */
-	*ptr = '\0';
-	ptr++;
+	if (h->img_dirty == NVRAM_NO_OFFSET &&
+		header->len >= sizeof(nvram_header_t) + pos) {
+		/* Nothing changed, only make sure the CRC8 is right */
+		len = header->len;
+		crc = hndcrc8((unsigned char *) data + pos,
+			len - sizeof(nvram_header_t) - pos, crc);
 
-	if( (int)ptr % 4 )
-		memset(ptr, 0, 4 - ((int)ptr % 4));
+		if ((header->crc_ver_init & 0xff) == crc)
+			return 0;
+	} else {
+		/* Make sure everything fits before touching the image */
+		for (len = pos, u = t; u; u = u->img_next)
+			len += strlen(u->name) + 1 + strlen(u->value) + 1;
 
-	ptr++;
+		len = NVRAM_ROUNDUP(sizeof(nvram_header_t) + len + 1, 4);
+		if (len > h->length - h->offset)
+			return -ENOSPC;
 
-	/* Set new length */
-	header->len = NVRAM_ROUNDUP(ptr - (char *) header, 4);
+		/* Write out the tuples from the first change on */
+		for (ptr = data + pos; t; t = t->img_next) {
+			t->img_offset = ptr - data;
+			ptr += sprintf(ptr, "%s=%s", t->name, t->value) + 1;
+			crc = hndcrc8((unsigned char *) data + t->img_offset,
+				ptr - data - t->img_offset, crc);
+			t->crc = crc;
+		}
 
-	/* Little-endian CRC8 over the last 11 bytes of the header */
-	tmp.crc_ver_init   = header->crc_ver_init;
-	tmp.config_refresh = header->config_refresh;
-	tmp.config_ncdl    = header->config_ncdl;
-	crc = hndcrc8((unsigned char *) &tmp + NVRAM_CRC_START_POSITION,
-		sizeof(nvram_header_t) - NVRAM_CRC_START_POSITION, 0xff);
+		h->img_used = ptr - data;
 
-	/* Continue CRC8 over data bytes */
-	crc = hndcrc8((unsigned char *) &header[0] + sizeof(nvram_header_t),
-		header->len - sizeof(nvram_header_t), crc);
+		/* End with a double NUL and pad to 4 bytes */
+		memset(ptr, 0, (char *) header + len - ptr);
+		crc = hndcrc8((unsigned char *) ptr, (char *) header + len - ptr, crc);
 
-	/* Set new CRC8 */
-	header->crc_ver_init |= crc;
+		/* Clear the rest of the previous contents */
+		sync_len = len;
+		if (header->len > len) {
+			memset((char *) header + len, 0xFF, header->len - len);
+			sync_len = header->len;
+		}
+		sync_len -= sizeof(nvram_header_t) + pos;
+	}
 
-	/* Write out */
-	msync(h->mmap, h->length, MS_SYNC);
+	/* Set new header */
+	header->magic = tmp.magic;
+	header->len = len;
+	header->crc_ver_init = tmp.crc_ver_init | crc;
+	header->config_refresh = tmp.config_refresh;
+	header->config_ncdl = tmp.config_ncdl;
+
+	/* Write out the header and the pages that changed */
+	_nvram_sync(h, (char *) header, sizeof(nvram_header_t));
+	if (sync_len)
+		_nvram_sync(h, data + pos, sync_len);
 	fsync(h->fd);
 
-	/* Reinitialize hash table */
+	h->img_dirty = NVRAM_NO_OFFSET;
+
+	return 0;
+}
+
+/* Discard changes. */
+int nvram_rollback(nvram_handle_t *h)
+{
 	return _nvram_rehash(h);
 }
 
@@ -398,13 +553,15 @@ nvram_handle_t * nvram_open(const char *file, int rdonly)
 				header = nvram_header(h);
 
 				if (header->magic == NVRAM_MAGIC &&
-				    (rdonly || header->len < h->length - h->offset)) {
-					_nvram_rehash(h);
+				    (rdonly || header->len < h->length - h->offset) &&
+				    !_nvram_rehash(h)) {
 					free(mtd);
 					return h;
 				}
 				else
 				{
+					_nvram_free(h);
+					free(h->nvram_hash);
 					munmap(h->mmap, h->length);
 					free(h);
 				}
@@ -421,6 +578,7 @@ nvram_handle_t * nvram_open(const char *file, int rdonly)
 int nvram_close(nvram_handle_t *h)
 {
 	_nvram_free(h);
+	free(h->nvram_hash);
 	munmap(h->mmap, h->length);
 	close(h->fd);
 	free(h);
@@ -40,6 +40,11 @@ struct nvram_header {
 struct nvram_tuple {
 	char *value;
 	struct nvram_tuple *next;
+	struct nvram_tuple *img_prev;	/* neighbours in image order */
+	struct nvram_tuple *img_next;
+	uint32_t hash;
+	uint32_t img_offset;	/* position of "name=value" in the data area */
+	uint8_t crc;		/* crc8 up to and including this tuple */
 	char name[];
 };
 
@@ -48,8 +53,14 @@ struct nvram_handle {
 	char *mmap;
 	unsigned int length;
 	unsigned int offset;
-	struct nvram_tuple *nvram_hash[257];
+	struct nvram_tuple **nvram_hash;
+	unsigned int hash_size;		/* power of two */
+	unsigned int count;
 	struct nvram_tuple *nvram_dead;
+	struct nvram_tuple *img_first;
+	struct nvram_tuple *img_last;
+	uint32_t img_used;	/* bytes of tuple data currently in the image */
+	uint32_t img_dirty;	/* data offset of the first pending change */
 };
 
 typedef struct nvram_handle nvram_handle_t;
@@ -72,9 +83,15 @@ int nvram_unset(nvram_handle_t *h, const char *name);
 /* Get all NVRAM variables. */
 nvram_tuple_t * nvram_getall(nvram_handle_t *h);
 
-/* Regenerate NVRAM. */
+/*
+ * Write out all changes made since the last commit. Only the part of the
+ * image from the first changed tuple onwards is rewritten and synced.
+ */
 int nvram_commit(nvram_handle_t *h);
 
+/* Discard all changes made since the last commit. */
+int nvram_rollback(nvram_handle_t *h);
+
 /* Open NVRAM and obtain a handle. */
 nvram_handle_t * nvram_open(const char *file, int rdonly);
 
@@ -102,9 +119,24 @@ int staging_to_nvram(void);
 /* Check NVRAM staging file. */
 char * nvram_find_staging(void);
 
+/* Runs one nvram command line with the given streams. */
+typedef int (*nvram_request_cb)(int argc, const char *argv[],
+	FILE *in, FILE *out, FILE *err);
+
+/* Serve command lines on NVRAM_SOCKET, only returns on error. */
+int nvram_daemon(nvram_request_cb cb);
+
+/* Run a command line in the daemon, returns -1 if there is none. */
+int nvram_daemon_call(int argc, const char *argv[]);
+
+
+/* Size of "nvram" MTD partition, set by nvram_find_mtd() */
+extern size_t nvram_part_size;
+
 
 /* Staging file for NVRAM */
 #define NVRAM_STAGING		"/tmp/.nvram"
+#define NVRAM_SOCKET		"/var/run/nvram.sock"
 #define NVRAM_RO			1
 #define NVRAM_RW			0
 
@@ -119,5 +151,8 @@ char * nvram_find_staging(void);
 
 #define NVRAM_CRC_START_POSITION	9 /* magic, len, crc8 to be skipped */
 
+#define NVRAM_HASH_MIN			256
+#define NVRAM_NO_OFFSET			0xFFFFFFFF /* not written out yet */
+
 
 #endif /* _nvram_h_ */
@@ -0,0 +1,989 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * Cache of the parsed Kconfig tree
+ *
+ * Parsing the full tree, including the generated package and target menus,
+ * is the most expensive part of every conf/mconf/nconf run. If the
+ * KCONFIG_PARSE_CACHE environment variable names a file, the symbol,
+ * property, menu and expression graph is written to it after a successful
+ * parse, and loaded instead of parsing as long as none of the inputs
+ * changed: the contents of every sourced file, the files matched by each
+ * 'source' statement, the referenced environment variables and the output
+ * of all $(shell,...) calls.
+ *
+ * Diagnostics printed while parsing (warnings, $(info,...)) are not
+ * repeated when the cache is used.
+ */
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <glob.h>
+#include <libgen.h>
+#include <limits.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "lkc.h"
+
+#define CACHE_ENV	"KCONFIG_PARSE_CACHE"
+#define CACHE_MAGIC	0x4b435043	/* "KCPC" */
+#define CACHE_VERSION	1
+
+#define CACHE_NULL	0xffffffffU
+
+/* symbol references, real symbols start at CACHE_SYM_BASE */
+enum {
+	CACHE_SYM_NULL,
+	CACHE_SYM_YES,
+	CACHE_SYM_MOD,
+	CACHE_SYM_NO,
+	CACHE_SYM_BASE,
+};
+
+enum cache_input_type {
+	CACHE_INPUT_ENV,
+	CACHE_INPUT_SHELL,
+	CACHE_INPUT_SOURCE,
+};
+
+/* an input of the parse, other than the contents of the parsed files */
+struct cache_input {
+	struct list_head node;
+	enum cache_input_type type;
+	char *key;	/* variable name, command or source pattern */
+	char *arg;	/* source: file containing the statement */
+	char *value;	/* variable value (NULL if unset), output or matches */
+};
+
+static LIST_HEAD(cache_inputs);
+
+static bool cache_enabled(void)
+{
+	const char *name = getenv(CACHE_ENV);
+
+	return name && *name;
+}
+
+static void cache_add_input(enum cache_input_type type, const char *key,
+			    const char *arg, const char *value)
+{
+	struct cache_input *in;
+
+	list_for_each_entry(in, &cache_inputs, node) {
+		if (in->type == type && !strcmp(in->key, key) &&
+		    !strcmp(in->arg ?: "", arg ?: ""))
+			return;
+	}
+
+	in = xcalloc(1, sizeof(*in));
+	in->type = type;
+	in->key = xstrdup(key);
+	in->arg = arg ? xstrdup(arg) : NULL;
+	in->value = value ? xstrdup(value) : NULL;
+	list_add_tail(&in->node, &cache_inputs);
+}
+
+static void cache_free_inputs(void)
+{
+	struct cache_input *in, *tmp;
+
+	list_for_each_entry_safe(in, tmp, &cache_inputs, node) {
+		list_del(&in->node);
+		free(in->key);
+		free(in->arg);
+		free(in->value);
+		free(in);
+	}
+}
+
+/*
+ * Resolve a 'source' pattern the same way zconf_nextfile() does, and return
+ * the matched files as a newline separated list.
+ */
+static char *cache_source_matches(const char *name, const char *curname)
+{
+	char path[PATH_MAX], *p;
+	struct gstr res = str_new();
+	glob_t gl;
+	size_t i;
+	int err;
+
+	err = glob(name, GLOB_ERR | GLOB_MARK, NULL, &gl);
+	if (err == GLOB_NOMATCH && !strchr(name, '*')) {
+		p = xstrdup(curname);
+		snprintf(path, sizeof(path), "%s/%s", dirname(p), name);
+		free(p);
+		err = glob(path, GLOB_ERR | GLOB_MARK, NULL, &gl);
+	}
+
+	if (!err) {
+		for (i = 0; i < gl.gl_pathc; i++) {
+			str_append(&res, gl.gl_pathv[i]);
+			str_append(&res, "\n");
+		}
+		globfree(&gl);
+	}
+
+	p = xstrdup(str_get(&res));
+	str_free(&res);
+
+	return p;
+}
+
+void conf_cache_add_env(const char *name, const char *value)
+{
+	if (cache_enabled())
+		cache_add_input(CACHE_INPUT_ENV, name, NULL, value);
+}
+
+void conf_cache_add_shell(const char *cmd, const char *output)
+{
+	if (cache_enabled())
+		cache_add_input(CACHE_INPUT_SHELL, cmd, NULL, output);
+}
+
+void conf_cache_add_source(const char *name, const char *curname)
+{
+	char *matches;
+
+	if (!cache_enabled())
+		return;
+
+	matches = cache_source_matches(name, curname);
+	cache_add_input(CACHE_INPUT_SOURCE, name, curname, matches);
+	free(matches);
+}
+
+static uint64_t cache_hash(const void *data, size_t len)
+{
+	const unsigned char *p = data;
+	uint64_t h = 0xcbf29ce484222325ULL ^ len;
+	uint64_t v;
+
+	for (; len >= 8; p += 8, len -= 8) {
+		memcpy(&v, p, sizeof(v));
+		h = (h ^ v) * 0x100000001b3ULL;
+		h ^= h >> 29;
+	}
+
+	for (; len; p++, len--)
+		h = (h ^ *p) * 0x100000001b3ULL;
+
+	return h ^ (h >> 32);
+}
+
+static bool cache_hash_file(const char *name, uint64_t *size, uint64_t *hash)
+{
+	struct stat st;
+	void *data;
+	FILE *f;
+	bool ret = false;
+
+	f = zconf_fopen(name);
+	if (!f)
+		return false;
+
+	if (fstat(fileno(f), &st) || !S_ISREG(st.st_mode))
+		goto out;
+
+	*size = st.st_size;
+	if (!st.st_size) {
+		*hash = cache_hash(NULL, 0);
+		ret = true;
+		goto out;
+	}
+
+	data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fileno(f), 0);
+	if (data == MAP_FAILED)
+		goto out;
+
+	*hash = cache_hash(data, st.st_size);
+	munmap(data, st.st_size);
+	ret = true;
+
+out:
+	fclose(f);
+	return ret;
+}
+
+/*
+ * Pointer to index map, used to turn the graph into references while
+ * writing the cache.
+ */
+struct cache_map {
+	const void **keys;
+	uint32_t *vals;
+	size_t size, count;
+};
+
+static size_t cache_map_slot(struct cache_map *m, const void *key)
+{
+	size_t i = ((uintptr_t)key >> 4) * 0x9e3779b97f4a7c15ULL;
+
+	for (i &= m->size - 1; m->keys[i] && m->keys[i] != key;
+	     i = (i + 1) & (m->size - 1))
+		;
+
+	return i;
+}
+
+static void cache_map_add(struct cache_map *m, const void *key, uint32_t val)
+{
+	const void **keys = m->keys;
+	uint32_t *vals = m->vals;
+	size_t i, size = m->size;
+
+	if (2 * (m->count + 1) > m->size) {
+		m->size = size ? size * 2 : 1024;
+		m->keys = xcalloc(m->size, sizeof(*m->keys));
+		m->vals = xcalloc(m->size, sizeof(*m->vals));
+		m->count = 0;
+		for (i = 0; i < size; i++) {
+			if (keys[i])
+				cache_map_add(m, keys[i], vals[i]);
+		}
+		free(keys);
+		free(vals);
+	}
+
+	i = cache_map_slot(m, key);
+	if (!m->keys[i]) {
+		m->keys[i] = key;
+		m->count++;
+	}
+	m->vals[i] = val;
+}
+
+static uint32_t cache_map_get(struct cache_map *m, const void *key)
+{
+	size_t i;
+
+	if (!key || !m->size)
+		return CACHE_NULL;
+
+	i = cache_map_slot(m, key);
+	return m->keys[i] ? m->vals[i] : CACHE_NULL;
+}
+
+static void cache_map_free(struct cache_map *m)
+{
+	free(m->keys);
+	free(m->vals);
+}
+
+struct cache_writer {
+	char *data;
+	size_t len, size;
+	struct cache_map syms, props, menus, files;
+
+	struct property **prop_list;
+	struct menu **menu_list;
+	uint32_t nprops, nmenus;
+
+	/* set if something unexpected was found, the cache is not written */
+	bool error;
+};
+
+static void cache_put(struct cache_writer *w, const void *p, size_t len)
+{
+	if (w->len + len > w->size) {
+		while (w->len + len > w->size)
+			w->size = w->size ? w->size * 2 : 65536;
+		w->data = xrealloc(w->data, w->size);
+	}
+	memcpy(w->data + w->len, p, len);
+	w->len += len;
+}
+
+static void cache_put_u32(struct cache_writer *w, uint32_t val)
+{
+	cache_put(w, &val, sizeof(val));
+}
+
+static void cache_put_u64(struct cache_writer *w, uint64_t val)
+{
+	cache_put(w, &val, sizeof(val));
+}
+
+static void cache_put_str(struct cache_writer *w, const char *s)
+{
+	size_t len;
+
+	if (!s) {
+		cache_put_u32(w, CACHE_NULL);
+		return;
+	}
+
+	len = strlen(s);
+	cache_put_u32(w, len);
+	cache_put(w, s, len + 1);
+}
+
+static void cache_put_sym(struct cache_writer *w, struct symbol *sym)
+{
+	uint32_t idx;
+
+	if (!sym)
+		idx = CACHE_SYM_NULL;
+	else if (sym == &symbol_yes)
+		idx = CACHE_SYM_YES;
+	else if (sym == &symbol_mod)
+		idx = CACHE_SYM_MOD;
+	else if (sym == &symbol_no)
+		idx = CACHE_SYM_NO;
+	else if ((idx = cache_map_get(&w->syms, sym)) == CACHE_NULL)
+		w->error = true;
+	else
+		idx += CACHE_SYM_BASE;
+
+	cache_put_u32(w, idx);
+}
+
+static void cache_put_expr(struct cache_writer *w, struct expr *e)
+{
+	if (!e) {
+		cache_put_u32(w, CACHE_NULL);
+		return;
+	}
+
+	cache_put_u32(w, e->type);
+	switch (e->type) {
+	case E_OR:
+	case E_AND:
+		cache_put_expr(w, e->left.expr);
+		cache_put_expr(w, e->right.expr);
+		break;
+	case E_NOT:
+		cache_put_expr(w, e->left.expr);
+		break;
+	case E_SYMBOL:
+		cache_put_sym(w, e->left.sym);
+		break;
+	case E_LIST:
+		cache_put_sym(w, e->right.sym);
+		cache_put_expr(w, e->left.expr);
+		break;
+	case E_EQUAL:
+	case E_UNEQUAL:
+	case E_LTH:
+	case E_LEQ:
+	case E_GTH:
+	case E_GEQ:
+	case E_RANGE:
+		cache_put_sym(w, e->left.sym);
+		cache_put_sym(w, e->right.sym);
+		break;
+	default:
+		break;
+	}
+}
+
+/* arrays are grown whenever their size reaches a power of 2 */
+static void *cache_grow(void *array, uint32_t count, size_t elem)
+{
+	if (count & (count - 1))
+		return array;
+
+	return xrealloc(array, (count ? 2 * count : 16) * elem);
+}
+
+static void cache_collect_prop(struct cache_writer *w, struct property *prop)
+{
+	if (!prop || cache_map_get(&w->props, prop) != CACHE_NULL)
+		return;
+
+	w->prop_list = cache_grow(w->prop_list, w->nprops,
+				  sizeof(*w->prop_list));
+	cache_map_add(&w->props, prop, w->nprops);
+	w->prop_list[w->nprops++] = prop;
+}
+
+static void cache_collect_menu(struct cache_writer *w, struct menu *menu)
+{
+	w->menu_list = cache_grow(w->menu_list, w->nmenus,
+				  sizeof(*w->menu_list));
+	cache_map_add(&w->menus, menu, w->nmenus);
+	w->menu_list[w->nmenus++] = menu;
+
+	cache_collect_prop(w, menu->prompt);
+}
+
+static void cache_write_inputs(struct cache_writer *w, const char *name)
+{
+	struct cache_input *in;
+	struct file *file;
+	uint64_t size, hash;
+	char cwd[PATH_MAX];
+	uint32_t count = 0;
+
+	if (!getcwd(cwd, sizeof(cwd)))
+		cwd[0] = 0;
+
+	cache_put_u32(w, CACHE_MAGIC);
+	cache_put_u32(w, CACHE_VERSION);
+	cache_put_str(w, cwd);
+	cache_put_str(w, name);
+	cache_put_str(w, getenv(SRCTREE));
+
+	for (file = file_list; file; file = file->next)
+		count++;
+	cache_put_u32(w, count);
+	for (file = file_list; file; file = file->next) {
+		if (!cache_hash_file(file->name, &size, &hash))
+			size = hash = 0;
+		cache_put_str(w, file->name);
+		cache_put_u64(w, size);
+		cache_put_u64(w, hash);
+	}
+
+	count = 0;
+	list_for_each_entry(in, &cache_inputs, node)
+		count++;
+	cache_put_u32(w, count);
+	list_for_each_entry(in, &cache_inputs, node) {
+		cache_put_u32(w, in->type);
+		cache_put_str(w, in->key);
+		cache_put_str(w, in->arg);
+		cache_put_str(w, in->value);
+	}
+}
+
+static void cache_write_tree(struct cache_writer *w)
+{
+	struct property *prop;
+	struct symbol *sym;
+	struct menu *menu;
+	struct file *file;
+	uint32_t nsyms = 0, nfiles = 0, i;
+	size_t start = w->len;
+	int n;
+
+	/* number everything first, the graph is full of forward references */
+	for (file = file_list; file; file = file->next)
+		cache_map_add(&w->files, file, nfiles++);
+	for_all_symbols(n, sym)
+		cache_map_add(&w->syms, sym, nsyms++);
+
+	for (menu = &rootmenu; menu; ) {
+		cache_collect_menu(w, menu);
+
+		if (menu->list) {
+			menu = menu->list;
+			continue;
+		}
+		while (menu && !menu->next)
+			menu = menu->parent;
+		if (menu)
+			menu = menu->next;
+	}
+
+	for_all_symbols(n, sym) {
+		for (prop = sym->prop; prop; prop = prop->next)
+			cache_collect_prop(w, prop);
+	}
+
+	cache_put_u32(w, nfiles);
+	cache_put_u32(w, symbol_hash_size);
+	cache_put_u32(w, nsyms);
+	cache_put_u32(w, w->nprops);
+	cache_put_u32(w, w->nmenus);
+
+	for (file = file_list; file; file = file->next) {
+		cache_put_str(w, file->name);
+		cache_put_u32(w, cache_map_get(&w->files, file->parent));
+		cache_put_u32(w, file->lineno);
+	}
+
+	for_all_symbols(n, sym) {
+		cache_put_str(w, sym->name);
+		cache_put_u32(w, sym->type);
+		cache_put_u32(w, sym->flags & ~SYMBOL_VALID);
+		cache_put_u32(w, cache_map_get(&w->props, sym->prop));
+		cache_put_expr(w, sym->dir_dep.expr);
+		cache_put_expr(w, sym->rev_dep.expr);
+		cache_put_expr(w, sym->implied.expr);
+	}
+	cache_put_sym(w, modules_sym);
+
+	for (i = 0; i < w->nprops; i++) {
+		prop = w->prop_list[i];
+		cache_put_u32(w, cache_map_get(&w->props, prop->next));
+		cache_put_u32(w, prop->type);
+		cache_put_str(w, prop->text);
+		cache_put_expr(w, prop->visible.expr);
+		cache_put_expr(w, prop->expr);
+		cache_put_u32(w, cache_map_get(&w->menus, prop->menu));
+		cache_put_u32(w, cache_map_get(&w->files, prop->file));
+		cache_put_u32(w, prop->lineno);
+	}
+
+	for (i = 0; i < w->nmenus; i++) {
+		menu = w->menu_list[i];
+		cache_put_u32(w, cache_map_get(&w->menus, menu->next));
+		cache_put_u32(w, cache_map_get(&w->menus, menu->parent));
+		cache_put_u32(w, cache_map_get(&w->menus, menu->list));
+		cache_put_sym(w, menu->sym);
+		cache_put_u32(w, cache_map_get(&w->props, menu->prompt));
+		cache_put_expr(w, menu->visibility);
+		cache_put_expr(w, menu->dep);
+		cache_put_u32(w, menu->flags);
+		cache_put_str(w, menu->help);
+		cache_put_u32(w, cache_map_get(&w->files, menu->file));
+		cache_put_u32(w, menu->lineno);
+	}
+
+	/* a damaged tree could send the menu code into loops, checksum it */
+	cache_put_u64(w, cache_hash(w->data + start, w->len - start));
+}
+
+void conf_cache_save(const char *name)
+{
+	struct cache_writer w = {};
+	const char *path = getenv(CACHE_ENV);
+	char tmpname[PATH_MAX];
+	FILE *f;
+
+	if (!path || !*path)
+		return;
+
+	cache_write_inputs(&w, name);
+	cache_write_tree(&w);
+
+	/* the cache may be shared by concurrent runs, replace it atomically */
+	snprintf(tmpname, sizeof(tmpname), "%s.%d.tmp", path, (int)getpid());
+	f = w.error ? NULL : fopen(tmpname, "w");
+	if (f) {
+		if (fwrite(w.data, 1, w.len, f) != w.len) {
+			fclose(f);
+			unlink(tmpname);
+		} else if (fclose(f) || rename(tmpname, path)) {
+			unlink(tmpname);
+		}
+	}
+
+	cache_map_free(&w.syms);
+	cache_map_free(&w.props);
+	cache_map_free(&w.menus);
+	cache_map_free(&w.files);
+	free(w.prop_list);
+	free(w.menu_list);
+	free(w.data);
+}
+
+struct cache_reader {
+	const char *p, *end;
+	bool error;
+
+	struct symbol *syms;
+	struct property *props;
+	struct menu **menus;
+	struct file *files;
+	uint32_t nsyms, nprops, nmenus, nfiles;
+};
+
+static const void *cache_get(struct cache_reader *r, size_t len)
+{
+	const void *p = r->p;
+
+	if (r->error || (size_t)(r->end - r->p) < len) {
+		r->error = true;
+		return NULL;
+	}
+	r->p += len;
+
+	return p;
+}
+
+static uint32_t cache_get_u32(struct cache_reader *r)
+{
+	const void *p = cache_get(r, sizeof(uint32_t));
+	uint32_t val = 0;
+
+	if (p)
+		memcpy(&val, p, sizeof(val));
+
+	return val;
+}
+
+static uint64_t cache_get_u64(struct cache_reader *r)
+{
+	const void *p = cache_get(r, sizeof(uint64_t));
+	uint64_t val = 0;
+
+	if (p)
+		memcpy(&val, p, sizeof(val));
+
+	return val;
+}
+
+/* returns a pointer into the mapped cache, or NULL */
+static const char *cache_get_str(struct cache_reader *r)
+{
+	uint32_t len = cache_get_u32(r);
+	const char *s;
+
+	if (len == CACHE_NULL)
+		return NULL;
+
+	s = cache_get(r, (size_t)len + 1);
+	if (s && s[len]) {
+		r->error = true;
+		return NULL;
+	}
+
+	return s;
+}
+
+static char *cache_dup_str(struct cache_reader *r)
+{
+	const char *s = cache_get_str(r);
+
+	return s ? xstrdup(s) : NULL;
+}
+
+static bool cache_str_eq(const char *a, const char *b)
+{
+	if (!a || !b)
+		return a == b;
+
+	return !strcmp(a, b);
+}
+
+static struct symbol *cache_get_sym(struct cache_reader *r)
+{
+	uint32_t idx = cache_get_u32(r);
+
+	switch (idx) {
+	case CACHE_SYM_NULL:
+		return NULL;
+	case CACHE_SYM_YES:
+		return &symbol_yes;
+	case CACHE_SYM_MOD:
+		return &symbol_mod;
+	case CACHE_SYM_NO:
+		return &symbol_no;
+	}
+
+	idx -= CACHE_SYM_BASE;
+	if (idx >= r->nsyms) {
+		r->error = true;
+		return NULL;
+	}
+
+	return &r->syms[idx];
+}
+
+static struct property *cache_get_prop(struct cache_reader *r)
+{
+	uint32_t idx = cache_get_u32(r);
+
+	if (idx == CACHE_NULL)
+		return NULL;
+	if (idx >= r->nprops) {
+		r->error = true;
+		return NULL;
+	}
+
+	return &r->props[idx];
+}
+
+static struct menu *cache_get_menu(struct cache_reader *r)
+{
+	uint32_t idx = cache_get_u32(r);
+
+	if (idx == CACHE_NULL)
+		return NULL;
+	if (idx >= r->nmenus) {
+		r->error = true;
+		return NULL;
+	}
+
+	return r->menus[idx];
+}
+
+static struct file *cache_get_file(struct cache_reader *r)
+{
+	uint32_t idx = cache_get_u32(r);
+
+	if (idx == CACHE_NULL)
+		return NULL;
+	if (idx >= r->nfiles) {
+		r->error = true;
+		return NULL;
+	}
+
+	return &r->files[idx];
+}
+
+static struct expr *cache_get_expr(struct cache_reader *r)
+{
+	uint32_t type = cache_get_u32(r);
+	struct expr *e;
+
+	if (type == CACHE_NULL || r->error)
+		return NULL;
+
+	e = xcalloc(1, sizeof(*e));
+	e->type = type;
+	switch (type) {
+	case E_OR:
+	case E_AND:
+		e->left.expr = cache_get_expr(r);
+		e->right.expr = cache_get_expr(r);
+		break;
+	case E_NOT:
+		e->left.expr = cache_get_expr(r);
+		break;
+	case E_SYMBOL:
+		e->left.sym = cache_get_sym(r);
+		break;
+	case E_LIST:
+		e->right.sym = cache_get_sym(r);
+		e->left.expr = cache_get_expr(r);
+		break;
+	case E_EQUAL:
+	case E_UNEQUAL:
+	case E_LTH:
+	case E_LEQ:
+	case E_GTH:
+	case E_GEQ:
+	case E_RANGE:
+		e->left.sym = cache_get_sym(r);
+		e->right.sym = cache_get_sym(r);
+		break;
+	case E_NONE:
+		break;
+	default:
+		r->error = true;
+		break;
+	}
+
+	return e;
+}
+
+/* check that nothing the cached parse depended on has changed */
+static bool cache_check_inputs(struct cache_reader *r, const char *name)
+{
+	uint64_t size, hash, cur_size, cur_hash;
+	const char *key, *arg, *value, *fname;
+	char cwd[PATH_MAX];
+	uint32_t i, count, type;
+	char *cur;
+	bool ok;
+
+	if (cache_get_u32(r) != CACHE_MAGIC ||
+	    cache_get_u32(r) != CACHE_VERSION)
+		return false;
+
+	if (!getcwd(cwd, sizeof(cwd)))
+		cwd[0] = 0;
+	if (!cache_str_eq(cache_get_str(r), cwd) ||
+	    !cache_str_eq(cache_get_str(r), name) ||
+	    !cache_str_eq(cache_get_str(r), getenv(SRCTREE)))
+		return false;
+
+	count = cache_get_u32(r);
+	for (i = 0; i < count && !r->error; i++) {
+		fname = cache_get_str(r);
+		size = cache_get_u64(r);
+		hash = cache_get_u64(r);
+		if (!fname || !cache_hash_file(fname, &cur_size, &cur_hash) ||
+		    cur_size != size || cur_hash != hash)
+			return false;
+	}
+
+	count = cache_get_u32(r);
+	for (i = 0; i < count && !r->error; i++) {
+		type = cache_get_u32(r);
+		key = cache_get_str(r);
+		arg = cache_get_str(r);
+		value = cache_get_str(r);
+		if (!key)
+			return false;
+
+		switch (type) {
+		case CACHE_INPUT_ENV:
+			ok = cache_str_eq(getenv(key), value);
+			if (ok)
+				cache_add_input(type, key, NULL, value);
+			break;
+		case CACHE_INPUT_SHELL:
+			cur = shell_output(key);
+			ok = cache_str_eq(cur, value);
+			free(cur);
+			break;
+		case CACHE_INPUT_SOURCE:
+			cur = cache_source_matches(key, arg ?: "");
+			ok = cache_str_eq(cur, value);
+			free(cur);
+			break;
+		default:
+			ok = false;
+			break;
+		}
+		if (!ok)
+			return false;
+	}
+
+	return !r->error;
+}
+
+static bool cache_read_tree(struct cache_reader *r)
+{
+	struct property *prop;
+	struct symbol *sym;
+	struct menu *menu;
+	struct file *file;
+	uint32_t i, hash_size;
+	uint64_t sum;
+
+	if ((size_t)(r->end - r->p) < sizeof(sum))
+		return false;
+	r->end -= sizeof(sum);
+	memcpy(&sum, r->end, sizeof(sum));
+	if (cache_hash(r->p, r->end - r->p) != sum)
+		return false;
+
+	r->nfiles = cache_get_u32(r);
+	hash_size = cache_get_u32(r);
+	r->nsyms = cache_get_u32(r);
+	r->nprops = cache_get_u32(r);
+	r->nmenus = cache_get_u32(r);
+	if (r->error || !r->nmenus || hash_size < SYMBOL_HASHSIZE_MIN ||
+	    (hash_size & (hash_size - 1)))
+		return false;
+
+	/* every record takes at least a few bytes, reject bogus counts early */
+	if ((uint64_t)r->nfiles + r->nsyms + r->nprops + r->nmenus >
+	    (uint64_t)(r->end - r->p))
+		return false;
+
+	r->files = xcalloc(r->nfiles ?: 1, sizeof(*r->files));
+	r->syms = xcalloc(r->nsyms ?: 1, sizeof(*r->syms));
+	r->props = xcalloc(r->nprops ?: 1, sizeof(*r->props));
+	r->menus = xcalloc(r->nmenus, sizeof(*r->menus));
+
+	r->menus[0] = &rootmenu;
+	for (i = 1; i < r->nmenus; i++)
+		r->menus[i] = xcalloc(1, sizeof(struct menu));
+
+	for (i = 0; i < r->nfiles; i++) {
+		file = &r->files[i];
+		file->next = i + 1 < r->nfiles ? &r->files[i + 1] : NULL;
+		file->name = cache_dup_str(r);
+		file->parent = cache_get_file(r);
+		file->lineno = cache_get_u32(r);
+	}
+
+	for (i = 0; i < r->nsyms; i++) {
+		sym = &r->syms[i];
+		sym->name = cache_dup_str(r);
+		sym->type = cache_get_u32(r);
+		sym->flags = cache_get_u32(r);
+		sym->prop = cache_get_prop(r);
+		sym->dir_dep.expr = cache_get_expr(r);
+		sym->rev_dep.expr = cache_get_expr(r);
+		sym->implied.expr = cache_get_expr(r);
+	}
+	modules_sym = cache_get_sym(r);
+
+	for (i = 0; i < r->nprops; i++) {
+		prop = &r->props[i];
+		prop->next = cache_get_prop(r);
+		prop->type = cache_get_u32(r);
+		prop->text = cache_dup_str(r);
+		prop->visible.expr = cache_get_expr(r);
+		prop->expr = cache_get_expr(r);
+		prop->menu = cache_get_menu(r);
+		prop->file = cache_get_file(r);
+		prop->lineno = cache_get_u32(r);
+	}
+
+	for (i = 0; i < r->nmenus; i++) {
+		menu = r->menus[i];
+		menu->next = cache_get_menu(r);
+		menu->parent = cache_get_menu(r);
+		menu->list = cache_get_menu(r);
+		menu->sym = cache_get_sym(r);
+		menu->prompt = cache_get_prop(r);
+		menu->visibility = cache_get_expr(r);
+		menu->dep = cache_get_expr(r);
+		menu->flags = cache_get_u32(r);
+		menu->help = cache_dup_str(r);
+		menu->file = cache_get_file(r);
+		menu->lineno = cache_get_u32(r);
+	}
+
+	if (r->error || r->p != r->end)
+		return false;
+
+	file_list = r->nfiles ? r->files : NULL;
+	sym_hash_restore(r->syms, r->nsyms, hash_size);
+
+	return true;
+}
+
+/*
+ * Load the parsed tree for the Kconfig file 'name' from the cache. Returns
+ * false if there is no usable cache, in which case nothing was changed and
+ * the tree needs to be parsed.
+ */
+bool conf_cache_load(const char *name)
+{
+	struct cache_reader r = {};
+	struct cache_input *in;
+	const char *path = getenv(CACHE_ENV);
+	struct menu root = rootmenu;
+	struct stat st;
+	void *data;
+	bool ret = false;
+	int fd;
+
+	if (!path || !*path)
+		return false;
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return false;
+
+	if (fstat(fd, &st) || !st.st_size) {
+		close(fd);
+		return false;
+	}
+
+	data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (data == MAP_FAILED)
+		return false;
+
+	r.p = data;
+	r.end = r.p + st.st_size;
+
+	if (!cache_check_inputs(&r, name))
+		goto out;
+
+	/*
+	 * A cache that turns out to be corrupt leaks what was read so far,
+	 * which is fine since we fall back to parsing anyway.
+	 */
+	if (!cache_read_tree(&r)) {
+		rootmenu = root;
+		modules_sym = NULL;
+		goto out;
+	}
+
+	/* variables referenced from the environment, for env_write_dep() */
+	list_for_each_entry(in, &cache_inputs, node) {
+		if (in->type == CACHE_INPUT_ENV && in->value)
+			env_add(in->key, in->value);
+	}
+	ret = true;
+
+out:
+	munmap(data, st.st_size);
+	if (!ret)
+		cache_free_inputs();
+	return ret;
+}
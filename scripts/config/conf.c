@@ -36,6 +36,7 @@ enum input_mode {
 	yes2modconfig,
 	mod2yesconfig,
 	mod2noconfig,
+	applydiff,
 	fatalrecursive,
 };
 static enum input_mode input_mode = oldaskconfig;
@@ -230,7 +231,7 @@ static bool conf_set_all_new_symbols(enum conf_def_mode mode)
 	sym_clear_all_valid();
 
 	for_all_symbols(i, sym) {
-		if (sym_has_value(sym) || sym->flags & SYMBOL_VALID)
+		if (sym_has_value(sym) || sym_is_valid(sym))
 			continue;
 		switch (sym_get_type(sym)) {
 		case S_BOOLEAN:
@@ -315,6 +316,102 @@ static void conf_rewrite_tristates(tristate old_val, tristate new_val)
 	sym_clear_all_valid();
 }
 
+/* value of a symbol as written to .config, before --applydiff */
+struct diff_entry {
+	struct symbol *sym;
+	char *val;
+};
+
+static struct diff_entry *diff_entries;
+static int diff_count;
+
+static char *conf_diff_value(struct symbol *sym)
+{
+	sym_calc_value(sym);
+	if (!(sym->flags & SYMBOL_WRITE))
+		return NULL;
+
+	return xstrdup(sym_get_string_value(sym));
+}
+
+static void conf_diff_save(void)
+{
+	struct symbol *sym;
+	int i, n = 0;
+
+	for_all_symbols(i, sym)
+		n++;
+	diff_entries = xcalloc(n ?: 1, sizeof(*diff_entries));
+
+	for_all_symbols(i, sym) {
+		if (!sym->name || sym_is_choice(sym) ||
+		    (sym->flags & SYMBOL_NO_WRITE))
+			continue;
+		diff_entries[diff_count].sym = sym;
+		diff_entries[diff_count].val = conf_diff_value(sym);
+		diff_count++;
+	}
+}
+
+static int diff_entry_cmp(const void *a, const void *b)
+{
+	const struct diff_entry *da = a, *db = b;
+
+	return strcmp(da->sym->name, db->sym->name);
+}
+
+static void conf_diff_print_value(struct symbol *sym, const char *val)
+{
+	if (sym->type == S_STRING)
+		printf("\"%s\"", val);
+	else
+		printf("%s", val);
+}
+
+/*
+ * List the symbols whose value in .config changed, in the same format as
+ * the kernel's scripts/diffconfig: "-FOO y" for a symbol that is no longer
+ * written, "+FOO y" for a new one and " FOO n -> y" for a changed value.
+ */
+static void conf_diff_report(void)
+{
+	struct diff_entry *d;
+	char *val;
+	int i;
+
+	qsort(diff_entries, diff_count, sizeof(*diff_entries), diff_entry_cmp);
+
+	for (i = 0; i < diff_count; i++) {
+		d = &diff_entries[i];
+		val = conf_diff_value(d->sym);
+		if (!val && !d->val)
+			continue;
+		if (val && d->val && !strcmp(val, d->val)) {
+			free(val);
+			continue;
+		}
+
+		if (!val) {
+			printf("-%s ", d->sym->name);
+			conf_diff_print_value(d->sym, d->val);
+		} else if (!d->val) {
+			printf("+%s ", d->sym->name);
+			conf_diff_print_value(d->sym, val);
+		} else {
+			printf(" %s ", d->sym->name);
+			conf_diff_print_value(d->sym, d->val);
+			printf(" -> ");
+			conf_diff_print_value(d->sym, val);
+		}
+		printf("\n");
+		free(val);
+	}
+
+	for (i = 0; i < diff_count; i++)
+		free(diff_entries[i].val);
+	free(diff_entries);
+}
+
 static int conf_askvalue(struct symbol *sym, const char *def)
 {
 	if (!sym_has_value(sym))
@@ -684,6 +781,7 @@ static const struct option long_opts[] = {
 	{"yes2modconfig", no_argument,       &input_mode_opt, yes2modconfig},
 	{"mod2yesconfig", no_argument,       &input_mode_opt, mod2yesconfig},
 	{"mod2noconfig",  no_argument,       &input_mode_opt, mod2noconfig},
+	{"applydiff",     required_argument, &input_mode_opt, applydiff},
 	{"fatalrecursive",no_argument,       &input_mode_opt, fatalrecursive},
 	{NULL, 0, NULL, 0}
 };
@@ -717,6 +815,8 @@ static void conf_usage(const char *progname)
 	printf("  --yes2modconfig         Change answers from yes to mod if possible\n");
 	printf("  --mod2yesconfig         Change answers from mod to yes if possible\n");
 	printf("  --mod2noconfig          Change answers from mod to no if possible\n");
+	printf("  --applydiff <file>      Apply the settings in <file> to the current config\n"
+	       "                          and list the symbols that changed\n");
 	printf("  (If none of the above is given, --oldaskconfig is the default)\n");
 }
 
@@ -729,6 +829,7 @@ int main(int ac, char **av)
 	int no_conf_write = 0;
 
 	tty_stdio = isatty(0) && isatty(1);
+	conf_timing(NULL);
 
 	while ((opt = getopt_long(ac, av, "hr:w:s", long_opts, NULL)) != -1) {
 		switch (opt) {
@@ -758,6 +859,7 @@ int main(int ac, char **av)
 				break;
 			case defconfig:
 			case savedefconfig:
+			case applydiff:
 				defconfig_file = optarg;
 				break;
 			case randconfig:
@@ -780,6 +882,7 @@ int main(int ac, char **av)
 		exit(1);
 	}
 	conf_parse(av[optind]);
+	conf_timing("parse");
 	//zconfdump(stdout);
 
 	switch (input_mode) {
@@ -803,6 +906,7 @@ int main(int ac, char **av)
 	case yes2modconfig:
 	case mod2yesconfig:
 	case mod2noconfig:
+	case applydiff:
 	case allnoconfig:
 	case allyesconfig:
 	case allmodconfig:
@@ -813,6 +917,7 @@ int main(int ac, char **av)
 	default:
 		break;
 	}
+	conf_timing("read");
 
 	if (sync_kconfig) {
 		name = getenv("KCONFIG_NOSILENTUPDATE");
@@ -857,6 +962,18 @@ int main(int ac, char **av)
 	case mod2noconfig:
 		conf_rewrite_tristates(mod, no);
 		break;
+	case applydiff:
+		conf_diff_save();
+		if (conf_apply_diff(defconfig_file)) {
+			fprintf(stderr,
+				"***\n"
+				  "*** Can't find configuration fragment \"%s\"!\n"
+				  "***\n",
+				defconfig_file);
+			exit(1);
+		}
+		conf_diff_report();
+		break;
 	case oldaskconfig:
 		rootEntry = &rootmenu;
 		conf(&rootmenu);
@@ -876,6 +993,7 @@ int main(int ac, char **av)
 	default:
 		break;
 	}
+	conf_timing("update");
 
 	if (input_mode == savedefconfig) {
 		if (conf_write_defconfig(defconfig_file)) {
@@ -905,5 +1023,6 @@ int main(int ac, char **av)
 			return 1;
 		}
 	}
+	conf_timing("write");
 	return 0;
 }
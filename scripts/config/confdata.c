@@ -271,6 +271,7 @@ static int conf_set_sym_val(struct symbol *sym, int def, int def_flags, char *p)
 	case S_INT:
 	case S_HEX:
 		if (sym_string_valid(sym, p)) {
+			free(sym->def[def].val);
 			sym->def[def].val = xstrdup(p);
 			sym->flags |= def_flags;
 		} else {
@@ -341,6 +342,114 @@ e_out:
 	return -1;
 }
 
+/*
+ * Apply one line of a .config file to the 'def' values of its symbol.
+ * Returns the symbol that was set, or NULL if the line was skipped.
+ */
+static struct symbol *conf_read_line(char *line, int def, int def_flags,
+				     const char *warn_unknown)
+{
+	struct symbol *sym = NULL;
+	char *p, *p2;
+
+	if (line[0] == '#') {
+		if (memcmp(line + 2, CONFIG_, strlen(CONFIG_)))
+			return NULL;
+		p = strchr(line + 2 + strlen(CONFIG_), ' ');
+		if (!p)
+			return NULL;
+		*p++ = 0;
+		if (strncmp(p, "is not set", 10))
+			return NULL;
+		if (def == S_DEF_USER) {
+			sym = sym_find(line + 2 + strlen(CONFIG_));
+			if (!sym) {
+				if (warn_unknown)
+					conf_warning("unknown symbol: %s",
+						     line + 2 + strlen(CONFIG_));
+
+				conf_set_changed(true);
+				return NULL;
+			}
+		} else {
+			sym = sym_lookup(line + 2 + strlen(CONFIG_), 0);
+			if (sym->type == S_UNKNOWN)
+				sym->type = S_BOOLEAN;
+		}
+		switch (sym->type) {
+		case S_BOOLEAN:
+		case S_TRISTATE:
+			sym->def[def].tri = no;
+			sym->flags |= def_flags;
+			break;
+		default:
+			;
+		}
+	} else if (memcmp(line, CONFIG_, strlen(CONFIG_)) == 0) {
+		p = strchr(line + strlen(CONFIG_), '=');
+		if (!p)
+			return NULL;
+		*p++ = 0;
+		p2 = strchr(p, '\n');
+		if (p2) {
+			*p2-- = 0;
+			if (*p2 == '\r')
+				*p2 = 0;
+		}
+
+		sym = sym_find(line + strlen(CONFIG_));
+		if (!sym) {
+			if (def == S_DEF_AUTO) {
+				/*
+				 * Reading from include/config/auto.conf
+				 * If CONFIG_FOO previously existed in
+				 * auto.conf but it is missing now,
+				 * include/config/FOO must be touched.
+				 */
+				conf_touch_dep(line + strlen(CONFIG_));
+			} else {
+				if (warn_unknown)
+					conf_warning("unknown symbol: %s",
+						     line + strlen(CONFIG_));
+
+				conf_set_changed(true);
+			}
+			return NULL;
+		}
+
+		if (conf_set_sym_val(sym, def, def_flags, p))
+			return NULL;
+	} else {
+		if (line[0] != '\r' && line[0] != '\n')
+			conf_warning("unexpected data: %.*s",
+				     (int)strcspn(line, "\r\n"), line);
+
+		return NULL;
+	}
+
+	if (sym && sym_is_choice_value(sym)) {
+		struct symbol *cs = prop_get_symbol(sym_get_choice_prop(sym));
+		switch (sym->def[def].tri) {
+		case no:
+			break;
+		case mod:
+			if (cs->def[def].tri == yes) {
+				conf_warning("%s creates inconsistent choice state", sym->name);
+				cs->flags &= ~def_flags;
+			}
+			break;
+		case yes:
+			if (cs->def[def].tri != no)
+				conf_warning("override: %s changes choice state", sym->name);
+			cs->def[def].val = sym;
+			break;
+		}
+		cs->def[def].tri = EXPR_OR(cs->def[def].tri, sym->def[def].tri);
+	}
+
+	return sym;
+}
+
 void conf_reset(int def)
 {
 	struct symbol *sym;
@@ -371,8 +480,7 @@ int conf_read_simple(const char *name, int def)
 	FILE *in = NULL;
 	char   *line = NULL;
 	size_t  line_asize = 0;
-	char *p, *p2;
-	struct symbol *sym;
+	char *p;
 	int def_flags;
 	const char *warn_unknown;
 	const char *werror;
@@ -437,101 +545,7 @@ load:
 
 	while (compat_getline(&line, &line_asize, in) != -1) {
 		conf_lineno++;
-		sym = NULL;
-		if (line[0] == '#') {
-			if (memcmp(line + 2, CONFIG_, strlen(CONFIG_)))
-				continue;
-			p = strchr(line + 2 + strlen(CONFIG_), ' ');
-			if (!p)
-				continue;
-			*p++ = 0;
-			if (strncmp(p, "is not set", 10))
-				continue;
-			if (def == S_DEF_USER) {
-				sym = sym_find(line + 2 + strlen(CONFIG_));
-				if (!sym) {
-					if (warn_unknown)
-						conf_warning("unknown symbol: %s",
-							     line + 2 + strlen(CONFIG_));
-
-					conf_set_changed(true);
-					continue;
-				}
-			} else {
-				sym = sym_lookup(line + 2 + strlen(CONFIG_), 0);
-				if (sym->type == S_UNKNOWN)
-					sym->type = S_BOOLEAN;
-			}
-			switch (sym->type) {
-			case S_BOOLEAN:
-			case S_TRISTATE:
-				sym->def[def].tri = no;
-				sym->flags |= def_flags;
-				break;
-			default:
-				;
-			}
-		} else if (memcmp(line, CONFIG_, strlen(CONFIG_)) == 0) {
-			p = strchr(line + strlen(CONFIG_), '=');
-			if (!p)
-				continue;
-			*p++ = 0;
-			p2 = strchr(p, '\n');
-			if (p2) {
-				*p2-- = 0;
-				if (*p2 == '\r')
-					*p2 = 0;
-			}
-
-			sym = sym_find(line + strlen(CONFIG_));
-			if (!sym) {
-				if (def == S_DEF_AUTO) {
-					/*
-					 * Reading from include/config/auto.conf
-					 * If CONFIG_FOO previously existed in
-					 * auto.conf but it is missing now,
-					 * include/config/FOO must be touched.
-					 */
-					conf_touch_dep(line + strlen(CONFIG_));
-				} else {
-					if (warn_unknown)
-						conf_warning("unknown symbol: %s",
-							     line + strlen(CONFIG_));
-
-					conf_set_changed(true);
-				}
-				continue;
-			}
-
-			if (conf_set_sym_val(sym, def, def_flags, p))
-				continue;
-		} else {
-			if (line[0] != '\r' && line[0] != '\n')
-				conf_warning("unexpected data: %.*s",
-					     (int)strcspn(line, "\r\n"), line);
-
-			continue;
-		}
-
-		if (sym && sym_is_choice_value(sym)) {
-			struct symbol *cs = prop_get_symbol(sym_get_choice_prop(sym));
-			switch (sym->def[def].tri) {
-			case no:
-				break;
-			case mod:
-				if (cs->def[def].tri == yes) {
-					conf_warning("%s creates inconsistent choice state", sym->name);
-					cs->flags &= ~def_flags;
-				}
-				break;
-			case yes:
-				if (cs->def[def].tri != no)
-					conf_warning("override: %s changes choice state", sym->name);
-				cs->def[def].val = sym;
-				break;
-			}
-			cs->def[def].tri = EXPR_OR(cs->def[def].tri, sym->def[def].tri);
-		}
+		conf_read_line(line, def, def_flags, warn_unknown);
 	}
 	free(line);
 	fclose(in);
@@ -612,6 +626,76 @@ int conf_read(const char *name)
 	return 0;
 }
 
+/*
+ * Apply the symbol values from 'name', typically a diffconfig fragment, on
+ * top of the configuration that has been read already. Unlike
+ * conf_read_simple() the other user values are kept, and only the symbols
+ * depending on the ones set are calculated again.
+ */
+int conf_apply_diff(const char *name)
+{
+	FILE *in;
+	char *line = NULL;
+	size_t line_asize = 0;
+	struct symbol *sym, *cs, **strs = NULL;
+	int i, nstrs = 0;
+	const char *warn_unknown;
+
+	in = zconf_fopen(name);
+	if (!in)
+		return 1;
+
+	warn_unknown = getenv("KCONFIG_WARN_UNKNOWN_SYMBOLS");
+	conf_filename = name;
+	conf_lineno = 0;
+	conf_warnings = 0;
+
+	while (compat_getline(&line, &line_asize, in) != -1) {
+		conf_lineno++;
+		sym = conf_read_line(line, S_DEF_USER, SYMBOL_DEF_USER,
+				     warn_unknown);
+		if (!sym)
+			continue;
+
+		sym_clear_valid(sym);
+		if (sym_is_choice_value(sym)) {
+			cs = prop_get_symbol(sym_get_choice_prop(sym));
+			sym_clear_valid(cs);
+		}
+
+		switch (sym->type) {
+		case S_STRING:
+		case S_INT:
+		case S_HEX:
+			strs = xrealloc(strs, (nstrs + 1) * sizeof(*strs));
+			strs[nstrs++] = sym;
+			break;
+		default:
+			break;
+		}
+	}
+	free(line);
+	fclose(in);
+
+	/* drop values out of range, once all the limits have been applied */
+	for (i = 0; i < nstrs; i++) {
+		sym = strs[i];
+		if (!(sym->flags & SYMBOL_DEF_USER) ||
+		    sym_string_within_range(sym, sym->def[S_DEF_USER].val))
+			continue;
+		sym->flags &= ~SYMBOL_DEF_USER;
+		sym_clear_valid(sym);
+	}
+	free(strs);
+
+	if (conf_warnings)
+		conf_set_changed(true);
+	if (conf_warnings && getenv("KCONFIG_WERROR"))
+		exit(1);
+
+	return 0;
+}
+
 struct comment_style {
 	const char *decoration;
 	const char *prefix;
@@ -92,8 +92,9 @@ struct symbol {
 
 	/*
 	 * The calculated value of the symbol. The SYMBOL_VALID bit is set in
-	 * 'flags' when this is up to date. Note that this value might differ
-	 * from the user value set in e.g. a .config file, due to visibility.
+	 * 'flags' (and 'valid_gen' matches) when this is up to date. Note that
+	 * this value might differ from the user value set in e.g. a .config
+	 * file, due to visibility.
 	 */
 	struct symbol_value curr;
 
@@ -129,9 +130,22 @@ struct symbol {
 	 * "Weak" reverse dependencies through being implied by other symbols
 	 */
 	struct expr_value implied;
+
+	/*
+	 * Symbols whose value is calculated from this one. Used to only
+	 * invalidate the affected symbols when a value changes.
+	 */
+	struct symbol **rdeps;
+	int rdeps_count, rdeps_size;
+
+	/* Generation the calculated value is valid for, see sym_is_valid() */
+	unsigned int valid_gen;
+
+	/* Marker used while walking the dependency graph */
+	unsigned int walk_gen;
 };
 
-#define for_all_symbols(i, sym) for (i = 0; i < SYMBOL_HASHSIZE; i++) for (sym = symbol_hash[i]; sym; sym = sym->next)
+#define for_all_symbols(i, sym) for (i = 0; i < symbol_hash_size; i++) for (sym = symbol_hash[i]; sym; sym = sym->next)
 
 #define SYMBOL_CONST      0x0001  /* symbol is const */
 #define SYMBOL_CHECK      0x0008  /* used during dependency checking */
@@ -157,7 +171,7 @@ struct symbol {
 #define SYMBOL_NEED_SET_CHOICE_VALUES  0x100000
 
 #define SYMBOL_MAXLENGTH	256
-#define SYMBOL_HASHSIZE		9973
+#define SYMBOL_HASHSIZE_MIN	1024	/* must be a power of 2 */
 
 /* A property represent the config options that can be associated
  * with a config "symbol".
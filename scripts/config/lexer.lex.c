@@ -4129,6 +4129,8 @@ void zconf_nextfile(const char *name)
 	int i;
 	char path[PATH_MAX], *p;
 
+	conf_cache_add_source(name, current_file->name);
+
 	err = glob(name, GLOB_ERR | GLOB_MARK, NULL, &gl);
 
 	/* ignore wildcard patterns that return no result */
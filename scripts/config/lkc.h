@@ -40,6 +40,13 @@ int zconf_lineno(void);
 const char *zconf_curname(void);
 extern int recursive_is_error;
 
+/* cache.c */
+bool conf_cache_load(const char *name);
+void conf_cache_save(const char *name);
+void conf_cache_add_env(const char *name, const char *value);
+void conf_cache_add_shell(const char *cmd, const char *output);
+void conf_cache_add_source(const char *name, const char *curname);
+
 /* confdata.c */
 const char *conf_get_configname(void);
 void set_all_choice_values(struct symbol *csym);
@@ -60,6 +67,7 @@ void *xcalloc(size_t nmemb, size_t size);
 void *xrealloc(void *p, size_t size);
 char *xstrdup(const char *s);
 char *xstrndup(const char *s, size_t n);
+void conf_timing(const char *phase);
 
 /* lexer.l */
 int yylex(void);
@@ -109,12 +117,23 @@ void menu_get_ext_help(struct menu *menu, struct gstr *help);
 
 /* symbol.c */
 void sym_clear_all_valid(void);
+void sym_clear_valid(struct symbol *sym);
+void sym_hash_restore(struct symbol *syms, int count, int size);
 struct symbol *sym_choice_default(struct symbol *sym);
 struct property *sym_get_range_prop(struct symbol *sym);
 const char *sym_get_string_default(struct symbol *sym);
 struct symbol *sym_check_deps(struct symbol *sym);
 struct symbol *prop_get_symbol(struct property *prop);
 
+extern unsigned int sym_valid_gen;
+
+static inline bool sym_is_valid(struct symbol *sym)
+{
+	if (!(sym->flags & SYMBOL_VALID))
+		return false;
+	return (sym->flags & SYMBOL_CONST) || sym->valid_gen == sym_valid_gen;
+}
+
 static inline tristate sym_get_tristate_value(struct symbol *sym)
 {
 	return sym->curr.tri;
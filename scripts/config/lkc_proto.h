@@ -5,6 +5,7 @@
 void conf_parse(const char *name);
 int conf_read(const char *name);
 int conf_read_simple(const char *name, int);
+int conf_apply_diff(const char *name);
 void conf_reset(int def);
 int conf_write_defconfig(const char *name);
 int conf_write(const char *name);
@@ -15,7 +16,8 @@ void conf_set_changed_callback(void (*fn)(void));
 void conf_set_message_callback(void (*fn)(const char *s));
 
 /* symbol.c */
-extern struct symbol * symbol_hash[SYMBOL_HASHSIZE];
+extern struct symbol **symbol_hash;
+extern int symbol_hash_size;
 
 struct symbol * sym_lookup(const char *name, int flags);
 struct symbol * sym_find(const char *name);
@@ -42,12 +44,14 @@ enum variable_flavor {
 	VAR_RECURSIVE,
 	VAR_APPEND,
 };
+void env_add(const char *name, const char *value);
 void env_write_dep(FILE *f, const char *auto_conf_name);
 void variable_add(const char *name, const char *value,
 		  enum variable_flavor flavor);
 void variable_all_del(void);
 char *expand_dollar(const char **str);
 char *expand_one_token(const char **str);
+char *shell_output(const char *cmd);
 
 /* expr.c */
 void expr_print(struct expr *e, void (*fn)(void *, struct symbol *, const char *), void *data, int prevtoken);
@@ -987,6 +987,7 @@ static int handle_exit(void)
 
 	switch (res) {
 	case 0:
+		conf_timing(NULL);
 		if (conf_write(filename)) {
 			fprintf(stderr, "\n\n"
 					  "Error while writing of the configuration.\n"
@@ -995,6 +996,7 @@ static int handle_exit(void)
 			return 1;
 		}
 		conf_write_autoconf(0);
+		conf_timing("write");
 		/* fall through */
 	case -1:
 		if (!silent)
@@ -1027,6 +1029,7 @@ int main(int ac, char **av)
 	int res;
 
 	signal(SIGINT, sig_handler);
+	conf_timing(NULL);
 
 	if (ac > 1 && strcmp(av[1], "-s") == 0) {
 		silent = 1;
@@ -1035,7 +1038,9 @@ int main(int ac, char **av)
 		av++;
 	}
 	conf_parse(av[1]);
+	conf_timing("parse");
 	conf_read(NULL);
+	conf_timing("read");
 
 	mode = getenv("MENUCONFIG_MODE");
 	if (mode) {
@@ -92,8 +92,6 @@ static void zconf_error(const char *err, ...);
 static bool zconf_endtoken(const char *tokenname,
 			   const char *expected_tokenname);
 
-struct symbol *symbol_hash[SYMBOL_HASHSIZE];
-
 struct menu *current_menu, *current_entry;
 
 
@@ -612,17 +610,17 @@ static const yytype_int8 yytranslate[] =
 /* YYRLINE[YYN] -- Source line where rule number YYN was defined.  */
 static const yytype_int16 yyrline[] =
 {
-       0,   110,   110,   110,   114,   119,   121,   122,   123,   124,
-     125,   126,   127,   128,   129,   130,   133,   135,   136,   137,
-     138,   143,   150,   155,   162,   171,   173,   174,   175,   178,
-     186,   192,   202,   208,   214,   220,   230,   240,   245,   253,
-     256,   258,   259,   260,   263,   269,   276,   282,   287,   295,
-     296,   297,   298,   301,   302,   305,   306,   307,   311,   319,
-     327,   330,   335,   342,   347,   355,   358,   360,   361,   364,
-     373,   380,   383,   385,   390,   396,   408,   415,   422,   424,
-     429,   430,   431,   434,   435,   438,   439,   440,   441,   442,
-     443,   444,   445,   446,   447,   448,   452,   454,   455,   458,
-     459,   463,   466,   467,   468,   472,   473
+       0,   108,   108,   108,   112,   117,   119,   120,   121,   122,
+     123,   124,   125,   126,   127,   128,   131,   133,   134,   135,
+     136,   141,   148,   153,   160,   169,   171,   172,   173,   176,
+     184,   190,   200,   206,   212,   218,   228,   238,   243,   251,
+     254,   256,   257,   258,   261,   267,   274,   280,   285,   293,
+     294,   295,   296,   299,   300,   303,   304,   305,   309,   317,
+     325,   328,   333,   340,   345,   353,   356,   358,   359,   362,
+     371,   378,   381,   383,   388,   394,   406,   413,   420,   422,
+     427,   428,   429,   432,   433,   436,   437,   438,   439,   440,
+     441,   442,   443,   444,   445,   446,   450,   452,   453,   456,
+     457,   461,   464,   465,   466,   470,   471
 };
 #endif
 
@@ -1938,6 +1936,11 @@ void conf_parse(const char *name)
 	struct symbol *sym;
 	int i;
 
+	if (conf_cache_load(name)) {
+		conf_set_changed(true);
+		return;
+	}
+
 	zconf_initscan(name);
 
 	_menu_init();
@@ -1968,6 +1971,7 @@ void conf_parse(const char *name)
 	}
 	if (yynerrs)
 		exit(1);
+	conf_cache_save(name);
 	conf_set_changed(true);
 }
 
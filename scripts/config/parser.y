@@ -27,8 +27,6 @@ static void zconf_error(const char *err, ...);
 static bool zconf_endtoken(const char *tokenname,
 			   const char *expected_tokenname);
 
-struct symbol *symbol_hash[SYMBOL_HASHSIZE];
-
 struct menu *current_menu, *current_entry;
 
 %}
@@ -480,6 +478,11 @@ void conf_parse(const char *name)
 	struct symbol *sym;
 	int i;
 
+	if (conf_cache_load(name)) {
+		conf_set_changed(true);
+		return;
+	}
+
 	zconf_initscan(name);
 
 	_menu_init();
@@ -510,6 +513,7 @@ void conf_parse(const char *name)
 	}
 	if (yynerrs)
 		exit(1);
+	conf_cache_save(name);
 	conf_set_changed(true);
 }
 
@@ -35,10 +35,24 @@ static struct symbol symbol_empty = {
 	.flags = SYMBOL_VALID,
 };
 
+struct symbol **symbol_hash;
+int symbol_hash_size;
+static int symbol_count;
+
 struct symbol *modules_sym;
 static tristate modules_val;
 int recursive_is_error;
 
+/*
+ * Calculated values are only valid for the current generation, bumping it
+ * invalidates all symbols at once.
+ */
+unsigned int sym_valid_gen;
+
+/* set once the reverse dependencies of all symbols are known */
+static bool sym_rdeps_valid;
+static unsigned int sym_walk_gen;
+
 enum symbol_type sym_get_type(struct symbol *sym)
 {
 	enum symbol_type type = sym->type;
@@ -308,7 +322,7 @@ void sym_calc_value(struct symbol *sym)
 	if (!sym)
 		return;
 
-	if (sym->flags & SYMBOL_VALID)
+	if (sym_is_valid(sym))
 		return;
 
 	if (sym_is_choice_value(sym) &&
@@ -319,6 +333,7 @@ void sym_calc_value(struct symbol *sym)
 	}
 
 	sym->flags |= SYMBOL_VALID;
+	sym->valid_gen = sym_valid_gen;
 
 	oldval = sym->curr;
 
@@ -444,14 +459,136 @@ void sym_calc_value(struct symbol *sym)
 }
 
 void sym_clear_all_valid(void)
+{
+	sym_valid_gen++;
+	conf_set_changed(true);
+	sym_calc_value(modules_sym);
+}
+
+static void sym_add_rdep(struct symbol *sym, struct symbol *dep)
+{
+	if (!dep || dep == sym || dep->flags & SYMBOL_CONST)
+		return;
+	if (dep->walk_gen == sym_walk_gen)
+		return;
+	dep->walk_gen = sym_walk_gen;
+
+	if (dep->rdeps_count == dep->rdeps_size) {
+		dep->rdeps_size = dep->rdeps_size ? dep->rdeps_size * 2 : 4;
+		dep->rdeps = xrealloc(dep->rdeps,
+				      dep->rdeps_size * sizeof(*dep->rdeps));
+	}
+	dep->rdeps[dep->rdeps_count++] = sym;
+}
+
+static void sym_add_expr_rdeps(struct symbol *sym, struct expr *e)
+{
+	if (!e)
+		return;
+
+	switch (e->type) {
+	case E_OR:
+	case E_AND:
+		sym_add_expr_rdeps(sym, e->left.expr);
+		sym_add_expr_rdeps(sym, e->right.expr);
+		break;
+	case E_NOT:
+		sym_add_expr_rdeps(sym, e->left.expr);
+		break;
+	case E_SYMBOL:
+		sym_add_rdep(sym, e->left.sym);
+		break;
+	case E_LIST:
+		sym_add_rdep(sym, e->right.sym);
+		sym_add_expr_rdeps(sym, e->left.expr);
+		break;
+	case E_EQUAL:
+	case E_GEQ:
+	case E_GTH:
+	case E_LEQ:
+	case E_LTH:
+	case E_UNEQUAL:
+	case E_RANGE:
+		sym_add_rdep(sym, e->left.sym);
+		sym_add_rdep(sym, e->right.sym);
+		break;
+	default:
+		break;
+	}
+}
+
+/*
+ * Record for every symbol which other symbols are calculated from it, based
+ * on all expressions sym_calc_value() may evaluate. This is only built when
+ * a user value is changed for the first time, modes that only read and
+ * write a configuration never need it.
+ */
+static void sym_calc_rdeps(void)
 {
 	struct symbol *sym;
+	struct property *prop;
 	int i;
 
-	for_all_symbols(i, sym)
-		sym->flags &= ~SYMBOL_VALID;
+	for_all_symbols(i, sym) {
+		sym_walk_gen++;
+		sym_add_expr_rdeps(sym, sym->dir_dep.expr);
+		sym_add_expr_rdeps(sym, sym->rev_dep.expr);
+		sym_add_expr_rdeps(sym, sym->implied.expr);
+		for (prop = sym->prop; prop; prop = prop->next) {
+			sym_add_expr_rdeps(sym, prop->expr);
+			sym_add_expr_rdeps(sym, prop->visible.expr);
+		}
+	}
+	sym_rdeps_valid = true;
+}
+
+static bool sym_clear_valid_rdeps(struct symbol *sym, int *budget)
+{
+	int i;
+
+	if (sym->walk_gen == sym_walk_gen)
+		return true;
+	if (--*budget < 0)
+		return false;
+
+	sym->walk_gen = sym_walk_gen;
+	sym->flags &= ~SYMBOL_VALID;
+
+	for (i = 0; i < sym->rdeps_count; i++) {
+		if (!sym_clear_valid_rdeps(sym->rdeps[i], budget))
+			return false;
+	}
+
+	return true;
+}
+
+/*
+ * Invalidate the value of a symbol after its user value changed, along with
+ * everything that (indirectly) depends on it. If that turns out to be a large
+ * part of the tree, invalidating everything is cheaper. Anything touching the
+ * modules symbol changes the type of every tristate, so that needs a full
+ * update as well.
+ */
+void sym_clear_valid(struct symbol *sym)
+{
+	int budget = symbol_count / 8;
+
+	if (!sym_rdeps_valid)
+		sym_calc_rdeps();
+
+	if (sym == modules_sym) {
+		sym_clear_all_valid();
+		return;
+	}
+
+	sym_walk_gen++;
+	if (!sym_clear_valid_rdeps(sym, &budget) ||
+	    (modules_sym && !sym_is_valid(modules_sym))) {
+		sym_clear_all_valid();
+		return;
+	}
+
 	conf_set_changed(true);
-	sym_calc_value(modules_sym);
 }
 
 bool sym_tristate_within_range(struct symbol *sym, tristate val)
@@ -504,7 +641,7 @@ bool sym_set_tristate_value(struct symbol *sym, tristate val)
 
 	sym->def[S_DEF_USER].tri = val;
 	if (oldval != val)
-		sym_clear_all_valid();
+		sym_clear_valid(sym);
 
 	return true;
 }
@@ -661,7 +798,7 @@ bool sym_set_string_value(struct symbol *sym, const char *newval)
 
 	strcpy(val, newval);
 	free((void *)oldval);
-	sym_clear_all_valid();
+	sym_clear_valid(sym);
 
 	return true;
 }
@@ -781,12 +918,60 @@ static unsigned strhash(const char *s)
 	return hash;
 }
 
+static void sym_hash_resize(void)
+{
+	struct symbol **old_hash = symbol_hash;
+	struct symbol *sym, *next;
+	int old_size = symbol_hash_size;
+	int i, hash;
+
+	symbol_hash_size = old_size ? old_size * 2 : SYMBOL_HASHSIZE_MIN;
+	symbol_hash = xcalloc(symbol_hash_size, sizeof(*symbol_hash));
+
+	for (i = 0; i < old_size; i++) {
+		for (sym = old_hash[i]; sym; sym = next) {
+			next = sym->next;
+			hash = sym->name ?
+			       strhash(sym->name) & (symbol_hash_size - 1) : 0;
+			sym->next = symbol_hash[hash];
+			symbol_hash[hash] = sym;
+		}
+	}
+
+	free(old_hash);
+}
+
+/*
+ * Rebuild the hash table from symbols loaded from the parse cache, in the
+ * order they were saved in, so iterating over them gives the same order.
+ */
+void sym_hash_restore(struct symbol *syms, int count, int size)
+{
+	struct symbol *sym;
+	int i, hash;
+
+	free(symbol_hash);
+	symbol_hash_size = size;
+	symbol_hash = xcalloc(symbol_hash_size, sizeof(*symbol_hash));
+
+	for (i = count - 1; i >= 0; i--) {
+		sym = &syms[i];
+		hash = sym->name ? strhash(sym->name) & (size - 1) : 0;
+		sym->next = symbol_hash[hash];
+		symbol_hash[hash] = sym;
+	}
+	symbol_count = count;
+}
+
 struct symbol *sym_lookup(const char *name, int flags)
 {
 	struct symbol *symbol;
 	char *new_name;
 	int hash;
 
+	if (symbol_count >= symbol_hash_size)
+		sym_hash_resize();
+
 	if (name) {
 		if (name[0] && !name[1]) {
 			switch (name[0]) {
@@ -795,7 +980,7 @@ struct symbol *sym_lookup(const char *name, int flags)
 			case 'n': return &symbol_no;
 			}
 		}
-		hash = strhash(name) % SYMBOL_HASHSIZE;
+		hash = strhash(name) & (symbol_hash_size - 1);
 
 		for (symbol = symbol_hash[hash]; symbol; symbol = symbol->next) {
 			if (symbol->name &&
@@ -818,6 +1003,7 @@ struct symbol *sym_lookup(const char *name, int flags)
 
 	symbol->next = symbol_hash[hash];
 	symbol_hash[hash] = symbol;
+	symbol_count++;
 
 	return symbol;
 }
@@ -837,7 +1023,10 @@ struct symbol *sym_find(const char *name)
 		case 'n': return &symbol_no;
 		}
 	}
-	hash = strhash(name) % SYMBOL_HASHSIZE;
+	if (!symbol_hash_size)
+		return NULL;
+
+	hash = strhash(name) & (symbol_hash_size - 1);
 
 	for (symbol = symbol_hash[hash]; symbol; symbol = symbol->next) {
 		if (symbol->name &&
@@ -7,6 +7,7 @@
 #include <stdarg.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include "lkc.h"
 
 /* file already present in list? If not add it */
@@ -127,3 +128,26 @@ char *xstrndup(const char *s, size_t n)
 	fprintf(stderr, "Out of memory.\n");
 	exit(1);
 }
+
+/*
+ * If KCONFIG_TIMING is set, print the time spent since the previous call.
+ * Passing NULL only starts the clock.
+ */
+void conf_timing(const char *phase)
+{
+	static struct timespec last;
+	static int enabled = -1;
+	struct timespec now;
+
+	if (enabled < 0)
+		enabled = getenv("KCONFIG_TIMING") != NULL;
+	if (!enabled)
+		return;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	if (phase)
+		fprintf(stderr, "kconfig: %-10s %8.3f ms\n", phase,
+			(now.tv_sec - last.tv_sec) * 1000.0 +
+			(now.tv_nsec - last.tv_nsec) / 1000000.0);
+	last = now;
+}
@@ -85,11 +85,16 @@
 #include <sys/endian.h>
 #endif
 
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <stdint.h>
 #include <stdbool.h>
 #include <unistd.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 
 #define ARRAY_SIZE(_n) (sizeof(_n) / sizeof((_n)[0]))
@@ -674,71 +679,458 @@ SHA256_Final(unsigned char digest[static SHA256_DIGEST_LENGTH], SHA256_CTX *ctx)
 	memset(ctx, 0, sizeof(*ctx));
 }
 
-static void *hash_buf(FILE *f, int *len)
+/*
+ * xxHash64, a fast non-cryptographic hash. Only meant for internal
+ * change detection (stamp files), never for verifying downloads.
+ */
+#define XXH64_DIGEST_LENGTH	8
+
+#define XXH_PRIME64_1	0x9E3779B185EBCA87ULL
+#define XXH_PRIME64_2	0xC2B2AE3D27D4EB4FULL
+#define XXH_PRIME64_3	0x165667B19E3779F9ULL
+#define XXH_PRIME64_4	0x85EBCA77C2B2AE63ULL
+#define XXH_PRIME64_5	0x27D4EB2F165667C5ULL
+
+typedef struct XXH64_CTX {
+	uint64_t total_len;
+	uint64_t v[4];
+	unsigned char mem[32];
+	unsigned int memsize;
+} XXH64_CTX;
+
+static inline uint64_t
+xxh64_rotl(uint64_t x, int r)
 {
-	static char buf[1024];
+	return (x << r) | (x >> (64 - r));
+}
 
-	*len = fread(buf, 1, sizeof(buf), f);
+static inline uint64_t
+xxh64_read64(const void *p)
+{
+	uint64_t v;
 
-	return *len > 0 ? buf : NULL;
+	memcpy(&v, p, sizeof(v));
+	return le64toh(v);
 }
 
-static char *hash_string(unsigned char *buf, int len)
+static inline uint32_t
+xxh64_read32(const void *p)
 {
-	static char str[SHA256_DIGEST_LENGTH * 2 + 1];
-	int i;
+	uint32_t v;
 
-	if (len * 2 + 1 > sizeof(str))
-		return NULL;
+	memcpy(&v, p, sizeof(v));
+	return le32toh(v);
+}
 
-	for (i = 0; i < len; i++)
-		sprintf(&str[i * 2], "%02x", buf[i]);
+static inline uint64_t
+xxh64_round(uint64_t acc, uint64_t input)
+{
+	acc += input * XXH_PRIME64_2;
+	acc = xxh64_rotl(acc, 31);
+	return acc * XXH_PRIME64_1;
+}
 
-	return str;
+static inline uint64_t
+xxh64_merge_round(uint64_t acc, uint64_t val)
+{
+	acc ^= xxh64_round(0, val);
+	return acc * XXH_PRIME64_1 + XXH_PRIME64_4;
 }
 
-static const char *md5_hash(FILE *f)
+static void
+XXH64_Init(XXH64_CTX *ctx)
 {
-	MD5_CTX ctx;
-	unsigned char val[MD5_DIGEST_LENGTH];
-	void *buf;
-	int len;
+	memset(ctx, 0, sizeof(*ctx));
+	ctx->v[0] = XXH_PRIME64_1 + XXH_PRIME64_2;
+	ctx->v[1] = XXH_PRIME64_2;
+	ctx->v[2] = 0;
+	ctx->v[3] = -XXH_PRIME64_1;
+}
+
+static const unsigned char *
+XXH64_body(XXH64_CTX *ctx, const unsigned char *p, size_t len)
+{
+	uint64_t v0 = ctx->v[0], v1 = ctx->v[1];
+	uint64_t v2 = ctx->v[2], v3 = ctx->v[3];
+
+	while (len >= 32) {
+		v0 = xxh64_round(v0, xxh64_read64(p));
+		v1 = xxh64_round(v1, xxh64_read64(p + 8));
+		v2 = xxh64_round(v2, xxh64_read64(p + 16));
+		v3 = xxh64_round(v3, xxh64_read64(p + 24));
+		p += 32;
+		len -= 32;
+	}
 
-	MD5_begin(&ctx);
-	while ((buf = hash_buf(f, &len)) != NULL)
-		MD5_hash(buf, len, &ctx);
-	MD5_end(val, &ctx);
+	ctx->v[0] = v0;
+	ctx->v[1] = v1;
+	ctx->v[2] = v2;
+	ctx->v[3] = v3;
 
-	return hash_string(val, MD5_DIGEST_LENGTH);
+	return p;
 }
 
-static const char *sha256_hash(FILE *f)
+static void
+XXH64_Update(XXH64_CTX *ctx, const void *in, size_t len)
 {
-	SHA256_CTX ctx;
-	unsigned char val[SHA256_DIGEST_LENGTH];
-	void *buf;
-	int len;
+	const unsigned char *src = in;
+	size_t fill;
+
+	ctx->total_len += len;
+
+	if (ctx->memsize + len < 32) {
+		memcpy(&ctx->mem[ctx->memsize], src, len);
+		ctx->memsize += len;
+		return;
+	}
+
+	if (ctx->memsize) {
+		fill = 32 - ctx->memsize;
+		memcpy(&ctx->mem[ctx->memsize], src, fill);
+		XXH64_body(ctx, ctx->mem, 32);
+		src += fill;
+		len -= fill;
+		ctx->memsize = 0;
+	}
+
+	src = XXH64_body(ctx, src, len & ~(size_t)31);
+	len &= 31;
+
+	memcpy(ctx->mem, src, len);
+	ctx->memsize = len;
+}
+
+static void
+XXH64_Final(unsigned char digest[static XXH64_DIGEST_LENGTH], XXH64_CTX *ctx)
+{
+	const unsigned char *p = ctx->mem;
+	unsigned int rem = ctx->memsize;
+	uint64_t h;
+
+	if (ctx->total_len >= 32) {
+		h = xxh64_rotl(ctx->v[0], 1) + xxh64_rotl(ctx->v[1], 7) +
+		    xxh64_rotl(ctx->v[2], 12) + xxh64_rotl(ctx->v[3], 18);
+		h = xxh64_merge_round(h, ctx->v[0]);
+		h = xxh64_merge_round(h, ctx->v[1]);
+		h = xxh64_merge_round(h, ctx->v[2]);
+		h = xxh64_merge_round(h, ctx->v[3]);
+	} else {
+		h = ctx->v[2] + XXH_PRIME64_5;
+	}
+
+	h += ctx->total_len;
+
+	for (; rem >= 8; p += 8, rem -= 8) {
+		h ^= xxh64_round(0, xxh64_read64(p));
+		h = xxh64_rotl(h, 27) * XXH_PRIME64_1 + XXH_PRIME64_4;
+	}
+
+	if (rem >= 4) {
+		h ^= (uint64_t)xxh64_read32(p) * XXH_PRIME64_1;
+		h = xxh64_rotl(h, 23) * XXH_PRIME64_2 + XXH_PRIME64_3;
+		p += 4;
+		rem -= 4;
+	}
+
+	for (; rem; p++, rem--) {
+		h ^= *p * XXH_PRIME64_5;
+		h = xxh64_rotl(h, 11) * XXH_PRIME64_1;
+	}
+
+	h ^= h >> 33;
+	h *= XXH_PRIME64_2;
+	h ^= h >> 29;
+	h *= XXH_PRIME64_3;
+	h ^= h >> 32;
+
+	/* canonical (big endian) representation, same as xxhsum */
+	be64enc(digest, h);
+
+	memset(ctx, 0, sizeof(*ctx));
+}
+
 
-	SHA256_Init(&ctx);
-	while ((buf = hash_buf(f, &len)) != NULL)
-		SHA256_Update(&ctx, buf, len);
-	SHA256_Final(val, &ctx);
+#define HASH_BUF_SIZE		(256 * 1024)
+#define HASH_MAX_LENGTH		SHA256_DIGEST_LENGTH
+#define HASH_MAX_THREADS	16
 
-	return hash_string(val, SHA256_DIGEST_LENGTH);
+union hash_ctx {
+	MD5_CTX md5;
+	SHA256_CTX sha256;
+	XXH64_CTX xxh64;
+};
+
+static void md5_init(union hash_ctx *ctx)
+{
+	MD5_begin(&ctx->md5);
+}
+
+static void md5_update(union hash_ctx *ctx, const void *data, size_t len)
+{
+	MD5_hash(data, len, &ctx->md5);
+}
+
+static void md5_final(union hash_ctx *ctx, unsigned char *val)
+{
+	MD5_end(val, &ctx->md5);
+}
+
+static void sha256_init(union hash_ctx *ctx)
+{
+	SHA256_Init(&ctx->sha256);
+}
+
+static void sha256_update(union hash_ctx *ctx, const void *data, size_t len)
+{
+	SHA256_Update(&ctx->sha256, data, len);
+}
+
+static void sha256_final(union hash_ctx *ctx, unsigned char *val)
+{
+	SHA256_Final(val, &ctx->sha256);
+}
+
+static void xxh64_init(union hash_ctx *ctx)
+{
+	XXH64_Init(&ctx->xxh64);
+}
+
+static void xxh64_update(union hash_ctx *ctx, const void *data, size_t len)
+{
+	XXH64_Update(&ctx->xxh64, data, len);
+}
+
+static void xxh64_final(union hash_ctx *ctx, unsigned char *val)
+{
+	XXH64_Final(val, &ctx->xxh64);
 }
 
 
 struct hash_type {
 	const char *name;
-	const char *(*func)(FILE *f);
+	void (*init)(union hash_ctx *ctx);
+	void (*update)(union hash_ctx *ctx, const void *data, size_t len);
+	void (*final)(union hash_ctx *ctx, unsigned char *val);
 	int len;
 };
 
 struct hash_type types[] = {
-	{ "md5", md5_hash, MD5_DIGEST_LENGTH },
-	{ "sha256", sha256_hash, SHA256_DIGEST_LENGTH },
+	{ "md5", md5_init, md5_update, md5_final, MD5_DIGEST_LENGTH },
+	{ "sha256", sha256_init, sha256_update, sha256_final, SHA256_DIGEST_LENGTH },
+	{ "xxh64", xxh64_init, xxh64_update, xxh64_final, XXH64_DIGEST_LENGTH },
+};
+
+enum hash_status {
+	HASH_OK,
+	HASH_ERR_ISDIR,
+	HASH_ERR_OPEN,
+	HASH_ERR_HASH,
+};
+
+struct hash_job {
+	const char *filename;
+	enum hash_status status;
+	char str[HASH_MAX_LENGTH * 2 + 1];
+};
+
+
+static void hash_string(unsigned char *buf, int len, char *str)
+{
+	static const char hex[] = "0123456789abcdef";
+	int i;
+
+	for (i = 0; i < len; i++) {
+		str[i * 2] = hex[buf[i] >> 4];
+		str[i * 2 + 1] = hex[buf[i] & 0xf];
+	}
+	str[len * 2] = 0;
+}
+
+/*
+ * Regular files are mapped and hashed in one go, everything else (pipes,
+ * stdin, or files that cannot be mapped) is read in large chunks.
+ */
+static int hash_fd(struct hash_type *t, int fd, char *str)
+{
+	unsigned char val[HASH_MAX_LENGTH];
+	union hash_ctx ctx;
+	struct stat st;
+	ssize_t len;
+	void *buf;
+
+	t->init(&ctx);
+
+	if (!fstat(fd, &st) && S_ISREG(st.st_mode) && st.st_size > 0 &&
+	    (uint64_t)st.st_size <= SIZE_MAX && !lseek(fd, 0, SEEK_CUR)) {
+		buf = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (buf != MAP_FAILED) {
+#ifdef MADV_SEQUENTIAL
+			madvise(buf, st.st_size, MADV_SEQUENTIAL);
+#endif
+			t->update(&ctx, buf, st.st_size);
+			munmap(buf, st.st_size);
+			goto out;
+		}
+	}
+
+	buf = malloc(HASH_BUF_SIZE);
+	if (!buf)
+		return -1;
+
+	while ((len = read(fd, buf, HASH_BUF_SIZE)) != 0) {
+		if (len < 0) {
+			if (errno == EINTR)
+				continue;
+			free(buf);
+			return -1;
+		}
+		t->update(&ctx, buf, len);
+	}
+	free(buf);
+
+out:
+	t->final(&ctx, val);
+	hash_string(val, t->len, str);
+	return 0;
+}
+
+static void hash_job_run(struct hash_type *t, struct hash_job *job)
+{
+	const char *filename = job->filename;
+	struct stat path_stat;
+	int fd;
+
+	if (!filename || !strcmp(filename, "-")) {
+		fd = STDIN_FILENO;
+	} else {
+		if (!stat(filename, &path_stat) && S_ISDIR(path_stat.st_mode)) {
+			job->status = HASH_ERR_ISDIR;
+			return;
+		}
+
+		fd = open(filename, O_RDONLY);
+		if (fd < 0) {
+			job->status = HASH_ERR_OPEN;
+			return;
+		}
+	}
+
+	job->status = hash_fd(t, fd, job->str) ? HASH_ERR_HASH : HASH_OK;
+
+	if (fd != STDIN_FILENO)
+		close(fd);
+}
+
+static int hash_job_print(struct hash_job *job, bool add_filename,
+	bool no_newline)
+{
+	const char *filename = job->filename;
+
+	switch (job->status) {
+	case HASH_OK:
+		break;
+	case HASH_ERR_ISDIR:
+		fprintf(stderr, "Failed to open '%s': Is a directory\n", filename);
+		return 1;
+	case HASH_ERR_OPEN:
+		fprintf(stderr, "Failed to open '%s'\n", filename);
+		return 1;
+	case HASH_ERR_HASH:
+		fprintf(stderr, "Failed to generate hash\n");
+		return 1;
+	}
+
+	if (add_filename)
+		printf("%s %s%s", job->str, filename ? filename : "-",
+			no_newline ? "" : "\n");
+	else
+		printf("%s%s", job->str, no_newline ? "" : "\n");
+	return 0;
+}
+
+
+struct hash_queue {
+	pthread_mutex_t lock;
+	struct hash_type *t;
+	struct hash_job *jobs;
+	int n_jobs;
+	int next;
 };
 
+static void *hash_worker(void *arg)
+{
+	struct hash_queue *q = arg;
+	int i;
+
+	for (;;) {
+		pthread_mutex_lock(&q->lock);
+		i = q->next++;
+		pthread_mutex_unlock(&q->lock);
+
+		if (i >= q->n_jobs)
+			break;
+
+		hash_job_run(q->t, &q->jobs[i]);
+	}
+
+	return NULL;
+}
+
+/*
+ * Hash all files on a small pool of worker threads, then print the results
+ * in command line order. As before, output stops at the first failing file.
+ */
+static int hash_files(struct hash_type *t, char **files, int n_files,
+	bool add_filename, bool no_newline)
+{
+	pthread_t threads[HASH_MAX_THREADS];
+	struct hash_queue q = {
+		.lock = PTHREAD_MUTEX_INITIALIZER,
+		.t = t,
+		.n_jobs = n_files,
+	};
+	long n_threads = 1;
+	int i, n_started = 0, ret = 0;
+
+	q.jobs = calloc(n_files, sizeof(*q.jobs));
+	if (!q.jobs) {
+		fprintf(stderr, "Out of memory\n");
+		return 1;
+	}
+
+	for (i = 0; i < n_files; i++)
+		q.jobs[i].filename = files[i];
+
+#ifdef _SC_NPROCESSORS_ONLN
+	n_threads = sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+	if (n_threads > HASH_MAX_THREADS)
+		n_threads = HASH_MAX_THREADS;
+	if (n_threads > n_files)
+		n_threads = n_files;
+
+	/* the calling thread always takes part, so start one less */
+	for (i = 1; i < n_threads; i++) {
+		if (pthread_create(&threads[n_started], NULL, hash_worker, &q))
+			break;
+		n_started++;
+	}
+
+	hash_worker(&q);
+
+	for (i = 0; i < n_started; i++)
+		pthread_join(threads[i], NULL);
+
+	for (i = 0; i < n_files; i++) {
+		ret = hash_job_print(&q.jobs[i], add_filename, no_newline);
+		if (ret)
+			break;
+	}
+
+	free(q.jobs);
+	return ret;
+}
+
 
 static int usage(const char *progname)
 {
@@ -772,50 +1164,11 @@ static struct hash_type *get_hash_type(const char *name)
 }
 
 
-static int hash_file(struct hash_type *t, const char *filename, bool add_filename,
-	bool no_newline)
-{
-	const char *str;
-
-	if (!filename || !strcmp(filename, "-")) {
-		str = t->func(stdin);
-	} else {
-		struct stat path_stat;
-		stat(filename, &path_stat);
-		if (S_ISDIR(path_stat.st_mode)) {
-			fprintf(stderr, "Failed to open '%s': Is a directory\n", filename);
-			return 1;
-		}
-
-		FILE *f = fopen(filename, "r");
-
-		if (!f) {
-			fprintf(stderr, "Failed to open '%s'\n", filename);
-			return 1;
-		}
-		str = t->func(f);
-		fclose(f);
-	}
-
-	if (!str) {
-		fprintf(stderr, "Failed to generate hash\n");
-		return 1;
-	}
-
-	if (add_filename)
-		printf("%s %s%s", str, filename ? filename : "-",
-			no_newline ? "" : "\n");
-	else
-		printf("%s%s", str, no_newline ? "" : "\n");
-	return 0;
-}
-
-
 int main(int argc, char **argv)
 {
 	struct hash_type *t;
 	const char *progname = argv[0];
-	int i, ch;
+	int ch;
 	bool add_filename = false, no_newline = false;
 
 	while ((ch = getopt(argc, argv, "nN")) != -1) {
@@ -841,14 +1194,12 @@ int main(int argc, char **argv)
 	if (!t)
 		return usage(progname);
 
-	if (argc < 2)
-		return hash_file(t, NULL, add_filename, no_newline);
+	if (argc < 2) {
+		struct hash_job job = {};
 
-	for (i = 0; i < argc - 1; i++) {
-		int ret = hash_file(t, argv[1 + i], add_filename, no_newline);
-		if (ret)
-			return ret;
+		hash_job_run(t, &job);
+		return hash_job_print(&job, add_filename, no_newline);
 	}
 
-	return 0;
+	return hash_files(t, argv + 1, argc - 1, add_filename, no_newline);
 }
@@ -12,18 +12,266 @@
 
 #define pr_fmt(fmt)	"mtdsplit: " fmt
 
+#include <linux/debugfs.h>
 #include <linux/export.h>
 #include <linux/init.h>
 #include <linux/kernel.h>
+#include <linux/list.h>
 #include <linux/magic.h>
+#include <linux/mm.h>
 #include <linux/mtd/mtd.h>
 #include <linux/mtd/partitions.h>
+#include <linux/mutex.h>
+#include <linux/seq_file.h>
+#include <linux/slab.h>
 #include <linux/byteorder/generic.h>
 
 #include "mtdsplit.h"
 
 #define UBI_EC_MAGIC			0x55424923	/* UBI# */
 
+/*
+ * Parsers probe the same devices for headers at the start of each erase
+ * block, and on NAND every one of these small reads is a full page read.
+ * While the parsers of a partition run, between mtdsplit_scan_begin() and
+ * mtdsplit_scan_end(), the first MTDSPLIT_SCAN_HEAD bytes of each erase
+ * block are read once and shared by all of them. The cache lives for one
+ * parser run of a device the caller holds, so it can neither outlive the
+ * device nor serve data from before a later write or erase.
+ */
+#define MTDSPLIT_SCAN_HEAD		256
+
+struct mtdsplit_scan_stats {
+	u64 reads;	/* erase block heads read from flash */
+	u64 hits;	/* lookups answered from a cached head */
+	u64 bypass;	/* lookups outside of the heads, read directly */
+	u64 errors;	/* erase block head reads that failed */
+};
+
+struct mtdsplit_scan_block {
+	u8 *head;	/* NULL until read */
+	size_t len;
+	int err;	/* mtd_read() result for the head */
+};
+
+struct mtdsplit_scan {
+	struct list_head list;
+	struct mtd_info *mtd;
+	unsigned int users;
+	unsigned int nr_blocks;
+	struct mtdsplit_scan_block *blocks;
+	struct mtdsplit_scan_stats stats;
+};
+
+static LIST_HEAD(mtdsplit_scans);
+static DEFINE_MUTEX(mtdsplit_scan_lock);
+static struct mtdsplit_scan_stats mtdsplit_scan_total;
+
+static void mtdsplit_scan_free(struct mtdsplit_scan *scan)
+{
+	unsigned int i;
+
+	pr_debug("scan of \"%s\": %llu reads, %llu hits, %llu bypass, %llu errors\n",
+		 scan->mtd->name, scan->stats.reads, scan->stats.hits,
+		 scan->stats.bypass, scan->stats.errors);
+
+	mtdsplit_scan_total.reads += scan->stats.reads;
+	mtdsplit_scan_total.hits += scan->stats.hits;
+	mtdsplit_scan_total.bypass += scan->stats.bypass;
+	mtdsplit_scan_total.errors += scan->stats.errors;
+
+	for (i = 0; i < scan->nr_blocks; i++)
+		kfree(scan->blocks[i].head);
+	kvfree(scan->blocks);
+	list_del(&scan->list);
+	kfree(scan);
+}
+
+/* Called with mtdsplit_scan_lock held */
+static struct mtdsplit_scan *mtdsplit_scan_find(struct mtd_info *mtd)
+{
+	struct mtdsplit_scan *scan;
+
+	list_for_each_entry(scan, &mtdsplit_scans, list)
+		if (scan->mtd == mtd)
+			return scan;
+
+	return NULL;
+}
+
+/* Called with mtdsplit_scan_lock held */
+static void mtdsplit_scan_put(struct mtdsplit_scan *scan)
+{
+	if (!--scan->users)
+		mtdsplit_scan_free(scan);
+}
+
+/**
+ * mtdsplit_scan_begin - start caching erase block heads of a device
+ *
+ * @mtd:	device about to be parsed
+ *
+ * The caller has to hold @mtd until the matching mtdsplit_scan_end(). If
+ * the cache can't be set up, mtdsplit_read() just reads from the device.
+ */
+void mtdsplit_scan_begin(struct mtd_info *mtd)
+{
+	struct mtdsplit_scan *scan;
+
+	mutex_lock(&mtdsplit_scan_lock);
+
+	scan = mtdsplit_scan_find(mtd);
+	if (scan) {
+		scan->users++;
+		goto out;
+	}
+
+	scan = kzalloc(sizeof(*scan), GFP_KERNEL);
+	if (!scan)
+		goto out;
+
+	scan->mtd = mtd;
+	scan->users = 1;
+	scan->nr_blocks = mtd_div_by_eb(mtd->size, mtd) + 1;
+	scan->blocks = kvcalloc(scan->nr_blocks, sizeof(*scan->blocks),
+				GFP_KERNEL);
+	if (!scan->blocks) {
+		kfree(scan);
+		goto out;
+	}
+
+	list_add(&scan->list, &mtdsplit_scans);
+
+out:
+	mutex_unlock(&mtdsplit_scan_lock);
+}
+EXPORT_SYMBOL_GPL(mtdsplit_scan_begin);
+
+/**
+ * mtdsplit_scan_end - drop the erase block heads cached for a device
+ *
+ * @mtd:	device passed to mtdsplit_scan_begin()
+ */
+void mtdsplit_scan_end(struct mtd_info *mtd)
+{
+	struct mtdsplit_scan *scan;
+
+	mutex_lock(&mtdsplit_scan_lock);
+
+	scan = mtdsplit_scan_find(mtd);
+	if (scan)
+		mtdsplit_scan_put(scan);
+
+	mutex_unlock(&mtdsplit_scan_lock);
+}
+EXPORT_SYMBOL_GPL(mtdsplit_scan_end);
+
+/*
+ * Read the head of the erase block at @start. Called without
+ * mtdsplit_scan_lock, so that other devices don't wait for the flash.
+ */
+static int mtdsplit_scan_fill(struct mtd_info *mtd,
+			      struct mtdsplit_scan_block *blk, size_t start)
+{
+	size_t retlen;
+
+	blk->head = kmalloc(MTDSPLIT_SCAN_HEAD, GFP_KERNEL);
+	if (!blk->head)
+		return -ENOMEM;
+
+	blk->len = min_t(u64, MTDSPLIT_SCAN_HEAD, mtd->size - start);
+	blk->err = mtd_read(mtd, start, blk->len, &retlen, blk->head);
+	if (!blk->err && retlen != blk->len)
+		blk->err = -EIO;
+
+	return 0;
+}
+
+/**
+ * mtdsplit_read - read the header of a parser's image
+ *
+ * @mtd:	device to read from
+ * @offset:	offset to read at
+ * @len:	number of bytes to read
+ * @buf:	buffer to read into
+ *
+ * Between mtdsplit_scan_begin() and mtdsplit_scan_end(), reads within the
+ * first MTDSPLIT_SCAN_HEAD bytes of an erase block are served from the scan
+ * cache. All others are passed on to mtd_read().
+ *
+ * Returns 0, the mtd_read() error, or -EIO on a short read
+ */
+int mtdsplit_read(struct mtd_info *mtd, size_t offset, size_t len, void *buf)
+{
+	struct mtdsplit_scan_block *blk, fill = {};
+	struct mtdsplit_scan *scan;
+	size_t start, retlen;
+	bool ref = false;
+	int err;
+
+	start = mtd_rounddown_to_eb(offset, mtd);
+
+	mutex_lock(&mtdsplit_scan_lock);
+
+	scan = mtdsplit_scan_find(mtd);
+	if (!scan)
+		goto bypass;
+
+	if (offset + len > start + MTDSPLIT_SCAN_HEAD ||
+	    offset + len > mtd->size) {
+		scan->stats.bypass++;
+		goto bypass;
+	}
+
+	blk = &scan->blocks[mtd_div_by_eb(offset, mtd)];
+	if (blk->head) {
+		scan->stats.hits++;
+	} else {
+		/* Read unlocked, the reference keeps the scan around */
+		scan->users++;
+		ref = true;
+
+		mutex_unlock(&mtdsplit_scan_lock);
+		err = mtdsplit_scan_fill(mtd, &fill, start);
+		mutex_lock(&mtdsplit_scan_lock);
+
+		if (err) {
+			mtdsplit_scan_put(scan);
+			goto bypass;
+		}
+
+		scan->stats.reads++;
+		if (fill.err)
+			scan->stats.errors++;
+
+		/* Unless a concurrent reader of the block was first */
+		if (!blk->head)
+			swap(*blk, fill);
+	}
+
+	/* Data comes with -EUCLEAN, pass it on as mtd_read() would */
+	memcpy(buf, blk->head + (offset - start), len);
+	err = blk->err;
+
+	if (ref)
+		mtdsplit_scan_put(scan);
+
+	mutex_unlock(&mtdsplit_scan_lock);
+	kfree(fill.head);
+
+	return err;
+
+bypass:
+	mutex_unlock(&mtdsplit_scan_lock);
+
+	err = mtd_read(mtd, offset, len, &retlen, buf);
+	if (!err && retlen != len)
+		err = -EIO;
+
+	return err;
+}
+EXPORT_SYMBOL_GPL(mtdsplit_read);
+
 struct squashfs_super_block {
 	__le32 s_magic;
 	__le32 pad0[9];
@@ -38,8 +286,8 @@ int mtd_get_squashfs_len(struct mtd_info *master,
 	size_t retlen;
 	int err;
 
-	err = mtd_read(master, offset, sizeof(sb), &retlen, (void *)&sb);
-	if (err || (retlen != sizeof(sb))) {
+	err = mtdsplit_read(master, offset, sizeof(sb), &sb);
+	if (err) {
 		pr_alert("error occured while reading from \"%s\"\n",
 			 master->name);
 		return -EIO;
@@ -76,17 +324,12 @@ int mtd_check_rootfs_magic(struct mtd_info *mtd, size_t offset,
 			   enum mtdsplit_part_type *type)
 {
 	u32 magic;
-	size_t retlen;
 	int ret;
 
-	ret = mtd_read(mtd, offset, sizeof(magic), &retlen,
-		       (unsigned char *) &magic);
+	ret = mtdsplit_read(mtd, offset, sizeof(magic), &magic);
 	if (ret)
 		return ret;
 
-	if (retlen != sizeof(magic))
-		return -EIO;
-
 	if (le32_to_cpu(magic) == SQUASHFS_MAGIC) {
 		if (type)
 			*type = MTDSPLIT_PART_TYPE_SQUASHFS;
@@ -128,3 +371,100 @@ int mtd_find_rootfs_from(struct mtd_info *mtd,
 }
 EXPORT_SYMBOL_GPL(mtd_find_rootfs_from);
 
+#ifdef CONFIG_DEBUG_FS
+static int mtdsplit_scan_stats_show(struct seq_file *s, void *unused)
+{
+	struct mtdsplit_scan_stats total;
+	struct mtdsplit_scan *scan;
+
+	mutex_lock(&mtdsplit_scan_lock);
+
+	total = mtdsplit_scan_total;
+	seq_printf(s, "%-16s %8s %8s %8s %8s %8s\n",
+		   "mtd", "blocks", "reads", "hits", "bypass", "errors");
+
+	list_for_each_entry(scan, &mtdsplit_scans, list) {
+		seq_printf(s, "%-16s %8u %8llu %8llu %8llu %8llu\n",
+			   scan->mtd->name, scan->nr_blocks, scan->stats.reads,
+			   scan->stats.hits, scan->stats.bypass,
+			   scan->stats.errors);
+
+		total.reads += scan->stats.reads;
+		total.hits += scan->stats.hits;
+		total.bypass += scan->stats.bypass;
+		total.errors += scan->stats.errors;
+	}
+
+	seq_printf(s, "%-16s %8s %8llu %8llu %8llu %8llu\n", "total", "",
+		   total.reads, total.hits, total.bypass, total.errors);
+
+	mutex_unlock(&mtdsplit_scan_lock);
+
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(mtdsplit_scan_stats);
+
+/*
+ * Writing an mtd number looks for rootfs magics in all of its erase blocks
+ * the way the parsers do, eg. to exercise the cache on mtdram or nandsim.
+ */
+static ssize_t mtdsplit_scan_write(struct file *file, const char __user *ubuf,
+				   size_t count, loff_t *ppos)
+{
+	enum mtdsplit_part_type type;
+	struct mtd_info *mtd;
+	unsigned int index;
+	size_t offset;
+	int ret;
+
+	ret = kstrtouint_from_user(ubuf, count, 0, &index);
+	if (ret)
+		return ret;
+
+	mtd = get_mtd_device(NULL, index);
+	if (IS_ERR(mtd))
+		return PTR_ERR(mtd);
+
+	mtdsplit_scan_begin(mtd);
+	for (offset = 0; offset < mtd->size; offset = mtd_next_eb(mtd, offset)) {
+		if (mtd_find_rootfs_from(mtd, offset, mtd->size, &offset, &type))
+			break;
+
+		pr_info("\"%s\": rootfs type %d at 0x%zx\n", mtd->name, type,
+			offset);
+	}
+	mtdsplit_scan_end(mtd);
+
+	put_mtd_device(mtd);
+
+	return count;
+}
+
+static const struct file_operations mtdsplit_scan_fops = {
+	.owner = THIS_MODULE,
+	.open = simple_open,
+	.write = mtdsplit_scan_write,
+	.llseek = noop_llseek,
+};
+
+static void mtdsplit_scan_debugfs_init(void)
+{
+	struct dentry *dir = debugfs_create_dir("mtdsplit", NULL);
+
+	debugfs_create_file("scan_stats", 0400, dir, NULL,
+			    &mtdsplit_scan_stats_fops);
+	debugfs_create_file("scan", 0200, dir, NULL, &mtdsplit_scan_fops);
+}
+#else
+static inline void mtdsplit_scan_debugfs_init(void)
+{
+}
+#endif /* CONFIG_DEBUG_FS */
+
+static int __init mtdsplit_scan_init(void)
+{
+	mtdsplit_scan_debugfs_init();
+
+	return 0;
+}
+subsys_initcall(mtdsplit_scan_init);
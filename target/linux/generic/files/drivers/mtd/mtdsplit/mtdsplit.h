@@ -27,6 +27,10 @@ enum mtdsplit_part_type {
 };
 
 #ifdef CONFIG_MTD_SPLIT
+void mtdsplit_scan_begin(struct mtd_info *mtd);
+void mtdsplit_scan_end(struct mtd_info *mtd);
+int mtdsplit_read(struct mtd_info *mtd, size_t offset, size_t len, void *buf);
+
 int mtd_get_squashfs_len(struct mtd_info *master,
 			 size_t offset,
 			 size_t *squashfs_len);
@@ -41,6 +45,27 @@ int mtd_find_rootfs_from(struct mtd_info *mtd,
 			 enum mtdsplit_part_type *type);
 
 #else
+static inline void mtdsplit_scan_begin(struct mtd_info *mtd)
+{
+}
+
+static inline void mtdsplit_scan_end(struct mtd_info *mtd)
+{
+}
+
+static inline int mtdsplit_read(struct mtd_info *mtd, size_t offset,
+				size_t len, void *buf)
+{
+	size_t retlen;
+	int err;
+
+	err = mtd_read(mtd, offset, len, &retlen, buf);
+	if (!err && retlen != len)
+		err = -EIO;
+
+	return err;
+}
+
 static inline int mtd_get_squashfs_len(struct mtd_info *master,
 				       size_t offset,
 				       size_t *squashfs_len)
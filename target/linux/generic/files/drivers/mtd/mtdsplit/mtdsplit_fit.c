@@ -219,18 +219,13 @@ mtdsplit_fit_parse(struct mtd_info *mtd,
 
 	/* Parse the MTD device & search for the FIT image location */
 	for (offset = 0; offset + offset_start + hdr_len <= mtd->size; offset += mtd->erasesize) {
-		ret = mtd_read(mtd, offset + offset_start, hdr_len, &retlen, (void*) &hdr);
+		ret = mtdsplit_read(mtd, offset + offset_start, hdr_len, &hdr);
 		if (ret) {
 			pr_err("read error in \"%s\" at offset 0x%llx\n",
 			       mtd->name, (unsigned long long) offset);
 			return ret;
 		}
 
-		if (retlen != hdr_len) {
-			pr_err("short read in \"%s\"\n", mtd->name);
-			return -EIO;
-		}
-
 		/* Check the magic - see if this is a FIT image */
 		if (be32_to_cpu(hdr.magic) != OF_DT_HEADER) {
 			pr_debug("no valid FIT image found in \"%s\" at offset %llx\n",
@@ -17,16 +17,63 @@
 #include <linux/gfp.h>
 #include <linux/slab.h>
 #include <linux/bits.h>
+#include <linux/mutex.h>
+#include <linux/rwsem.h>
+#include <linux/seq_file.h>
+#include <kunit/visibility.h>
 #include "mtk_bmt.h"
 
-struct bmt_desc bmtd = {};
+/*
+ * The list is only written on attach and detach. MTD operations hold it for
+ * reading, so that detach can wait for them, and lock their own instance.
+ */
+static LIST_HEAD(mtk_bmt_list);
+static DECLARE_RWSEM(mtk_bmt_list_lock);
+
+static struct bmt_desc *mtk_bmt_find(struct mtd_info *mtd)
+{
+	struct bmt_desc *bmtd;
+
+	lockdep_assert_held(&mtk_bmt_list_lock);
+
+	list_for_each_entry(bmtd, &mtk_bmt_list, list)
+		if (bmtd->mtd == mtd)
+			return bmtd;
+
+	return NULL;
+}
+
+VISIBLE_IF_KUNIT struct bmt_desc *mtk_bmt_get(struct mtd_info *mtd)
+{
+	struct bmt_desc *bmtd;
+
+	down_read(&mtk_bmt_list_lock);
+	bmtd = mtk_bmt_find(mtd);
+	if (!bmtd) {
+		up_read(&mtk_bmt_list_lock);
+		return NULL;
+	}
+
+	mutex_lock(&bmtd->lock);
+
+	return bmtd;
+}
+EXPORT_SYMBOL_IF_KUNIT(mtk_bmt_get);
+
+VISIBLE_IF_KUNIT void mtk_bmt_put(struct bmt_desc *bmtd)
+{
+	mutex_unlock(&bmtd->lock);
+	up_read(&mtk_bmt_list_lock);
+}
+EXPORT_SYMBOL_IF_KUNIT(mtk_bmt_put);
 
 /* -------- Nand operations wrapper -------- */
-int bbt_nand_copy(u16 dest_blk, u16 src_blk, loff_t max_offset)
+int bbt_nand_copy(struct bmt_desc *bmtd, u16 dest_blk, u16 src_blk,
+		  loff_t max_offset)
 {
-	int pages = bmtd.blk_size >> bmtd.pg_shift;
-	loff_t src = (loff_t)src_blk << bmtd.blk_shift;
-	loff_t dest = (loff_t)dest_blk << bmtd.blk_shift;
+	int pages = bmtd->blk_size >> bmtd->pg_shift;
+	loff_t src = (loff_t)src_blk << bmtd->blk_shift;
+	loff_t dest = (loff_t)dest_blk << bmtd->blk_shift;
 	loff_t offset = 0;
 	uint8_t oob[64];
 	int i, ret;
@@ -35,28 +82,28 @@ int bbt_nand_copy(u16 dest_blk, u16 src_blk, loff_t max_offset)
 		struct mtd_oob_ops rd_ops = {
 			.mode = MTD_OPS_PLACE_OOB,
 			.oobbuf = oob,
-			.ooblen = min_t(int, bmtd.mtd->oobsize / pages, sizeof(oob)),
-			.datbuf = bmtd.data_buf,
-			.len = bmtd.pg_size,
+			.ooblen = min_t(int, bmtd->mtd->oobsize / pages, sizeof(oob)),
+			.datbuf = bmtd->data_buf,
+			.len = bmtd->pg_size,
 		};
 		struct mtd_oob_ops wr_ops = {
 			.mode = MTD_OPS_PLACE_OOB,
 			.oobbuf = oob,
-			.datbuf = bmtd.data_buf,
-			.len = bmtd.pg_size,
+			.datbuf = bmtd->data_buf,
+			.len = bmtd->pg_size,
 		};
 
 		if (offset >= max_offset)
 			break;
 
-		ret = bmtd._read_oob(bmtd.mtd, src + offset, &rd_ops);
+		ret = bmtd->_read_oob(bmtd->mtd, src + offset, &rd_ops);
 		if (ret < 0 && !mtd_is_bitflip(ret))
 			return ret;
 
 		if (!rd_ops.retlen)
 			break;
 
-		ret = bmtd._write_oob(bmtd.mtd, dest + offset, &wr_ops);
+		ret = bmtd->_write_oob(bmtd->mtd, dest + offset, &wr_ops);
 		if (ret < 0)
 			return ret;
 
@@ -68,19 +115,20 @@ int bbt_nand_copy(u16 dest_blk, u16 src_blk, loff_t max_offset)
 }
 
 /* -------- Bad Blocks Management -------- */
-bool mapping_block_in_range(int block, int *start, int *end)
+bool mapping_block_in_range(struct bmt_desc *bmtd, int block, int *start,
+			    int *end)
 {
-	const __be32 *cur = bmtd.remap_range;
-	u32 addr = block << bmtd.blk_shift;
+	const __be32 *cur = bmtd->remap_range;
+	u32 addr = block << bmtd->blk_shift;
 	int i;
 
-	if (!cur || !bmtd.remap_range_len) {
+	if (!cur || !bmtd->remap_range_len) {
 		*start = 0;
-		*end = bmtd.total_blks;
+		*end = bmtd->total_blks;
 		return true;
 	}
 
-	for (i = 0; i < bmtd.remap_range_len; i++, cur += 2) {
+	for (i = 0; i < bmtd->remap_range_len; i++, cur += 2) {
 		if (addr < be32_to_cpu(cur[0]) || addr >= be32_to_cpu(cur[1]))
 			continue;
 
@@ -93,23 +141,68 @@ bool mapping_block_in_range(int block, int *start, int *end)
 }
 
 static bool
-mtk_bmt_remap_block(u32 block, u32 mapped_block, int copy_len)
+mtk_bmt_remap_block(struct bmt_desc *bmtd, u32 block, u32 mapped_block,
+		    int copy_len)
 {
 	int start, end;
 
-	if (!mapping_block_in_range(block, &start, &end))
+	if (!mapping_block_in_range(bmtd, block, &start, &end))
 		return false;
 
-	return bmtd.ops->remap_block(block, mapped_block, copy_len);
+	return bmtd->ops->remap_block(bmtd, block, mapped_block, copy_len);
+}
+
+static void
+mtk_bmt_account_read(struct bmt_desc *bmtd, int block, int n_blocks,
+		     int bitflips)
+{
+	int i;
+
+	bmtd->stats.reads++;
+	bmtd->stats.blocks_read += n_blocks;
+	if (n_blocks > 1)
+		bmtd->stats.merged_reads++;
+
+	if (bitflips <= 0 || !bmtd->bitflips)
+		return;
+
+	/* for merged reads this is an upper bound for each block */
+	bitflips = min(bitflips, U8_MAX);
+	for (i = block; i < block + n_blocks && i < bmtd->total_blks; i++)
+		bmtd->bitflips[i] = max_t(u8, bmtd->bitflips[i], bitflips);
+}
+
+/*
+ * Extend a read starting in block to all following blocks that are mapped
+ * to physically contiguous blocks, so that it can be issued as one read.
+ */
+static int
+mtk_bmt_read_extent(struct bmt_desc *bmtd, u32 block, int cur_block,
+		    u32 offset, size_t len, size_t *cur_len)
+{
+	int n_blocks = 1;
+
+	*cur_len = min_t(size_t, bmtd->blk_size - offset, len);
+	while (*cur_len < len) {
+		if (bmtd->ops->get_mapping_block(bmtd, block + n_blocks) !=
+		    cur_block + n_blocks)
+			break;
+
+		*cur_len += min_t(size_t, bmtd->blk_size, len - *cur_len);
+		n_blocks++;
+	}
+
+	return n_blocks;
 }
 
 static int
-mtk_bmt_read(struct mtd_info *mtd, loff_t from,
-	     struct mtd_oob_ops *ops)
+__mtk_bmt_read(struct bmt_desc *bmtd, struct mtd_info *mtd, loff_t from,
+	       struct mtd_oob_ops *ops)
 {
 	struct mtd_oob_ops cur_ops = *ops;
 	int retry_count = 0;
 	loff_t cur_from;
+	loff_t single_end = 0;
 	int ret = 0;
 	int max_bitflips = 0;
 
@@ -119,27 +212,48 @@ mtk_bmt_read(struct mtd_info *mtd, loff_t from,
 	while (ops->retlen < ops->len || ops->oobretlen < ops->ooblen) {
 		int cur_ret;
 
-		u32 offset = from & (bmtd.blk_size - 1);
-		u32 block = from >> bmtd.blk_shift;
-		int cur_block;
+		u32 offset = from & (bmtd->blk_size - 1);
+		u32 block = from >> bmtd->blk_shift;
+		int cur_block, n_blocks = 1;
+		size_t cur_len;
 
-		cur_block = bmtd.ops->get_mapping_block(block);
+		cur_block = bmtd->ops->get_mapping_block(bmtd, block);
 		if (cur_block < 0)
 			return -EIO;
 
-		cur_from = ((loff_t)cur_block << bmtd.blk_shift) + offset;
+		cur_from = ((loff_t)cur_block << bmtd->blk_shift) + offset;
 
 		cur_ops.oobretlen = 0;
 		cur_ops.retlen = 0;
-		cur_ops.len = min_t(u32, mtd->erasesize - offset,
-					 ops->len - ops->retlen);
-		cur_ret = bmtd._read_oob(mtd, cur_from, &cur_ops);
+		if (from >= single_end)
+			n_blocks = mtk_bmt_read_extent(bmtd, block, cur_block,
+						       offset,
+						       ops->len - ops->retlen,
+						       &cur_len);
+		else
+			cur_len = min_t(size_t, mtd->erasesize - offset,
+					ops->len - ops->retlen);
+		cur_ops.len = cur_len;
+		cur_ret = bmtd->_read_oob(mtd, cur_from, &cur_ops);
+
+		/*
+		 * The failing or worn block of a merged read is not known,
+		 * read the range again block by block to handle it.
+		 */
+		if (n_blocks > 1 &&
+		    ((cur_ret < 0 && !mtd_is_bitflip(cur_ret)) ||
+		     (mtd->bitflip_threshold && cur_ret >= mtd->bitflip_threshold))) {
+			single_end = from + cur_len;
+			continue;
+		}
+
+		mtk_bmt_account_read(bmtd, cur_block, n_blocks, cur_ret);
 		if (cur_ret < 0)
 			ret = cur_ret;
 		else
 			max_bitflips = max_t(int, max_bitflips, cur_ret);
 		if (cur_ret < 0 && !mtd_is_bitflip(cur_ret)) {
-			if (mtk_bmt_remap_block(block, cur_block, mtd->erasesize) &&
+			if (mtk_bmt_remap_block(bmtd, block, cur_block, mtd->erasesize) &&
 				retry_count++ < 10)
 				continue;
 
@@ -147,7 +261,7 @@ mtk_bmt_read(struct mtd_info *mtd, loff_t from,
 		}
 
 		if (mtd->bitflip_threshold && cur_ret >= mtd->bitflip_threshold)
-			mtk_bmt_remap_block(block, cur_block, mtd->erasesize);
+			mtk_bmt_remap_block(bmtd, block, cur_block, mtd->erasesize);
 
 		ops->retlen += cur_ops.retlen;
 		ops->oobretlen += cur_ops.oobretlen;
@@ -172,8 +286,8 @@ out:
 }
 
 static int
-mtk_bmt_write(struct mtd_info *mtd, loff_t to,
-	      struct mtd_oob_ops *ops)
+__mtk_bmt_write(struct bmt_desc *bmtd, struct mtd_info *mtd, loff_t to,
+		struct mtd_oob_ops *ops)
 {
 	struct mtd_oob_ops cur_ops = *ops;
 	int retry_count = 0;
@@ -184,23 +298,23 @@ mtk_bmt_write(struct mtd_info *mtd, loff_t to,
 	ops->oobretlen = 0;
 
 	while (ops->retlen < ops->len || ops->oobretlen < ops->ooblen) {
-		u32 offset = to & (bmtd.blk_size - 1);
-		u32 block = to >> bmtd.blk_shift;
+		u32 offset = to & (bmtd->blk_size - 1);
+		u32 block = to >> bmtd->blk_shift;
 		int cur_block;
 
-		cur_block = bmtd.ops->get_mapping_block(block);
+		cur_block = bmtd->ops->get_mapping_block(bmtd, block);
 		if (cur_block < 0)
 			return -EIO;
 
-		cur_to = ((loff_t)cur_block << bmtd.blk_shift) + offset;
+		cur_to = ((loff_t)cur_block << bmtd->blk_shift) + offset;
 
 		cur_ops.oobretlen = 0;
 		cur_ops.retlen = 0;
-		cur_ops.len = min_t(u32, bmtd.blk_size - offset,
+		cur_ops.len = min_t(u32, bmtd->blk_size - offset,
 					 ops->len - ops->retlen);
-		ret = bmtd._write_oob(mtd, cur_to, &cur_ops);
+		ret = bmtd->_write_oob(mtd, cur_to, &cur_ops);
 		if (ret < 0) {
-			if (mtk_bmt_remap_block(block, cur_block, offset) &&
+			if (mtk_bmt_remap_block(bmtd, block, cur_block, offset) &&
 			    retry_count++ < 10)
 				continue;
 
@@ -226,10 +340,11 @@ mtk_bmt_write(struct mtd_info *mtd, loff_t to,
 }
 
 static int
-mtk_bmt_mtd_erase(struct mtd_info *mtd, struct erase_info *instr)
+__mtk_bmt_mtd_erase(struct bmt_desc *bmtd, struct mtd_info *mtd,
+		    struct erase_info *instr)
 {
 	struct erase_info mapped_instr = {
-		.len = bmtd.blk_size,
+		.len = bmtd->blk_size,
 	};
 	int retry_count = 0;
 	u64 start_addr, end_addr;
@@ -241,14 +356,14 @@ mtk_bmt_mtd_erase(struct mtd_info *mtd, struct erase_info *instr)
 	end_addr = instr->addr + instr->len;
 
 	while (start_addr < end_addr) {
-		orig_block = start_addr >> bmtd.blk_shift;
-		block = bmtd.ops->get_mapping_block(orig_block);
+		orig_block = start_addr >> bmtd->blk_shift;
+		block = bmtd->ops->get_mapping_block(bmtd, orig_block);
 		if (block < 0)
 			return -EIO;
-		mapped_instr.addr = (loff_t)block << bmtd.blk_shift;
-		ret = bmtd._erase(mtd, &mapped_instr);
+		mapped_instr.addr = (loff_t)block << bmtd->blk_shift;
+		ret = bmtd->_erase(mtd, &mapped_instr);
 		if (ret) {
-			if (mtk_bmt_remap_block(orig_block, block, 0) &&
+			if (mtk_bmt_remap_block(bmtd, orig_block, block, 0) &&
 			    retry_count++ < 10)
 				continue;
 			instr->fail_addr = start_addr;
@@ -260,19 +375,20 @@ mtk_bmt_mtd_erase(struct mtd_info *mtd, struct erase_info *instr)
 
 	return ret;
 }
+
 static int
-mtk_bmt_block_isbad(struct mtd_info *mtd, loff_t ofs)
+__mtk_bmt_block_isbad(struct bmt_desc *bmtd, struct mtd_info *mtd, loff_t ofs)
 {
 	int retry_count = 0;
-	u16 orig_block = ofs >> bmtd.blk_shift;
+	u16 orig_block = ofs >> bmtd->blk_shift;
 	u16 block;
 	int ret;
 
 retry:
-	block = bmtd.ops->get_mapping_block(orig_block);
-	ret = bmtd._block_isbad(mtd, (loff_t)block << bmtd.blk_shift);
+	block = bmtd->ops->get_mapping_block(bmtd, orig_block);
+	ret = bmtd->_block_isbad(mtd, (loff_t)block << bmtd->blk_shift);
 	if (ret) {
-		if (mtk_bmt_remap_block(orig_block, block, bmtd.blk_size) &&
+		if (mtk_bmt_remap_block(bmtd, orig_block, block, bmtd->blk_size) &&
 		    retry_count++ < 10)
 			goto retry;
 	}
@@ -280,28 +396,60 @@ retry:
 }
 
 static int
-mtk_bmt_block_markbad(struct mtd_info *mtd, loff_t ofs)
+__mtk_bmt_block_markbad(struct bmt_desc *bmtd, struct mtd_info *mtd, loff_t ofs)
 {
-	u16 orig_block = ofs >> bmtd.blk_shift;
+	u16 orig_block = ofs >> bmtd->blk_shift;
 	int block;
 
-	block = bmtd.ops->get_mapping_block(orig_block);
+	block = bmtd->ops->get_mapping_block(bmtd, orig_block);
 	if (block < 0)
 		return -EIO;
 
-	mtk_bmt_remap_block(orig_block, block, bmtd.blk_size);
+	mtk_bmt_remap_block(bmtd, orig_block, block, bmtd->blk_size);
 
-	return bmtd._block_markbad(mtd, (loff_t)block << bmtd.blk_shift);
+	return bmtd->_block_markbad(mtd, (loff_t)block << bmtd->blk_shift);
 }
 
+#define MTK_BMT_WRAP_OP(_name, _proto, _args)		\
+static int _name _proto					\
+{							\
+	struct bmt_desc *bmtd;				\
+	int ret;					\
+							\
+	bmtd = mtk_bmt_get(mtd);			\
+	if (!bmtd)					\
+		return -ENODEV;				\
+							\
+	ret = __##_name _args;				\
+	mtk_bmt_put(bmtd);				\
+							\
+	return ret;					\
+}
+
+MTK_BMT_WRAP_OP(mtk_bmt_read,
+		(struct mtd_info *mtd, loff_t from, struct mtd_oob_ops *ops),
+		(bmtd, mtd, from, ops))
+MTK_BMT_WRAP_OP(mtk_bmt_write,
+		(struct mtd_info *mtd, loff_t to, struct mtd_oob_ops *ops),
+		(bmtd, mtd, to, ops))
+MTK_BMT_WRAP_OP(mtk_bmt_mtd_erase,
+		(struct mtd_info *mtd, struct erase_info *instr),
+		(bmtd, mtd, instr))
+MTK_BMT_WRAP_OP(mtk_bmt_block_isbad,
+		(struct mtd_info *mtd, loff_t ofs),
+		(bmtd, mtd, ofs))
+MTK_BMT_WRAP_OP(mtk_bmt_block_markbad,
+		(struct mtd_info *mtd, loff_t ofs),
+		(bmtd, mtd, ofs))
+
 static void
-mtk_bmt_replace_ops(struct mtd_info *mtd)
+mtk_bmt_replace_ops(struct bmt_desc *bmtd, struct mtd_info *mtd)
 {
-	bmtd._read_oob = mtd->_read_oob;
-	bmtd._write_oob = mtd->_write_oob;
-	bmtd._erase = mtd->_erase;
-	bmtd._block_isbad = mtd->_block_isbad;
-	bmtd._block_markbad = mtd->_block_markbad;
+	bmtd->_read_oob = mtd->_read_oob;
+	bmtd->_write_oob = mtd->_write_oob;
+	bmtd->_erase = mtd->_erase;
+	bmtd->_block_isbad = mtd->_block_isbad;
+	bmtd->_block_markbad = mtd->_block_markbad;
 
 	mtd->_read_oob = mtk_bmt_read;
 	mtd->_write_oob = mtk_bmt_write;
@@ -310,55 +458,93 @@ mtk_bmt_replace_ops(struct mtd_info *mtd)
 	mtd->_block_markbad = mtk_bmt_block_markbad;
 }
 
-static int mtk_bmt_debug_repair(void *data, u64 val)
+static int __mtk_bmt_debug_repair(struct bmt_desc *bmtd, u64 val)
 {
-	int block = val >> bmtd.blk_shift;
+	int block = val >> bmtd->blk_shift;
 	int prev_block, new_block;
 
-	prev_block = bmtd.ops->get_mapping_block(block);
+	prev_block = bmtd->ops->get_mapping_block(bmtd, block);
 	if (prev_block < 0)
 		return -EIO;
 
-	bmtd.ops->unmap_block(block);
-	new_block = bmtd.ops->get_mapping_block(block);
+	bmtd->ops->unmap_block(bmtd, block);
+	new_block = bmtd->ops->get_mapping_block(bmtd, block);
 	if (new_block < 0)
 		return -EIO;
 
 	if (prev_block == new_block)
 		return 0;
 
-	bbt_nand_erase(new_block);
-	bbt_nand_copy(new_block, prev_block, bmtd.blk_size);
+	bbt_nand_erase(bmtd, new_block);
+	bbt_nand_copy(bmtd, new_block, prev_block, bmtd->blk_size);
 
 	return 0;
 }
 
-static int mtk_bmt_debug_mark_good(void *data, u64 val)
+static int __mtk_bmt_debug_mark_good(struct bmt_desc *bmtd, u64 val)
 {
-	bmtd.ops->unmap_block(val >> bmtd.blk_shift);
+	bmtd->ops->unmap_block(bmtd, val >> bmtd->blk_shift);
 
 	return 0;
 }
 
-static int mtk_bmt_debug_mark_bad(void *data, u64 val)
+static int __mtk_bmt_debug_mark_bad(struct bmt_desc *bmtd, u64 val)
 {
-	u32 block = val >> bmtd.blk_shift;
+	u32 block = val >> bmtd->blk_shift;
 	int cur_block;
 
-	cur_block = bmtd.ops->get_mapping_block(block);
+	cur_block = bmtd->ops->get_mapping_block(bmtd, block);
 	if (cur_block < 0)
 		return -EIO;
 
-	mtk_bmt_remap_block(block, cur_block, bmtd.blk_size);
+	mtk_bmt_remap_block(bmtd, block, cur_block, bmtd->blk_size);
 
 	return 0;
 }
 
-static int mtk_bmt_debug(void *data, u64 val)
+static int __mtk_bmt_debug(struct bmt_desc *bmtd, u64 val)
 {
-	return bmtd.ops->debug(data, val);
+	return bmtd->ops->debug(bmtd, val);
 }
 
+static int mtk_bmt_bitflips_show(struct seq_file *m, void *private)
+{
+	struct bmt_desc *bmtd = m->private;
+	int i;
+
+	mutex_lock(&bmtd->lock);
+
+	seq_printf(m, "reads: %llu\n", bmtd->stats.reads);
+	seq_printf(m, "merged_reads: %llu\n", bmtd->stats.merged_reads);
+	seq_printf(m, "blocks_read: %llu\n", bmtd->stats.blocks_read);
+
+	for (i = 0; bmtd->bitflips && i < bmtd->total_blks; i++)
+		if (bmtd->bitflips[i])
+			seq_printf(m, "block %d: %d\n", i, bmtd->bitflips[i]);
+
+	mutex_unlock(&bmtd->lock);
+
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(mtk_bmt_bitflips);
+
+#define MTK_BMT_WRAP_DEBUGFS(_name)				\
+static int _name(void *data, u64 val)				\
+{								\
+	struct bmt_desc *bmtd = data;				\
+	int ret;						\
+								\
+	mutex_lock(&bmtd->lock);				\
+	ret = __##_name(bmtd, val);				\
+	mutex_unlock(&bmtd->lock);				\
+								\
+	return ret;						\
+}
+
+MTK_BMT_WRAP_DEBUGFS(mtk_bmt_debug_repair)
+MTK_BMT_WRAP_DEBUGFS(mtk_bmt_debug_mark_good)
+MTK_BMT_WRAP_DEBUGFS(mtk_bmt_debug_mark_bad)
+MTK_BMT_WRAP_DEBUGFS(mtk_bmt_debug)
 
 DEFINE_DEBUGFS_ATTRIBUTE(fops_repair, NULL, mtk_bmt_debug_repair, "%llu\n");
 DEFINE_DEBUGFS_ATTRIBUTE(fops_mark_good, NULL, mtk_bmt_debug_mark_good, "%llu\n");
@@ -366,105 +552,174 @@ DEFINE_DEBUGFS_ATTRIBUTE(fops_mark_bad, NULL, mtk_bmt_debug_mark_bad, "%llu\n");
 DEFINE_DEBUGFS_ATTRIBUTE(fops_debug, NULL, mtk_bmt_debug, "%llu\n");
 
 static void
-mtk_bmt_add_debugfs(void)
+mtk_bmt_add_debugfs(struct bmt_desc *bmtd)
 {
 	struct dentry *dir;
+	char name[64];
+
+	/* keep the old name for the first instance */
+	if (list_empty(&mtk_bmt_list))
+		strscpy(name, "mtk-bmt", sizeof(name));
+	else
+		snprintf(name, sizeof(name), "mtk-bmt-%s", bmtd->mtd->name);
 
-	dir = bmtd.debugfs_dir = debugfs_create_dir("mtk-bmt", NULL);
+	dir = bmtd->debugfs_dir = debugfs_create_dir(name, NULL);
 	if (!dir)
 		return;
 
-	debugfs_create_file_unsafe("repair", S_IWUSR, dir, NULL, &fops_repair);
-	debugfs_create_file_unsafe("mark_good", S_IWUSR, dir, NULL, &fops_mark_good);
-	debugfs_create_file_unsafe("mark_bad", S_IWUSR, dir, NULL, &fops_mark_bad);
-	debugfs_create_file_unsafe("debug", S_IWUSR, dir, NULL, &fops_debug);
+	debugfs_create_file_unsafe("repair", S_IWUSR, dir, bmtd, &fops_repair);
+	debugfs_create_file_unsafe("mark_good", S_IWUSR, dir, bmtd, &fops_mark_good);
+	debugfs_create_file_unsafe("mark_bad", S_IWUSR, dir, bmtd, &fops_mark_bad);
+	debugfs_create_file_unsafe("debug", S_IWUSR, dir, bmtd, &fops_debug);
+	debugfs_create_file("bitflips", S_IRUSR, dir, bmtd, &mtk_bmt_bitflips_fops);
+}
+
+static void
+mtk_bmt_restore_ops(struct bmt_desc *bmtd, struct mtd_info *mtd)
+{
+	mtd->_read_oob = bmtd->_read_oob;
+	mtd->_write_oob = bmtd->_write_oob;
+	mtd->_erase = bmtd->_erase;
+	mtd->_block_isbad = bmtd->_block_isbad;
+	mtd->_block_markbad = bmtd->_block_markbad;
+	mtd->size = bmtd->total_blks << bmtd->blk_shift;
+}
+
+static void
+mtk_bmt_free(struct bmt_desc *bmtd)
+{
+	if (bmtd->ops->cleanup)
+		bmtd->ops->cleanup(bmtd);
+	kfree(bmtd->bbt_buf);
+	kfree(bmtd->data_buf);
+	kfree(bmtd->bitflips);
 }
 
 void mtk_bmt_detach(struct mtd_info *mtd)
 {
-	if (bmtd.mtd != mtd)
+	struct bmt_desc *bmtd;
+
+	/* waits for running operations, later ones get -ENODEV */
+	down_write(&mtk_bmt_list_lock);
+	bmtd = mtk_bmt_find(mtd);
+	if (bmtd) {
+		mtk_bmt_restore_ops(bmtd, mtd);
+		list_del(&bmtd->list);
+	}
+	up_write(&mtk_bmt_list_lock);
+
+	if (!bmtd)
 		return;
 
-	debugfs_remove_recursive(bmtd.debugfs_dir);
-	bmtd.debugfs_dir = NULL;
+	/* waits for running debugfs handlers */
+	debugfs_remove_recursive(bmtd->debugfs_dir);
 
-	kfree(bmtd.bbt_buf);
-	kfree(bmtd.data_buf);
+	mtk_bmt_free(bmtd);
+	mutex_destroy(&bmtd->lock);
+	kfree(bmtd);
+}
+EXPORT_SYMBOL_IF_KUNIT(mtk_bmt_detach);
 
-	mtd->_read_oob = bmtd._read_oob;
-	mtd->_write_oob = bmtd._write_oob;
-	mtd->_erase = bmtd._erase;
-	mtd->_block_isbad = bmtd._block_isbad;
-	mtd->_block_markbad = bmtd._block_markbad;
-	mtd->size = bmtd.total_blks << bmtd.blk_shift;
+static const struct mtk_bmt_ops *
+mtk_bmt_get_ops(struct device_node *np)
+{
+	if (of_property_read_bool(np, "mediatek,bmt-v2"))
+		return &mtk_bmt_v2_ops;
+	if (of_property_read_bool(np, "mediatek,nmbm"))
+		return &mtk_bmt_nmbm_ops;
+	if (of_property_read_bool(np, "mediatek,bbt"))
+		return &mtk_bmt_bbt_ops;
 
-	memset(&bmtd, 0, sizeof(bmtd));
+	return NULL;
 }
 
-
-int mtk_bmt_attach(struct mtd_info *mtd)
+VISIBLE_IF_KUNIT int
+mtk_bmt_attach_node(struct mtd_info *mtd, struct device_node *np)
 {
-	struct device_node *np;
+	const struct mtk_bmt_ops *ops;
+	struct bmt_desc *bmtd;
 	int ret = 0;
 	u32 overridden_oobsize = 0;
 
-	if (bmtd.mtd)
-		return -ENOSPC;
-
-	np = mtd_get_of_node(mtd);
 	if (!np)
 		return 0;
 
-	if (of_property_read_bool(np, "mediatek,bmt-v2"))
-		bmtd.ops = &mtk_bmt_v2_ops;
-	else if (of_property_read_bool(np, "mediatek,nmbm"))
-		bmtd.ops = &mtk_bmt_nmbm_ops;
-	else if (of_property_read_bool(np, "mediatek,bbt"))
-		bmtd.ops = &mtk_bmt_bbt_ops;
-	else
+	ops = mtk_bmt_get_ops(np);
+	if (!ops)
 		return 0;
 
-	bmtd.remap_range = of_get_property(np, "mediatek,bmt-remap-range",
-					   &bmtd.remap_range_len);
-	bmtd.remap_range_len /= 8;
+	bmtd = kzalloc(sizeof(*bmtd), GFP_KERNEL);
+	if (!bmtd)
+		return -ENOMEM;
 
-	bmtd.mtd = mtd;
-	mtk_bmt_replace_ops(mtd);
+	mutex_init(&bmtd->lock);
+	down_write(&mtk_bmt_list_lock);
+
+	if (mtk_bmt_find(mtd)) {
+		ret = -EBUSY;
+		goto out;
+	}
+
+	bmtd->ops = ops;
+	bmtd->remap_range = of_get_property(np, "mediatek,bmt-remap-range",
+					    &bmtd->remap_range_len);
+	bmtd->remap_range_len /= 8;
+
+	bmtd->mtd = mtd;
+	mtk_bmt_replace_ops(bmtd, mtd);
 
 	if (!of_property_read_u32(np, "mediatek,bmt-mtd-overridden-oobsize",
 				  &overridden_oobsize))
-		if (overridden_oobsize < bmtd.mtd->oobsize) {
-			bmtd.mtd->oobsize = overridden_oobsize;
+		if (overridden_oobsize < bmtd->mtd->oobsize) {
+			bmtd->mtd->oobsize = overridden_oobsize;
 			pr_info("NMBM: mtd OOB size has been overridden to %luB\n",
-				(long unsigned int)bmtd.mtd->oobsize);
+				(long unsigned int)bmtd->mtd->oobsize);
 		}
 
-	bmtd.blk_size = mtd->erasesize;
-	bmtd.blk_shift = ffs(bmtd.blk_size) - 1;
-	bmtd.pg_size = mtd->writesize;
-	bmtd.pg_shift = ffs(bmtd.pg_size) - 1;
-	bmtd.total_blks = mtd->size >> bmtd.blk_shift;
+	bmtd->blk_size = mtd->erasesize;
+	bmtd->blk_shift = ffs(bmtd->blk_size) - 1;
+	bmtd->pg_size = mtd->writesize;
+	bmtd->pg_shift = ffs(bmtd->pg_size) - 1;
+	bmtd->total_blks = mtd->size >> bmtd->blk_shift;
 
-	bmtd.data_buf = kzalloc(bmtd.pg_size + bmtd.mtd->oobsize, GFP_KERNEL);
-	if (!bmtd.data_buf) {
+	bmtd->data_buf = kzalloc(bmtd->pg_size + bmtd->mtd->oobsize, GFP_KERNEL);
+	if (!bmtd->data_buf) {
 		pr_info("nand: FATAL ERR: allocate buffer failed!\n");
 		ret = -1;
 		goto error;
 	}
 
-	memset(bmtd.data_buf, 0xff, bmtd.pg_size + bmtd.mtd->oobsize);
+	memset(bmtd->data_buf, 0xff, bmtd->pg_size + bmtd->mtd->oobsize);
+
+	/* statistics only, not fatal */
+	bmtd->bitflips = kcalloc(bmtd->total_blks, sizeof(*bmtd->bitflips),
+				 GFP_KERNEL);
 
-	ret = bmtd.ops->init(np);
+	ret = bmtd->ops->init(bmtd, np);
 	if (ret)
 		goto error;
 
-	mtk_bmt_add_debugfs();
+	mtk_bmt_add_debugfs(bmtd);
+	list_add_tail(&bmtd->list, &mtk_bmt_list);
+	up_write(&mtk_bmt_list_lock);
+
 	return 0;
 
 error:
-	mtk_bmt_detach(mtd);
+	mtk_bmt_restore_ops(bmtd, mtd);
+	mtk_bmt_free(bmtd);
+out:
+	up_write(&mtk_bmt_list_lock);
+	mutex_destroy(&bmtd->lock);
+	kfree(bmtd);
 	return ret;
 }
+EXPORT_SYMBOL_IF_KUNIT(mtk_bmt_attach_node);
+
+int mtk_bmt_attach(struct mtd_info *mtd)
+{
+	return mtk_bmt_attach_node(mtd, mtd_get_of_node(mtd));
+}
 
 
 MODULE_LICENSE("GPL");
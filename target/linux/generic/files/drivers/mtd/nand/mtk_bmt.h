@@ -2,6 +2,7 @@
 #define __MTK_BMT_PRIV_H
 
 #include <linux/kernel.h>
+#include <linux/mutex.h>
 #include <linux/of.h>
 #include <linux/mtd/mtd.h>
 #include <linux/mtd/partitions.h>
@@ -13,20 +14,30 @@
 
 #define BBT_LOG(fmt, ...) pr_debug("[BBT][%s|%d] "fmt"\n", __func__, __LINE__, ##__VA_ARGS__)
 
+struct bmt_desc;
+
 struct mtk_bmt_ops {
 	char *sig;
 	unsigned int sig_len;
-	int (*init)(struct device_node *np);
-	bool (*remap_block)(u16 block, u16 mapped_block, int copy_len);
-	void (*unmap_block)(u16 block);
-	int (*get_mapping_block)(int block);
-	int (*debug)(void *data, u64 val);
+	int (*init)(struct bmt_desc *bmtd, struct device_node *np);
+	void (*cleanup)(struct bmt_desc *bmtd);
+	bool (*remap_block)(struct bmt_desc *bmtd, u16 block, u16 mapped_block,
+			    int copy_len);
+	void (*unmap_block)(struct bmt_desc *bmtd, u16 block);
+	int (*get_mapping_block)(struct bmt_desc *bmtd, int block);
+	int (*debug)(struct bmt_desc *bmtd, u64 val);
 };
 
 struct bbbt;
 struct nmbm_instance;
 
+/*
+ * Every attached MTD device has its own struct bmt_desc, which is passed to
+ * all backend code. Its lock is held while the mapping is used or changed.
+ */
 struct bmt_desc {
+	struct list_head list;
+	struct mutex lock;
 	struct mtd_info *mtd;
 	unsigned char *bbt_buf;
 	unsigned char *data_buf;
@@ -48,6 +59,14 @@ struct bmt_desc {
 
 	struct dentry *debugfs_dir;
 
+	/* max bitflips seen per physical block */
+	u8 *bitflips;
+	struct {
+		u64 reads;
+		u64 merged_reads;
+		u64 blocks_read;
+	} stats;
+
 	u32 table_size;
 	u32 pg_size;
 	u32 blk_size;
@@ -73,23 +92,22 @@ struct bmt_desc {
 	u8 oob_offset;
 };
 
-extern struct bmt_desc bmtd;
 extern const struct mtk_bmt_ops mtk_bmt_v2_ops;
 extern const struct mtk_bmt_ops mtk_bmt_bbt_ops;
 extern const struct mtk_bmt_ops mtk_bmt_nmbm_ops;
 
-static inline u32 blk_pg(u16 block)
+static inline u32 blk_pg(struct bmt_desc *bmtd, u16 block)
 {
-	return (u32)(block << (bmtd.blk_shift - bmtd.pg_shift));
+	return (u32)(block << (bmtd->blk_shift - bmtd->pg_shift));
 }
 
 static inline int
-bbt_nand_read(u32 page, unsigned char *dat, int dat_len,
-	      unsigned char *fdm, int fdm_len)
+bbt_nand_read(struct bmt_desc *bmtd, u32 page, unsigned char *dat,
+	      int dat_len, unsigned char *fdm, int fdm_len)
 {
 	struct mtd_oob_ops ops = {
 		.mode = MTD_OPS_PLACE_OOB,
-		.ooboffs = bmtd.oob_offset,
+		.ooboffs = bmtd->oob_offset,
 		.oobbuf = fdm,
 		.ooblen = fdm_len,
 		.datbuf = dat,
@@ -97,7 +115,7 @@ bbt_nand_read(u32 page, unsigned char *dat, int dat_len,
 	};
 	int ret;
 
-	ret = bmtd._read_oob(bmtd.mtd, page << bmtd.pg_shift, &ops);
+	ret = bmtd->_read_oob(bmtd->mtd, page << bmtd->pg_shift, &ops);
 	if (ret < 0)
 		return ret;
 	if (ret)
@@ -105,33 +123,42 @@ bbt_nand_read(u32 page, unsigned char *dat, int dat_len,
 	return 0;
 }
 
-static inline int bbt_nand_erase(u16 block)
+static inline int bbt_nand_erase(struct bmt_desc *bmtd, u16 block)
 {
-	struct mtd_info *mtd = bmtd.mtd;
+	struct mtd_info *mtd = bmtd->mtd;
 	struct erase_info instr = {
-		.addr = (loff_t)block << bmtd.blk_shift,
-		.len = bmtd.blk_size,
+		.addr = (loff_t)block << bmtd->blk_shift,
+		.len = bmtd->blk_size,
 	};
 
-	return bmtd._erase(mtd, &instr);
+	return bmtd->_erase(mtd, &instr);
 }
 
-static inline int write_bmt(u16 block, unsigned char *dat)
+static inline int write_bmt(struct bmt_desc *bmtd, u16 block,
+			    unsigned char *dat)
 {
 	struct mtd_oob_ops ops = {
 		.mode = MTD_OPS_PLACE_OOB,
-		.ooboffs = OOB_SIGNATURE_OFFSET + bmtd.oob_offset,
-		.oobbuf = bmtd.ops->sig,
-		.ooblen = bmtd.ops->sig_len,
+		.ooboffs = OOB_SIGNATURE_OFFSET + bmtd->oob_offset,
+		.oobbuf = bmtd->ops->sig,
+		.ooblen = bmtd->ops->sig_len,
 		.datbuf = dat,
-		.len = bmtd.bmt_pgs << bmtd.pg_shift,
+		.len = bmtd->bmt_pgs << bmtd->pg_shift,
 	};
-	loff_t addr = (loff_t)block << bmtd.blk_shift;
+	loff_t addr = (loff_t)block << bmtd->blk_shift;
 
-	return bmtd._write_oob(bmtd.mtd, addr, &ops);
+	return bmtd->_write_oob(bmtd->mtd, addr, &ops);
 }
 
-int bbt_nand_copy(u16 dest_blk, u16 src_blk, loff_t max_offset);
-bool mapping_block_in_range(int block, int *start, int *end);
+#if IS_ENABLED(CONFIG_KUNIT)
+struct bmt_desc *mtk_bmt_get(struct mtd_info *mtd);
+void mtk_bmt_put(struct bmt_desc *bmtd);
+int mtk_bmt_attach_node(struct mtd_info *mtd, struct device_node *np);
+#endif
+
+int bbt_nand_copy(struct bmt_desc *bmtd, u16 dest_blk, u16 src_blk,
+		  loff_t max_offset);
+bool mapping_block_in_range(struct bmt_desc *bmtd, int block, int *start,
+			    int *end);
 
 #endif
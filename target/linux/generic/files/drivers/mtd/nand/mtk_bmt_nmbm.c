@@ -74,6 +74,8 @@ struct nmbm_info_table_header {
 };
 
 struct nmbm_instance {
+	struct bmt_desc *bmtd;
+
 	u32 rawpage_size;
 	u32 rawblock_size;
 	u32 rawchip_size;
@@ -200,7 +202,9 @@ static void nlog_table_found(struct nmbm_instance *ni, bool first_table,
  */
 static uint64_t ba2addr(struct nmbm_instance *ni, uint32_t ba)
 {
-	return (uint64_t)ba << bmtd.blk_shift;
+	struct bmt_desc *bmtd = ni->bmtd;
+
+	return (uint64_t)ba << bmtd->blk_shift;
 }
 /*
  * size2blk - Get minimum required blocks for storing specific size of data
@@ -209,7 +213,9 @@ static uint64_t ba2addr(struct nmbm_instance *ni, uint32_t ba)
  */
 static uint32_t size2blk(struct nmbm_instance *ni, uint64_t size)
 {
-	return (size + bmtd.blk_size - 1) >> bmtd.blk_shift;
+	struct bmt_desc *bmtd = ni->bmtd;
+
+	return (size + bmtd->blk_size - 1) >> bmtd->blk_shift;
 }
 
 /*****************************************************************************/
@@ -231,6 +237,7 @@ static uint32_t size2blk(struct nmbm_instance *ni, uint64_t size)
 static int nmbm_read_phys_page(struct nmbm_instance *ni, uint64_t addr,
 			       void *data, void *oob)
 {
+	struct bmt_desc *bmtd = ni->bmtd;
 	int tries, ret;
 
 	for (tries = 0; tries < NMBM_TRY_COUNT; tries++) {
@@ -241,14 +248,14 @@ static int nmbm_read_phys_page(struct nmbm_instance *ni, uint64_t addr,
 		};
 
 		if (data)
-			ops.len = bmtd.pg_size;
+			ops.len = bmtd->pg_size;
 		if (oob)
-			ops.ooblen = mtd_oobavail(bmtd.mtd, &ops);
+			ops.ooblen = mtd_oobavail(bmtd->mtd, &ops);
 
-		ret = bmtd._read_oob(bmtd.mtd, addr, &ops);
+		ret = bmtd->_read_oob(bmtd->mtd, addr, &ops);
 		if (ret == -EUCLEAN)
-			return min_t(u32, bmtd.mtd->bitflip_threshold + 1,
-				     bmtd.mtd->ecc_strength);
+			return min_t(u32, bmtd->mtd->bitflip_threshold + 1,
+				     bmtd->mtd->ecc_strength);
 		if (ret >= 0)
 			return 0;
 	}
@@ -271,6 +278,7 @@ static int nmbm_read_phys_page(struct nmbm_instance *ni, uint64_t addr,
 static bool nmbm_write_phys_page(struct nmbm_instance *ni, uint64_t addr,
 				 const void *data, const void *oob)
 {
+	struct bmt_desc *bmtd = ni->bmtd;
 	int tries, ret;
 
 	for (tries = 0; tries < NMBM_TRY_COUNT; tries++) {
@@ -281,11 +289,11 @@ static bool nmbm_write_phys_page(struct nmbm_instance *ni, uint64_t addr,
 		};
 
 		if (data)
-			ops.len = bmtd.pg_size;
+			ops.len = bmtd->pg_size;
 		if (oob)
-			ops.ooblen = mtd_oobavail(bmtd.mtd, &ops);
+			ops.ooblen = mtd_oobavail(bmtd->mtd, &ops);
 
-		ret = bmtd._write_oob(bmtd.mtd, addr, &ops);
+		ret = bmtd->_write_oob(bmtd->mtd, addr, &ops);
 		if (!ret)
 			return true;
 	}
@@ -304,15 +312,16 @@ static bool nmbm_write_phys_page(struct nmbm_instance *ni, uint64_t addr,
  */
 static bool nmbm_erase_phys_block(struct nmbm_instance *ni, uint64_t addr)
 {
+	struct bmt_desc *bmtd = ni->bmtd;
 	int tries, ret;
 
 	for (tries = 0; tries < NMBM_TRY_COUNT; tries++) {
 		struct erase_info ei = {
 			.addr = addr,
-			.len = bmtd.mtd->erasesize,
+			.len = bmtd->mtd->erasesize,
 		};
 
-		ret = bmtd._erase(bmtd.mtd, &ei);
+		ret = bmtd->_erase(bmtd->mtd, &ei);
 		if (!ret)
 			return true;
 	}
@@ -329,9 +338,10 @@ static bool nmbm_erase_phys_block(struct nmbm_instance *ni, uint64_t addr)
  */
 static bool nmbm_check_bad_phys_block(struct nmbm_instance *ni, uint32_t ba)
 {
+	struct bmt_desc *bmtd = ni->bmtd;
 	uint64_t addr = ba2addr(ni, ba);
 
-	return bmtd._block_isbad(bmtd.mtd, addr);
+	return bmtd->_block_isbad(bmtd->mtd, addr);
 }
 
 /*
@@ -341,11 +351,12 @@ static bool nmbm_check_bad_phys_block(struct nmbm_instance *ni, uint32_t ba)
  */
 static int nmbm_mark_phys_bad_block(struct nmbm_instance *ni, uint32_t ba)
 {
+	struct bmt_desc *bmtd = ni->bmtd;
 	uint64_t addr = ba2addr(ni, ba);
 
 	nlog_info(ni, "Block %u [0x%08llx] will be marked bad\n", ba, addr);
 
-	return bmtd._block_markbad(bmtd.mtd, addr);
+	return bmtd->_block_markbad(bmtd->mtd, addr);
 }
 
 /*****************************************************************************/
@@ -643,6 +654,7 @@ static void nmbm_build_mapping_table(struct nmbm_instance *ni)
  */
 static bool nmbm_erase_block_and_check(struct nmbm_instance *ni, uint32_t ba)
 {
+	struct bmt_desc *bmtd = ni->bmtd;
 	uint64_t addr, off;
 	bool success;
 	int ret;
@@ -658,7 +670,7 @@ static bool nmbm_erase_block_and_check(struct nmbm_instance *ni, uint32_t ba)
 
 	addr = ba2addr(ni, ba);
 
-	for (off = 0; off < bmtd.blk_size; off += bmtd.pg_size) {
+	for (off = 0; off < bmtd->blk_size; off += bmtd->pg_size) {
 		ret = nmbm_read_phys_page(ni, addr + off, ni->page_cache, NULL);
 		if (ret == -EBADMSG) {
 			/*
@@ -734,16 +746,17 @@ static void nmbm_erase_range(struct nmbm_instance *ni, uint32_t ba,
 static bool nmbm_write_repeated_data(struct nmbm_instance *ni, uint32_t ba,
 				     const void *data, uint32_t size)
 {
+	struct bmt_desc *bmtd = ni->bmtd;
 	uint64_t addr, off;
 	bool success;
 	int ret;
 
-	if (size > bmtd.pg_size)
+	if (size > bmtd->pg_size)
 		return false;
 
 	addr = ba2addr(ni, ba);
 
-	for (off = 0; off < bmtd.blk_size; off += bmtd.pg_size) {
+	for (off = 0; off < bmtd->blk_size; off += bmtd->pg_size) {
 		/* Prepare page data. fill 0xff to unused region */
 		memcpy(ni->page_cache, data, size);
 		memset(ni->page_cache + size, 0xff, ni->rawpage_size - size);
@@ -831,18 +844,19 @@ static bool nmbm_write_signature(struct nmbm_instance *ni, uint32_t limit,
 static int nmbn_read_data(struct nmbm_instance *ni, uint64_t addr, void *data,
 			  uint32_t size)
 {
+	struct bmt_desc *bmtd = ni->bmtd;
 	uint64_t off = addr;
 	uint8_t *ptr = data;
 	uint32_t sizeremain = size, chunksize, leading;
 	int ret;
 
 	while (sizeremain) {
-		leading = off & (bmtd.pg_size - 1);
-		chunksize = bmtd.pg_size - leading;
+		leading = off & (bmtd->pg_size - 1);
+		chunksize = bmtd->pg_size - leading;
 		if (chunksize > sizeremain)
 			chunksize = sizeremain;
 
-		if (chunksize == bmtd.pg_size) {
+		if (chunksize == bmtd->pg_size) {
 			ret = nmbm_read_phys_page(ni, off - leading, ptr, NULL);
 			if (ret < 0)
 				return ret;
@@ -876,6 +890,7 @@ static int nmbn_read_data(struct nmbm_instance *ni, uint64_t addr, void *data,
 static bool nmbn_write_verify_data(struct nmbm_instance *ni, uint64_t addr,
 				   const void *data, uint32_t size)
 {
+	struct bmt_desc *bmtd = ni->bmtd;
 	uint64_t off = addr;
 	const uint8_t *ptr = data;
 	uint32_t sizeremain = size, chunksize, leading;
@@ -883,8 +898,8 @@ static bool nmbn_write_verify_data(struct nmbm_instance *ni, uint64_t addr,
 	int ret;
 
 	while (sizeremain) {
-		leading = off & (bmtd.pg_size - 1);
-		chunksize = bmtd.pg_size - leading;
+		leading = off & (bmtd->pg_size - 1);
+		chunksize = bmtd->pg_size - leading;
 		if (chunksize > sizeremain)
 			chunksize = sizeremain;
 
@@ -930,14 +945,15 @@ static bool nmbm_write_mgmt_range(struct nmbm_instance *ni, uint32_t ba,
 				  uint32_t size, uint32_t *actual_start_ba,
 				  uint32_t *actual_end_ba)
 {
+	struct bmt_desc *bmtd = ni->bmtd;
 	const uint8_t *ptr = data;
 	uint32_t sizeremain = size, chunksize;
 	bool success;
 
 	while (sizeremain && ba < limit) {
 		chunksize = sizeremain;
-		if (chunksize > bmtd.blk_size)
-			chunksize = bmtd.blk_size;
+		if (chunksize > bmtd->blk_size)
+			chunksize = bmtd->blk_size;
 
 		if (nmbm_get_block_state(ni, ba) != BLOCK_ST_GOOD)
 			goto next_block;
@@ -1625,6 +1641,7 @@ static bool nmbm_create_info_table(struct nmbm_instance *ni)
  */
 static bool nmbm_create_new(struct nmbm_instance *ni)
 {
+	struct bmt_desc *bmtd = ni->bmtd;
 	bool success;
 
 	/* Determine the boundary of management blocks */
@@ -1644,10 +1661,10 @@ static bool nmbm_create_new(struct nmbm_instance *ni)
 	ni->signature.header.magic = NMBM_MAGIC_SIGNATURE;
 	ni->signature.header.version = NMBM_VER;
 	ni->signature.header.size = sizeof(ni->signature);
-	ni->signature.nand_size = bmtd.total_blks << bmtd.blk_shift;
-	ni->signature.block_size = bmtd.blk_size;
-	ni->signature.page_size = bmtd.pg_size;
-	ni->signature.spare_size = bmtd.mtd->oobsize;
+	ni->signature.nand_size = bmtd->total_blks << bmtd->blk_shift;
+	ni->signature.block_size = bmtd->blk_size;
+	ni->signature.page_size = bmtd->pg_size;
+	ni->signature.spare_size = bmtd->mtd->oobsize;
 	ni->signature.mgmt_start_pb = ni->mgmt_start_ba;
 	ni->signature.max_try_count = NMBM_TRY_COUNT;
 	nmbm_update_checksum(&ni->signature.header);
@@ -1750,6 +1767,7 @@ static bool nmbm_try_load_info_table(struct nmbm_instance *ni, uint32_t ba,
 				     uint32_t *mapping_blocks_top_ba,
 				     bool table_loaded)
 {
+	struct bmt_desc *bmtd = ni->bmtd;
 	struct nmbm_info_table_header *ifthdr = (void *)ni->info_table_cache;
 	uint8_t *off = ni->info_table_cache;
 	uint32_t limit = ba + size2blk(ni, ni->info_table_size);
@@ -1767,8 +1785,8 @@ static bool nmbm_try_load_info_table(struct nmbm_instance *ni, uint32_t ba,
 		}
 
 		chunksize = sizeremain;
-		if (chunksize > bmtd.blk_size)
-			chunksize = bmtd.blk_size;
+		if (chunksize > bmtd->blk_size)
+			chunksize = bmtd->blk_size;
 
 		/* Assume block with ECC error has no info table data */
 		ret = nmbn_read_data(ni, ba2addr(ni, ba), off, chunksize);
@@ -2025,6 +2043,7 @@ static bool nmbm_find_signature(struct nmbm_instance *ni,
 				struct nmbm_signature *signature,
 				uint32_t *signature_ba)
 {
+	struct bmt_desc *bmtd = ni->bmtd;
 	struct nmbm_signature sig;
 	uint64_t off, addr;
 	uint32_t block_count, ba, limit;
@@ -2032,7 +2051,7 @@ static bool nmbm_find_signature(struct nmbm_instance *ni,
 	int ret;
 
 	/* Calculate top and bottom block address */
-	block_count = bmtd.total_blks;
+	block_count = bmtd->total_blks;
 	ba = block_count;
 	limit = (block_count / NMBM_MGMT_DIV) * (NMBM_MGMT_DIV - ni->max_ratio);
 	if (ni->max_reserved_blocks && block_count - limit > ni->max_reserved_blocks)
@@ -2049,8 +2068,8 @@ static bool nmbm_find_signature(struct nmbm_instance *ni,
 		 * As long as at leaset one page contains valid signature,
 		 * the block is treated as a valid signature block.
 		 */
-		for (off = 0; off < bmtd.blk_size;
-		     off += bmtd.pg_size) {
+		for (off = 0; off < bmtd->blk_size;
+		     off += bmtd->pg_size) {
 			ret = nmbn_read_data(ni, addr + off, &sig,
 					     sizeof(sig));
 			if (ret)
@@ -2078,12 +2097,12 @@ static bool nmbm_find_signature(struct nmbm_instance *ni,
  * nmbm_calc_structure_size - Calculate the instance structure size
  * @nld: NMBM lower device structure
  */
-static size_t nmbm_calc_structure_size(void)
+static size_t nmbm_calc_structure_size(struct bmt_desc *bmtd)
 {
 	uint32_t state_table_size, mapping_table_size, info_table_size;
 	uint32_t block_count;
 
-	block_count = bmtd.total_blks;
+	block_count = bmtd->total_blks;
 
 	/* Calculate info table size */
 	state_table_size = ((block_count + NMBM_BITMAP_BLOCKS_PER_UNIT - 1) /
@@ -2091,9 +2110,9 @@ static size_t nmbm_calc_structure_size(void)
 	mapping_table_size = block_count * sizeof(int32_t);
 
 	info_table_size = ALIGN(sizeof(struct nmbm_info_table_header),
-				     bmtd.pg_size);
-	info_table_size += ALIGN(state_table_size, bmtd.pg_size);
-	info_table_size += ALIGN(mapping_table_size, bmtd.pg_size);
+				     bmtd->pg_size);
+	info_table_size += ALIGN(state_table_size, bmtd->pg_size);
+	info_table_size += ALIGN(mapping_table_size, bmtd->pg_size);
 
 	return info_table_size + state_table_size + mapping_table_size +
 		sizeof(struct nmbm_instance);
@@ -2105,13 +2124,14 @@ static size_t nmbm_calc_structure_size(void)
  */
 static void nmbm_init_structure(struct nmbm_instance *ni)
 {
+	struct bmt_desc *bmtd = ni->bmtd;
 	uint32_t pages_per_block, blocks_per_chip;
 	uintptr_t ptr;
 
-	pages_per_block = bmtd.blk_size / bmtd.pg_size;
-	blocks_per_chip = bmtd.total_blks;
+	pages_per_block = bmtd->blk_size / bmtd->pg_size;
+	blocks_per_chip = bmtd->total_blks;
 
-	ni->rawpage_size = bmtd.pg_size + bmtd.mtd->oobsize;
+	ni->rawpage_size = bmtd->pg_size + bmtd->mtd->oobsize;
 	ni->rawblock_size = pages_per_block * ni->rawpage_size;
 	ni->rawchip_size = blocks_per_chip * ni->rawblock_size;
 
@@ -2124,15 +2144,15 @@ static void nmbm_init_structure(struct nmbm_instance *ni)
 	ni->mapping_table_size = ni->block_count * sizeof(*ni->block_mapping);
 
 	ni->info_table_size = ALIGN(sizeof(ni->info_table),
-					 bmtd.pg_size);
+					 bmtd->pg_size);
 	ni->info_table.state_table_off = ni->info_table_size;
 
 	ni->info_table_size += ALIGN(ni->state_table_size,
-					  bmtd.pg_size);
+					  bmtd->pg_size);
 	ni->info_table.mapping_table_off = ni->info_table_size;
 
 	ni->info_table_size += ALIGN(ni->mapping_table_size,
-					  bmtd.pg_size);
+					  bmtd->pg_size);
 
 	ni->info_table_spare_blocks = nmbm_get_spare_block_count(
 		size2blk(ni, ni->info_table_size));
@@ -2149,7 +2169,7 @@ static void nmbm_init_structure(struct nmbm_instance *ni)
 	ni->block_mapping = (void *)ptr;
 	ptr += ni->mapping_table_size;
 
-	ni->page_cache = bmtd.data_buf;
+	ni->page_cache = bmtd->data_buf;
 
 	/* Initialize block state table */
 	ni->block_state_changed = 0;
@@ -2165,6 +2185,7 @@ static void nmbm_init_structure(struct nmbm_instance *ni)
  */
 static int nmbm_attach(struct nmbm_instance *ni)
 {
+	struct bmt_desc *bmtd = ni->bmtd;
 	bool success;
 
 	if (!ni)
@@ -2197,10 +2218,10 @@ static int nmbm_attach(struct nmbm_instance *ni)
 		return -EINVAL;
 	}
 
-	if (ni->signature.nand_size != bmtd.total_blks << bmtd.blk_shift ||
-	    ni->signature.block_size != bmtd.blk_size ||
-	    ni->signature.page_size != bmtd.pg_size ||
-	    ni->signature.spare_size != bmtd.mtd->oobsize) {
+	if (ni->signature.nand_size != bmtd->total_blks << bmtd->blk_shift ||
+	    ni->signature.block_size != bmtd->blk_size ||
+	    ni->signature.page_size != bmtd->pg_size ||
+	    ni->signature.spare_size != bmtd->mtd->oobsize) {
 		nlog_err(ni, "NMBM configuration mismatch\n");
 		return -EINVAL;
 	}
@@ -2212,9 +2233,10 @@ static int nmbm_attach(struct nmbm_instance *ni)
 	return 0;
 }
 
-static bool remap_block_nmbm(u16 block, u16 mapped_block, int copy_len)
+static bool remap_block_nmbm(struct bmt_desc *bmtd, u16 block, u16 mapped_block,
+			     int copy_len)
 {
-	struct nmbm_instance *ni = bmtd.ni;
+	struct nmbm_instance *ni = bmtd->ni;
 	int new_block;
 
 	if (block >= ni->data_block_count)
@@ -2225,17 +2247,17 @@ static bool remap_block_nmbm(u16 block, u16 mapped_block, int copy_len)
 		return false;
 
 	new_block = ni->block_mapping[block];
-	bbt_nand_erase(new_block);
+	bbt_nand_erase(bmtd, new_block);
     if (copy_len > 0)
-		bbt_nand_copy(new_block, mapped_block, copy_len);
+		bbt_nand_copy(bmtd, new_block, mapped_block, copy_len);
 	nmbm_update_info_table(ni);
 
 	return true;
 }
 
-static int get_mapping_block_index_nmbm(int block)
+static int get_mapping_block_index_nmbm(struct bmt_desc *bmtd, int block)
 {
-	struct nmbm_instance *ni = bmtd.ni;
+	struct nmbm_instance *ni = bmtd->ni;
 
 	if (block >= ni->data_block_count)
 		return -1;
@@ -2243,16 +2265,17 @@ static int get_mapping_block_index_nmbm(int block)
 	return ni->block_mapping[block];
 }
 
-static int mtk_bmt_init_nmbm(struct device_node *np)
+static int mtk_bmt_init_nmbm(struct bmt_desc *bmtd, struct device_node *np)
 {
 	struct nmbm_instance *ni;
 	int ret;
 
-	ni = kzalloc(nmbm_calc_structure_size(), GFP_KERNEL);
+	ni = kzalloc(nmbm_calc_structure_size(bmtd), GFP_KERNEL);
 	if (!ni)
 		return -ENOMEM;
 
-	bmtd.ni = ni;
+	bmtd->ni = ni;
+	ni->bmtd = bmtd;
 
 	if (of_property_read_u32(np, "mediatek,bmt-max-ratio", &ni->max_ratio))
 		ni->max_ratio = 1;
@@ -2268,20 +2291,26 @@ static int mtk_bmt_init_nmbm(struct device_node *np)
 	if (ret)
 		goto out;
 
-	bmtd.mtd->size = ni->data_block_count << bmtd.blk_shift;
+	bmtd->mtd->size = ni->data_block_count << bmtd->blk_shift;
 
 	return 0;
 
 out:
 	kfree(ni);
-	bmtd.ni = NULL;
+	bmtd->ni = NULL;
 
 	return ret;
 }
 
-static int mtk_bmt_debug_nmbm(void *data, u64 val)
+static void mtk_bmt_cleanup_nmbm(struct bmt_desc *bmtd)
+{
+	kfree(bmtd->ni);
+	bmtd->ni = NULL;
+}
+
+static int mtk_bmt_debug_nmbm(struct bmt_desc *bmtd, u64 val)
 {
-	struct nmbm_instance *ni = bmtd.ni;
+	struct nmbm_instance *ni = bmtd->ni;
 	int i;
 
 	switch (val) {
@@ -2297,9 +2326,9 @@ static int mtk_bmt_debug_nmbm(void *data, u64 val)
 	return 0;
 }
 
-static void unmap_block_nmbm(u16 block)
+static void unmap_block_nmbm(struct bmt_desc *bmtd, u16 block)
 {
-	struct nmbm_instance *ni = bmtd.ni;
+	struct nmbm_instance *ni = bmtd->ni;
 	int start, offset;
 	int new_block;
 
@@ -2341,6 +2370,7 @@ static void unmap_block_nmbm(u16 block)
 
 const struct mtk_bmt_ops mtk_bmt_nmbm_ops = {
 	.init = mtk_bmt_init_nmbm,
+	.cleanup = mtk_bmt_cleanup_nmbm,
 	.remap_block = remap_block_nmbm,
 	.unmap_block = unmap_block_nmbm,
 	.get_mapping_block = get_mapping_block_index_nmbm,
@@ -0,0 +1,580 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * KUnit tests for the MediaTek NAND bad block management backends. They run
+ * on a nandsim device, whose contents are erased, e.g.
+ *
+ *   modprobe nandsim id_bytes=0xec,0xda,0x00,0x15
+ *   modprobe mtk_bmt_test
+ *
+ * Bad blocks and bitflips are injected below the remapping layer by wrapping
+ * the nandsim MTD operations. The read benchmark compares per-block reads
+ * with reads that are merged across contiguous blocks, its size can be set
+ * with the bench_mb parameter.
+ */
+
+#include <kunit/test.h>
+#include <linux/bitmap.h>
+#include <linux/ktime.h>
+#include <linux/math64.h>
+#include <linux/module.h>
+#include <linux/mtd/mtd.h>
+#include <linux/of.h>
+#include <linux/random.h>
+#include <linux/slab.h>
+#include <linux/version.h>
+#include "mtk_bmt.h"
+
+#define MTK_BMT_TEST_MAX_MTD	64
+#define MTK_BMT_TEST_CHUNK	SZ_1M
+
+static unsigned int bench_mb = 16;
+module_param(bench_mb, uint, 0444);
+MODULE_PARM_DESC(bench_mb, "Size of the read benchmark in MiB");
+
+struct mtk_bmt_test_backend {
+	const char *name;
+	const char *prop;
+	/* the bbt backend does not create its table */
+	bool bbt_sig;
+};
+
+static const struct mtk_bmt_test_backend mtk_bmt_test_backends[] = {
+	{ .name = "v2", .prop = "mediatek,bmt-v2" },
+	{ .name = "bbt", .prop = "mediatek,bbt", .bbt_sig = true },
+	{ .name = "nmbm", .prop = "mediatek,nmbm" },
+};
+
+static void mtk_bmt_test_backend_desc(const struct mtk_bmt_test_backend *b,
+				      char *desc)
+{
+	strscpy(desc, b->name, KUNIT_PARAM_DESC_SIZE);
+}
+
+KUNIT_ARRAY_PARAM(mtk_bmt_test_backend, mtk_bmt_test_backends,
+		  mtk_bmt_test_backend_desc);
+
+struct mtk_bmt_test {
+	struct kunit *test;
+	/* nandsim partition holding the device, the BMT attaches to its master */
+	struct mtd_info *part;
+	struct mtd_info *mtd;
+	u64 size;
+	u32 bitflip_threshold;
+
+	struct of_changeset ocs;
+	struct device_node *np;
+	bool ocs_applied;
+
+	int (*_read_oob)(struct mtd_info *mtd, loff_t from,
+			 struct mtd_oob_ops *ops);
+	int (*_write_oob)(struct mtd_info *mtd, loff_t to,
+			  struct mtd_oob_ops *ops);
+	int (*_erase)(struct mtd_info *mtd, struct erase_info *instr);
+
+	/* physical blocks failing erase and write, or reading with bitflips */
+	unsigned long *fail;
+	unsigned long *flips;
+	/* reads that reached nandsim */
+	unsigned int reads;
+
+	u8 *buf;
+	u8 *cmp;
+};
+
+/* state of the wrapped nandsim operations, there is one test at a time */
+static struct mtk_bmt_test *mtk_bmt_test_inj;
+
+static bool
+mtk_bmt_test_hit(struct mtk_bmt_test *t, unsigned long *map, loff_t ofs,
+		 size_t len)
+{
+	u32 first = mtd_div_by_eb(ofs, t->mtd);
+	u32 last = mtd_div_by_eb(ofs + max_t(size_t, len, 1) - 1, t->mtd);
+
+	return find_next_bit(map, last + 1, first) <= last;
+}
+
+static int
+mtk_bmt_test_read_oob(struct mtd_info *mtd, loff_t from,
+		      struct mtd_oob_ops *ops)
+{
+	struct mtk_bmt_test *t = mtk_bmt_test_inj;
+	int ret;
+
+	t->reads++;
+	ret = t->_read_oob(mtd, from, ops);
+	if (ret < 0 || !mtk_bmt_test_hit(t, t->flips, from, ops->len))
+		return ret;
+
+	return max_t(int, ret, mtd->bitflip_threshold);
+}
+
+static int
+mtk_bmt_test_write_oob(struct mtd_info *mtd, loff_t to,
+		       struct mtd_oob_ops *ops)
+{
+	struct mtk_bmt_test *t = mtk_bmt_test_inj;
+
+	if (mtk_bmt_test_hit(t, t->fail, to, ops->len))
+		return -EIO;
+
+	return t->_write_oob(mtd, to, ops);
+}
+
+static int mtk_bmt_test_erase(struct mtd_info *mtd, struct erase_info *instr)
+{
+	struct mtk_bmt_test *t = mtk_bmt_test_inj;
+
+	if (mtk_bmt_test_hit(t, t->fail, instr->addr, instr->len)) {
+		instr->fail_addr = instr->addr;
+		return -EIO;
+	}
+
+	return t->_erase(mtd, instr);
+}
+
+static struct mtd_info *mtk_bmt_test_get_nandsim(void)
+{
+	struct mtd_info *mtd;
+	int i;
+
+	for (i = 0; i < MTK_BMT_TEST_MAX_MTD; i++) {
+		mtd = get_mtd_device(NULL, i);
+		if (IS_ERR(mtd))
+			continue;
+
+		if (strstarts(mtd->name, "NAND simulator"))
+			return mtd;
+
+		put_mtd_device(mtd);
+	}
+
+	return NULL;
+}
+
+static void mtk_bmt_test_cleanup(void *data)
+{
+	struct mtk_bmt_test *t = data;
+	struct mtd_info *mtd = t->mtd;
+
+	/* before the node goes away, the backends keep its properties */
+	mtk_bmt_detach(mtd);
+
+	if (mtk_bmt_test_inj == t) {
+		mtd->_read_oob = t->_read_oob;
+		mtd->_write_oob = t->_write_oob;
+		mtd->_erase = t->_erase;
+		mtk_bmt_test_inj = NULL;
+	}
+
+	if (t->ocs_applied)
+		of_changeset_revert(&t->ocs);
+	of_changeset_destroy(&t->ocs);
+
+	mtd->bitflip_threshold = t->bitflip_threshold;
+	put_mtd_device(t->part);
+}
+
+static void mtk_bmt_test_erase_all(struct mtk_bmt_test *t)
+{
+	struct mtd_info *mtd = t->mtd;
+	loff_t ofs;
+
+	/* blocks that nandsim was told are bad stay so */
+	for (ofs = 0; ofs < t->size; ofs += mtd->erasesize) {
+		struct erase_info instr = {
+			.addr = ofs,
+			.len = mtd->erasesize,
+		};
+
+		mtd_erase(mtd, &instr);
+	}
+}
+
+static void mtk_bmt_test_write_bbt(struct mtk_bmt_test *t)
+{
+	struct kunit *test = t->test;
+	struct mtd_info *mtd = t->mtd;
+	struct mtd_oob_ops ops = {
+		.mode = MTD_OPS_PLACE_OOB,
+		.oobbuf = "\xffmtknand",
+		.ooblen = 8,
+		.len = mtd->writesize,
+	};
+
+	/* an all zero table has no bad blocks */
+	ops.datbuf = kunit_kzalloc(test, mtd->writesize, GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, ops.datbuf);
+	KUNIT_ASSERT_EQ(test, mtd_write_oob(mtd, t->size - mtd->erasesize, &ops), 0);
+}
+
+static void mtk_bmt_test_create_node(struct mtk_bmt_test *t)
+{
+	const struct mtk_bmt_test_backend *b = t->test->param_value;
+	struct kunit *test = t->test;
+	u32 range[2];
+
+	if (!of_root)
+		kunit_skip(test, "no device tree");
+
+	t->np = of_changeset_create_node(&t->ocs, of_root, "mtk-bmt-test");
+	KUNIT_ASSERT_NOT_NULL(test, t->np);
+
+	/* bbt only remaps within a range, use the first half for all */
+	range[0] = 0;
+	range[1] = min_t(u64, t->size / 2, SZ_2G);
+	KUNIT_ASSERT_EQ(test, of_changeset_add_prop_bool(&t->ocs, t->np, b->prop), 0);
+	KUNIT_ASSERT_EQ(test, of_changeset_add_prop_bool(&t->ocs, t->np,
+							 "mediatek,bmt-force-create"), 0);
+	KUNIT_ASSERT_EQ(test, of_changeset_add_prop_u32_array(&t->ocs, t->np,
+							      "mediatek,bmt-remap-range",
+							      range, ARRAY_SIZE(range)), 0);
+	KUNIT_ASSERT_EQ(test, of_changeset_apply(&t->ocs), 0);
+	t->ocs_applied = true;
+}
+
+static struct mtk_bmt_test *mtk_bmt_test_setup(struct kunit *test)
+{
+	const struct mtk_bmt_test_backend *b = test->param_value;
+	struct mtk_bmt_test *t;
+	struct bmt_desc *bmtd;
+	struct mtd_info *part, *mtd;
+	u32 blocks;
+
+	t = kunit_kzalloc(test, sizeof(*t), GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, t);
+
+	part = mtk_bmt_test_get_nandsim();
+	if (!part)
+		kunit_skip(test, "no nandsim device");
+
+	mtd = mtd_get_master(part);
+	if (mtd->writesize < 2048 || mtd->oobsize < 64) {
+		put_mtd_device(part);
+		kunit_skip(test, "nandsim needs large pages");
+	}
+
+	bmtd = mtk_bmt_get(mtd);
+	if (bmtd) {
+		mtk_bmt_put(bmtd);
+		put_mtd_device(part);
+		kunit_skip(test, "%s is in use", mtd->name);
+	}
+
+	t->test = test;
+	t->part = part;
+	t->mtd = mtd;
+	t->size = mtd->size;
+	t->bitflip_threshold = mtd->bitflip_threshold;
+	of_changeset_init(&t->ocs);
+	KUNIT_ASSERT_EQ(test, kunit_add_action_or_reset(test, mtk_bmt_test_cleanup, t), 0);
+
+	blocks = mtd_div_by_eb(t->size, mtd);
+	t->fail = kunit_kcalloc(test, BITS_TO_LONGS(blocks), sizeof(long), GFP_KERNEL);
+	t->flips = kunit_kcalloc(test, BITS_TO_LONGS(blocks), sizeof(long), GFP_KERNEL);
+	t->buf = kunit_kmalloc(test, mtd->erasesize, GFP_KERNEL);
+	t->cmp = kunit_kmalloc(test, mtd->erasesize, GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, t->fail);
+	KUNIT_ASSERT_NOT_NULL(test, t->flips);
+	KUNIT_ASSERT_NOT_NULL(test, t->buf);
+	KUNIT_ASSERT_NOT_NULL(test, t->cmp);
+
+	/* masters that are not registered have no default */
+	if (!mtd->bitflip_threshold)
+		mtd->bitflip_threshold = max(mtd->ecc_strength, 1U);
+
+	mtk_bmt_test_create_node(t);
+	mtk_bmt_test_erase_all(t);
+	if (b->bbt_sig)
+		mtk_bmt_test_write_bbt(t);
+
+	t->_read_oob = mtd->_read_oob;
+	t->_write_oob = mtd->_write_oob;
+	t->_erase = mtd->_erase;
+	mtk_bmt_test_inj = t;
+	mtd->_read_oob = mtk_bmt_test_read_oob;
+	mtd->_write_oob = mtk_bmt_test_write_oob;
+	mtd->_erase = mtk_bmt_test_erase;
+
+	KUNIT_ASSERT_EQ(test, mtk_bmt_attach_node(mtd, t->np), 0);
+	KUNIT_ASSERT_LT(test, mtd->size, t->size);
+
+	return t;
+}
+
+static int mtk_bmt_test_map(struct mtk_bmt_test *t, int block)
+{
+	struct bmt_desc *bmtd;
+	int ret;
+
+	bmtd = mtk_bmt_get(t->mtd);
+	KUNIT_ASSERT_NOT_NULL(t->test, bmtd);
+	ret = bmtd->ops->get_mapping_block(bmtd, block);
+	mtk_bmt_put(bmtd);
+
+	return ret;
+}
+
+static void mtk_bmt_test_write(struct mtk_bmt_test *t, int block)
+{
+	struct mtd_info *mtd = t->mtd;
+	size_t retlen;
+
+	get_random_bytes(t->buf, mtd->erasesize);
+	KUNIT_ASSERT_EQ(t->test, mtd_write(mtd, (loff_t)block * mtd->erasesize,
+					   mtd->erasesize, &retlen, t->buf), 0);
+	KUNIT_EXPECT_EQ(t->test, retlen, mtd->erasesize);
+}
+
+/* returns the mtd_read() result, -EUCLEAN for bitflips */
+static int mtk_bmt_test_check(struct mtk_bmt_test *t, int block)
+{
+	struct mtd_info *mtd = t->mtd;
+	size_t retlen;
+	int ret;
+
+	memset(t->cmp, 0, mtd->erasesize);
+	ret = mtd_read(mtd, (loff_t)block * mtd->erasesize, mtd->erasesize,
+		       &retlen, t->cmp);
+	KUNIT_EXPECT_EQ(t->test, retlen, mtd->erasesize);
+	KUNIT_EXPECT_MEMEQ(t->test, t->cmp, t->buf, mtd->erasesize);
+
+	return ret;
+}
+
+static void mtk_bmt_test_attach(struct kunit *test)
+{
+	struct mtk_bmt_test *t = mtk_bmt_test_setup(test);
+	struct mtd_info *mtd = t->mtd;
+	u64 size = mtd->size;
+	int i;
+
+	for (i = 0; i < 4; i++)
+		KUNIT_EXPECT_EQ(test, mtk_bmt_test_map(t, i), i);
+
+	mtk_bmt_test_write(t, 1);
+	KUNIT_EXPECT_EQ(test, mtk_bmt_test_check(t, 1), 0);
+
+	mtk_bmt_detach(mtd);
+	KUNIT_EXPECT_EQ(test, mtd->size, t->size);
+	KUNIT_EXPECT_PTR_EQ(test, mtd->_read_oob, mtk_bmt_test_read_oob);
+
+	/* the table written on the first attach is found again */
+	KUNIT_ASSERT_EQ(test, mtk_bmt_attach_node(mtd, t->np), 0);
+	KUNIT_EXPECT_EQ(test, mtd->size, size);
+	KUNIT_EXPECT_EQ(test, mtk_bmt_test_check(t, 1), 0);
+	KUNIT_EXPECT_EQ(test, mtk_bmt_attach_node(mtd, t->np), -EBUSY);
+}
+
+static void mtk_bmt_test_write_fail(struct kunit *test)
+{
+	struct mtk_bmt_test *t = mtk_bmt_test_setup(test);
+	int block = 4, pblock;
+
+	pblock = mtk_bmt_test_map(t, block);
+	set_bit(pblock, t->fail);
+
+	mtk_bmt_test_write(t, block);
+	KUNIT_EXPECT_NE(test, mtk_bmt_test_map(t, block), pblock);
+	KUNIT_EXPECT_EQ(test, mtk_bmt_test_check(t, block), 0);
+}
+
+static void mtk_bmt_test_erase_fail(struct kunit *test)
+{
+	struct mtk_bmt_test *t = mtk_bmt_test_setup(test);
+	struct mtd_info *mtd = t->mtd;
+	struct erase_info instr = {
+		.len = mtd->erasesize,
+	};
+	int block = 6, pblock;
+
+	mtk_bmt_test_write(t, block);
+	pblock = mtk_bmt_test_map(t, block);
+	set_bit(pblock, t->fail);
+
+	instr.addr = (loff_t)block * mtd->erasesize;
+	KUNIT_EXPECT_EQ(test, mtd_erase(mtd, &instr), 0);
+	KUNIT_EXPECT_NE(test, mtk_bmt_test_map(t, block), pblock);
+
+	memset(t->buf, 0xff, mtd->erasesize);
+	KUNIT_EXPECT_EQ(test, mtk_bmt_test_check(t, block), 0);
+}
+
+static void mtk_bmt_test_bitflips(struct kunit *test)
+{
+	struct mtk_bmt_test *t = mtk_bmt_test_setup(test);
+	struct bmt_desc *bmtd;
+	int block = 8, pblock;
+
+	mtk_bmt_test_write(t, block);
+	pblock = mtk_bmt_test_map(t, block);
+	set_bit(pblock, t->flips);
+
+	/* worn blocks are moved on read, with their data */
+	KUNIT_EXPECT_EQ(test, mtk_bmt_test_check(t, block), -EUCLEAN);
+	KUNIT_EXPECT_NE(test, mtk_bmt_test_map(t, block), pblock);
+	KUNIT_EXPECT_EQ(test, mtk_bmt_test_check(t, block), 0);
+
+	bmtd = mtk_bmt_get(t->mtd);
+	KUNIT_ASSERT_NOT_NULL(test, bmtd);
+	if (bmtd->bitflips)
+		KUNIT_EXPECT_GE(test, bmtd->bitflips[pblock],
+				t->mtd->bitflip_threshold);
+	mtk_bmt_put(bmtd);
+}
+
+KUNIT_DEFINE_ACTION_WRAPPER(mtk_bmt_test_kvfree, kvfree, const void *);
+
+static u8 *mtk_bmt_test_kvmalloc(struct kunit *test, size_t size)
+{
+	u8 *buf = kvmalloc(size, GFP_KERNEL);
+
+	KUNIT_ASSERT_NOT_NULL(test, buf);
+	KUNIT_ASSERT_EQ(test, kunit_add_action_or_reset(test, mtk_bmt_test_kvfree, buf), 0);
+
+	return buf;
+}
+
+static void mtk_bmt_test_read_merge(struct kunit *test)
+{
+	struct mtk_bmt_test *t = mtk_bmt_test_setup(test);
+	struct mtd_info *mtd = t->mtd;
+	struct erase_info instr = {
+		.len = mtd->erasesize,
+	};
+	int block = 16, blocks = 8, remapped = 19, pblock, i;
+	/* the last one, bbt moves the blocks after a remapped one */
+	int worn = block + blocks - 1;
+	size_t len = blocks * mtd->erasesize, retlen;
+	loff_t ofs = (loff_t)block * mtd->erasesize;
+	struct bmt_desc *bmtd;
+	u8 *buf, *cmp;
+	u64 merged;
+
+	buf = mtk_bmt_test_kvmalloc(test, len);
+	cmp = mtk_bmt_test_kvmalloc(test, len);
+
+	/* a remapped block in the middle splits the range */
+	set_bit(mtk_bmt_test_map(t, remapped), t->fail);
+	instr.addr = (loff_t)remapped * mtd->erasesize;
+	KUNIT_ASSERT_EQ(test, mtd_erase(mtd, &instr), 0);
+	bitmap_zero(t->fail, mtd_div_by_eb(t->size, mtd));
+
+	get_random_bytes(buf, len);
+	KUNIT_ASSERT_EQ(test, mtd_write(mtd, ofs, len, &retlen, buf), 0);
+
+	bmtd = mtk_bmt_get(mtd);
+	KUNIT_ASSERT_NOT_NULL(test, bmtd);
+	merged = bmtd->stats.merged_reads;
+	mtk_bmt_put(bmtd);
+
+	t->reads = 0;
+	KUNIT_EXPECT_EQ(test, mtd_read(mtd, ofs, len, &retlen, cmp), 0);
+	KUNIT_EXPECT_EQ(test, retlen, len);
+	KUNIT_EXPECT_MEMEQ(test, cmp, buf, len);
+	KUNIT_EXPECT_LT(test, t->reads, blocks);
+
+	bmtd = mtk_bmt_get(mtd);
+	KUNIT_ASSERT_NOT_NULL(test, bmtd);
+	KUNIT_EXPECT_GT(test, bmtd->stats.merged_reads, merged);
+	mtk_bmt_put(bmtd);
+
+	/* the worn block of a merged read is found and moved */
+	pblock = mtk_bmt_test_map(t, worn);
+	set_bit(pblock, t->flips);
+	memset(cmp, 0, len);
+	KUNIT_EXPECT_EQ(test, mtd_read(mtd, ofs, len, &retlen, cmp), -EUCLEAN);
+	KUNIT_EXPECT_MEMEQ(test, cmp, buf, len);
+	KUNIT_EXPECT_NE(test, mtk_bmt_test_map(t, worn), pblock);
+	for (i = block; i < block + blocks; i++)
+		if (i != worn)
+			KUNIT_EXPECT_FALSE(test, test_bit(mtk_bmt_test_map(t, i), t->flips));
+
+	memset(cmp, 0, len);
+	KUNIT_EXPECT_EQ(test, mtd_read(mtd, ofs, len, &retlen, cmp), 0);
+	KUNIT_EXPECT_MEMEQ(test, cmp, buf, len);
+}
+
+static u64 mtk_bmt_test_read_pass(struct mtk_bmt_test *t, u8 *buf, u64 size,
+				  size_t chunk)
+{
+	struct mtd_info *mtd = t->mtd;
+	size_t retlen;
+	u64 start, ofs;
+
+	t->reads = 0;
+	start = ktime_get_ns();
+	for (ofs = 0; ofs < size; ofs += chunk)
+		KUNIT_ASSERT_EQ(t->test, mtd_read(mtd, ofs, chunk, &retlen,
+						  buf + (ofs % MTK_BMT_TEST_CHUNK)), 0);
+
+	return max_t(u64, ktime_get_ns() - start, 1);
+}
+
+/* KiB/s */
+static u64 mtk_bmt_test_rate(u64 size, u64 ns)
+{
+	return div64_u64(size * NSEC_PER_SEC, ns * SZ_1K);
+}
+
+static void mtk_bmt_test_read_bench(struct kunit *test)
+{
+	const struct mtk_bmt_test_backend *b = test->param_value;
+	struct mtk_bmt_test *t = mtk_bmt_test_setup(test);
+	struct mtd_info *mtd = t->mtd;
+	unsigned int block_reads;
+	u64 size, ofs, block_ns, chunk_ns;
+	size_t retlen;
+	u8 *buf;
+
+	/* within the remap range, the backends differ in the rest */
+	size = min_t(u64, (u64)bench_mb * SZ_1M, t->size / 2);
+	size = round_down(size, MTK_BMT_TEST_CHUNK);
+	if (!size)
+		kunit_skip(test, "no room for the benchmark");
+
+	buf = mtk_bmt_test_kvmalloc(test, MTK_BMT_TEST_CHUNK);
+	for (ofs = 0; ofs < size; ofs += MTK_BMT_TEST_CHUNK) {
+		get_random_bytes(buf, MTK_BMT_TEST_CHUNK);
+		KUNIT_ASSERT_EQ(test, mtd_write(mtd, ofs, MTK_BMT_TEST_CHUNK,
+						&retlen, buf), 0);
+	}
+
+	block_ns = mtk_bmt_test_read_pass(t, buf, size, mtd->erasesize);
+	block_reads = t->reads;
+	chunk_ns = mtk_bmt_test_read_pass(t, buf, size, MTK_BMT_TEST_CHUNK);
+
+	kunit_info(test, "%s: %llu MiB, %u KiB reads: %llu KiB/s, %u nand reads\n",
+		   b->name, size >> 20, mtd->erasesize >> 10,
+		   mtk_bmt_test_rate(size, block_ns), block_reads);
+	kunit_info(test, "%s: %llu MiB, %u KiB reads: %llu KiB/s, %u nand reads\n",
+		   b->name, size >> 20, MTK_BMT_TEST_CHUNK >> 10,
+		   mtk_bmt_test_rate(size, chunk_ns), t->reads);
+
+	KUNIT_EXPECT_LT(test, t->reads, block_reads);
+}
+
+static struct kunit_case mtk_bmt_test_cases[] = {
+	KUNIT_CASE_PARAM(mtk_bmt_test_attach, mtk_bmt_test_backend_gen_params),
+	KUNIT_CASE_PARAM(mtk_bmt_test_write_fail, mtk_bmt_test_backend_gen_params),
+	KUNIT_CASE_PARAM(mtk_bmt_test_erase_fail, mtk_bmt_test_backend_gen_params),
+	KUNIT_CASE_PARAM(mtk_bmt_test_bitflips, mtk_bmt_test_backend_gen_params),
+	KUNIT_CASE_PARAM(mtk_bmt_test_read_merge, mtk_bmt_test_backend_gen_params),
+	KUNIT_CASE_PARAM_ATTR(mtk_bmt_test_read_bench, mtk_bmt_test_backend_gen_params,
+			      { .speed = KUNIT_SPEED_SLOW }),
+	{}
+};
+
+static struct kunit_suite mtk_bmt_test_suite = {
+	.name = "mtk-bmt",
+	.test_cases = mtk_bmt_test_cases,
+};
+kunit_test_suite(mtk_bmt_test_suite);
+
+#if LINUX_VERSION_CODE < KERNEL_VERSION(6,13,0)
+MODULE_IMPORT_NS(EXPORTED_FOR_KUNIT_TESTING);
+#else
+MODULE_IMPORT_NS("EXPORTED_FOR_KUNIT_TESTING");
+#endif
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("KUnit tests for the MediaTek NAND bad block management table");
@@ -1745,6 +1745,41 @@ unlock:
 	return ret;
 }
 
+int
+ar8xxx_sw_get_mibs(struct switch_dev *dev, struct switch_mibs *mibs)
+{
+	struct ar8xxx_priv *priv = swdev_to_ar8xxx(dev);
+	const struct ar8xxx_chip *chip = priv->chip;
+	int i, ret;
+
+	if (!ar8xxx_has_mib_counters(priv) || !priv->mib_poll_interval)
+		return -EOPNOTSUPP;
+
+	ret = switch_mibs_alloc(dev, mibs, chip->num_mibs);
+	if (ret)
+		return ret;
+
+	for (i = 0; i < chip->num_mibs; i++)
+		if (chip->mib_decs[i].type <= priv->mib_type)
+			mibs->names[i] = chip->mib_decs[i].name;
+
+	mutex_lock(&priv->mib_lock);
+	ret = ar8xxx_mib_capture(priv);
+	if (ret)
+		goto unlock;
+
+	/* one capture covers all ports */
+	for (i = 0; i < dev->ports; i++)
+		ar8xxx_mib_fetch_port_stat(priv, i, false);
+
+	memcpy(mibs->values, priv->mib_stats,
+	       array3_size(dev->ports, chip->num_mibs, sizeof(*priv->mib_stats)));
+
+unlock:
+	mutex_unlock(&priv->mib_lock);
+	return ret;
+}
+
 int
 ar8xxx_sw_set_arl_age_time(struct switch_dev *dev, const struct switch_attr *attr,
 			   struct switch_val *val)
@@ -2054,6 +2089,7 @@ static const struct switch_dev_ops ar8xxx_sw_ops = {
 	.reset_switch = ar8xxx_sw_reset_switch,
 	.get_port_link = ar8xxx_sw_get_port_link,
 	.get_port_stats = ar8xxx_sw_get_port_stats,
+	.get_mibs = ar8xxx_sw_get_mibs,
 };
 
 static const struct ar8xxx_chip ar7240sw_chip = {
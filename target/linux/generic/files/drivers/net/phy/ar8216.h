@@ -625,6 +625,8 @@ ar8xxx_sw_get_port_mib(struct switch_dev *dev,
                        const struct switch_attr *attr,
                        struct switch_val *val);
 int
+ar8xxx_sw_get_mibs(struct switch_dev *dev, struct switch_mibs *mibs);
+int
 ar8xxx_sw_get_arl_age_time(struct switch_dev *dev,
 			   const struct switch_attr *attr,
 			   struct switch_val *val);
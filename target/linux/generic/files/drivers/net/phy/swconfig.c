@@ -906,6 +906,99 @@ error:
 	return err;
 }
 
+static int
+swconfig_send_mibs(struct swconfig_callback *cb, void *arg)
+{
+	const struct switch_mibs *mibs = arg;
+	struct genl_info *info = cb->info;
+	struct sk_buff *msg = cb->msg;
+	int port = cb->args[0];
+	const u64 *values = &mibs->values[port * mibs->n_mibs];
+	struct nlattr *n, *p;
+	void *hdr;
+	int i;
+
+	hdr = genlmsg_put(msg, info->snd_portid, info->snd_seq, &switch_fam,
+			NLM_F_MULTI, SWITCH_CMD_GET_MIBS);
+	if (!hdr)
+		return -1;
+
+	if (nla_put_u32(msg, SWITCH_ATTR_OP_PORT, port))
+		goto nla_put_failure;
+
+	n = nla_nest_start(msg, SWITCH_ATTR_OP_VALUE_MIBS);
+	if (!n)
+		goto nla_put_failure;
+
+	for (i = 0; i < mibs->n_mibs; i++) {
+		if (!mibs->names[i])
+			continue;
+
+		p = nla_nest_start(msg, SWITCH_ATTR_MIB);
+		if (!p)
+			goto nla_put_failure;
+		if (nla_put_string(msg, SWITCH_MIB_NAME, mibs->names[i]))
+			goto nla_put_failure;
+		if (nla_put_u64_64bit(msg, SWITCH_MIB_VALUE, values[i],
+				      SWITCH_MIB_PAD))
+			goto nla_put_failure;
+		nla_nest_end(msg, p);
+	}
+	nla_nest_end(msg, n);
+
+	genlmsg_end(msg, hdr);
+	return msg->len;
+nla_put_failure:
+	genlmsg_cancel(msg, hdr);
+	return -EMSGSIZE;
+}
+
+/* send the counters of all ports, captured by the driver in one go */
+static int
+swconfig_get_mibs(struct sk_buff *skb, struct genl_info *info)
+{
+	struct switch_mibs mibs = {};
+	struct swconfig_callback cb;
+	struct switch_dev *dev;
+	int err = -EOPNOTSUPP;
+	int i;
+
+	dev = swconfig_get_dev(info);
+	if (!dev)
+		return -EINVAL;
+
+	if (!dev->ops->get_mibs)
+		goto out;
+
+	err = dev->ops->get_mibs(dev, &mibs);
+	if (err)
+		goto out;
+
+	memset(&cb, 0, sizeof(cb));
+	cb.info = info;
+	cb.fill = swconfig_send_mibs;
+	for (i = 0; i < dev->ports; i++) {
+		cb.args[0] = i;
+		err = swconfig_send_multipart(&cb, &mibs);
+		if (err < 0) {
+			err = -ENOMEM;
+			goto out;
+		}
+	}
+	swconfig_put_dev(dev);
+	kfree(mibs.values);
+
+	if (!cb.msg)
+		return 0;
+
+	return genlmsg_reply(cb.msg, info);
+
+out:
+	kfree(mibs.values);
+	swconfig_put_dev(dev);
+	return err;
+}
+
 static int
 swconfig_send_switch(struct sk_buff *msg, u32 pid, u32 seq, int flags,
 		const struct switch_dev *dev)
@@ -1041,6 +1134,11 @@ static struct genl_ops swconfig_ops[] = {
 		.validate = GENL_DONT_VALIDATE_STRICT | GENL_DONT_VALIDATE_DUMP,
 		.dumpit = swconfig_dump_switches,
 		.done = swconfig_done,
+	},
+	{
+		.cmd = SWITCH_CMD_GET_MIBS,
+		.validate = GENL_DONT_VALIDATE_STRICT | GENL_DONT_VALIDATE_DUMP,
+		.doit = swconfig_get_mibs,
 	}
 };
 
@@ -1244,6 +1342,26 @@ switch_generic_set_link(struct switch_dev *dev, int port,
 }
 EXPORT_SYMBOL_GPL(switch_generic_set_link);
 
+int
+switch_mibs_alloc(struct switch_dev *dev, struct switch_mibs *mibs,
+		  unsigned int n_mibs)
+{
+	size_t len;
+
+	/* values and names share one allocation, freed through values */
+	len = array3_size(dev->ports, n_mibs, sizeof(*mibs->values));
+	len = size_add(len, array_size(n_mibs, sizeof(*mibs->names)));
+	mibs->values = kzalloc(len, GFP_KERNEL);
+	if (!mibs->values)
+		return -ENOMEM;
+
+	mibs->names = (const char **) &mibs->values[dev->ports * n_mibs];
+	mibs->n_mibs = n_mibs;
+
+	return 0;
+}
+EXPORT_SYMBOL_GPL(switch_mibs_alloc);
+
 static int __init
 swconfig_init(void)
 {
@@ -11,7 +11,8 @@
  * This driver exposes the data encoded in the "hard_config" flash segment of
  * MikroTik RouterBOARDs devices. It presents the data in a sysfs folder
  * named "hard_config". The WLAN calibration data is available on demand via
- * the 'wlan_data' sysfs file in that folder.
+ * the 'wlan_data' sysfs file in that folder, and to other drivers through
+ * rb_hardconfig_wlan_data_read().
  *
  * This driver permanently allocates a chunk of RAM as large as the hard_config
  * MTD partition, although it is technically possible to operate entirely from
@@ -31,18 +32,20 @@
 #include <linux/slab.h>
 #include <linux/errno.h>
 #include <linux/kobject.h>
+#include <linux/mutex.h>
 #include <linux/bitops.h>
 #include <linux/string.h>
 #include <linux/mtd/mtd.h>
 #include <linux/sysfs.h>
 #include <linux/lzo.h>
 #include <linux/version.h>
+#include <asm/barrier.h>
 
 #include "rb_hardconfig.h"
 #include "routerboot.h"
 #include "rb_lz77.h"
 
-#define RB_HARDCONFIG_VER		"0.08"
+#define RB_HARDCONFIG_VER		"0.09"
 #define RB_HC_PR_PFX			"[rb_hardconfig] "
 
 /* Bit definitions for hardware options */
@@ -75,6 +78,8 @@
 static struct kobject *hc_kobj;
 static u8 *hc_buf;		// ro buffer after init(): no locking required
 static size_t hc_buflen;
+static DEFINE_MUTEX(hc_wlan_lock);	// serializes WLAN data unpacking
+static bool hc_wlan_final;		// init() ran, under hc_wlan_lock
 
 /*
  * For LZOR style WLAN data unpacking.
@@ -352,23 +357,33 @@ static ssize_t hc_wlan_data_bin_read(struct file *filp, struct kobject *kobj,
 				     loff_t off, size_t count);
 #endif
 
+/*
+ * The unpacked data is cached in data/data_len until exit(). data is set
+ * with release semantics once data_len is valid, and only under hc_wlan_lock.
+ */
 static struct hc_wlan_attr {
 	const u16 erd_tag_id;
+	const u8 radio;
 	struct bin_attribute battr;
 	u16 pld_ofs;
 	u16 pld_len;
+	void *data;
+	size_t data_len;
 } hc_wd_multi_battrs[] = {
 	{
 		.erd_tag_id = RB_WLAN_ERD_ID_MULTI_8001,
+		.radio = 0,
 		.battr = __BIN_ATTR(data_0, S_IRUSR, hc_wlan_data_bin_read, NULL, 0),
 	}, {
 		.erd_tag_id = RB_WLAN_ERD_ID_MULTI_8201,
+		.radio = 2,
 		.battr = __BIN_ATTR(data_2, S_IRUSR, hc_wlan_data_bin_read, NULL, 0),
 	}
 };
 
 static struct hc_wlan_attr hc_wd_solo_battr = {
 	.erd_tag_id = RB_WLAN_ERD_ID_SOLO,
+	.radio = 0,
 	.battr = __BIN_ATTR(wlan_data, S_IRUSR, hc_wlan_data_bin_read, NULL, 0),
 };
 
@@ -653,61 +668,180 @@ static ssize_t hc_attr_show(struct kobject *kobj, struct kobj_attribute *attr,
 }
 
 /*
- * This function will allocate and free memory every time it is called. This
- * is not the fastest way to do this, but since the data is rarely read (mainly
- * at boot time to load wlan caldata), this makes it possible to save memory for
- * the system.
+ * Unpack the WLAN data unless it is cached already, and cache it: readers
+ * fetch it in page sized chunks, and it used to be unpacked again for each
+ * of them. Only the unpacked length is kept, a few KB for known devices.
+ * Called with hc_wlan_lock held. Returns the cached data or an ERR_PTR.
  */
-#if LINUX_VERSION_CODE < KERNEL_VERSION(6,18,0)
-static ssize_t hc_wlan_data_bin_read(struct file *filp, struct kobject *kobj,
-				     struct bin_attribute *attr, char *buf,
-				     loff_t off, size_t count)
-#else
-static ssize_t hc_wlan_data_bin_read(struct file *filp, struct kobject *kobj,
-				     const struct bin_attribute *attr, char *buf,
-				     loff_t off, size_t count)
-#endif
+static const u8 *hc_wlan_data_unpack_cached(struct hc_wlan_attr *hc_wattr, size_t *len)
 {
-	struct hc_wlan_attr *hc_wattr;
 	size_t outlen;
-	void *outbuf;
+	void *outbuf, *shrunk;
 	int ret;
 
-	hc_wattr = container_of(attr, typeof(*hc_wattr), battr);
+	lockdep_assert_held(&hc_wlan_lock);
+
+	if (hc_wattr->data)
+		goto out;
 
 	if (!hc_wattr->pld_len)
-		return -ENOENT;
+		return ERR_PTR(-ENOENT);
 
 	outlen = RB_ART_SIZE;
 
 	/* Don't bother unpacking if the source is already too large */
 	if (hc_wattr->pld_len > outlen)
-		return -EFBIG;
+		return ERR_PTR(-EFBIG);
 
 	outbuf = kmalloc(outlen, GFP_KERNEL);
 	if (!outbuf)
-		return -ENOMEM;
+		return ERR_PTR(-ENOMEM);
 
 	ret = hc_wlan_data_unpack(hc_wattr->erd_tag_id, hc_wattr->pld_ofs, hc_wattr->pld_len, outbuf, &outlen);
 	if (ret) {
 		kfree(outbuf);
-		return ret;
+		return ERR_PTR(ret);
 	}
 
-	if (off >= outlen) {
-		kfree(outbuf);
+	shrunk = krealloc(outbuf, outlen, GFP_KERNEL);
+	if (shrunk)
+		outbuf = shrunk;
+
+	hc_wattr->data_len = outlen;
+	/* Pairs with smp_load_acquire() in hc_wlan_data_bin_read() */
+	smp_store_release(&hc_wattr->data, outbuf);
+
+out:
+	*len = hc_wattr->data_len;
+	return hc_wattr->data;
+}
+
+static ssize_t hc_wlan_data_copy(const u8 *data, size_t len, char *buf,
+				 loff_t off, size_t count)
+{
+	if (IS_ERR(data))
+		return PTR_ERR(data);
+
+	if (off >= len)
 		return 0;
-	}
 
-	if (off + count > outlen)
-		count = outlen - off;
+	if (off + count > len)
+		count = len - off;
 
-	memcpy(buf, outbuf + off, count);
+	memcpy(buf, data + off, count);
 
-	kfree(outbuf);
 	return count;
 }
 
+#if LINUX_VERSION_CODE < KERNEL_VERSION(6,18,0)
+static ssize_t hc_wlan_data_bin_read(struct file *filp, struct kobject *kobj,
+				     struct bin_attribute *attr, char *buf,
+				     loff_t off, size_t count)
+#else
+static ssize_t hc_wlan_data_bin_read(struct file *filp, struct kobject *kobj,
+				     const struct bin_attribute *attr, char *buf,
+				     loff_t off, size_t count)
+#endif
+{
+	struct hc_wlan_attr *hc_wattr;
+	const u8 *data;
+	size_t len = 0;
+	ssize_t ret;
+
+	hc_wattr = container_of(attr, typeof(*hc_wattr), battr);
+
+	/* Once unpacked, serve straight from the cache without locking */
+	data = smp_load_acquire(&hc_wattr->data);
+	if (data)
+		return hc_wlan_data_copy(data, hc_wattr->data_len, buf, off, count);
+
+	mutex_lock(&hc_wlan_lock);
+	data = hc_wlan_data_unpack_cached(hc_wattr, &len);
+	ret = hc_wlan_data_copy(data, len, buf, off, count);
+	mutex_unlock(&hc_wlan_lock);
+
+	return ret;
+}
+
+/**
+ * rb_hardconfig_wlan_data_read() - Read unpacked WLAN calibration data.
+ * @radio: 0 for "wlan_data" or "wlan_data/data_0", 2 for "wlan_data/data_2"
+ * @buf: buffer to read into
+ * @off: offset in the unpacked data
+ * @count: number of bytes to read
+ *
+ * The data is unpacked once and shared with the sysfs readers.
+ *
+ * Return: number of bytes read, 0 past the end of the data, -EPROBE_DEFER
+ * until hard_config has been parsed, -ENOENT if @radio has no data, or errno
+ */
+ssize_t rb_hardconfig_wlan_data_read(unsigned int radio, void *buf,
+				     loff_t off, size_t count)
+{
+	struct hc_wlan_attr *hc_wattr = NULL;
+	const u8 *data;
+	size_t len = 0;
+	ssize_t ret;
+	int i;
+
+	/* The lock also keeps exit() from freeing the data under us */
+	mutex_lock(&hc_wlan_lock);
+
+	if (hc_wd_solo_battr.pld_len && hc_wd_solo_battr.radio == radio)
+		hc_wattr = &hc_wd_solo_battr;
+
+	for (i = 0; !hc_wattr && i < ARRAY_SIZE(hc_wd_multi_battrs); i++)
+		if (hc_wd_multi_battrs[i].pld_len && hc_wd_multi_battrs[i].radio == radio)
+			hc_wattr = &hc_wd_multi_battrs[i];
+
+	if (hc_wattr) {
+		data = hc_wlan_data_unpack_cached(hc_wattr, &len);
+		ret = hc_wlan_data_copy(data, len, buf, off, count);
+	} else {
+		ret = hc_wlan_final ? -ENOENT : -EPROBE_DEFER;
+	}
+
+	mutex_unlock(&hc_wlan_lock);
+
+	return ret;
+}
+EXPORT_SYMBOL_GPL(rb_hardconfig_wlan_data_read);
+
+static void hc_wlan_attr_reset(struct hc_wlan_attr *hc_wattr)
+{
+	mutex_lock(&hc_wlan_lock);
+	kfree(hc_wattr->data);
+	hc_wattr->data = NULL;
+	hc_wattr->data_len = 0;
+	hc_wattr->pld_ofs = hc_wattr->pld_len = 0;
+	mutex_unlock(&hc_wlan_lock);
+}
+
+/*
+ * init() has to unpack the WLAN data to know which attributes to publish:
+ * keep the result as the cache, so that it is only ever unpacked once.
+ */
+static void hc_wlan_attr_set(struct hc_wlan_attr *hc_wattr, u16 pld_ofs,
+			     u16 pld_len, const void *data, size_t data_len)
+{
+	mutex_lock(&hc_wlan_lock);
+	kfree(hc_wattr->data);
+	hc_wattr->pld_ofs = pld_ofs;
+	hc_wattr->pld_len = pld_len;
+	hc_wattr->data_len = data_len;
+	/* On failure the first reader unpacks it again */
+	smp_store_release(&hc_wattr->data, kmemdup(data, data_len, GFP_KERNEL));
+	mutex_unlock(&hc_wlan_lock);
+}
+
+/* Tell rb_hardconfig_wlan_data_read() whether missing WLAN data may still appear */
+static void hc_wlan_set_final(bool final)
+{
+	mutex_lock(&hc_wlan_lock);
+	hc_wlan_final = final;
+	mutex_unlock(&hc_wlan_lock);
+}
+
 int rb_hardconfig_init(struct kobject *rb_kobj, struct mtd_info *mtd)
 {
 	struct kobject *hc_wlan_kobj;
@@ -791,8 +925,8 @@ int rb_hardconfig_init(struct kobject *rb_kobj, struct mtd_info *mtd)
 			/* Test ID_SOLO first, if found: done */
 			ret = hc_wlan_data_unpack(RB_WLAN_ERD_ID_SOLO, hc_attrs[i].pld_ofs, hc_attrs[i].pld_len, outbuf, &outlen);
 			if (!ret) {
-				hc_wd_solo_battr.pld_ofs = hc_attrs[i].pld_ofs;
-				hc_wd_solo_battr.pld_len = hc_attrs[i].pld_len;
+				hc_wlan_attr_set(&hc_wd_solo_battr, hc_attrs[i].pld_ofs,
+						 hc_attrs[i].pld_len, outbuf, outlen);
 
 				ret = sysfs_create_bin_file(hc_kobj, &hc_wd_solo_battr.battr);
 				if (ret)
@@ -813,12 +947,12 @@ int rb_hardconfig_init(struct kobject *rb_kobj, struct mtd_info *mtd)
 					ret = hc_wlan_data_unpack(hc_wd_multi_battrs[j].erd_tag_id,
 								  hc_attrs[i].pld_ofs, hc_attrs[i].pld_len, outbuf, &outlen);
 					if (ret) {
-						hc_wd_multi_battrs[j].pld_ofs = hc_wd_multi_battrs[j].pld_len = 0;
+						hc_wlan_attr_reset(&hc_wd_multi_battrs[j]);
 						continue;
 					}
 
-					hc_wd_multi_battrs[j].pld_ofs = hc_attrs[i].pld_ofs;
-					hc_wd_multi_battrs[j].pld_len = hc_attrs[i].pld_len;
+					hc_wlan_attr_set(&hc_wd_multi_battrs[j], hc_attrs[i].pld_ofs,
+							 hc_attrs[i].pld_len, outbuf, outlen);
 
 					ret = sysfs_create_bin_file(hc_wlan_kobj, &hc_wd_multi_battrs[j].battr);
 					if (ret)
@@ -840,18 +974,30 @@ int rb_hardconfig_init(struct kobject *rb_kobj, struct mtd_info *mtd)
 
 	pr_info("MikroTik RouterBOARD hardware configuration sysfs driver v" RB_HARDCONFIG_VER "\n");
 
+	hc_wlan_set_final(true);
 	return 0;
 
 fail:
 	kfree(hc_buf);
 	hc_buf = NULL;
+	/* No WLAN data is coming, don't keep its consumers waiting */
+	hc_wlan_set_final(true);
 	return ret;
 }
 
 void rb_hardconfig_exit(void)
 {
+	int i;
+
+	hc_wlan_set_final(false);
+
 	kobject_put(hc_kobj);
 	hc_kobj = NULL;
+
+	hc_wlan_attr_reset(&hc_wd_solo_battr);
+	for (i = 0; i < ARRAY_SIZE(hc_wd_multi_battrs); i++)
+		hc_wlan_attr_reset(&hc_wd_multi_battrs[i]);
+
 	kfree(hc_buf);
 	hc_buf = NULL;
 }
@@ -4,10 +4,12 @@
  */
 
 #include <linux/module.h>
-#include <linux/slab.h>
 #include <linux/string.h>
 #include <linux/errno.h>
 #include <linux/minmax.h>
+#include <linux/bitops.h>
+#include <linux/bitrev.h>
+#include <linux/unaligned.h>
 
 #include "rb_lz77.h"
 
@@ -24,7 +26,6 @@
 #define MIKRO_LZ77_MAX_COUNT_BIT_LEN 27
 
 enum rb_lz77_instruction {
-	INSTR_ERROR = -1,
 	INSTR_LITERAL_BYTE = 0,
 	/* a (non aligned) byte follows this instruction,
 	 * which is directly copied into output
@@ -52,236 +53,164 @@ enum rb_lz77_instruction {
 	 */
 };
 
-struct rb_lz77_instr_opcodes {
-	/* group instruction */
-	enum rb_lz77_instruction instruction;
-	/* if >0, a match group,
-	 * which starts at byte output_position - 1*offset
-	 */
-	size_t offset;
-	/* how long the match group is,
-	 * or how long the (following counter) non-match group is
-	 */
-	size_t length;
-	/* how many bits were used for this instruction + op code(s) */
-	size_t bits_used;
-	/* input char */
-	u8 *in;
-	/* offset where this instruction started */
-	size_t in_pos;
+/*
+ * Instruction and the number of bits it takes, indexed by the next two
+ * input bits (the first one in bit 0)
+ */
+static const struct {
+	u8 instruction;
+	u8 bits;
+} rb_lz77_instr_table[4] = {
+	{ INSTR_LITERAL_BYTE, 1 },	/* 0x */
+	{ INSTR_PREVIOUS_OFFSET, 2 },	/* 10 */
+	{ INSTR_LITERAL_BYTE, 1 },	/* 0x */
+	{ INSTR_LONG, 2 },		/* 11 */
 };
 
-/**
- * rb_lz77_get_bit
- *
- * @in:			compressed data ptr
- * @in_offset_bit:	bit offset to extract
- *
- * convert the bit offset to byte offset,
- * shift to modulo of bits per bytes, so that wanted bit is lsb
- * and to extract only that bit.
- * Caller is responsible for ensuring that in_offset_bit/8
- * does not exceed input length
+/*
+ * The input is read least significant bit of each byte first. The bit
+ * buffer holds the next (at least MIKRO_LZ77_REFILL_BITS after a refill)
+ * bits of the input with the next one in bit 0. Past the end of the input
+ * it is filled with zero bits, callers check positions against the input
+ * length before using them.
  */
-static inline u8 rb_lz77_get_bit(const u8 *in, const size_t in_offset_bit)
+struct rb_lz77_bits {
+	const u8 *in;
+	size_t in_len;
+	/* next input byte to load into buf */
+	size_t next;
+	u64 buf;
+	/* number of valid bits in buf */
+	unsigned int avail;
+};
+
+#define MIKRO_LZ77_REFILL_BITS 56
+
+static __always_inline void rb_lz77_refill(struct rb_lz77_bits *b)
 {
-	return ((in[in_offset_bit / BITS_PER_BYTE] >>
-		 (in_offset_bit % BITS_PER_BYTE)) &
-		1);
+	unsigned int n;
+
+	if (b->avail >= MIKRO_LZ77_REFILL_BITS)
+		return;
+
+	if (likely(b->next + sizeof(u64) <= b->in_len)) {
+		/*
+		 * Load as many whole bytes as fit, the partial byte above
+		 * them is loaded again at the same position next time
+		 */
+		b->buf |= get_unaligned_le64(b->in + b->next) << b->avail;
+		n = (63 - b->avail) / BITS_PER_BYTE;
+		b->next += n;
+		b->avail += n * BITS_PER_BYTE;
+		return;
+	}
+
+	while (b->avail < MIKRO_LZ77_REFILL_BITS) {
+		if (b->next < b->in_len)
+			b->buf |= (u64)b->in[b->next] << b->avail;
+		b->next++;
+		b->avail += BITS_PER_BYTE;
+	}
 }
 
-/**
- * rb_lz77_get_byte
- *
- * @in:			compressed data
- * @in_offset_bit:	bit offset to extract byte
- */
-static inline u8 rb_lz77_get_byte(const u8 *in, const size_t in_offset_bit)
+static __always_inline void rb_lz77_skip(struct rb_lz77_bits *b,
+					 unsigned int bits)
 {
-	u8 buf = 0;
-	int i;
+	b->buf >>= bits;
+	b->avail -= bits;
+}
 
-	/* built a reversed byte from (likely) unaligned bits */
-	for (i = 0; i <= 7; ++i)
-		buf += rb_lz77_get_bit(in, in_offset_bit + i) << (7 - i);
-	return buf;
+/* bit offset of the next bit in the input */
+static __always_inline size_t rb_lz77_bitpos(const struct rb_lz77_bits *b)
+{
+	return b->next * BITS_PER_BYTE - b->avail;
 }
 
 /**
- * rb_lz77_decode_count - decode bits at given offset as a count
+ * rb_lz77_decode_count - decode the next bits as a count
  *
- * @in:			compressed data
- * @in_len:		length of compressed data
- * @in_offset_bit:	bit offset where count starts
+ * @b:			input bits
+ * @in_bits:		length of compressed data in bits
  * @shift:		left shift operand value of first count bit
  * @count:		initial count
- * @bits_used:		how many bits were consumed by this count
- * @max_bits:		maximum bit count for this counter
  *
- * Returns the decoded count
+ * A count is a run of n set bits, adding 1 << shift for the first one and
+ * doubling for each following one, a clear bit, and then shift + n more
+ * bits that are added most significant bit first.
+ *
+ * Returns the decoded count, or negative error
  */
-static int rb_lz77_decode_count(const u8 *in, const size_t in_len,
-				const size_t in_offset_bit, u8 shift,
-				size_t count, u8 *bits_used, const u8 max_bits)
+static int rb_lz77_decode_count(struct rb_lz77_bits *b, const size_t in_bits,
+				const unsigned int shift, const int count)
 {
-	size_t pos = in_offset_bit;
-	const size_t max_pos = min(pos + max_bits, in_len * BITS_PER_BYTE);
-	bool up = true;
-
-	*bits_used = 0;
-	pr_debug(MIKRO_LZ77
-		 "decode_count inbit: %zu, start shift:%u, initial count:%zu\n",
-		 in_offset_bit, shift, count);
-
-	while (true) {
-		/* check the input offset bit does not overflow the minimum of
-		 * a reasonable length for this encoded count, and
-		 * the end of the input */
-		if (unlikely(pos >= max_pos)) {
-			pr_err(MIKRO_LZ77
-			       "max bit index reached before count completed\n");
-			return -EFBIG;
-		}
-
-		/* if the bit value at offset is set */
-		if (rb_lz77_get_bit(in, pos))
-			count += (1 << shift);
-
-		/* shift increases until we find an unsed bit */
-		else if (up)
-			up = false;
+	const size_t pos = rb_lz77_bitpos(b);
+	const size_t max_bits = pos < in_bits ?
+		min_t(size_t, in_bits - pos, MIKRO_LZ77_MAX_COUNT_BIT_LEN) : 0;
+	unsigned int ones, bits, used;
+	u32 value;
+
+	rb_lz77_refill(b);
+
+	ones = ~b->buf ? __ffs64(~b->buf) : 64;
+	bits = shift + ones;
+	used = ones + 1 + bits;
+
+	/* the count may neither be too long nor run past the input */
+	if (unlikely(used > max_bits)) {
+		pr_err(MIKRO_LZ77
+		       "max bit index reached before count completed\n");
+		return -EFBIG;
+	}
 
-		if (up)
-			++shift;
-		else {
-			if (!shift) {
-				*bits_used = pos - in_offset_bit + 1;
-				return count;
-			}
-			--shift;
-		}
+	value = (b->buf >> (ones + 1)) & ((1U << bits) - 1);
+	if (bits)
+		value = bitrev32(value) >> (32 - bits);
 
-		++pos;
-	}
+	rb_lz77_skip(b, used);
 
-	return -EINVAL;
+	return count + (1 << bits) - (1 << shift) + value;
 }
 
 /**
- * rb_lz77_decode_instruction
+ * rb_lz77_copy_literals - copy a non-matching group to the output
  *
- * @in:			compressed data
- * @in_offset_bit:	bit offset where instruction starts
- * @bits_used:		how many bits were consumed by this count
+ * @b:			input bits
+ * @in_bits:		length of compressed data in bits
+ * @out:		output position, updated
+ * @out_end:		end of the output buffer
+ * @length:		number of bytes in the group
  *
- * Returns the decoded instruction
+ * Returns 0 on success, or negative error
  */
-static enum rb_lz77_instruction
-rb_lz77_decode_instruction(const u8 *in, size_t in_offset_bit, u8 *bits_used)
+static int rb_lz77_copy_literals(struct rb_lz77_bits *b, const size_t in_bits,
+				 u8 **out, const u8 *out_end, size_t length)
 {
-	if (rb_lz77_get_bit(in, in_offset_bit)) {
-		*bits_used = 2;
-		if (rb_lz77_get_bit(in, ++in_offset_bit))
-			return INSTR_LONG;
-		else
-			return INSTR_PREVIOUS_OFFSET;
-	} else {
-		*bits_used = 1;
-		return INSTR_LITERAL_BYTE;
+	u8 *output_ptr = *out;
+	size_t n;
+
+	if (unlikely(length > out_end - output_ptr)) {
+		pr_err(MIKRO_LZ77 "output overrun\n");
+		return -EOVERFLOW;
 	}
-	return INSTR_ERROR;
-}
 
-/**
- * rb_lz77_decode_instruction_operators
- *
- * @in:			compressed data
- * @in_len:		length of compressed data
- * @in_offset_bit:	bit offset where instruction starts
- * @previous_offset:	last used match offset
- * @opcode:		struct to hold instruction & operators
- *
- * Returns error code
- */
-static int rb_lz77_decode_instruction_operators(
-	const u8 *in, const size_t in_len, const size_t in_offset_bit,
-	const size_t previous_offset, struct rb_lz77_instr_opcodes *opcode)
-{
-	enum rb_lz77_instruction instruction;
-	u8 bit_count = 0;
-	u8 bits_used = 0;
-	int offset = 0;
-	int length = 0;
-
-	instruction = rb_lz77_decode_instruction(in, in_offset_bit, &bit_count);
-
-	/* skip bits used by instruction */
-	bits_used += bit_count;
-
-	switch (instruction) {
-	case INSTR_LITERAL_BYTE:
-		/* non-matching char */
-		offset = 0;
-		length = 1;
-		break;
-
-	case INSTR_PREVIOUS_OFFSET:
-		/* matching group uses previous offset */
-		offset = previous_offset;
-
-		length = rb_lz77_decode_count(in, in_len,
-					      in_offset_bit + bits_used, 0, 1,
-					      &bit_count,
-					      MIKRO_LZ77_MAX_COUNT_BIT_LEN);
-		if (unlikely(length < 0))
-			return length;
-		/* skip bits used by count */
-		bits_used += bit_count;
-		break;
-
-	case INSTR_LONG:
-		offset = rb_lz77_decode_count(in, in_len,
-					      in_offset_bit + bits_used, 4, 0,
-					      &bit_count,
-					      MIKRO_LZ77_MAX_COUNT_BIT_LEN);
-		if (unlikely(offset < 0))
-			return offset;
-
-		/* skip bits used by offset count */
-		bits_used += bit_count;
-
-		if (offset == 0) {
-			/* non-matching long group */
-			length = rb_lz77_decode_count(
-				in, in_len, in_offset_bit + bits_used, 4, 12,
-				&bit_count, MIKRO_LZ77_MAX_COUNT_BIT_LEN);
-			if (unlikely(length < 0))
-				return length;
-			/* skip bits used by length count */
-			bits_used += bit_count;
-		} else {
-			/* matching group */
-			length = rb_lz77_decode_count(
-				in, in_len, in_offset_bit + bits_used, 0, 2,
-				&bit_count, MIKRO_LZ77_MAX_COUNT_BIT_LEN);
-			if (unlikely(length < 0))
-				return length;
-			/* skip bits used by length count */
-			bits_used += bit_count;
-		}
+	if (unlikely(rb_lz77_bitpos(b) + length * BITS_PER_BYTE > in_bits)) {
+		pr_err(MIKRO_LZ77 "input overrun\n");
+		return -ENODATA;
+	}
 
-		break;
+	while (length) {
+		rb_lz77_refill(b);
 
-	case INSTR_ERROR:
-		return -EINVAL;
+		/* the bytes are not aligned, and stored bit reversed */
+		n = min_t(size_t, length, b->avail / BITS_PER_BYTE);
+		length -= n;
+		while (n--) {
+			*output_ptr++ = bitrev8(b->buf);
+			rb_lz77_skip(b, BITS_PER_BYTE);
+		}
 	}
 
-	opcode->instruction = instruction;
-	opcode->offset = offset;
-	opcode->length = length;
-	opcode->bits_used = bits_used;
-	opcode->in = (u8 *)in;
-	opcode->in_pos = in_offset_bit;
+	*out = output_ptr;
 	return 0;
 }
 
@@ -299,145 +228,120 @@ static int rb_lz77_decode_instruction_operators(
 int rb_lz77_decompress(const u8 *in, const size_t in_len, u8 *out,
 		       size_t *out_len)
 {
-	u8 *output_ptr;
-	size_t input_bit = 0;
+	struct rb_lz77_bits b = { .in = in, .in_len = in_len };
 	const u8 *output_end = out + *out_len;
-	struct rb_lz77_instr_opcodes *opcode;
-	size_t match_offset = 0;
-	int rc = 0;
-	size_t match_length, partial_count, i;
+	u8 *output_ptr = out;
+	size_t in_bits, match_offset = 0, offset, length, dist;
+	int instruction, count, rc;
 
-	output_ptr = out;
-
-	if (unlikely((in_len * BITS_PER_BYTE) > SIZE_MAX)) {
+	if (unlikely(in_len > SIZE_MAX / BITS_PER_BYTE)) {
 		pr_err(MIKRO_LZ77 "input longer than expected\n");
 		return -EFBIG;
 	}
-
-	opcode = kmalloc(sizeof(*opcode), GFP_KERNEL);
-	if (!opcode)
-		return -ENOMEM;
+	in_bits = in_len * BITS_PER_BYTE;
 
 	while (true) {
-		if (unlikely(output_ptr > output_end)) {
-			pr_err(MIKRO_LZ77 "output overrun\n");
-			rc = -EOVERFLOW;
-			goto free_lz77_struct;
-		}
-		if (unlikely(input_bit > in_len * BITS_PER_BYTE)) {
+		if (unlikely(rb_lz77_bitpos(&b) > in_bits)) {
 			pr_err(MIKRO_LZ77 "input overrun\n");
-			rc = -ENODATA;
-			goto free_lz77_struct;
-		}
-
-		rc = rb_lz77_decode_instruction_operators(in, in_len, input_bit,
-							  match_offset, opcode);
-		if (unlikely(rc < 0)) {
-			pr_err(MIKRO_LZ77
-			       "instruction operands decode error\n");
-			goto free_lz77_struct;
+			return -ENODATA;
 		}
 
-		pr_debug(MIKRO_LZ77 "inbit:0x%zx->outbyte:0x%zx", input_bit,
-			 output_ptr - out);
+		rb_lz77_refill(&b);
+		instruction = rb_lz77_instr_table[b.buf & 3].instruction;
+		rb_lz77_skip(&b, rb_lz77_instr_table[b.buf & 3].bits);
 
-		input_bit += opcode->bits_used;
-		switch (opcode->instruction) {
+		switch (instruction) {
 		case INSTR_LITERAL_BYTE:
-			pr_debug(" short");
-			fallthrough;
-		case INSTR_LONG:
-			if (opcode->offset == 0) {
-				/* this is a non-matching group */
-				pr_debug(" non-match, len: 0x%zx\n",
-					 opcode->length);
-				/* test end marker */
-				if (opcode->length == 0xc &&
-				    ((input_bit +
-				      opcode->length * BITS_PER_BYTE) >
-				     in_len)) {
-					*out_len = output_ptr - out;
-					pr_debug(
-						MIKRO_LZ77
-						"lz77 decompressed from %zu to %zu\n",
-						in_len, *out_len);
-					rc = 0;
-					goto free_lz77_struct;
-				}
-				for (i = opcode->length; i > 0; --i) {
-					*output_ptr =
-						rb_lz77_get_byte(in, input_bit);
-					++output_ptr;
-					input_bit += BITS_PER_BYTE;
-				}
-				/* do no fallthrough if a non-match group */
-				break;
-			}
-			match_offset = opcode->offset;
-			fallthrough;
-		case INSTR_PREVIOUS_OFFSET:
-			match_length = opcode->length;
-			partial_count = 0;
+			rc = rb_lz77_copy_literals(&b, in_bits, &output_ptr,
+						   output_end, 1);
+			if (unlikely(rc))
+				return rc;
+			continue;
 
-			pr_debug(" match, offset: 0x%zx, len: 0x%zx",
-				 opcode->offset, match_length);
+		case INSTR_PREVIOUS_OFFSET:
+			count = rb_lz77_decode_count(&b, in_bits, 0, 1);
+			if (unlikely(count < 0))
+				return count;
 
-			if (unlikely(opcode->offset == 0)) {
-				pr_err(MIKRO_LZ77
-				       "match group missing opcode->offset\n");
-				rc = -EBADMSG;
-				goto free_lz77_struct;
-			}
+			offset = match_offset;
+			length = count;
+			break;
 
-			/* overflow */
-			if (unlikely((output_ptr + match_length) >
-				     output_end)) {
-				pr_err(MIKRO_LZ77
-				       "match group output overflow\n");
-				rc = -ENOBUFS;
-				goto free_lz77_struct;
-			}
+		case INSTR_LONG:
+		default:
+			count = rb_lz77_decode_count(&b, in_bits, 4, 0);
+			if (unlikely(count < 0))
+				return count;
+			offset = count;
 
-			/* underflow */
-			if (unlikely((output_ptr - opcode->offset) < out)) {
-				pr_err(MIKRO_LZ77
-				       "match group offset underflow\n");
-				rc = -ESPIPE;
-				goto free_lz77_struct;
-			}
+			if (offset == 0)
+				count = rb_lz77_decode_count(&b, in_bits, 4, 12);
+			else
+				count = rb_lz77_decode_count(&b, in_bits, 0, 2);
+			if (unlikely(count < 0))
+				return count;
+			length = count;
+
+			if (offset == 0) {
+				/*
+				 * test end marker; this compares a bit offset
+				 * against the input length in bytes, which is
+				 * how the encoder output has always been read
+				 */
+				if (length == 0xc &&
+				    rb_lz77_bitpos(&b) + length * BITS_PER_BYTE >
+					    in_len) {
+					*out_len = output_ptr - out;
+					pr_debug(MIKRO_LZ77
+						 "lz77 decompressed from %zu to %zu\n",
+						 in_len, *out_len);
+					return 0;
+				}
 
-			/* there are cases where the match (length) includes
-			 * data that is a part of the same match
-			 */
-			while (opcode->offset < match_length) {
-				++partial_count;
-				memcpy(output_ptr, output_ptr - opcode->offset,
-				       opcode->offset);
-				output_ptr += opcode->offset;
-				match_length -= opcode->offset;
+				rc = rb_lz77_copy_literals(&b, in_bits,
+							   &output_ptr,
+							   output_end, length);
+				if (unlikely(rc))
+					return rc;
+				continue;
 			}
-			memcpy(output_ptr, output_ptr - opcode->offset,
-			       match_length);
-			output_ptr += match_length;
-			if (partial_count)
-				pr_debug(" (%zu partial memcpy)",
-					 partial_count);
-			pr_debug("\n");
 
+			match_offset = offset;
 			break;
+		}
 
-		case INSTR_ERROR:
-			rc = -EINVAL;
-			goto free_lz77_struct;
+		if (unlikely(offset == 0)) {
+			pr_err(MIKRO_LZ77 "match group missing opcode->offset\n");
+			return -EBADMSG;
 		}
-	}
 
-	pr_err(MIKRO_LZ77 "decode loop broken\n");
-	rc = -EINVAL;
+		/* overflow */
+		if (unlikely(length > output_end - output_ptr)) {
+			pr_err(MIKRO_LZ77 "match group output overflow\n");
+			return -ENOBUFS;
+		}
 
-free_lz77_struct:
-	kfree(opcode);
-	return rc;
+		/* underflow */
+		if (unlikely(offset > output_ptr - out)) {
+			pr_err(MIKRO_LZ77 "match group offset underflow\n");
+			return -ESPIPE;
+		}
+
+		/*
+		 * there are cases where the match (length) includes
+		 * data that is a part of the same match, copy whole
+		 * repetitions of it, twice as many each time
+		 */
+		dist = offset;
+		while (dist < length) {
+			memcpy(output_ptr, output_ptr - dist, dist);
+			output_ptr += dist;
+			length -= dist;
+			dist *= 2;
+		}
+		memcpy(output_ptr, output_ptr - dist, length);
+		output_ptr += length;
+	}
 }
 EXPORT_SYMBOL_GPL(rb_lz77_decompress);
 
@@ -196,11 +196,107 @@ static int rb_parse_table(struct nvmem_layout *layout)
 	return rb_add_cells(dev, nvmem, mtd_size, data);
 }
 
+#if IS_REACHABLE(CONFIG_MIKROTIK_RB_SYSFS)
+/*
+ * The wlan-data cell holds the calibration data compressed. The unpacked
+ * data, as cached by rb_hardconfig, is served by a separate read-only nvmem
+ * device with the data of radio N at N * RB_ART_SIZE. Its cells are taken
+ * from the "wlan-calibration" child of the layout node, eg:
+ *
+ *	wlan-calibration {
+ *		#address-cells = <1>;
+ *		#size-cells = <1>;
+ *
+ *		caldata_0: calibration@0 {
+ *			reg = <0x0 0x2f20>;
+ *		};
+ *	};
+ */
+static int rb_wlan_cal_read(void *priv, unsigned int offset, void *val,
+			    size_t bytes)
+{
+	unsigned int radio = offset / RB_ART_SIZE;
+	ssize_t ret;
+
+	offset %= RB_ART_SIZE;
+	if (offset + bytes > RB_ART_SIZE)
+		return -EINVAL;
+
+	ret = rb_hardconfig_wlan_data_read(radio, val, offset, bytes);
+	if (ret < 0)
+		return ret;
+
+	/* Cells may extend past the unpacked data */
+	memset(val + ret, 0, bytes - ret);
+
+	return 0;
+}
+
+static void rb_wlan_cal_put_node(void *np)
+{
+	of_node_put(np);
+}
+
+static int rb_wlan_cal_register(struct nvmem_layout *layout)
+{
+	struct nvmem_config config = {
+		.dev = &layout->dev,
+		.name = "rb-wlan-calibration",
+		.id = NVMEM_DEVID_AUTO,
+		.owner = THIS_MODULE,
+		.add_legacy_fixed_of_cells = true,
+		.read_only = true,
+		.reg_read = rb_wlan_cal_read,
+		.size = 3 * RB_ART_SIZE,
+		.word_size = 1,
+		.stride = 1,
+	};
+	struct device_node *container, *np;
+	struct nvmem_device *nvmem;
+	int ret;
+
+	container = of_nvmem_layout_get_container(layout->nvmem);
+	if (!container)
+		return 0;
+
+	np = of_get_child_by_name(container, "wlan-calibration");
+	of_node_put(container);
+	if (!np)
+		return 0;
+
+	/* nvmem does not take a reference, drop ours after it unregisters */
+	ret = devm_add_action_or_reset(&layout->dev, rb_wlan_cal_put_node, np);
+	if (ret)
+		return ret;
+
+	config.of_node = np;
+	nvmem = devm_nvmem_register(&layout->dev, &config);
+
+	return PTR_ERR_OR_ZERO(nvmem);
+}
+#else
+static inline int rb_wlan_cal_register(struct nvmem_layout *layout)
+{
+	return 0;
+}
+#endif
+
 static int rb_nvmem_probe(struct nvmem_layout *layout)
 {
+	int ret;
+
 	layout->add_cells = rb_parse_table;
 
-	return nvmem_layout_register(layout);
+	ret = nvmem_layout_register(layout);
+	if (ret)
+		return ret;
+
+	ret = rb_wlan_cal_register(layout);
+	if (ret)
+		dev_warn(&layout->dev, "Could not register WLAN calibration data (%d)\n",
+			 ret);
+
+	return 0;
 }
 
 static void rb_nvmem_remove(struct nvmem_layout *layout)
@@ -28,6 +28,7 @@ int routerboot_rle_decode(const u8 *in, size_t inlen, u8 *out, size_t *outlen);
 
 int rb_hardconfig_init(struct kobject *rb_kobj, struct mtd_info *mtd);
 void rb_hardconfig_exit(void);
+ssize_t rb_hardconfig_wlan_data_read(unsigned int radio, void *buf, loff_t off, size_t count);
 
 int rb_softconfig_init(struct kobject *rb_kobj, struct mtd_info *mtd);
 void rb_softconfig_exit(void);
@@ -63,6 +63,21 @@ struct switch_port_stats {
 	unsigned long long rx_bytes;
 };
 
+/**
+ * struct switch_mibs - MIB counters of all ports
+ *
+ * @n_mibs: number of counters per port
+ * @names: counter names, NULL for counters that are not reported
+ * @values: counter values, @n_mibs per port
+ *
+ * set up with switch_mibs_alloc(), freed by swconfig
+ */
+struct switch_mibs {
+	unsigned int n_mibs;
+	const char **names;
+	u64 *values;
+};
+
 /**
  * struct switch_dev_ops - switch driver operations
  *
@@ -80,6 +95,8 @@ struct switch_port_stats {
  *
  * @apply_config: apply all changed settings to the switch
  * @reset_switch: resetting the switch
+ *
+ * @get_mibs: capture the MIB counters of all ports at once
  */
 struct switch_dev_ops {
 	struct switch_attrlist attr_global, attr_port, attr_vlan;
@@ -99,6 +116,7 @@ struct switch_dev_ops {
 			     struct switch_port_link *link);
 	int (*get_port_stats)(struct switch_dev *dev, int port,
 			      struct switch_port_stats *stats);
+	int (*get_mibs)(struct switch_dev *dev, struct switch_mibs *mibs);
 
 	int (*phy_read16)(struct switch_dev *dev, int addr, u8 reg, u16 *value);
 	int (*phy_write16)(struct switch_dev *dev, int addr, u8 reg, u16 value);
@@ -175,5 +193,7 @@ struct switch_attr {
 
 int switch_generic_set_link(struct switch_dev *dev, int port,
 			    struct switch_port_link *link);
+int switch_mibs_alloc(struct switch_dev *dev, struct switch_mibs *mibs,
+		      unsigned int n_mibs);
 
 #endif /* _LINUX_SWITCH_H */
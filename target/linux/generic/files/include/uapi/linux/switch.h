@@ -54,6 +54,9 @@ enum {
 	SWITCH_ATTR_OP_DESCRIPTION,
 	/* port lists */
 	SWITCH_ATTR_PORT,
+	/* mib counters */
+	SWITCH_ATTR_OP_VALUE_MIBS,
+	SWITCH_ATTR_MIB,
 	SWITCH_ATTR_MAX
 };
 
@@ -78,7 +81,8 @@ enum {
 	SWITCH_CMD_SET_PORT,
 	SWITCH_CMD_LIST_VLAN,
 	SWITCH_CMD_GET_VLAN,
-	SWITCH_CMD_SET_VLAN
+	SWITCH_CMD_SET_VLAN,
+	SWITCH_CMD_GET_MIBS
 };
 
 /* data types */
@@ -113,6 +117,15 @@ enum {
 	SWITCH_LINK_ATTR_MAX,
 };
 
+/* mib counter nested attributes */
+enum {
+	SWITCH_MIB_UNSPEC,
+	SWITCH_MIB_NAME,
+	SWITCH_MIB_VALUE,
+	SWITCH_MIB_PAD,
+	SWITCH_MIB_ATTR_MAX,
+};
+
 #define SWITCH_ATTR_DEFAULTS_OFFSET	0x1000
 
 
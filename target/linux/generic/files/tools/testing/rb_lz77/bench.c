@@ -0,0 +1,164 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * Decompression throughput of rb_lz77_decompress() and the reference
+ * decoder, on caldata taken from a hard_config dump, an LZ77 payload
+ * with or without its magic, or on generated data if no file is given
+ */
+
+#include <stdlib.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include "rb_lz77_test.h"
+
+#define RB_ID_WLAN_DATA		0x16
+
+int rb_lz77_verbose = 1;
+
+typedef int (*decompress_fn)(const u8 *in, const size_t in_len, u8 *out,
+			     size_t *out_len);
+
+static double now(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+static u32 get_u32(const u8 *p, bool be)
+{
+	return be ? (u32)p[0] << 24 | p[1] << 16 | p[2] << 8 | p[3] :
+		    (u32)p[3] << 24 | p[2] << 16 | p[1] << 8 | p[0];
+}
+
+/* Find the LZ77 stream, see routerboot_tag_find() and rb_hardconfig.c */
+static const u8 *find_stream(const u8 *buf, size_t *len)
+{
+	bool be = !memcmp(buf, "draH", 4);
+	size_t pos = 4, tlen;
+	u32 node;
+
+	if (*len >= 4 && !memcmp(buf, "77ZL", 4)) {
+		*len -= 4;
+		return buf + 4;
+	}
+	if (*len >= 4 && !memcmp(buf, "LZ77", 4)) {
+		*len -= 4;
+		return buf + 4;
+	}
+	if (*len < 4 || (memcmp(buf, "Hard", 4) && !be))
+		return buf;
+
+	while (pos + 4 <= *len) {
+		node = get_u32(buf + pos, be);
+		pos += 4;
+		if (!node)
+			break;
+
+		tlen = node >> 16;
+		if ((node & 0xffff) == RB_ID_WLAN_DATA) {
+			if (pos + tlen > *len || tlen < 4 ||
+			    (memcmp(buf + pos, "77ZL", 4) &&
+			     memcmp(buf + pos, "LZ77", 4)))
+				break;
+			*len = tlen - 4;
+			return buf + pos + 4;
+		}
+		pos += (tlen + 3) & ~3;
+	}
+
+	fprintf(stderr, "no LZ77 compressed WLAN data tag\n");
+	return NULL;
+}
+
+static double run(decompress_fn fn, const u8 *in, size_t in_len,
+		  size_t *out_len, u8 *out, int count)
+{
+	double start = now();
+	int i, rc;
+
+	for (i = 0; i < count; i++) {
+		*out_len = RB_LZ77_TEST_OUT_SIZE;
+		rc = fn(in, in_len, out, out_len);
+		if (rc) {
+			fprintf(stderr, "decompress error %d\n", rc);
+			return -1;
+		}
+	}
+
+	return now() - start;
+}
+
+static int bench(const char *name, const u8 *in, size_t in_len, int count)
+{
+	static u8 new_out[RB_LZ77_TEST_OUT_SIZE], ref_out[RB_LZ77_TEST_OUT_SIZE];
+	size_t new_len, ref_len;
+	double t_new, t_ref;
+
+	t_ref = run(ref_lz77_decompress, in, in_len, &ref_len, ref_out, count);
+	t_new = run(rb_lz77_decompress, in, in_len, &new_len, new_out, count);
+	if (t_ref < 0 || t_new < 0)
+		return -1;
+
+	if (new_len != ref_len || memcmp(new_out, ref_out, new_len)) {
+		fprintf(stderr, "%s: output differs\n", name);
+		return -1;
+	}
+
+	printf("%s: %zu -> %zu bytes, reference %.1f MB/s, rb_lz77 %.1f MB/s (%.1fx)\n",
+	       name, in_len, new_len, new_len * count / t_ref / 1e6,
+	       new_len * count / t_new / 1e6, t_ref / t_new);
+
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	static u8 buf[1 << 20], plain[RB_LZ77_TEST_OUT_SIZE];
+	const u8 *in;
+	size_t len;
+	int ch, i, count = 200;
+	FILE *f;
+
+	while ((ch = getopt(argc, argv, "n:")) != -1) {
+		switch (ch) {
+		case 'n':
+			count = atoi(optarg);
+			break;
+		default:
+			fprintf(stderr, "Usage: %s [-n <count>] [file...]\n",
+				argv[0]);
+			return 1;
+		}
+	}
+
+	if (count <= 0)
+		return 1;
+
+	if (optind == argc) {
+		for (i = 0; i < 3; i++) {
+			len = rb_lz77_test_data(plain, sizeof(plain), i);
+			len = rb_lz77_encode(plain, len, buf, sizeof(buf));
+			if (!len || bench("generated", buf, len, count))
+				return 1;
+		}
+		return 0;
+	}
+
+	for (; optind < argc; optind++) {
+		f = fopen(argv[optind], "rb");
+		if (!f) {
+			perror(argv[optind]);
+			return 1;
+		}
+		len = fread(buf, 1, sizeof(buf), f);
+		fclose(f);
+
+		in = find_stream(buf, &len);
+		if (!in || bench(argv[optind], in, len, count))
+			return 1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,216 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * A simple encoder for the RouterBOOT LZ77 bitstream, using every
+ * instruction the decoder knows, and test data resembling caldata
+ */
+
+#include <stdlib.h>
+
+#include "rb_lz77_test.h"
+
+#define ENC_HASH_BITS		14
+#define ENC_MAX_OFFSET		0x7fef	/* offset count fits in 27 bits */
+#define ENC_MAX_MATCH		0x1000
+#define ENC_MIN_RUN		13	/* a run of 12 may read as end marker */
+#define ENC_MAX_RUN		0x4000
+
+struct enc {
+	u8 *out;
+	size_t size;
+	size_t bit;
+};
+
+static void put_bit(struct enc *e, unsigned int v)
+{
+	size_t byte = e->bit / BITS_PER_BYTE;
+
+	if (byte >= e->size) {
+		e->bit++;
+		return;
+	}
+	if (!(e->bit % BITS_PER_BYTE))
+		e->out[byte] = 0;
+	e->out[byte] |= (v & 1) << (e->bit % BITS_PER_BYTE);
+	e->bit++;
+}
+
+/* k set bits, a clear bit and shift + k bits of value, msb first */
+static void put_count(struct enc *e, size_t count, unsigned int shift,
+		      size_t init)
+{
+	size_t v = count - init;
+	unsigned int k = 0, m;
+
+	while (v >= (((size_t)1 << (shift + k + 1)) - ((size_t)1 << shift)))
+		k++;
+	m = shift + k;
+	v -= ((size_t)1 << m) - ((size_t)1 << shift);
+
+	while (k--)
+		put_bit(e, 1);
+	put_bit(e, 0);
+	while (m--)
+		put_bit(e, v >> m);
+}
+
+static void put_byte(struct enc *e, u8 c)
+{
+	int i;
+
+	for (i = 7; i >= 0; i--)
+		put_bit(e, c >> i);
+}
+
+static void put_literals(struct enc *e, const u8 *p, size_t n)
+{
+	size_t run;
+
+	while (n >= ENC_MIN_RUN) {
+		run = min(n, (size_t)ENC_MAX_RUN);
+		n -= run;
+		put_bit(e, 1);
+		put_bit(e, 1);
+		put_count(e, 0, 4, 0);
+		put_count(e, run, 4, 12);
+		while (run--)
+			put_byte(e, *p++);
+	}
+
+	while (n--) {
+		put_bit(e, 0);
+		put_byte(e, *p++);
+	}
+}
+
+static unsigned int hash3(const u8 *p)
+{
+	u32 v = p[0] | p[1] << 8 | p[2] << 16;
+
+	return (v * 2654435761U) >> (32 - ENC_HASH_BITS);
+}
+
+static size_t match_len(const u8 *a, const u8 *b, size_t max)
+{
+	size_t n = 0;
+
+	while (n < max && a[n] == b[n])
+		n++;
+	return n;
+}
+
+/**
+ * rb_lz77_encode - greedy single candidate LZ77 compression
+ *
+ * Returns the compressed length, or 0 if it did not fit in out_size
+ */
+size_t rb_lz77_encode(const u8 *in, size_t in_len, u8 *out, size_t out_size)
+{
+	struct enc e = { .out = out, .size = out_size };
+	size_t *head, pos = 0, lit = 0, prev = 0, cand, len, plen, max;
+
+	head = calloc(1 << ENC_HASH_BITS, sizeof(*head));
+	if (!head)
+		return 0;
+
+	while (pos < in_len) {
+		max = min(in_len - pos, (size_t)ENC_MAX_MATCH);
+		len = plen = 0;
+		cand = 0;
+
+		if (max >= 3) {
+			unsigned int h = hash3(in + pos);
+
+			/* head holds position + 1 */
+			if (head[h] && pos - (head[h] - 1) <= ENC_MAX_OFFSET) {
+				cand = pos - (head[h] - 1);
+				len = match_len(in + pos, in + pos - cand, max);
+			}
+			head[h] = pos + 1;
+		}
+		if (prev && prev <= pos)
+			plen = match_len(in + pos, in + pos - prev, max);
+
+		if (plen >= 1 && plen + 2 >= len) {
+			put_literals(&e, in + pos - lit, lit);
+			lit = 0;
+			put_bit(&e, 1);
+			put_bit(&e, 0);
+			put_count(&e, plen, 0, 1);
+			pos += plen;
+		} else if (len >= 3) {
+			put_literals(&e, in + pos - lit, lit);
+			lit = 0;
+			put_bit(&e, 1);
+			put_bit(&e, 1);
+			put_count(&e, cand, 4, 0);
+			put_count(&e, len, 0, 2);
+			prev = cand;
+			pos += len;
+		} else {
+			lit++;
+			pos++;
+		}
+	}
+	put_literals(&e, in + pos - lit, lit);
+
+	/* end marker, non-matching group of 12, then byte aligned */
+	put_bit(&e, 1);
+	put_bit(&e, 1);
+	put_count(&e, 0, 4, 0);
+	put_count(&e, 12, 4, 12);
+	while (e.bit % BITS_PER_BYTE)
+		put_bit(&e, 0);
+
+	free(head);
+
+	len = e.bit / BITS_PER_BYTE;
+	return len <= out_size ? len : 0;
+}
+
+/* xorshift, so runs are repeatable across libcs */
+static u32 test_rand(u32 *s)
+{
+	*s ^= *s << 13;
+	*s ^= *s >> 17;
+	*s ^= *s << 5;
+	return *s;
+}
+
+/**
+ * rb_lz77_test_data - fill buf with compressible data
+ *
+ * Runs of fill bytes, small tables repeated with a few changes and some
+ * noise, roughly the mix found in Wi-Fi calibration data
+ *
+ * Returns len
+ */
+size_t rb_lz77_test_data(u8 *buf, size_t len, unsigned int seed)
+{
+	u32 s = seed * 2 + 1;
+	size_t pos = 0, n, i, back;
+
+	while (pos < len) {
+		n = min((size_t)(test_rand(&s) % 256 + 1), len - pos);
+
+		switch (test_rand(&s) % 4) {
+		case 0:
+			memset(buf + pos, test_rand(&s) & 1 ? 0xff : 0, n);
+			break;
+		case 1:
+			for (i = 0; i < n; i++)
+				buf[pos + i] = test_rand(&s);
+			break;
+		default:
+			back = pos ? test_rand(&s) % min(pos, (size_t)0x2000) + 1 : 0;
+			for (i = 0; i < n; i++) {
+				buf[pos + i] = back ? buf[pos + i - back] : i;
+				if (!(test_rand(&s) % 32))
+					buf[pos + i] ^= test_rand(&s);
+			}
+			break;
+		}
+		pos += n;
+	}
+
+	return len;
+}
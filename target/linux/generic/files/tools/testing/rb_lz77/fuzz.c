@@ -0,0 +1,177 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * Differential fuzzer: rb_lz77_decompress() must return the same error,
+ * or the same output, as the reference bit at a time decoder.
+ *
+ * Built with RB_LZ77_LIBFUZZER it is a libFuzzer target, the first two
+ * input bytes select the output buffer size. Otherwise it replays the
+ * given files through the same check, or runs its own generated,
+ * mutated and random inputs.
+ */
+
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "rb_lz77_test.h"
+
+int rb_lz77_verbose;
+
+static void check(const u8 *in, size_t in_len, size_t out_size)
+{
+	size_t new_len = out_size, ref_len = out_size;
+	u8 *new_out = malloc(out_size + 1);
+	u8 *ref_out = malloc(out_size + 1);
+	int new_rc, ref_rc;
+
+	if (!new_out || !ref_out)
+		abort();
+
+	new_rc = rb_lz77_decompress(in, in_len, new_out, &new_len);
+	ref_rc = ref_lz77_decompress(in, in_len, ref_out, &ref_len);
+
+	if (new_rc != ref_rc ||
+	    (!new_rc && (new_len != ref_len ||
+			 memcmp(new_out, ref_out, new_len)))) {
+		fprintf(stderr,
+			"mismatch: in_len %zu out_size %zu: rc %d/%d len %zu/%zu\n",
+			in_len, out_size, new_rc, ref_rc, new_len, ref_len);
+		abort();
+	}
+
+	free(new_out);
+	free(ref_out);
+}
+
+int LLVMFuzzerTestOneInput(const u8 *data, size_t size)
+{
+	if (size < 2)
+		return 0;
+
+	check(data + 2, size - 2, (data[0] << 8 | data[1]) + 1);
+	return 0;
+}
+
+#ifndef RB_LZ77_LIBFUZZER
+static u32 rnd(u32 *s)
+{
+	*s ^= *s << 13;
+	*s ^= *s >> 17;
+	*s ^= *s << 5;
+	return *s;
+}
+
+static int replay(const char *file)
+{
+	static u8 buf[1 << 20];
+	size_t len;
+	FILE *f;
+
+	f = fopen(file, "rb");
+	if (!f) {
+		perror(file);
+		return -1;
+	}
+	len = fread(buf, 1, sizeof(buf), f);
+	fclose(f);
+
+	LLVMFuzzerTestOneInput(buf, len);
+	return 0;
+}
+
+/* the encoder output has to decode back to its input */
+static void roundtrip(const u8 *plain, size_t len, const u8 *enc,
+		      size_t enc_len)
+{
+	static u8 out[RB_LZ77_TEST_OUT_SIZE];
+	size_t out_len = sizeof(out);
+	int rc;
+
+	rc = rb_lz77_decompress(enc, enc_len, out, &out_len);
+	if (rc || out_len != len || memcmp(out, plain, len)) {
+		fprintf(stderr, "roundtrip: rc %d, len %zu/%zu\n", rc, out_len,
+			len);
+		abort();
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	static u8 plain[RB_LZ77_TEST_OUT_SIZE];
+	static u8 enc[2 * RB_LZ77_TEST_OUT_SIZE];
+	static u8 mut[2 * RB_LZ77_TEST_OUT_SIZE];
+	unsigned long i, iterations = 2000;
+	size_t len, enc_len, mut_len, j;
+	u32 s = 1;
+	int ch;
+
+	while ((ch = getopt(argc, argv, "n:s:v")) != -1) {
+		switch (ch) {
+		case 'n':
+			iterations = strtoul(optarg, NULL, 0);
+			break;
+		case 's':
+			s = strtoul(optarg, NULL, 0) | 1;
+			break;
+		case 'v':
+			rb_lz77_verbose = 1;
+			break;
+		default:
+			fprintf(stderr,
+				"Usage: %s [-v] [-n <iterations>] [-s <seed>] [file...]\n",
+				argv[0]);
+			return 1;
+		}
+	}
+
+	if (optind < argc) {
+		for (; optind < argc; optind++)
+			if (replay(argv[optind]))
+				return 1;
+		return 0;
+	}
+
+	for (i = 0; i < iterations; i++) {
+		len = rnd(&s) % sizeof(plain) + 1;
+		rb_lz77_test_data(plain, len, rnd(&s));
+		enc_len = rb_lz77_encode(plain, len, enc, sizeof(enc));
+		if (!enc_len)
+			abort();
+
+		roundtrip(plain, len, enc, enc_len);
+		check(enc, enc_len, len);
+		check(enc, enc_len, len - 1);
+		check(enc, enc_len, rnd(&s) % (len + 1));
+
+		/* flipped bits, changed bytes and truncation */
+		for (j = 0; j < 8; j++) {
+			memcpy(mut, enc, enc_len);
+			mut_len = enc_len;
+			switch (j % 4) {
+			case 0:
+				mut[rnd(&s) % mut_len] ^= 1 << (rnd(&s) % 8);
+				break;
+			case 1:
+				mut[rnd(&s) % mut_len] = rnd(&s);
+				break;
+			case 2:
+				mut_len = rnd(&s) % mut_len;
+				break;
+			default:
+				mut[rnd(&s) % mut_len] ^= 1 << (rnd(&s) % 8);
+				mut_len -= rnd(&s) % min(mut_len, (size_t)16);
+				break;
+			}
+			check(mut, mut_len, sizeof(plain));
+		}
+
+		/* noise */
+		mut_len = rnd(&s) % 512;
+		for (j = 0; j < mut_len; j++)
+			mut[j] = rnd(&s);
+		check(mut, mut_len, rnd(&s) % sizeof(plain));
+	}
+
+	printf("%lu iterations ok\n", iterations);
+	return 0;
+}
+#endif /* RB_LZ77_LIBFUZZER */
@@ -0,0 +1,4 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/* the libc errno.h includes this one too */
+#include_next <linux/errno.h>
+#include "../shim.h"
@@ -0,0 +1,89 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Just enough of the kernel API to build rb_lz77.c in userspace
+ */
+
+#ifndef __RB_LZ77_SHIM_H__
+#define __RB_LZ77_SHIM_H__
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+typedef uint8_t u8;
+typedef uint16_t u16;
+typedef uint32_t u32;
+typedef uint64_t u64;
+
+#define BITS_PER_BYTE		8
+
+#define likely(x)		__builtin_expect(!!(x), 1)
+#define unlikely(x)		__builtin_expect(!!(x), 0)
+#define fallthrough		__attribute__((__fallthrough__))
+#ifndef __always_inline
+#define __always_inline		inline __attribute__((__always_inline__))
+#endif
+
+/* like the kernel's, evaluate each argument once */
+#define min(a, b) ({							\
+	__typeof__(a) __min_a = (a);					\
+	__typeof__(b) __min_b = (b);					\
+	__min_a < __min_b ? __min_a : __min_b;				\
+})
+#define min_t(t, a, b) ({						\
+	t __min_t_a = (a);						\
+	t __min_t_b = (b);						\
+	__min_t_a < __min_t_b ? __min_t_a : __min_t_b;			\
+})
+
+extern int rb_lz77_verbose;
+
+#define pr_err(...)							\
+	do {								\
+		if (rb_lz77_verbose)					\
+			fprintf(stderr, __VA_ARGS__);			\
+	} while (0)
+#define pr_debug(...)		do { } while (0)
+
+#define GFP_KERNEL		0
+#define kmalloc(size, gfp)	malloc(size)
+#define kfree(ptr)		free(ptr)
+
+#define EXPORT_SYMBOL_GPL(sym)
+#define MODULE_LICENSE(s)
+#define MODULE_DESCRIPTION(s)
+#define MODULE_AUTHOR(s)
+
+static inline u8 bitrev8(u8 x)
+{
+	x = (x >> 4) | (x << 4);
+	x = ((x & 0xcc) >> 2) | ((x & 0x33) << 2);
+	return ((x & 0xaa) >> 1) | ((x & 0x55) << 1);
+}
+
+static inline u32 bitrev32(u32 x)
+{
+	return (u32)bitrev8(x) << 24 | (u32)bitrev8(x >> 8) << 16 |
+	       (u32)bitrev8(x >> 16) << 8 | bitrev8(x >> 24);
+}
+
+static inline unsigned long __ffs64(u64 word)
+{
+	return __builtin_ctzll(word);
+}
+
+static inline u64 get_unaligned_le64(const void *p)
+{
+	u64 v;
+
+	memcpy(&v, p, sizeof(v));
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+	v = __builtin_bswap64(v);
+#endif
+	return v;
+}
+
+#endif /* __RB_LZ77_SHIM_H__ */
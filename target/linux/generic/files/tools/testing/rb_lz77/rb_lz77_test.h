@@ -0,0 +1,19 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+
+#ifndef __RB_LZ77_TEST_H__
+#define __RB_LZ77_TEST_H__
+
+#include <linux/errno.h>
+
+#include "rb_lz77.h"
+
+/* RB_ART_SIZE, what rb_hardconfig decompresses the caldata into */
+#define RB_LZ77_TEST_OUT_SIZE	0x10000
+
+int ref_lz77_decompress(const u8 *in, const size_t in_len, u8 *out,
+			size_t *out_len);
+
+size_t rb_lz77_encode(const u8 *in, size_t in_len, u8 *out, size_t out_size);
+size_t rb_lz77_test_data(u8 *buf, size_t len, unsigned int seed);
+
+#endif /* __RB_LZ77_TEST_H__ */
@@ -5,6 +5,8 @@
 
 #include <linux/bitfield.h>
 #include <linux/bitmap.h>
+#include <linux/if_ether.h>
+#include <linux/mutex.h>
 #include <linux/regmap.h>
 #include <linux/spinlock.h>
 #include <linux/types.h>
@@ -431,6 +433,7 @@
 #define PPE_FDB_DST_PORTMAP		3
 #define PPE_FDB_AGE_STATIC		3
 #define PPE_FDB_OP_FLUSH		4
+#define PPE_FDB_SHADOW_TTL		HZ
 
 #define PPE_XLT_TBL_NUM			64
 #define PPE_XLT_MISS_FWD_DROP		3
@@ -496,6 +499,25 @@ struct qca_ppe_vlan_entry {
 	int xlt_pvid_idx;
 };
 
+struct qca_ppe_fdb_entry {
+	u8 addr[ETH_ALEN];
+	u16 vid;
+	u16 port;
+	bool is_static;
+};
+
+/* Unicast FDB entries as of the last table walk, kept up to date by
+ * fdb_add/fdb_del. Entries learned or aged out by the hardware show up
+ * once the walk expires.
+ */
+struct qca_ppe_fdb_shadow {
+	struct mutex lock;
+	struct qca_ppe_fdb_entry *entries;
+	unsigned int count;
+	unsigned long expires;
+	bool valid;
+};
+
 struct qca_ppe_priv {
 	struct dsa_switch ds;
 	struct regmap *regmap;
@@ -503,6 +525,7 @@ struct qca_ppe_priv {
 	struct clk_bulk_data *clks;
 	int num_clks;
 	spinlock_t fdb_lock;
+	struct qca_ppe_fdb_shadow fdb_shadow;
 	DECLARE_BITMAP(vsi_bitmap, PPE_VSI_MAX);
 	DECLARE_BITMAP(xlt_bitmap, PPE_XLT_TBL_NUM);
 	u32 port_vsi[QCA_PPE_MAX_PORTS];
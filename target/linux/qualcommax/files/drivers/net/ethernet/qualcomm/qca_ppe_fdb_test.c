@@ -0,0 +1,362 @@
+// SPDX-License-Identifier: GPL-2.0-or-later OR MIT
+/*
+ * KUnit tests for the FDB shadow table. They run against a register map
+ * that emulates the FDB operation registers, so no PPE is needed.
+ *
+ * Included from qca_ppe_main.c to reach the static FDB helpers.
+ */
+
+#include <kunit/device.h>
+#include <kunit/test.h>
+
+#define PPE_FDB_KEY_MASK1	(GENMASK(15, 0) | PPE_FDB_DATA1_VSI)
+
+struct ppe_fdb_mock {
+	u32 tbl[PPE_FDB_TBL_NUM][3];
+	u32 op_data[3];
+	u32 rd_op_data[3];
+	u32 rd_rslt[3];
+	u32 op_rslt;
+	u32 rd_op_rslt;
+	unsigned int index_reads;
+};
+
+struct ppe_fdb_test {
+	struct qca_ppe_priv *priv;
+	struct ppe_fdb_mock *mock;
+};
+
+struct ppe_fdb_test_dump {
+	unsigned int count;
+	unsigned int num_static;
+	unsigned char last[ETH_ALEN];
+};
+
+static int ppe_fdb_mock_find(struct ppe_fdb_mock *m, const u32 *key)
+{
+	int i;
+
+	for (i = 0; i < PPE_FDB_TBL_NUM; i++) {
+		if (!(m->tbl[i][1] & PPE_FDB_DATA1_VALID))
+			continue;
+
+		if (m->tbl[i][0] == key[0] &&
+		    (m->tbl[i][1] & PPE_FDB_KEY_MASK1) ==
+		    (key[1] & PPE_FDB_KEY_MASK1))
+			return i;
+	}
+
+	return -1;
+}
+
+static int ppe_fdb_mock_free(struct ppe_fdb_mock *m)
+{
+	int i;
+
+	for (i = 0; i < PPE_FDB_TBL_NUM; i++)
+		if (!(m->tbl[i][1] & PPE_FDB_DATA1_VALID))
+			return i;
+
+	return -1;
+}
+
+static int ppe_fdb_mock_write(void *ctx, unsigned int reg, unsigned int val)
+{
+	struct ppe_fdb_mock *m = ctx;
+	u32 cmd_id = FIELD_GET(PPE_FDB_OP_CMD_ID, val);
+	int i;
+
+	switch (reg) {
+	case PPE_FDB_OP_DATA0 ... PPE_FDB_OP_DATA2:
+		m->op_data[(reg - PPE_FDB_OP_DATA0) / 4] = val;
+		break;
+	case PPE_FDB_RD_OP_DATA0 ... PPE_FDB_RD_OP_DATA2:
+		m->rd_op_data[(reg - PPE_FDB_RD_OP_DATA0) / 4] = val;
+		break;
+	case PPE_FDB_OP:
+		switch (FIELD_GET(PPE_FDB_OP_TYPE, val)) {
+		case PPE_FDB_OP_ADD:
+			i = ppe_fdb_mock_find(m, m->op_data);
+			if (i < 0)
+				i = ppe_fdb_mock_free(m);
+			if (i >= 0)
+				memcpy(m->tbl[i], m->op_data, sizeof(m->op_data));
+			break;
+		case PPE_FDB_OP_DEL:
+			i = ppe_fdb_mock_find(m, m->op_data);
+			if (i >= 0)
+				memset(m->tbl[i], 0, sizeof(m->tbl[i]));
+			break;
+		case PPE_FDB_OP_FLUSH:
+			memset(m->tbl, 0, sizeof(m->tbl));
+			break;
+		}
+		m->op_rslt = FIELD_PREP(PPE_FDB_RSLT_CMD_ID, cmd_id);
+		break;
+	case PPE_FDB_RD_OP:
+		if (val & PPE_FDB_OP_MODE) {
+			i = FIELD_GET(PPE_FDB_OP_ENTRY_IDX, val);
+			m->index_reads++;
+		} else {
+			i = ppe_fdb_mock_find(m, m->rd_op_data);
+		}
+
+		if (i >= 0)
+			memcpy(m->rd_rslt, m->tbl[i], sizeof(m->rd_rslt));
+		else
+			memset(m->rd_rslt, 0, sizeof(m->rd_rslt));
+		m->rd_op_rslt = FIELD_PREP(PPE_FDB_RSLT_CMD_ID, cmd_id);
+		break;
+	}
+
+	return 0;
+}
+
+static int ppe_fdb_mock_read(void *ctx, unsigned int reg, unsigned int *val)
+{
+	struct ppe_fdb_mock *m = ctx;
+
+	switch (reg) {
+	case PPE_FDB_OP_RSLT:
+		*val = m->op_rslt;
+		break;
+	case PPE_FDB_RD_OP_RSLT:
+		*val = m->rd_op_rslt;
+		break;
+	case PPE_FDB_RD_RSLT_DATA0 ... PPE_FDB_RD_RSLT_DATA2:
+		*val = m->rd_rslt[(reg - PPE_FDB_RD_RSLT_DATA0) / 4];
+		break;
+	default:
+		*val = 0;
+		break;
+	}
+
+	return 0;
+}
+
+static const struct regmap_config ppe_fdb_mock_regmap_cfg = {
+	.reg_bits = 32,
+	.reg_stride = 4,
+	.val_bits = 32,
+	.reg_read = ppe_fdb_mock_read,
+	.reg_write = ppe_fdb_mock_write,
+	/* fdb_lock is a spinlock, the mock is only used by one test */
+	.disable_locking = true,
+};
+
+/* An address the hardware learned by itself */
+static void ppe_fdb_mock_learn(struct ppe_fdb_mock *m, int idx, u8 id,
+			       int port, u16 vid)
+{
+	const unsigned char addr[ETH_ALEN] = { 0x02, 0, 0, 0, port, id };
+
+	ppe_fdb_encode(addr, port, vid, false,
+		       &m->tbl[idx][0], &m->tbl[idx][1], &m->tbl[idx][2]);
+}
+
+static int ppe_fdb_test_dump_cb(const unsigned char *addr, u16 vid,
+				bool is_static, void *data)
+{
+	struct ppe_fdb_test_dump *d = data;
+
+	d->count++;
+	if (is_static)
+		d->num_static++;
+	ether_addr_copy(d->last, addr);
+
+	return 0;
+}
+
+static struct ppe_fdb_test_dump
+ppe_fdb_test_port_dump(struct kunit *test, int port)
+{
+	struct ppe_fdb_test *t = test->priv;
+	struct ppe_fdb_test_dump d = {};
+
+	KUNIT_EXPECT_EQ(test, qca_ppe_port_fdb_dump(&t->priv->ds, port,
+						    ppe_fdb_test_dump_cb, &d), 0);
+
+	return d;
+}
+
+static int ppe_fdb_test_init(struct kunit *test)
+{
+	struct qca_ppe_priv *priv;
+	struct ppe_fdb_test *t;
+	struct device *dev;
+
+	dev = kunit_device_register(test, "qca-ppe-fdb-test");
+	KUNIT_ASSERT_NOT_ERR_OR_NULL(test, dev);
+
+	t = kunit_kzalloc(test, sizeof(*t), GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, t);
+
+	t->mock = kunit_kzalloc(test, sizeof(*t->mock), GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, t->mock);
+
+	priv = kunit_kzalloc(test, sizeof(*priv), GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, priv);
+
+	priv->fdb_shadow.entries = kunit_kcalloc(test, PPE_FDB_TBL_NUM,
+						 sizeof(*priv->fdb_shadow.entries),
+						 GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, priv->fdb_shadow.entries);
+
+	priv->regmap = devm_regmap_init(dev, NULL, t->mock,
+					&ppe_fdb_mock_regmap_cfg);
+	KUNIT_ASSERT_NOT_ERR_OR_NULL(test, priv->regmap);
+
+	spin_lock_init(&priv->fdb_lock);
+	mutex_init(&priv->fdb_shadow.lock);
+
+	t->priv = priv;
+	test->priv = t;
+
+	return 0;
+}
+
+static void ppe_fdb_test_single_walk(struct kunit *test)
+{
+	struct ppe_fdb_test *t = test->priv;
+	struct ppe_fdb_mock *m = t->mock;
+	int port;
+
+	ppe_fdb_mock_learn(m, 3, 1, 1, 0);
+	ppe_fdb_mock_learn(m, 700, 2, 1, 0);
+	ppe_fdb_mock_learn(m, 1024, 1, 2, 0);
+	ppe_fdb_mock_learn(m, PPE_FDB_TBL_NUM - 1, 1, 4, 1);
+
+	KUNIT_EXPECT_EQ(test, ppe_fdb_test_port_dump(test, 1).count, 2);
+	KUNIT_EXPECT_EQ(test, ppe_fdb_test_port_dump(test, 2).count, 1);
+	KUNIT_EXPECT_EQ(test, ppe_fdb_test_port_dump(test, 3).count, 0);
+	KUNIT_EXPECT_EQ(test, ppe_fdb_test_port_dump(test, 4).count, 1);
+	KUNIT_EXPECT_EQ(test, ppe_fdb_test_port_dump(test, 4).last[4], 4);
+
+	for (port = 5; port < QCA_PPE_MAX_PORTS; port++)
+		KUNIT_EXPECT_EQ(test, ppe_fdb_test_port_dump(test, port).count, 0);
+
+	/* Every port was served from one pass over the table */
+	KUNIT_EXPECT_EQ(test, m->index_reads, PPE_FDB_TBL_NUM);
+}
+
+static void ppe_fdb_test_add_del(struct kunit *test)
+{
+	const unsigned char addr[ETH_ALEN] = { 0x02, 0xaa, 0, 0, 0, 1 };
+	struct ppe_fdb_test *t = test->priv;
+	struct ppe_fdb_mock *m = t->mock;
+	struct ppe_fdb_test_dump d;
+	struct dsa_db db = {};
+
+	ppe_fdb_mock_learn(m, 10, 1, 2, 0);
+	KUNIT_EXPECT_EQ(test, ppe_fdb_test_port_dump(test, 2).count, 1);
+
+	KUNIT_ASSERT_EQ(test, qca_ppe_port_fdb_add(&t->priv->ds, 2, addr, 0, db), 0);
+	d = ppe_fdb_test_port_dump(test, 2);
+	KUNIT_EXPECT_EQ(test, d.count, 2);
+	KUNIT_EXPECT_EQ(test, d.num_static, 1);
+
+	/* Moving the address updates the existing entry */
+	KUNIT_ASSERT_EQ(test, qca_ppe_port_fdb_add(&t->priv->ds, 3, addr, 0, db), 0);
+	KUNIT_EXPECT_EQ(test, ppe_fdb_test_port_dump(test, 2).count, 1);
+	KUNIT_EXPECT_EQ(test, ppe_fdb_test_port_dump(test, 3).count, 1);
+	KUNIT_EXPECT_EQ(test, t->priv->fdb_shadow.count, 2);
+
+	KUNIT_ASSERT_EQ(test, qca_ppe_port_fdb_del(&t->priv->ds, 3, addr, 0, db), 0);
+	KUNIT_EXPECT_EQ(test, ppe_fdb_test_port_dump(test, 3).count, 0);
+	KUNIT_EXPECT_EQ(test, ppe_fdb_test_port_dump(test, 2).count, 1);
+
+	/* The hardware agrees and nothing was walked again */
+	KUNIT_EXPECT_EQ(test, ppe_fdb_mock_find(m, m->op_data), -1);
+	KUNIT_EXPECT_EQ(test, m->index_reads, PPE_FDB_TBL_NUM);
+}
+
+static void ppe_fdb_test_wide_vid(struct kunit *test)
+{
+	const unsigned char addr[ETH_ALEN] = { 0x02, 0xbb, 0, 0, 0, 1 };
+	struct ppe_fdb_test *t = test->priv;
+	struct qca_ppe_fdb_shadow *sh = &t->priv->fdb_shadow;
+	struct ppe_fdb_mock *m = t->mock;
+	struct dsa_db db = {};
+	u32 key[3];
+
+	KUNIT_EXPECT_EQ(test, ppe_fdb_test_port_dump(test, 1).count, 0);
+
+	/* VID 33 only keeps its VSI bits in hardware, so does the shadow */
+	KUNIT_ASSERT_EQ(test, qca_ppe_port_fdb_add(&t->priv->ds, 1, addr, 33, db), 0);
+	KUNIT_ASSERT_EQ(test, sh->count, 1);
+	KUNIT_EXPECT_EQ(test, sh->entries[0].vid, 1);
+
+	ppe_fdb_encode(addr, 1, 1, true, &key[0], &key[1], &key[2]);
+	KUNIT_EXPECT_GE(test, ppe_fdb_mock_find(m, key), 0);
+
+	/* Re-adding either alias updates the one entry */
+	KUNIT_ASSERT_EQ(test, qca_ppe_port_fdb_add(&t->priv->ds, 2, addr, 1, db), 0);
+	KUNIT_EXPECT_EQ(test, sh->count, 1);
+	KUNIT_EXPECT_EQ(test, ppe_fdb_test_port_dump(test, 1).count, 0);
+	KUNIT_EXPECT_EQ(test, ppe_fdb_test_port_dump(test, 2).count, 1);
+
+	KUNIT_ASSERT_EQ(test, qca_ppe_port_fdb_del(&t->priv->ds, 2, addr, 33, db), 0);
+	KUNIT_EXPECT_EQ(test, sh->count, 0);
+	KUNIT_EXPECT_EQ(test, ppe_fdb_mock_find(m, key), -1);
+	KUNIT_EXPECT_EQ(test, ppe_fdb_test_port_dump(test, 2).count, 0);
+	KUNIT_EXPECT_EQ(test, m->index_reads, PPE_FDB_TBL_NUM);
+}
+
+static void ppe_fdb_test_expire(struct kunit *test)
+{
+	struct ppe_fdb_test *t = test->priv;
+	struct qca_ppe_fdb_shadow *sh = &t->priv->fdb_shadow;
+	struct ppe_fdb_mock *m = t->mock;
+
+	ppe_fdb_mock_learn(m, 5, 1, 1, 0);
+	KUNIT_EXPECT_EQ(test, ppe_fdb_test_port_dump(test, 1).count, 1);
+
+	/* Aged out by the hardware, a new address learned */
+	memset(m->tbl[5], 0, sizeof(m->tbl[5]));
+	ppe_fdb_mock_learn(m, 6, 2, 2, 0);
+	KUNIT_EXPECT_EQ(test, ppe_fdb_test_port_dump(test, 1).count, 1);
+	KUNIT_EXPECT_EQ(test, ppe_fdb_test_port_dump(test, 2).count, 0);
+
+	sh->expires = jiffies - 1;
+	KUNIT_EXPECT_EQ(test, ppe_fdb_test_port_dump(test, 1).count, 0);
+	KUNIT_EXPECT_EQ(test, ppe_fdb_test_port_dump(test, 2).count, 1);
+	KUNIT_EXPECT_EQ(test, m->index_reads, 2 * PPE_FDB_TBL_NUM);
+
+	/* So does changing the ageing time */
+	KUNIT_EXPECT_EQ(test, qca_ppe_set_ageing_time(&t->priv->ds, 300000), 0);
+	KUNIT_EXPECT_EQ(test, ppe_fdb_test_port_dump(test, 2).count, 1);
+	KUNIT_EXPECT_EQ(test, m->index_reads, 3 * PPE_FDB_TBL_NUM);
+
+	KUNIT_EXPECT_EQ(test, ppe_fdb_flush(t->priv), 0);
+	KUNIT_EXPECT_EQ(test, ppe_fdb_test_port_dump(test, 2).count, 0);
+}
+
+static void ppe_fdb_test_skip_mcast(struct kunit *test)
+{
+	const unsigned char maddr[ETH_ALEN] = { 0x01, 0x00, 0x5e, 0, 0, 1 };
+	struct ppe_fdb_test *t = test->priv;
+
+	KUNIT_ASSERT_EQ(test, ppe_fdb_mcast_op(t->priv, maddr, BIT(1) | BIT(2),
+					       0, PPE_FDB_OP_ADD), 0);
+	ppe_fdb_mock_learn(t->mock, 1, 1, 1, 0);
+
+	KUNIT_EXPECT_EQ(test, ppe_fdb_test_port_dump(test, 1).count, 1);
+	KUNIT_EXPECT_EQ(test, ppe_fdb_test_port_dump(test, 2).count, 0);
+	KUNIT_EXPECT_EQ(test, t->priv->fdb_shadow.count, 1);
+}
+
+static struct kunit_case ppe_fdb_test_cases[] = {
+	KUNIT_CASE(ppe_fdb_test_single_walk),
+	KUNIT_CASE(ppe_fdb_test_add_del),
+	KUNIT_CASE(ppe_fdb_test_wide_vid),
+	KUNIT_CASE(ppe_fdb_test_expire),
+	KUNIT_CASE(ppe_fdb_test_skip_mcast),
+	{}
+};
+
+static struct kunit_suite ppe_fdb_test_suite = {
+	.name = "qca-ppe-fdb",
+	.init = ppe_fdb_test_init,
+	.test_cases = ppe_fdb_test_cases,
+};
+kunit_test_suite(ppe_fdb_test_suite);
@@ -12,6 +12,7 @@
 #include <linux/platform_device.h>
 #include <linux/reset.h>
 #include <linux/if_bridge.h>
+#include <linux/etherdevice.h>
 
 #include "qca_ppe.h"
 
@@ -325,6 +326,97 @@ unlock:
 	return 0;
 }
 
+static void ppe_fdb_shadow_invalidate(struct qca_ppe_priv *priv)
+{
+	mutex_lock(&priv->fdb_shadow.lock);
+	priv->fdb_shadow.valid = false;
+	mutex_unlock(&priv->fdb_shadow.lock);
+}
+
+/* Read the whole table once, keeping the valid unicast entries. */
+static void ppe_fdb_shadow_walk(struct qca_ppe_priv *priv)
+{
+	struct qca_ppe_fdb_shadow *sh = &priv->fdb_shadow;
+	struct qca_ppe_fdb_entry *e;
+	int port;
+	u32 i;
+
+	lockdep_assert_held(&sh->lock);
+
+	sh->count = 0;
+	for (i = 0; i < PPE_FDB_TBL_NUM; i++) {
+		e = &sh->entries[sh->count];
+		if (ppe_fdb_read_entry(priv, i, e->addr, &e->vid, &port,
+				       &e->is_static))
+			continue;
+
+		e->port = port;
+		sh->count++;
+	}
+
+	sh->expires = jiffies + PPE_FDB_SHADOW_TTL;
+	sh->valid = true;
+}
+
+/* The entries only hold the VID bits ppe_fdb_encode() puts in the VSI field */
+static u16 ppe_fdb_vid(u16 vid)
+{
+	return FIELD_GET(PPE_FDB_DATA1_VSI, FIELD_PREP(PPE_FDB_DATA1_VSI, vid));
+}
+
+static struct qca_ppe_fdb_entry *
+ppe_fdb_shadow_find(struct qca_ppe_fdb_shadow *sh,
+		    const unsigned char *addr, u16 vid)
+{
+	unsigned int i;
+
+	vid = ppe_fdb_vid(vid);
+	for (i = 0; i < sh->count; i++)
+		if (sh->entries[i].vid == vid &&
+		    ether_addr_equal(sh->entries[i].addr, addr))
+			return &sh->entries[i];
+
+	return NULL;
+}
+
+/* Mirror a successful fdb_add/fdb_del into the shadow table. */
+static void ppe_fdb_shadow_update(struct qca_ppe_priv *priv,
+				  const unsigned char *addr, int port,
+				  u16 vid, u32 op_type)
+{
+	struct qca_ppe_fdb_shadow *sh = &priv->fdb_shadow;
+	struct qca_ppe_fdb_entry *e;
+
+	mutex_lock(&sh->lock);
+
+	if (!sh->valid)
+		goto out;
+
+	e = ppe_fdb_shadow_find(sh, addr, vid);
+	if (op_type == PPE_FDB_OP_DEL) {
+		if (e)
+			*e = sh->entries[--sh->count];
+		goto out;
+	}
+
+	if (!e) {
+		if (sh->count >= PPE_FDB_TBL_NUM) {
+			sh->valid = false;
+			goto out;
+		}
+
+		e = &sh->entries[sh->count++];
+		ether_addr_copy(e->addr, addr);
+		e->vid = ppe_fdb_vid(vid);
+	}
+
+	e->port = port;
+	e->is_static = true;
+
+out:
+	mutex_unlock(&sh->lock);
+}
+
 static int ppe_fdb_flush(struct qca_ppe_priv *priv)
 {
 	int ret;
@@ -338,6 +430,8 @@ static int ppe_fdb_flush(struct qca_ppe_priv *priv)
 
 	spin_unlock_bh(&priv->fdb_lock);
 
+	ppe_fdb_shadow_invalidate(priv);
+
 	return ret;
 }
 
@@ -504,6 +598,8 @@ static int qca_ppe_set_ageing_time(struct dsa_switch *ds, unsigned int msecs)
 	regmap_update_bits(priv->regmap, PPE_AGE_TIMER, PPE_AGE_TIMER_MASK,
 			   FIELD_PREP(PPE_AGE_TIMER_MASK, timer));
 
+	ppe_fdb_shadow_invalidate(priv);
+
 	return 0;
 }
 
@@ -634,8 +730,13 @@ static int qca_ppe_port_fdb_add(struct dsa_switch *ds, int port,
 				    struct dsa_db db)
 {
 	struct qca_ppe_priv *priv = ds_to_priv(ds);
+	int ret;
 
-	return ppe_fdb_op(priv, addr, port, vid, PPE_FDB_OP_ADD);
+	ret = ppe_fdb_op(priv, addr, port, vid, PPE_FDB_OP_ADD);
+	if (!ret)
+		ppe_fdb_shadow_update(priv, addr, port, vid, PPE_FDB_OP_ADD);
+
+	return ret;
 }
 
 static int qca_ppe_port_fdb_del(struct dsa_switch *ds, int port,
@@ -643,32 +744,40 @@ static int qca_ppe_port_fdb_del(struct dsa_switch *ds, int port,
 				    struct dsa_db db)
 {
 	struct qca_ppe_priv *priv = ds_to_priv(ds);
+	int ret;
+
+	ret = ppe_fdb_op(priv, addr, port, vid, PPE_FDB_OP_DEL);
+	if (!ret)
+		ppe_fdb_shadow_update(priv, addr, port, vid, PPE_FDB_OP_DEL);
 
-	return ppe_fdb_op(priv, addr, port, vid, PPE_FDB_OP_DEL);
+	return ret;
 }
 
 static int qca_ppe_port_fdb_dump(struct dsa_switch *ds, int port,
 				     dsa_fdb_dump_cb_t *cb, void *data)
 {
 	struct qca_ppe_priv *priv = ds_to_priv(ds);
-	unsigned char addr[ETH_ALEN];
-	bool is_static;
-	int fdb_port;
-	u16 vid;
-	u32 i;
+	struct qca_ppe_fdb_shadow *sh = &priv->fdb_shadow;
+	struct qca_ppe_fdb_entry *e;
+	unsigned int i;
 
-	for (i = 0; i < PPE_FDB_TBL_NUM; i++) {
-		if (ppe_fdb_read_entry(priv, i, addr, &vid, &fdb_port,
-				       &is_static))
-			continue;
+	mutex_lock(&sh->lock);
+
+	/* The per-port dumps of one request share a single table walk */
+	if (!sh->valid || time_after(jiffies, sh->expires))
+		ppe_fdb_shadow_walk(priv);
 
-		if (fdb_port != port)
+	for (i = 0; i < sh->count; i++) {
+		e = &sh->entries[i];
+		if (e->port != port)
 			continue;
 
-		if (cb(addr, vid, is_static, data))
+		if (cb(e->addr, e->vid, e->is_static, data))
 			break;
 	}
 
+	mutex_unlock(&sh->lock);
+
 	return 0;
 }
 
@@ -1446,6 +1555,15 @@ static int qca_ppe_probe(struct platform_device *pdev)
 
 	spin_lock_init(&priv->fdb_lock);
 
+	mutex_init(&priv->fdb_shadow.lock);
+	priv->fdb_shadow.entries = devm_kcalloc(&pdev->dev, PPE_FDB_TBL_NUM,
+						sizeof(*priv->fdb_shadow.entries),
+						GFP_KERNEL);
+	if (!priv->fdb_shadow.entries) {
+		ret = -ENOMEM;
+		goto err_clk;
+	}
+
 	ds = &priv->ds;
 	ds->dev = &pdev->dev;
 	ds->num_ports = data->num_ports;
@@ -1565,3 +1683,7 @@ module_platform_driver(qca_ppe_driver);
 
 MODULE_LICENSE("GPL");
 MODULE_DESCRIPTION("Driver for Qualcomm PPE switches");
+
+#if IS_ENABLED(CONFIG_QCOM_80211AX_PPE_KUNIT_TEST)
+#include "qca_ppe_fdb_test.c"
+#endif
@@ -2,8 +2,10 @@
 
 #include <linux/debugfs.h>
 #include <linux/kernel.h>
+#include <linux/math64.h>
 #include <asm/mach-rtl-otto/mach-rtl-otto.h>
 
+#include "l3.h"
 #include "rtl-otto.h"
 
 #define RTL838X_DRIVER_NAME "rtl838x"
@@ -590,6 +592,41 @@ static const struct file_operations rtldsa_vlan_table_fops = {
 	.release = single_release,
 };
 
+static int rtldsa_l3_stats_show(struct seq_file *m, void *v)
+{
+	struct rtl838x_switch_priv *priv = m->private;
+	struct otto_l3_stats *s = &priv->l3_ctrl->stats;
+	unsigned long events = s->fib_add + s->fib_del;
+
+	seq_printf(m, "fib_add: %lu\n", s->fib_add);
+	seq_printf(m, "fib_del: %lu\n", s->fib_del);
+	seq_printf(m, "neigh_update: %lu\n", s->neigh_update);
+	seq_printf(m, "batches: %lu\n", s->batches);
+	seq_printf(m, "batch_max: %lu\n", s->batch_max);
+	seq_printf(m, "host_writes: %lu\n", s->host_writes);
+	seq_printf(m, "route_writes: %lu\n", s->route_writes);
+	seq_printf(m, "nexthop_writes: %lu\n", s->nexthop_writes);
+	seq_printf(m, "writes_elided: %lu\n", s->writes_elided);
+	seq_printf(m, "reads_avoided: %lu\n", s->reads_avoided);
+	seq_printf(m, "latency_avg_us: %llu\n", events ? div64_u64(s->latency_us, events) : 0);
+	seq_printf(m, "latency_max_us: %lu\n", s->latency_max_us);
+
+	return 0;
+}
+
+static int rtldsa_l3_stats_open(struct inode *inode, struct file *filp)
+{
+	return single_open(filp, rtldsa_l3_stats_show, inode->i_private);
+}
+
+static const struct file_operations rtldsa_l3_stats_fops = {
+	.owner = THIS_MODULE,
+	.open = rtldsa_l3_stats_open,
+	.read = seq_read,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
 static ssize_t age_out_read(struct file *filp, char __user *buffer, size_t count,
 			    loff_t *ppos)
 {
@@ -940,6 +977,10 @@ void rtl838x_dbgfs_init(struct rtl838x_switch_priv *priv)
 	debugfs_create_file("vlan_table", 0400, rtl838x_dir, priv,
 			    &rtldsa_vlan_table_fops);
 
+	if (priv->l3_ctrl)
+		debugfs_create_file("l3_stats", 0400, rtl838x_dir, priv,
+				    &rtldsa_l3_stats_fops);
+
 	return;
 err:
 	rtl838x_dbgfs_cleanup(priv);
@@ -974,4 +1015,8 @@ void rtl930x_dbgfs_init(struct rtl838x_switch_priv *priv)
 
 	debugfs_create_file("vlan_table", 0400, dbg_dir, priv,
 			    &rtldsa_vlan_table_fops);
+
+	if (priv->l3_ctrl)
+		debugfs_create_file("l3_stats", 0400, dbg_dir, priv,
+				    &rtldsa_l3_stats_fops);
 }
@@ -8,6 +8,7 @@
 #include <net/arp.h>
 #include <net/fib_notifier.h>
 #include <net/ip6_fib.h>
+#include <net/ipv6.h>
 #include <net/netevent.h>
 #include <net/nexthop.h>
 #include <uapi/linux/rtnetlink.h>
@@ -28,9 +29,10 @@ struct otto_l3_net_event_work {
 	u32 gw_addr;
 };
 
+/* A FIB event queued on otto_l3_ctrl.fib_events */
 struct otto_l3_fib_event_work {
-	struct work_struct work;
-	struct otto_l3_ctrl *ctrl;
+	struct list_head list;
+	ktime_t queued;
 	union {
 		struct fib_entry_notifier_info fen_info;
 		struct fib6_entry_notifier_info fen6_info;
@@ -255,7 +257,7 @@ static void otto_l3_930x_host_route_write(struct otto_l3_ctrl *ctrl, int idx, st
 		rt->attr.dst_null);
 	dev_dbg(ctrl->dev, "GW: %pI4, prefix_len: %d\n", &rt->dst_ip, rt->prefix_len);
 
-	v = BIT(31); /* Entry is valid */
+	v = rt->attr.valid ? BIT(31) : 0;
 	v |= (rt->attr.type & 0x3) << 29;
 	v |= rt->attr.hit ? BIT(20) : 0;
 	v |= rt->attr.dst_null ? BIT(19) : 0;
@@ -292,18 +294,25 @@ out:
 	rtl_table_release(r);
 }
 
+/*
+ * Find the host route table slot of a route in the shadow of the table. Returns the slot
+ * holding the route's destination or, unless must_exist is set, the first free slot of
+ * the destination's hash buckets.
+ */
 __maybe_unused
 static int otto_l3_930x_find_slot(struct otto_l3_ctrl *ctrl, struct otto_l3_route *rt, bool must_exist)
 {
-	int slot_width, algorithm, addr, idx;
-	struct otto_l3_route route_entry;
+	int slot_width, algorithm, addr, idx, free_idx = -1;
+	struct otto_l3_shadow_route *e;
 	u32 hash;
 
+	ctrl->stats.reads_avoided++;
+
 	/* IPv6 entries take up 3 slots */
 	slot_width = (rt->attr.type == 0) || (rt->attr.type == 2) ? 1 : 3;
 
 	for (int t = 0; t < 2; t++) {
-		algorithm = (sw_r32(RTL930X_L3_HOST_TBL_CTRL) >> (2 + t)) & 0x1;
+		algorithm = ctrl->host_hash_alg[t];
 		hash = otto_l3_930x_hash4(rt->dst_ip, algorithm, false);
 
 		dev_dbg(ctrl->dev, "table %d, algorithm %d, hash %04x\n", t, algorithm, hash);
@@ -314,17 +323,21 @@ static int otto_l3_930x_find_slot(struct otto_l3_ctrl *ctrl, struct otto_l3_rout
 			idx = ((addr / 8) * 6) + (addr % 8);
 			dev_dbg(ctrl->dev, "logical address %d\n", idx);
 
-			otto_l3_930x_host_route_read(ctrl, idx, &route_entry);
-			dev_dbg(ctrl->dev, "route valid %d, route dest: %pI4, hit %d\n",
-				rt->attr.valid, &rt->dst_ip, rt->attr.hit);
-			if (!must_exist && rt->attr.valid)
-				return idx;
-			if (must_exist && route_entry.dst_ip == rt->dst_ip)
+			e = &ctrl->host_shadow[idx];
+			if (!e->attr.valid) {
+				if (free_idx < 0)
+					free_idx = idx;
+				continue;
+			}
+			if (e->attr.type != rt->attr.type)
+				continue;
+			if (rt->attr.type == 2 ? ipv6_addr_equal(&e->dst_ip6, &rt->dst_ip6) :
+						 e->dst_ip == rt->dst_ip)
 				return idx;
 		}
 	}
 
-	return -1;
+	return must_exist ? -1 : free_idx;
 }
 
 /*
@@ -774,6 +787,7 @@ __maybe_unused
 static int otto_l3_930x_setup(struct otto_l3_ctrl *ctrl)
 {
 	struct rtl838x_switch_priv *priv = ctrl->priv;
+	struct otto_l3_route rt = {};
 
 	/* Setup MTU with id 0 for default interface */
 	for (int i = 0; i < MAX_INTF_MTUS; i++)
@@ -799,6 +813,14 @@ static int otto_l3_930x_setup(struct otto_l3_ctrl *ctrl)
 	/* Configure the default L3 hash algorithm */
 	sw_w32_mask(BIT(2), 0, RTL930X_L3_HOST_TBL_CTRL);  /* Algorithm selection 0 = 0 */
 	sw_w32_mask(0, BIT(3), RTL930X_L3_HOST_TBL_CTRL);  /* Algorithm selection 1 = 1 */
+	for (int t = 0; t < 2; t++)
+		ctrl->host_hash_alg[t] = (sw_r32(RTL930X_L3_HOST_TBL_CTRL) >> (2 + t)) & 0x1;
+
+	/* Start with empty route tables, as their shadows do */
+	for (int i = 0; i < L3_HOST_TBL_SIZE; i++)
+		otto_l3_930x_host_route_write(ctrl, i, &rt);
+	for (int i = 0; i < MAX_ROUTES; i++)
+		otto_l3_930x_route_write(ctrl, i, &rt);
 
 	pr_debug("L3_IPUC_ROUTE_CTRL %08x, IPMC_ROUTE %08x, IP6UC_ROUTE %08x, IP6MC_ROUTE %08x\n",
 		 sw_r32(RTL930X_L3_IPUC_ROUTE_CTRL), sw_r32(RTL930X_L3_IPMC_ROUTE_CTRL),
@@ -871,6 +893,199 @@ static int otto_l3_alloc_egress_intf(struct otto_l3_ctrl *ctrl, u64 mac, int vla
 	return free_mac;
 }
 
+static void otto_l3_shadow_from_route(struct otto_l3_shadow_route *e, struct otto_l3_route *rt)
+{
+	memset(e, 0, sizeof(*e));
+	if (!rt->attr.valid)
+		return;
+
+	if (rt->attr.type == 2)
+		e->dst_ip6 = rt->dst_ip6;
+	else
+		e->dst_ip = rt->dst_ip;
+	e->nh_id = rt->nh.id;
+	e->prefix_len = rt->prefix_len;
+	e->attr = rt->attr;
+}
+
+static void otto_l3_shadow_to_route(struct otto_l3_shadow_route *e, struct otto_l3_route *rt)
+{
+	memset(rt, 0, sizeof(*rt));
+	if (e->attr.type == 2)
+		rt->dst_ip6 = e->dst_ip6;
+	else
+		rt->dst_ip = e->dst_ip;
+	rt->nh.id = e->nh_id;
+	rt->prefix_len = e->prefix_len;
+	rt->attr = e->attr;
+}
+
+/* Queue a host route entry for the next otto_l3_shadow_commit() */
+static void otto_l3_host_route_set(struct otto_l3_ctrl *ctrl, int idx, struct otto_l3_route *rt)
+{
+	struct otto_l3_shadow_route e;
+
+	if (idx < 0) {
+		dev_warn(ctrl->dev, "no host route slot for %pI4\n", &rt->dst_ip);
+		return;
+	}
+
+	if (!ctrl->host_shadow) {
+		ctrl->cfg->host_route_write(ctrl, idx, rt);
+		ctrl->stats.host_writes++;
+		return;
+	}
+
+	otto_l3_shadow_from_route(&e, rt);
+	if (!memcmp(&e, &ctrl->host_shadow[idx], sizeof(e))) {
+		ctrl->stats.writes_elided++;
+		return;
+	}
+
+	ctrl->host_shadow[idx] = e;
+	set_bit(idx, ctrl->host_dirty_bm);
+}
+
+/* Queue a prefix route entry for the next otto_l3_shadow_commit() */
+static void otto_l3_prefix_route_set(struct otto_l3_ctrl *ctrl, int idx, struct otto_l3_route *rt)
+{
+	struct otto_l3_shadow_route e;
+
+	if (idx < 0 || idx >= MAX_ROUTES) {
+		dev_warn(ctrl->dev, "invalid prefix route index %d\n", idx);
+		return;
+	}
+
+	if (!ctrl->route_shadow) {
+		ctrl->cfg->route_write(ctrl, idx, rt);
+		ctrl->stats.route_writes++;
+		return;
+	}
+
+	otto_l3_shadow_from_route(&e, rt);
+	if (!memcmp(&e, &ctrl->route_shadow[idx], sizeof(e))) {
+		ctrl->stats.writes_elided++;
+		return;
+	}
+
+	ctrl->route_shadow[idx] = e;
+	set_bit(idx, ctrl->route_dirty_bm);
+}
+
+/* Queue a nexthop entry for the next otto_l3_shadow_commit() */
+static void otto_l3_nexthop_set(struct otto_l3_ctrl *ctrl, int idx, u16 dmac_id, u16 interface)
+{
+	struct otto_l3_shadow_nexthop *e;
+
+	if (!ctrl->nexthop_shadow) {
+		ctrl->cfg->set_nexthop(ctrl, idx, dmac_id, interface);
+		ctrl->stats.nexthop_writes++;
+		return;
+	}
+
+	e = &ctrl->nexthop_shadow[idx];
+	if (e->valid && e->dmac_id == dmac_id && e->interface == interface) {
+		ctrl->stats.writes_elided++;
+		return;
+	}
+
+	e->dmac_id = dmac_id;
+	e->interface = interface;
+	e->valid = true;
+	set_bit(idx, ctrl->nexthop_dirty_bm);
+}
+
+/* Software equivalent of the route_lookup_hw() CAM lookup in the prefix route table */
+static int otto_l3_shadow_route_lookup(struct otto_l3_ctrl *ctrl, struct otto_l3_route *rt)
+{
+	struct otto_l3_shadow_route *e;
+
+	ctrl->stats.reads_avoided++;
+
+	for (int i = 0; i < MAX_ROUTES; i++) {
+		e = &ctrl->route_shadow[i];
+		if (!e->attr.valid || e->attr.type != rt->attr.type ||
+		    e->prefix_len != rt->prefix_len)
+			continue;
+
+		if (rt->attr.type == 2) {
+			if (ipv6_prefix_equal(&e->dst_ip6, &rt->dst_ip6, rt->prefix_len))
+				return i;
+		} else if (!((e->dst_ip ^ rt->dst_ip) & inet_make_mask(rt->prefix_len))) {
+			return i;
+		}
+	}
+
+	return -1;
+}
+
+/*
+ * Write all table entries changed since the last commit to the hardware. Nexthops go
+ * first, so that a new or changed route never points to a stale nexthop entry.
+ */
+static void otto_l3_shadow_commit(struct otto_l3_ctrl *ctrl)
+{
+	struct otto_l3_shadow_nexthop *nh;
+	struct otto_l3_route rt;
+	unsigned int i;
+
+	if (!ctrl->host_shadow)
+		return;
+
+	mutex_lock(ctrl->lock);
+
+	for_each_set_bit(i, ctrl->nexthop_dirty_bm, L3_NEXTHOP_TBL_SIZE) {
+		nh = &ctrl->nexthop_shadow[i];
+		ctrl->cfg->set_nexthop(ctrl, i, nh->dmac_id, nh->interface);
+		ctrl->stats.nexthop_writes++;
+	}
+	bitmap_zero(ctrl->nexthop_dirty_bm, L3_NEXTHOP_TBL_SIZE);
+
+	for_each_set_bit(i, ctrl->host_dirty_bm, L3_HOST_TBL_SIZE) {
+		otto_l3_shadow_to_route(&ctrl->host_shadow[i], &rt);
+		ctrl->cfg->host_route_write(ctrl, i, &rt);
+		ctrl->stats.host_writes++;
+	}
+	bitmap_zero(ctrl->host_dirty_bm, L3_HOST_TBL_SIZE);
+
+	for_each_set_bit(i, ctrl->route_dirty_bm, MAX_ROUTES) {
+		otto_l3_shadow_to_route(&ctrl->route_shadow[i], &rt);
+		ctrl->cfg->route_write(ctrl, i, &rt);
+		ctrl->stats.route_writes++;
+	}
+	bitmap_zero(ctrl->route_dirty_bm, MAX_ROUTES);
+
+	mutex_unlock(ctrl->lock);
+}
+
+static void otto_l3_shadow_free(void *data)
+{
+	struct otto_l3_ctrl *ctrl = data;
+
+	kvfree(ctrl->host_shadow);
+	ctrl->host_shadow = NULL;
+}
+
+/* Only the RTL930x tables, which come with a host route table, are shadowed */
+static int otto_l3_shadow_alloc(struct otto_l3_ctrl *ctrl, struct device *dev)
+{
+	if (!ctrl->cfg->find_slot)
+		return 0;
+
+	ctrl->route_shadow = devm_kcalloc(dev, MAX_ROUTES, sizeof(*ctrl->route_shadow),
+					  GFP_KERNEL);
+	ctrl->nexthop_shadow = devm_kcalloc(dev, L3_NEXTHOP_TBL_SIZE,
+					    sizeof(*ctrl->nexthop_shadow), GFP_KERNEL);
+	if (!ctrl->route_shadow || !ctrl->nexthop_shadow)
+		return -ENOMEM;
+
+	ctrl->host_shadow = kvcalloc(L3_HOST_TBL_SIZE, sizeof(*ctrl->host_shadow), GFP_KERNEL);
+	if (!ctrl->host_shadow)
+		return -ENOMEM;
+
+	return devm_add_action_or_reset(dev, otto_l3_shadow_free, ctrl);
+}
+
 /* Updates an L3 next hop entry in the ROUTING table */
 static int otto_l3_nexthop_update(struct otto_l3_ctrl *ctrl, __be32 ip_addr, u64 mac)
 {
@@ -889,8 +1104,11 @@ static int otto_l3_nexthop_update(struct otto_l3_ctrl *ctrl, __be32 ip_addr, u64
 		dev_dbg(ctrl->dev, "%s: Setting up fwding: ip %pI4, GW mac %016llx\n",
 			__func__, &ip_addr, mac);
 
-		/* Reads the ROUTING table entry associated with the route */
-		ctrl->cfg->route_read(ctrl, r->id, r);
+		/* Reads the ROUTING table entry associated with the route, unless shadowed */
+		if (ctrl->route_shadow)
+			ctrl->stats.reads_avoided++;
+		else
+			ctrl->cfg->route_read(ctrl, r->id, r);
 		dev_dbg(ctrl->dev, "Route with id %d to %pI4 / %d\n",
 			r->id, &r->dst_ip, r->prefix_len);
 
@@ -918,16 +1136,16 @@ static int otto_l3_nexthop_update(struct otto_l3_ctrl *ctrl, __be32 ip_addr, u64
 			int slot = ctrl->cfg->find_slot(ctrl, r, false);
 
 			dev_info(ctrl->dev, "Got slot for route: %d\n", slot);
-			ctrl->cfg->host_route_write(ctrl, slot, r);
+			otto_l3_host_route_set(ctrl, slot, r);
 		} else {
-			ctrl->cfg->route_write(ctrl, r->id, r);
+			otto_l3_prefix_route_set(ctrl, r->id, r);
 			r->pr.fwd_sel = true;
 			r->pr.fwd_data = r->nh.l2_id;
 			r->pr.fwd_act = PIE_ACT_ROUTE_UC;
 		}
 
 		if (ctrl->cfg->set_nexthop)
-			ctrl->cfg->set_nexthop(ctrl, r->nh.id, r->nh.l2_id, r->nh.if_id);
+			otto_l3_nexthop_set(ctrl, r->nh.id, r->nh.l2_id, r->nh.if_id);
 
 		if (r->pr.id < 0) {
 			r->pr.packet_cntr = rtl83xx_packet_cntr_alloc(priv);
@@ -990,18 +1208,24 @@ static void otto_l3_route_remove(struct otto_l3_ctrl *ctrl, struct otto_l3_route
 		dev_warn(ctrl->dev, "Could not remove route\n");
 
 	if (r->is_host_route) {
-		id = ctrl->cfg->find_slot(ctrl, r, false);
+		id = ctrl->cfg->find_slot(ctrl, r, true);
 		dev_dbg(ctrl->dev, "Got id for host route: %d\n", id);
 		r->attr.valid = false;
-		ctrl->cfg->host_route_write(ctrl, id, r);
+		if (id >= 0)
+			otto_l3_host_route_set(ctrl, id, r);
 		clear_bit(r->id - MAX_ROUTES, ctrl->host_route_use_bm);
 	} else {
 		/* If there is a HW representation of the route, delete it */
-		if (ctrl->cfg->route_lookup_hw) {
+		if (ctrl->route_shadow)
+			id = otto_l3_shadow_route_lookup(ctrl, r);
+		else if (ctrl->cfg->route_lookup_hw)
 			id = ctrl->cfg->route_lookup_hw(ctrl, r);
-			dev_info(ctrl->dev, "Got id for prefix route: %d\n", id);
+		else
+			id = -1;
+		dev_info(ctrl->dev, "Got id for prefix route: %d\n", id);
+		if (id >= 0) {
 			r->attr.valid = false;
-			ctrl->cfg->route_write(ctrl, id, r);
+			otto_l3_prefix_route_set(ctrl, id, r);
 		}
 		clear_bit(r->id, ctrl->route_use_bm);
 	}
@@ -1176,7 +1400,7 @@ static int otto_l3_fib_add_v4(struct otto_l3_ctrl *ctrl, struct fib_entry_notifi
 
 			slot = ctrl->cfg->find_slot(ctrl, route, false);
 			dev_dbg(ctrl->dev, "Got slot for route: %d\n", slot);
-			ctrl->cfg->host_route_write(ctrl, slot, route);
+			otto_l3_host_route_set(ctrl, slot, route);
 		}
 	}
 
@@ -1240,21 +1464,18 @@ static int otto_l3_fib_add_v6(struct otto_l3_ctrl *ctrl, struct fib6_entry_notif
 	return 0;
 }
 
-static void otto_l3_fib_event_work_do(struct work_struct *work)
+static void otto_l3_fib_event_do(struct otto_l3_ctrl *ctrl,
+				 struct otto_l3_fib_event_work *fib_work)
 {
-	struct otto_l3_fib_event_work *fib_work =
-		container_of(work, struct otto_l3_fib_event_work, work);
-	struct otto_l3_ctrl *ctrl = fib_work->ctrl;
 	struct fib_rule *rule;
 	int err;
 
-	/* Protect internal structures from changes */
-	rtnl_lock();
 	dev_dbg(ctrl->dev, "doing work, event %ld\n", fib_work->event);
 	switch (fib_work->event) {
 	case FIB_EVENT_ENTRY_ADD:
 	case FIB_EVENT_ENTRY_REPLACE:
 	case FIB_EVENT_ENTRY_APPEND:
+		ctrl->stats.fib_add++;
 		if (fib_work->is_fib6)
 			err = otto_l3_fib_add_v6(ctrl, &fib_work->fen6_info);
 		else
@@ -1265,6 +1486,7 @@ static void otto_l3_fib_event_work_do(struct work_struct *work)
 		fib_info_put(fib_work->fen_info.fi);
 		break;
 	case FIB_EVENT_ENTRY_DEL:
+		ctrl->stats.fib_del++;
 		err = otto_l3_fib_del_v4(ctrl, &fib_work->fen_info);
 		if (err)
 			dev_err(ctrl->dev, "fib_del() failed\n");
@@ -1279,8 +1501,71 @@ static void otto_l3_fib_event_work_do(struct work_struct *work)
 		fib_rule_put(rule);
 		break;
 	}
-	rtnl_unlock();
-	kfree(fib_work);
+}
+
+/* The events counted in fib_add and fib_del, and so in the latency stats */
+static bool otto_l3_fib_event_is_entry(unsigned long event)
+{
+	switch (event) {
+	case FIB_EVENT_ENTRY_ADD:
+	case FIB_EVENT_ENTRY_REPLACE:
+	case FIB_EVENT_ENTRY_APPEND:
+	case FIB_EVENT_ENTRY_DEL:
+		return true;
+	default:
+		return false;
+	}
+}
+
+/*
+ * Handle the queued FIB events in batches of up to L3_FIB_BATCH events. Each batch is
+ * handled under a single rtnl_lock() and its table changes are committed to the hardware
+ * together, so that an entry changed by several events of a batch is written only once.
+ */
+static void otto_l3_fib_event_work_do(struct work_struct *work)
+{
+	struct otto_l3_ctrl *ctrl = container_of(work, struct otto_l3_ctrl, fib_work);
+	struct otto_l3_fib_event_work *fib_work, *tmp;
+	unsigned long n, latency;
+	LIST_HEAD(batch);
+	ktime_t now;
+
+	do {
+		n = 0;
+		spin_lock_bh(&ctrl->fib_events_lock);
+		list_for_each_entry_safe(fib_work, tmp, &ctrl->fib_events, list) {
+			list_move_tail(&fib_work->list, &batch);
+			if (++n == L3_FIB_BATCH)
+				break;
+		}
+		spin_unlock_bh(&ctrl->fib_events_lock);
+
+		if (!n)
+			break;
+
+		/* Protect internal structures from changes */
+		rtnl_lock();
+		list_for_each_entry(fib_work, &batch, list)
+			otto_l3_fib_event_do(ctrl, fib_work);
+		otto_l3_shadow_commit(ctrl);
+		rtnl_unlock();
+
+		now = ktime_get();
+		ctrl->stats.batches++;
+		ctrl->stats.batch_max = max(ctrl->stats.batch_max, n);
+
+		list_for_each_entry_safe(fib_work, tmp, &batch, list) {
+			if (otto_l3_fib_event_is_entry(fib_work->event)) {
+				latency = ktime_us_delta(now, fib_work->queued);
+				ctrl->stats.latency_us += latency;
+				ctrl->stats.latency_max_us = max(ctrl->stats.latency_max_us,
+								 latency);
+			}
+
+			list_del(&fib_work->list);
+			kfree(fib_work);
+		}
+	} while (n == L3_FIB_BATCH);
 }
 
 
@@ -1305,8 +1590,7 @@ static int otto_l3_fib_notifier(struct notifier_block *this, unsigned long event
 	if (!fib_work)
 		return NOTIFY_BAD;
 
-	INIT_WORK(&fib_work->work, otto_l3_fib_event_work_do);
-	fib_work->ctrl = ctrl;
+	fib_work->queued = ktime_get();
 	fib_work->event = event;
 	fib_work->is_fib6 = false;
 
@@ -1348,7 +1632,11 @@ static int otto_l3_fib_notifier(struct notifier_block *this, unsigned long event
 		break;
 	}
 
-	queue_work(priv->wq, &fib_work->work);
+	spin_lock_bh(&ctrl->fib_events_lock);
+	list_add_tail(&fib_work->list, &ctrl->fib_events);
+	spin_unlock_bh(&ctrl->fib_events_lock);
+
+	queue_work(priv->wq, &ctrl->fib_work);
 
 	return NOTIFY_DONE;
 }
@@ -1357,8 +1645,11 @@ static void otto_l3_net_event_work_do(struct work_struct *work)
 {
 	struct otto_l3_net_event_work *net_work =
 		container_of(work, struct otto_l3_net_event_work, work);
+	struct otto_l3_ctrl *ctrl = net_work->ctrl;
 
-	otto_l3_nexthop_update(net_work->ctrl, net_work->gw_addr, net_work->mac);
+	ctrl->stats.neigh_update++;
+	otto_l3_nexthop_update(ctrl, net_work->gw_addr, net_work->mac);
+	otto_l3_shadow_commit(ctrl);
 
 	kfree(net_work);
 }
@@ -1460,6 +1751,9 @@ void otto_l3_remove(struct rtl838x_switch_priv *priv)
 		unregister_fib_notifier(&init_net, &ctrl->fib_nb);
 		ctrl->fib_nb.notifier_call = NULL;
 	}
+
+	/* Release the references held by events still queued */
+	flush_work(&ctrl->fib_work);
 }
 
 int otto_l3_probe(struct device *dev, struct rtl838x_switch_priv *priv)
@@ -1476,12 +1770,19 @@ int otto_l3_probe(struct device *dev, struct rtl838x_switch_priv *priv)
 	ctrl->dev = priv->dev;
 	/* For now share the register access lock with the DSA driver */
 	ctrl->lock = &priv->reg_mutex;
+	INIT_LIST_HEAD(&ctrl->fib_events);
+	spin_lock_init(&ctrl->fib_events_lock);
+	INIT_WORK(&ctrl->fib_work, otto_l3_fib_event_work_do);
 
 	match = of_match_node(otto_l3_of_ids, dev->of_node);
 	if (!match)
 		return dev_err_probe(dev, -EINVAL, "No compatible configuration found\n");
 	ctrl->cfg = match->data;
 
+	err = otto_l3_shadow_alloc(ctrl, dev);
+	if (err)
+		return dev_err_probe(dev, err, "Could not allocate L3 table shadows\n");
+
 	if (ctrl->cfg->setup) {
 		err = ctrl->cfg->setup(ctrl);
 		if (err)
@@ -1517,3 +1818,7 @@ int otto_l3_probe(struct device *dev, struct rtl838x_switch_priv *priv)
 
 	return 0;
 }
+
+#if IS_ENABLED(CONFIG_NET_DSA_RTL83XX_L3_KUNIT_TEST)
+#include "l3_test.c"
+#endif
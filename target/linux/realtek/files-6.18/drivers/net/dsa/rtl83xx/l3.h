@@ -9,6 +9,12 @@
 #define MAX_ROUTES		512
 #define MAX_INTERFACES		100
 
+/* RTL930x L3_HOST_ROUTE: 2 hash tables of 512 buckets with 6 entries each */
+#define L3_HOST_TBL_SIZE	(2 * 512 * 6)
+#define L3_NEXTHOP_TBL_SIZE	(MAX_ROUTES + MAX_HOST_ROUTES)
+/* Number of FIB events handled under one rtnl_lock() and committed together */
+#define L3_FIB_BATCH		64
+
 #define HASH_PICK(val, lsb, len) ((val & (((1 << len) - 1) << lsb)) >> lsb)
 
 /* An entry in the RTL93XX SoC's ROUTER_MAC tables setting up a termination point
@@ -84,6 +90,41 @@ struct otto_l3_route {
 	struct otto_l3_route_attr attr;
 };
 
+/* Software copy of a host or prefix route entry as programmed into the hardware.
+ * Invalid entries are all zero, so that they can be compared with memcmp().
+ */
+struct otto_l3_shadow_route {
+	union {
+		u32 dst_ip;
+		struct in6_addr dst_ip6;
+	};
+	u16 nh_id;
+	s16 prefix_len;
+	struct otto_l3_route_attr attr;
+};
+
+struct otto_l3_shadow_nexthop {
+	u16 dmac_id;
+	u16 interface;
+	bool valid;
+};
+
+/* Only written from the driver's ordered workqueue, read locklessly by debugfs */
+struct otto_l3_stats {
+	unsigned long fib_add;
+	unsigned long fib_del;
+	unsigned long neigh_update;
+	unsigned long batches;
+	unsigned long batch_max;	/* Most FIB events committed together */
+	unsigned long host_writes;
+	unsigned long route_writes;
+	unsigned long nexthop_writes;
+	unsigned long writes_elided;	/* Updates leaving the hardware entry unchanged */
+	unsigned long reads_avoided;	/* Table reads and lookups served by the shadow */
+	u64 latency_us;			/* Sum of FIB entry event to hardware commit latencies */
+	unsigned long latency_max_us;
+};
+
 struct otto_l3_config {
 	int (*find_slot)(struct otto_l3_ctrl *ctrl, struct otto_l3_route *rt, bool must_exist);
 	void (*set_egress_intf)(struct otto_l3_ctrl *ctrl, int idx, struct otto_l3_intf *intf);
@@ -111,6 +152,23 @@ struct otto_l3_ctrl {
 	unsigned long host_route_use_bm[MAX_HOST_ROUTES / 32];
 	struct otto_l3_intf *interfaces[MAX_INTERFACES];
 	struct mutex *lock; /* protect register access */
+
+	/*
+	 * Shadow of the RTL930x host route, prefix route and nexthop tables. Changes are
+	 * collected in the shadow and written to the hardware by otto_l3_shadow_commit().
+	 */
+	struct otto_l3_shadow_route *host_shadow;
+	struct otto_l3_shadow_route *route_shadow;
+	struct otto_l3_shadow_nexthop *nexthop_shadow;
+	unsigned long host_dirty_bm[BITS_TO_LONGS(L3_HOST_TBL_SIZE)];
+	unsigned long route_dirty_bm[BITS_TO_LONGS(MAX_ROUTES)];
+	unsigned long nexthop_dirty_bm[BITS_TO_LONGS(L3_NEXTHOP_TBL_SIZE)];
+	u8 host_hash_alg[2];	/* Hash algorithm of each host route table */
+
+	struct list_head fib_events;
+	spinlock_t fib_events_lock; /* protect fib_events */
+	struct work_struct fib_work;
+	struct otto_l3_stats stats;
 };
 
 int otto_l3_probe(struct device *dev, struct rtl838x_switch_priv *priv);
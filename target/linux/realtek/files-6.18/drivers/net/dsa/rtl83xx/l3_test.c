@@ -0,0 +1,304 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * KUnit tests for the RTL930x L3 table shadows. The table accessors of the
+ * configuration are replaced by a simulated backend, so no switch is needed.
+ *
+ * Included from l3.c to reach the static shadow helpers.
+ */
+
+#include <kunit/device.h>
+#include <kunit/test.h>
+
+struct otto_l3_sim_route {
+	bool valid;
+	u8 type;
+	u32 dst_ip;
+	int prefix_len;
+	u16 nh_id;
+};
+
+struct otto_l3_sim {
+	struct otto_l3_ctrl ctrl;
+	struct mutex lock;
+	struct otto_l3_sim_route host[L3_HOST_TBL_SIZE];
+	struct otto_l3_sim_route route[MAX_ROUTES];
+	u32 nexthop[L3_NEXTHOP_TBL_SIZE];
+	unsigned int host_writes;
+	unsigned int route_writes;
+	unsigned int nexthop_writes;
+	unsigned int hw_lookups;
+	unsigned int seq, host_seq, nexthop_seq;
+};
+
+static struct otto_l3_sim *otto_l3_sim(struct otto_l3_ctrl *ctrl)
+{
+	return container_of(ctrl, struct otto_l3_sim, ctrl);
+}
+
+static void otto_l3_sim_entry(struct otto_l3_sim_route *e, struct otto_l3_route *rt)
+{
+	e->valid = rt->attr.valid;
+	e->type = rt->attr.type;
+	e->dst_ip = rt->dst_ip;
+	e->prefix_len = rt->prefix_len;
+	e->nh_id = rt->nh.id;
+}
+
+static void otto_l3_sim_host_route_write(struct otto_l3_ctrl *ctrl, int idx,
+					 struct otto_l3_route *rt)
+{
+	struct otto_l3_sim *sim = otto_l3_sim(ctrl);
+
+	otto_l3_sim_entry(&sim->host[idx], rt);
+	sim->host_writes++;
+	sim->host_seq = ++sim->seq;
+}
+
+static void otto_l3_sim_route_write(struct otto_l3_ctrl *ctrl, int idx,
+				    struct otto_l3_route *rt)
+{
+	struct otto_l3_sim *sim = otto_l3_sim(ctrl);
+
+	otto_l3_sim_entry(&sim->route[idx], rt);
+	sim->route_writes++;
+}
+
+static void otto_l3_sim_set_nexthop(struct otto_l3_ctrl *ctrl, int idx,
+				    u16 dmac_id, u16 interface)
+{
+	struct otto_l3_sim *sim = otto_l3_sim(ctrl);
+
+	sim->nexthop[idx] = (dmac_id << 7) | interface;
+	sim->nexthop_writes++;
+	sim->nexthop_seq = ++sim->seq;
+}
+
+static int otto_l3_sim_route_lookup_hw(struct otto_l3_ctrl *ctrl, struct otto_l3_route *rt)
+{
+	otto_l3_sim(ctrl)->hw_lookups++;
+
+	return -1;
+}
+
+static const struct otto_l3_config otto_l3_sim_cfg = {
+	.find_slot = otto_l3_930x_find_slot,
+	.host_route_write = otto_l3_sim_host_route_write,
+	.set_nexthop = otto_l3_sim_set_nexthop,
+	.route_lookup_hw = otto_l3_sim_route_lookup_hw,
+	.route_write = otto_l3_sim_route_write,
+};
+
+static void otto_l3_test_route(struct otto_l3_route *rt, u32 dst_ip, int prefix_len, u16 nh_id)
+{
+	memset(rt, 0, sizeof(*rt));
+	rt->dst_ip = dst_ip;
+	rt->prefix_len = prefix_len;
+	rt->nh.id = nh_id;
+	rt->attr.valid = true;
+	rt->attr.type = 0;
+}
+
+/* Logical host route table index of the first slot of the bucket an address hashes to */
+static int otto_l3_test_bucket(u32 dst_ip, int t, int algorithm)
+{
+	return t * (L3_HOST_TBL_SIZE / 2) + (otto_l3_930x_hash4(dst_ip, algorithm, false) & 0x1ff) * 6;
+}
+
+static void otto_l3_test_host_hash(struct kunit *test)
+{
+	struct otto_l3_sim *sim = test->priv;
+	struct otto_l3_ctrl *ctrl = &sim->ctrl;
+	struct otto_l3_route rt;
+	int slot;
+
+	otto_l3_test_route(&rt, 0xc0a80101, 32, 600);
+
+	KUNIT_EXPECT_EQ(test, ctrl->cfg->find_slot(ctrl, &rt, true), -1);
+	slot = ctrl->cfg->find_slot(ctrl, &rt, false);
+	KUNIT_ASSERT_EQ(test, slot, otto_l3_test_bucket(rt.dst_ip, 0, 0));
+
+	/* Visible to lookups right away, written to the hardware on commit */
+	otto_l3_host_route_set(ctrl, slot, &rt);
+	KUNIT_EXPECT_EQ(test, ctrl->cfg->find_slot(ctrl, &rt, true), slot);
+	KUNIT_EXPECT_EQ(test, sim->host_writes, 0);
+
+	otto_l3_shadow_commit(ctrl);
+	KUNIT_EXPECT_EQ(test, sim->host_writes, 1);
+	KUNIT_EXPECT_TRUE(test, sim->host[slot].valid);
+	KUNIT_EXPECT_EQ(test, sim->host[slot].dst_ip, rt.dst_ip);
+	KUNIT_EXPECT_EQ(test, sim->host[slot].nh_id, 600);
+
+	/* Removal */
+	rt.attr.valid = false;
+	otto_l3_host_route_set(ctrl, slot, &rt);
+	otto_l3_shadow_commit(ctrl);
+	KUNIT_EXPECT_EQ(test, sim->host_writes, 2);
+	KUNIT_EXPECT_FALSE(test, sim->host[slot].valid);
+	rt.attr.valid = true;
+	KUNIT_EXPECT_EQ(test, ctrl->cfg->find_slot(ctrl, &rt, true), -1);
+}
+
+static void otto_l3_test_host_overflow(struct kunit *test)
+{
+	struct otto_l3_sim *sim = test->priv;
+	struct otto_l3_ctrl *ctrl = &sim->ctrl;
+	const u32 base = 0x0a000000;
+	int bucket, slot, slots[7];
+	struct otto_l3_route rt;
+
+	bucket = otto_l3_test_bucket(base, 0, 0);
+
+	/* Flipping the same bits in two XOR-ed rows keeps the table 0 hash */
+	for (u32 k = 0; k < 7; k++) {
+		otto_l3_test_route(&rt, base ^ k ^ (k << 9), 32, 512 + k);
+		KUNIT_ASSERT_EQ(test, otto_l3_test_bucket(rt.dst_ip, 0, 0), bucket);
+
+		slots[k] = ctrl->cfg->find_slot(ctrl, &rt, false);
+		otto_l3_host_route_set(ctrl, slots[k], &rt);
+	}
+
+	for (int k = 0; k < 6; k++)
+		KUNIT_EXPECT_EQ(test, slots[k], bucket + k);
+	KUNIT_EXPECT_EQ(test, slots[6], otto_l3_test_bucket(base ^ 6 ^ (6 << 9), 1, 1));
+
+	otto_l3_shadow_commit(ctrl);
+	KUNIT_EXPECT_EQ(test, sim->host_writes, 7);
+
+	/* A freed slot is reused */
+	otto_l3_test_route(&rt, base ^ 2 ^ (2 << 9), 32, 514);
+	rt.attr.valid = false;
+	otto_l3_host_route_set(ctrl, slots[2], &rt);
+
+	otto_l3_test_route(&rt, base ^ 7 ^ (7 << 9), 32, 519);
+	slot = ctrl->cfg->find_slot(ctrl, &rt, false);
+	KUNIT_EXPECT_EQ(test, slot, slots[2]);
+}
+
+static void otto_l3_test_batch_commit(struct kunit *test)
+{
+	struct otto_l3_sim *sim = test->priv;
+	struct otto_l3_ctrl *ctrl = &sim->ctrl;
+	struct otto_l3_route rt;
+	int slot;
+
+	otto_l3_test_route(&rt, 0xc0a80102, 32, 1);
+	slot = ctrl->cfg->find_slot(ctrl, &rt, false);
+
+	/* Several updates of an entry within one batch give a single write */
+	for (u16 nh = 1; nh <= 3; nh++) {
+		rt.nh.id = nh;
+		otto_l3_host_route_set(ctrl, slot, &rt);
+	}
+	otto_l3_nexthop_set(ctrl, 3, 10, 1);
+	otto_l3_nexthop_set(ctrl, 3, 11, 1);
+
+	otto_l3_shadow_commit(ctrl);
+	KUNIT_EXPECT_EQ(test, sim->host_writes, 1);
+	KUNIT_EXPECT_EQ(test, sim->host[slot].nh_id, 3);
+	KUNIT_EXPECT_EQ(test, sim->nexthop_writes, 1);
+	KUNIT_EXPECT_EQ(test, sim->nexthop[3], (11 << 7) | 1);
+	KUNIT_EXPECT_LT(test, sim->nexthop_seq, sim->host_seq);
+
+	/* Unchanged entries are not written again */
+	otto_l3_host_route_set(ctrl, slot, &rt);
+	otto_l3_nexthop_set(ctrl, 3, 11, 1);
+	otto_l3_shadow_commit(ctrl);
+	KUNIT_EXPECT_EQ(test, sim->host_writes, 1);
+	KUNIT_EXPECT_EQ(test, sim->nexthop_writes, 1);
+	KUNIT_EXPECT_EQ(test, ctrl->stats.writes_elided, 2);
+
+	/* Nothing to do */
+	otto_l3_shadow_commit(ctrl);
+	KUNIT_EXPECT_EQ(test, sim->host_writes + sim->route_writes + sim->nexthop_writes, 2);
+}
+
+static void otto_l3_test_prefix_remove(struct kunit *test)
+{
+	struct otto_l3_sim *sim = test->priv;
+	struct otto_l3_ctrl *ctrl = &sim->ctrl;
+	struct otto_l3_route *r, *other;
+	int id;
+
+	/* Same destination, different prefix length */
+	other = otto_l3_route_alloc(ctrl, 0xc0a80001);
+	KUNIT_ASSERT_NOT_NULL(test, other);
+	other->dst_ip = 0x0a000000;
+	other->prefix_len = 16;
+	other->nh.id = other->id;
+	other->attr.valid = true;
+
+	r = otto_l3_route_alloc(ctrl, 0xc0a80001);
+	KUNIT_ASSERT_NOT_NULL(test, r);
+	id = r->id;
+
+	r->dst_ip = 0x0a000000;
+	r->prefix_len = 8;
+	r->nh.id = id;
+	r->attr.valid = true;
+
+	otto_l3_prefix_route_set(ctrl, other->id, other);
+	otto_l3_prefix_route_set(ctrl, id, r);
+	otto_l3_shadow_commit(ctrl);
+	KUNIT_EXPECT_EQ(test, sim->route_writes, 2);
+	KUNIT_EXPECT_TRUE(test, sim->route[id].valid);
+
+	/* The entry is found in the shadow, without a CAM lookup */
+	otto_l3_route_remove(ctrl, r);
+	otto_l3_shadow_commit(ctrl);
+	KUNIT_EXPECT_EQ(test, sim->hw_lookups, 0);
+	KUNIT_EXPECT_EQ(test, sim->route_writes, 3);
+	KUNIT_EXPECT_FALSE(test, sim->route[id].valid);
+	KUNIT_EXPECT_TRUE(test, sim->route[other->id].valid);
+	KUNIT_EXPECT_FALSE(test, test_bit(id, ctrl->route_use_bm));
+
+	otto_l3_route_remove(ctrl, other);
+}
+
+static int otto_l3_test_init(struct kunit *test)
+{
+	struct otto_l3_sim *sim;
+	struct device *dev;
+
+	dev = kunit_device_register(test, "otto-l3-test");
+	KUNIT_ASSERT_NOT_ERR_OR_NULL(test, dev);
+
+	sim = kunit_kzalloc(test, sizeof(*sim), GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, sim);
+
+	mutex_init(&sim->lock);
+	sim->ctrl.cfg = &otto_l3_sim_cfg;
+	sim->ctrl.dev = dev;
+	sim->ctrl.lock = &sim->lock;
+	sim->ctrl.host_hash_alg[0] = 0;
+	sim->ctrl.host_hash_alg[1] = 1;
+
+	KUNIT_ASSERT_EQ(test, otto_l3_shadow_alloc(&sim->ctrl, dev), 0);
+	KUNIT_ASSERT_EQ(test, rhltable_init(&sim->ctrl.routes, &otto_l3_route_ht_params), 0);
+
+	test->priv = sim;
+
+	return 0;
+}
+
+static void otto_l3_test_exit(struct kunit *test)
+{
+	struct otto_l3_sim *sim = test->priv;
+
+	rhltable_destroy(&sim->ctrl.routes);
+}
+
+static struct kunit_case otto_l3_test_cases[] = {
+	KUNIT_CASE(otto_l3_test_host_hash),
+	KUNIT_CASE(otto_l3_test_host_overflow),
+	KUNIT_CASE(otto_l3_test_batch_commit),
+	KUNIT_CASE(otto_l3_test_prefix_remove),
+	{}
+};
+
+static struct kunit_suite otto_l3_test_suite = {
+	.name = "otto-l3-shadow",
+	.init = otto_l3_test_init,
+	.exit = otto_l3_test_exit,
+	.test_cases = otto_l3_test_cases,
+};
+kunit_test_suite(otto_l3_test_suite);